@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <new>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+#include "AllocationTracker.h"
+
+//アラインメントを指定してメモリを確保する(SIMD命令のロード・ストア用、operator newを通らないためAllocationTrackerに直接数える)
+inline void *aligned_malloc(size_t size, size_t alignment)
+{
+#if defined(_MSC_VER)
+	void *p = _aligned_malloc(size, alignment);
+#else
+	void *p = 0;
+	if (posix_memalign(&p, alignment, size) != 0) p = 0;
+#endif
+	if (p) track_allocation(size);
+	return p;
+}
+inline void aligned_free(void *p)
+{
+	if (p) track_free();
+#if defined(_MSC_VER)
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+//std::vector用のアラインメント付きアロケータ
+//例:std::vector<FLOAT, AlignedAllocator<FLOAT, 32> >はAVXの256bitロード・ストアに使用できる
+template <typename T, size_t ALIGNMENT>
+struct AlignedAllocator
+{
+	typedef T value_type;
+	template <typename U> struct rebind { typedef AlignedAllocator<U, ALIGNMENT> other; };
+
+	AlignedAllocator() {}
+	template <typename U> AlignedAllocator(const AlignedAllocator<U, ALIGNMENT> &) {}
+
+	T *allocate(size_t n)
+	{
+		void *p = aligned_malloc(n * sizeof(T), ALIGNMENT);
+		if (!p) throw std::bad_alloc();
+		return static_cast<T *>(p);
+	}
+	void deallocate(T *p, size_t)
+	{
+		aligned_free(p);
+	}
+
+	template <typename U> bool operator==(const AlignedAllocator<U, ALIGNMENT> &) const { return true; }
+	template <typename U> bool operator!=(const AlignedAllocator<U, ALIGNMENT> &) const { return false; }
+};
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include "AllocationTracker.h"
+
+static std::atomic<bool> tracking(false);
+static std::atomic<unsigned long long> total_allocations(0), total_bytes(0), total_frees(0);
+static thread_local AllocationCounts thread_counts = { 0, 0, 0 };
+
+void enable_allocation_tracking(bool on)
+{
+	tracking.store(on, std::memory_order_relaxed);
+}
+
+bool allocation_tracking_enabled()
+{
+	return tracking.load(std::memory_order_relaxed);
+}
+
+AllocationCounts allocation_counts()
+{
+	AllocationCounts counts;
+	counts.allocations = total_allocations.load(std::memory_order_relaxed);
+	counts.bytes = total_bytes.load(std::memory_order_relaxed);
+	counts.frees = total_frees.load(std::memory_order_relaxed);
+	return counts;
+}
+
+AllocationCounts thread_allocation_counts()
+{
+	return thread_counts;
+}
+
+void track_allocation(size_t bytes)
+{
+	if (!tracking.load(std::memory_order_relaxed)) return;
+	thread_counts.allocations++;
+	thread_counts.bytes += bytes;
+	total_allocations.fetch_add(1, std::memory_order_relaxed);
+	total_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void track_free()
+{
+	if (!tracking.load(std::memory_order_relaxed)) return;
+	thread_counts.frees++;
+	total_frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+#if PHYSICS_TRACK_ALLOCATIONS
+
+//グローバルなoperator new/deleteの置き換え(確保はmallocに任せる)
+static void *tracked_new(size_t size)
+{
+	if (size == 0) size = 1;
+	for (;;)
+	{
+		void *p = malloc(size);
+		if (p)
+		{
+			track_allocation(size);
+			return p;
+		}
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+static void tracked_delete(void *p)
+{
+	if (!p) return;
+	track_free();
+	free(p);
+}
+
+void *operator new(size_t size)
+{
+	return tracked_new(size);
+}
+void *operator new[](size_t size)
+{
+	return tracked_new(size);
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	try
+	{
+		return tracked_new(size);
+	}
+	catch (...)
+	{
+		return 0;
+	}
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	try
+	{
+		return tracked_new(size);
+	}
+	catch (...)
+	{
+		return 0;
+	}
+}
+void operator delete(void *p) noexcept
+{
+	tracked_delete(p);
+}
+void operator delete[](void *p) noexcept
+{
+	tracked_delete(p);
+}
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+	tracked_delete(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+	tracked_delete(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+	tracked_delete(p);
+}
+void operator delete[](void *p, size_t) noexcept
+{
+	tracked_delete(p);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+
+//メモリ確保の計数(ステップの途中の確保を見つけ、定常状態で確保しないことを確かめるために使う)
+//
+//AllocationTracker.cppがグローバルなoperator new/deleteを置き換えて、確保と解放を数える
+//operator newを通らない確保(aligned_mallocなど)はtrack_allocation・track_freeで数える
+//数えるのはenable_allocation_trackingで有効にしている間だけで、無効な間の費用は確保ごとに読み込み1つ
+//
+//スレッドごとの累計(thread_allocation_counts)はPROFILE_SCOPEが区間ごとの確保の数として記録する(Profiler::allocations)
+//全体の累計(allocation_counts)はステップや処理の前後の差で確保の数を求めるのに使う
+//
+//PHYSICS_TRACK_ALLOCATIONSを0に定義するとoperator new/deleteを置き換えず、計数は常に0になる
+#ifndef PHYSICS_TRACK_ALLOCATIONS
+#define PHYSICS_TRACK_ALLOCATIONS 1
+#endif
+
+struct AllocationCounts
+{
+	unsigned long long allocations;	//確保の回数
+	unsigned long long bytes;	//確保したバイト数(解放した分は差し引かない)
+	unsigned long long frees;	//解放の回数
+};
+
+void enable_allocation_tracking(bool on);
+bool allocation_tracking_enabled();
+//全てのスレッドの累計
+AllocationCounts allocation_counts();
+//呼び出したスレッドの累計
+AllocationCounts thread_allocation_counts();
+
+//operator newを通らない確保・解放を数える
+void track_allocation(size_t bytes);
+void track_free();
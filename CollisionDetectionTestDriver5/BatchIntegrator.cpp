@@ -0,0 +1,338 @@
+#include "StrictFloat.h"
+#include <math.h>
+#include "BatchIntegrator.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BATCH_INTEGRATOR_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+//GCC/ClangではAVX2の関数だけをAVX2向けにコンパイルする(MSVCは指定なしで組み込み関数を使用できる)
+#if defined(BATCH_INTEGRATOR_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+SIMD_LEVEL detect_simd_level()
+{
+#if defined(BATCH_INTEGRATOR_X86)
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int max_function = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+	if (max_function >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+	//OSがYMMレジスタを保存するか確認する
+	if (osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6) return SIMD_AVX2;
+	if (sse2) return SIMD_SSE;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2")) return SIMD_SSE;
+#endif
+#endif
+	return SIMD_SCALAR;
+}
+
+void integrate_scalar(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration)
+{
+	FLOAT *px = bodies.position[0], *py = bodies.position[1], *pz = bodies.position[2];
+	FLOAT *qx = bodies.orientation[0], *qy = bodies.orientation[1], *qz = bodies.orientation[2], *qw = bodies.orientation[3];
+	FLOAT *vx = bodies.linear_velocity[0], *vy = bodies.linear_velocity[1], *vz = bodies.linear_velocity[2];
+	FLOAT *wx = bodies.angular_velocity[0], *wy = bodies.angular_velocity[1], *wz = bodies.angular_velocity[2];
+	FLOAT *fx = bodies.accumulated_force[0], *fy = bodies.accumulated_force[1], *fz = bodies.accumulated_force[2];
+	FLOAT *tx = bodies.accumulated_torque[0], *ty = bodies.accumulated_torque[1], *tz = bodies.accumulated_torque[2];
+	const FLOAT *im = bodies.inverse_mass;
+	const FLOAT *ix = bodies.inverse_inertia[0], *iy = bodies.inverse_inertia[1], *iz = bodies.inverse_inertia[2];
+
+	for (UINT i = begin; i < end; i++)
+	{
+		//可動オブジェクトの場合のみインテグレーションを行う
+		if (im[i] > 0)
+		{
+			//力から加速度を算出し速度を更新する
+			vx[i] += fx[i] * im[i] * duration;
+			vy[i] += fy[i] * im[i] * duration;
+			vz[i] += fz[i] * im[i] * duration;
+
+			//並進速度による位置の更新
+			px[i] += vx[i] * duration;
+			py[i] += vy[i] * duration;
+			pz[i] += vz[i] * duration;
+
+			//トルクから角加速度を算出し角速度を更新する
+			//ワールド空間の慣性モーメントテンソルの逆行列は R^T * I^-1 * R (Rは姿勢の回転行列)
+			FLOAT x = qx[i], y = qy[i], z = qz[i], w = qw[i];
+			FLOAT r[9];
+			quaternion_to_rotation(x, y, z, w, r);
+			FLOAT lx = (tx[i] * r[0] + ty[i] * r[1] + tz[i] * r[2]) * ix[i];
+			FLOAT ly = (tx[i] * r[3] + ty[i] * r[4] + tz[i] * r[5]) * iy[i];
+			FLOAT lz = (tx[i] * r[6] + ty[i] * r[7] + tz[i] * r[8]) * iz[i];
+			wx[i] += (lx * r[0] + ly * r[3] + lz * r[6]) * duration;
+			wy[i] += (lx * r[1] + ly * r[4] + lz * r[7]) * duration;
+			wz[i] += (lx * r[2] + ly * r[5] + lz * r[8]) * duration;
+
+			//角速度による姿勢の更新 orientation += 0.5 * (orientation * w) * duration
+			FLOAT h = 0.5f * duration;
+			FLOAT dx = w * wx[i] + wy[i] * z - wz[i] * y;
+			FLOAT dy = w * wy[i] + wz[i] * x - wx[i] * z;
+			FLOAT dz = w * wz[i] + wx[i] * y - wy[i] * x;
+			FLOAT dw = -(wx[i] * x + wy[i] * y + wz[i] * z);
+			x += h * dx;
+			y += h * dy;
+			z += h * dz;
+			w += h * dw;
+			FLOAT l = sqrtf(x * x + y * y + z * z + w * w);
+			qx[i] = x / l;
+			qy[i] = y / l;
+			qz[i] = z / l;
+			qw[i] = w / l;
+		}
+		//力とトルクのアキュムレータをゼロリセットする
+		fx[i] = fy[i] = fz[i] = 0;
+		tx[i] = ty[i] = tz[i] = 0;
+	}
+}
+
+#if defined(BATCH_INTEGRATOR_X86)
+//SSE2で4剛体ずつ処理する(演算の順序はintegrate_scalarと同じ)
+void integrate_sse(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration)
+{
+	FLOAT *px = bodies.position[0], *py = bodies.position[1], *pz = bodies.position[2];
+	FLOAT *qx = bodies.orientation[0], *qy = bodies.orientation[1], *qz = bodies.orientation[2], *qw = bodies.orientation[3];
+	FLOAT *vx = bodies.linear_velocity[0], *vy = bodies.linear_velocity[1], *vz = bodies.linear_velocity[2];
+	FLOAT *wx = bodies.angular_velocity[0], *wy = bodies.angular_velocity[1], *wz = bodies.angular_velocity[2];
+	FLOAT *fx = bodies.accumulated_force[0], *fy = bodies.accumulated_force[1], *fz = bodies.accumulated_force[2];
+	FLOAT *tx = bodies.accumulated_torque[0], *ty = bodies.accumulated_torque[1], *tz = bodies.accumulated_torque[2];
+	const FLOAT *im = bodies.inverse_mass;
+	const FLOAT *ix = bodies.inverse_inertia[0], *iy = bodies.inverse_inertia[1], *iz = bodies.inverse_inertia[2];
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 dt = _mm_set1_ps(duration);
+	const __m128 h = _mm_set1_ps(0.5f * duration);
+
+	UINT i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 m = _mm_loadu_ps(im + i);
+		//可動オブジェクトのレーンのみ結果を書き込むマスク
+		__m128 movable = _mm_cmpgt_ps(m, zero);
+
+		//並進
+		__m128 ovx = _mm_loadu_ps(vx + i), ovy = _mm_loadu_ps(vy + i), ovz = _mm_loadu_ps(vz + i);
+		__m128 nvx = _mm_add_ps(ovx, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(fx + i), m), dt));
+		__m128 nvy = _mm_add_ps(ovy, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(fy + i), m), dt));
+		__m128 nvz = _mm_add_ps(ovz, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(fz + i), m), dt));
+		__m128 opx = _mm_loadu_ps(px + i), opy = _mm_loadu_ps(py + i), opz = _mm_loadu_ps(pz + i);
+		__m128 npx = _mm_add_ps(opx, _mm_mul_ps(nvx, dt));
+		__m128 npy = _mm_add_ps(opy, _mm_mul_ps(nvy, dt));
+		__m128 npz = _mm_add_ps(opz, _mm_mul_ps(nvz, dt));
+
+		//姿勢の回転行列
+		__m128 x = _mm_loadu_ps(qx + i), y = _mm_loadu_ps(qy + i), z = _mm_loadu_ps(qz + i), w = _mm_loadu_ps(qw + i);
+		__m128 r0 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(y, y), _mm_mul_ps(z, z))));
+		__m128 r1 = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, y), _mm_mul_ps(z, w)));
+		__m128 r2 = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(x, z), _mm_mul_ps(y, w)));
+		__m128 r3 = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(x, y), _mm_mul_ps(z, w)));
+		__m128 r4 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z))));
+		__m128 r5 = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(y, z), _mm_mul_ps(x, w)));
+		__m128 r6 = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, z), _mm_mul_ps(y, w)));
+		__m128 r7 = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(y, z), _mm_mul_ps(x, w)));
+		__m128 r8 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))));
+
+		//角速度
+		__m128 ttx = _mm_loadu_ps(tx + i), tty = _mm_loadu_ps(ty + i), ttz = _mm_loadu_ps(tz + i);
+		__m128 lx = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ttx, r0), _mm_mul_ps(tty, r1)), _mm_mul_ps(ttz, r2)), _mm_loadu_ps(ix + i));
+		__m128 ly = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ttx, r3), _mm_mul_ps(tty, r4)), _mm_mul_ps(ttz, r5)), _mm_loadu_ps(iy + i));
+		__m128 lz = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ttx, r6), _mm_mul_ps(tty, r7)), _mm_mul_ps(ttz, r8)), _mm_loadu_ps(iz + i));
+		__m128 owx = _mm_loadu_ps(wx + i), owy = _mm_loadu_ps(wy + i), owz = _mm_loadu_ps(wz + i);
+		__m128 nwx = _mm_add_ps(owx, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, r0), _mm_mul_ps(ly, r3)), _mm_mul_ps(lz, r6)), dt));
+		__m128 nwy = _mm_add_ps(owy, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, r1), _mm_mul_ps(ly, r4)), _mm_mul_ps(lz, r7)), dt));
+		__m128 nwz = _mm_add_ps(owz, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, r2), _mm_mul_ps(ly, r5)), _mm_mul_ps(lz, r8)), dt));
+
+		//姿勢
+		__m128 dx = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(w, nwx), _mm_mul_ps(nwy, z)), _mm_mul_ps(nwz, y));
+		__m128 dy = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(w, nwy), _mm_mul_ps(nwz, x)), _mm_mul_ps(nwx, z));
+		__m128 dz = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(w, nwz), _mm_mul_ps(nwx, y)), _mm_mul_ps(nwy, x));
+		__m128 dw = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(_mm_mul_ps(nwx, x), _mm_mul_ps(nwy, y)), _mm_mul_ps(nwz, z)));
+		__m128 nx = _mm_add_ps(x, _mm_mul_ps(h, dx));
+		__m128 ny = _mm_add_ps(y, _mm_mul_ps(h, dy));
+		__m128 nz = _mm_add_ps(z, _mm_mul_ps(h, dz));
+		__m128 nw = _mm_add_ps(w, _mm_mul_ps(h, dw));
+		__m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)), _mm_mul_ps(nw, nw)));
+		nx = _mm_div_ps(nx, l);
+		ny = _mm_div_ps(ny, l);
+		nz = _mm_div_ps(nz, l);
+		nw = _mm_div_ps(nw, l);
+
+		//不動オブジェクトのレーンは元の値を書き戻す
+#define SELECT(a, b) _mm_or_ps(_mm_and_ps(movable, (a)), _mm_andnot_ps(movable, (b)))
+		_mm_storeu_ps(vx + i, SELECT(nvx, ovx));
+		_mm_storeu_ps(vy + i, SELECT(nvy, ovy));
+		_mm_storeu_ps(vz + i, SELECT(nvz, ovz));
+		_mm_storeu_ps(px + i, SELECT(npx, opx));
+		_mm_storeu_ps(py + i, SELECT(npy, opy));
+		_mm_storeu_ps(pz + i, SELECT(npz, opz));
+		_mm_storeu_ps(wx + i, SELECT(nwx, owx));
+		_mm_storeu_ps(wy + i, SELECT(nwy, owy));
+		_mm_storeu_ps(wz + i, SELECT(nwz, owz));
+		_mm_storeu_ps(qx + i, SELECT(nx, x));
+		_mm_storeu_ps(qy + i, SELECT(ny, y));
+		_mm_storeu_ps(qz + i, SELECT(nz, z));
+		_mm_storeu_ps(qw + i, SELECT(nw, w));
+#undef SELECT
+
+		//力とトルクのアキュムレータをゼロリセットする
+		_mm_storeu_ps(fx + i, zero);
+		_mm_storeu_ps(fy + i, zero);
+		_mm_storeu_ps(fz + i, zero);
+		_mm_storeu_ps(tx + i, zero);
+		_mm_storeu_ps(ty + i, zero);
+		_mm_storeu_ps(tz + i, zero);
+	}
+	//端数はスカラーで処理する
+	integrate_scalar(bodies, i, end, duration);
+}
+
+//AVX2で8剛体ずつ処理する(演算の順序はintegrate_scalarと同じ)
+TARGET_AVX2 void integrate_avx2(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration)
+{
+	FLOAT *px = bodies.position[0], *py = bodies.position[1], *pz = bodies.position[2];
+	FLOAT *qx = bodies.orientation[0], *qy = bodies.orientation[1], *qz = bodies.orientation[2], *qw = bodies.orientation[3];
+	FLOAT *vx = bodies.linear_velocity[0], *vy = bodies.linear_velocity[1], *vz = bodies.linear_velocity[2];
+	FLOAT *wx = bodies.angular_velocity[0], *wy = bodies.angular_velocity[1], *wz = bodies.angular_velocity[2];
+	FLOAT *fx = bodies.accumulated_force[0], *fy = bodies.accumulated_force[1], *fz = bodies.accumulated_force[2];
+	FLOAT *tx = bodies.accumulated_torque[0], *ty = bodies.accumulated_torque[1], *tz = bodies.accumulated_torque[2];
+	const FLOAT *im = bodies.inverse_mass;
+	const FLOAT *ix = bodies.inverse_inertia[0], *iy = bodies.inverse_inertia[1], *iz = bodies.inverse_inertia[2];
+
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 dt = _mm256_set1_ps(duration);
+	const __m256 h = _mm256_set1_ps(0.5f * duration);
+
+	UINT i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 m = _mm256_loadu_ps(im + i);
+		//可動オブジェクトのレーンのみ結果を書き込むマスク
+		__m256 movable = _mm256_cmp_ps(m, zero, _CMP_GT_OQ);
+
+		//並進
+		__m256 ovx = _mm256_loadu_ps(vx + i), ovy = _mm256_loadu_ps(vy + i), ovz = _mm256_loadu_ps(vz + i);
+		__m256 nvx = _mm256_add_ps(ovx, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(fx + i), m), dt));
+		__m256 nvy = _mm256_add_ps(ovy, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(fy + i), m), dt));
+		__m256 nvz = _mm256_add_ps(ovz, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(fz + i), m), dt));
+		__m256 opx = _mm256_loadu_ps(px + i), opy = _mm256_loadu_ps(py + i), opz = _mm256_loadu_ps(pz + i);
+		__m256 npx = _mm256_add_ps(opx, _mm256_mul_ps(nvx, dt));
+		__m256 npy = _mm256_add_ps(opy, _mm256_mul_ps(nvy, dt));
+		__m256 npz = _mm256_add_ps(opz, _mm256_mul_ps(nvz, dt));
+
+		//姿勢の回転行列
+		__m256 x = _mm256_loadu_ps(qx + i), y = _mm256_loadu_ps(qy + i), z = _mm256_loadu_ps(qz + i), w = _mm256_loadu_ps(qw + i);
+		__m256 r0 = _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(y, y), _mm256_mul_ps(z, z))));
+		__m256 r1 = _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(x, y), _mm256_mul_ps(z, w)));
+		__m256 r2 = _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(x, z), _mm256_mul_ps(y, w)));
+		__m256 r3 = _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(x, y), _mm256_mul_ps(z, w)));
+		__m256 r4 = _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(z, z))));
+		__m256 r5 = _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(y, z), _mm256_mul_ps(x, w)));
+		__m256 r6 = _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(x, z), _mm256_mul_ps(y, w)));
+		__m256 r7 = _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(y, z), _mm256_mul_ps(x, w)));
+		__m256 r8 = _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y))));
+
+		//角速度
+		__m256 ttx = _mm256_loadu_ps(tx + i), tty = _mm256_loadu_ps(ty + i), ttz = _mm256_loadu_ps(tz + i);
+		__m256 lx = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ttx, r0), _mm256_mul_ps(tty, r1)), _mm256_mul_ps(ttz, r2)), _mm256_loadu_ps(ix + i));
+		__m256 ly = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ttx, r3), _mm256_mul_ps(tty, r4)), _mm256_mul_ps(ttz, r5)), _mm256_loadu_ps(iy + i));
+		__m256 lz = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ttx, r6), _mm256_mul_ps(tty, r7)), _mm256_mul_ps(ttz, r8)), _mm256_loadu_ps(iz + i));
+		__m256 owx = _mm256_loadu_ps(wx + i), owy = _mm256_loadu_ps(wy + i), owz = _mm256_loadu_ps(wz + i);
+		__m256 nwx = _mm256_add_ps(owx, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, r0), _mm256_mul_ps(ly, r3)), _mm256_mul_ps(lz, r6)), dt));
+		__m256 nwy = _mm256_add_ps(owy, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, r1), _mm256_mul_ps(ly, r4)), _mm256_mul_ps(lz, r7)), dt));
+		__m256 nwz = _mm256_add_ps(owz, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, r2), _mm256_mul_ps(ly, r5)), _mm256_mul_ps(lz, r8)), dt));
+
+		//姿勢
+		__m256 dx = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(w, nwx), _mm256_mul_ps(nwy, z)), _mm256_mul_ps(nwz, y));
+		__m256 dy = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(w, nwy), _mm256_mul_ps(nwz, x)), _mm256_mul_ps(nwx, z));
+		__m256 dz = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(w, nwz), _mm256_mul_ps(nwx, y)), _mm256_mul_ps(nwy, x));
+		__m256 dw = _mm256_sub_ps(zero, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nwx, x), _mm256_mul_ps(nwy, y)), _mm256_mul_ps(nwz, z)));
+		__m256 nx = _mm256_add_ps(x, _mm256_mul_ps(h, dx));
+		__m256 ny = _mm256_add_ps(y, _mm256_mul_ps(h, dy));
+		__m256 nz = _mm256_add_ps(z, _mm256_mul_ps(h, dz));
+		__m256 nw = _mm256_add_ps(w, _mm256_mul_ps(h, dw));
+		__m256 l = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)), _mm256_mul_ps(nw, nw)));
+		nx = _mm256_div_ps(nx, l);
+		ny = _mm256_div_ps(ny, l);
+		nz = _mm256_div_ps(nz, l);
+		nw = _mm256_div_ps(nw, l);
+
+		//不動オブジェクトのレーンは元の値を書き戻す
+		_mm256_storeu_ps(vx + i, _mm256_blendv_ps(ovx, nvx, movable));
+		_mm256_storeu_ps(vy + i, _mm256_blendv_ps(ovy, nvy, movable));
+		_mm256_storeu_ps(vz + i, _mm256_blendv_ps(ovz, nvz, movable));
+		_mm256_storeu_ps(px + i, _mm256_blendv_ps(opx, npx, movable));
+		_mm256_storeu_ps(py + i, _mm256_blendv_ps(opy, npy, movable));
+		_mm256_storeu_ps(pz + i, _mm256_blendv_ps(opz, npz, movable));
+		_mm256_storeu_ps(wx + i, _mm256_blendv_ps(owx, nwx, movable));
+		_mm256_storeu_ps(wy + i, _mm256_blendv_ps(owy, nwy, movable));
+		_mm256_storeu_ps(wz + i, _mm256_blendv_ps(owz, nwz, movable));
+		_mm256_storeu_ps(qx + i, _mm256_blendv_ps(x, nx, movable));
+		_mm256_storeu_ps(qy + i, _mm256_blendv_ps(y, ny, movable));
+		_mm256_storeu_ps(qz + i, _mm256_blendv_ps(z, nz, movable));
+		_mm256_storeu_ps(qw + i, _mm256_blendv_ps(w, nw, movable));
+
+		//力とトルクのアキュムレータをゼロリセットする
+		_mm256_storeu_ps(fx + i, zero);
+		_mm256_storeu_ps(fy + i, zero);
+		_mm256_storeu_ps(fz + i, zero);
+		_mm256_storeu_ps(tx + i, zero);
+		_mm256_storeu_ps(ty + i, zero);
+		_mm256_storeu_ps(tz + i, zero);
+	}
+	//端数はSSEで処理する
+	integrate_sse(bodies, i, end, duration);
+}
+#else
+void integrate_sse(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration)
+{
+	integrate_scalar(bodies, begin, end, duration);
+}
+void integrate_avx2(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration)
+{
+	integrate_scalar(bodies, begin, end, duration);
+}
+#endif
+
+void integrate_batch(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration, SIMD_LEVEL level)
+{
+	//実行時に検出した命令セットを超える実装は呼び出さない
+	static const SIMD_LEVEL supported = detect_simd_level();
+	if (level > supported) level = supported;
+
+	switch (level)
+	{
+	case SIMD_AVX2:
+		integrate_avx2(bodies, begin, end, duration);
+		break;
+	case SIMD_SSE:
+		integrate_sse(bodies, begin, end, duration);
+		break;
+	default:
+		integrate_scalar(bodies, begin, end, duration);
+		break;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "PhysicsMath.h"
+
+//SIMD命令セットの種類
+enum SIMD_LEVEL
+{
+	SIMD_SCALAR,	//SIMDを使用しない
+	SIMD_SSE,	//4剛体ずつ処理する
+	SIMD_AVX2	//8剛体ずつ処理する
+};
+
+//実行中のCPUで使用できる最も広いSIMD命令セットを返す
+SIMD_LEVEL detect_simd_level();
+
+//一括インテグレーションの対象となる成分配列(RigidWorldの配列を指す)
+struct BodyArrays
+{
+	FLOAT *position[3];
+	FLOAT *orientation[4];
+	FLOAT *linear_velocity[3];
+	FLOAT *angular_velocity[3];
+	FLOAT *accumulated_force[3];
+	FLOAT *accumulated_torque[3];
+	const FLOAT *inverse_mass;
+	const FLOAT *inverse_inertia[3];
+};
+
+//剛体番号[begin, end)の剛体をRigidBody::integrateと同じ計算でインテグレーションする
+//不動オブジェクト(inverse_mass == 0)は状態を変更せず、アキュムレータのみゼロリセットする
+void integrate_scalar(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration);
+void integrate_sse(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration);
+void integrate_avx2(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration);
+
+//指定した命令セット(level)の実装を呼び出す(使用できない命令セットの場合はスカラー実装で処理する)
+void integrate_batch(const BodyArrays &bodies, UINT begin, UINT end, FLOAT duration, SIMD_LEVEL level);
+
+//クォータニオンから回転行列(D3DXMatrixRotationQuaternionと同じ並び)を求める
+inline void quaternion_to_rotation(FLOAT x, FLOAT y, FLOAT z, FLOAT w, FLOAT r[9])
+{
+	r[0] = 1 - 2 * (y * y + z * z); r[1] = 2 * (x * y + z * w); r[2] = 2 * (x * z - y * w);
+	r[3] = 2 * (x * y - z * w); r[4] = 1 - 2 * (x * x + z * z); r[5] = 2 * (y * z + x * w);
+	r[6] = 2 * (x * z + y * w); r[7] = 2 * (y * z - x * w); r[8] = 1 - 2 * (x * x + y * y);
+}
@@ -0,0 +1,128 @@
+//Cloth(Grid.xから作る布)の計測
+//Grid.xを溶接して布を作り、上端を固定して球と床に掛けた状態でN回stepを呼び、1ステップあたりの時間を出力する
+//
+//使い方:ClothBenchmark [Grid.xのパス] [ステップ数] [布の数] [スレッド数]
+//計測の前に、溶接後の頂点数と面の数、スレッド数を変えても結果が(ビット単位で)一致すること、
+//計測後に位置が有限で伸びが小さいことを確認し、満たさない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../Cloth.h"
+#include "../JobSystem.h"
+
+//上端の頂点を固定し、球と床を置く
+static void setup(Cloth *cloth, const ClothMesh &mesh, const Sphere *sphere, const Plane *floor)
+{
+	cloth->create(mesh, mat4_identity(), 1.0f);
+	FLOAT top = -FLT_MAX;
+	for (UINT i = 0; i < cloth->vertex_count(); i++)
+	{
+		top = std::max(top, cloth->particles.position[1][i]);
+	}
+	for (UINT i = 0; i < cloth->vertex_count(); i++)
+	{
+		if (cloth->particles.position[1][i] == top) cloth->pin(i);
+	}
+	cloth->spheres.push_back(sphere);
+	cloth->planes.push_back(floor);
+}
+
+//伸びの拘束の最大の相対的な伸び
+static FLOAT max_stretch(const Cloth &cloth)
+{
+	FLOAT e = 0;
+	for (UINT k = 0; k < cloth.stretch_count; k++)
+	{
+		vec3 d = cloth.particles.get_position(cloth.constraints.second[k]) - cloth.particles.get_position(cloth.constraints.first[k]);
+		e = std::max(e, fabsf(length(d) / cloth.constraints.length[k] - 1));
+	}
+	return e;
+}
+
+static bool is_finite(const Cloth &cloth)
+{
+	for (UINT i = 0; i < cloth.vertex_count(); i++)
+	{
+		vec3 p = cloth.particles.get_position(i);
+		if (!(fabsf(p.x) < 1e6f && fabsf(p.y) < 1e6f && fabsf(p.z) < 1e6f)) return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : "Grid.x";
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 600;
+	const UINT cloth_count = argc > 3 ? (UINT)atoi(argv[3]) : 1;
+	const UINT threads = argc > 4 ? (UINT)atoi(argv[4]) : hardware_thread_count();
+	const FLOAT duration = 1.0f / 60;
+	typedef std::chrono::high_resolution_clock Clock;
+	int result = 0;
+
+	ClothMesh mesh;
+	if (!mesh.load_x(path))
+	{
+		printf("cannot load %s\n", path);
+		return 1;
+	}
+	const UINT raw_vertices = (UINT)mesh.vertices.size();
+	mesh.weld();
+	printf("%s: %u vertices, welded to %u vertices, %u polygons\n", path, raw_vertices, (UINT)mesh.vertices.size(), (UINT)mesh.polygon_sizes.size());
+
+	//布の前に球、下に床を置く(布はxy平面、y = -1～1)
+	Sphere sphere(0.4f, 1);
+	sphere.position = vec3(0, -0.6f, 0.3f);
+	Plane floor(vec3(0, 1, 0), -1.2f);
+
+	//スレッド数によらず結果が一致すること
+	{
+		JobSystem many_jobs(std::max(threads, 4u));
+		Cloth a, b;
+		setup(&a, mesh, &sphere, &floor);
+		setup(&b, mesh, &sphere, &floor);
+		b.set_jobs(&many_jobs);
+		for (int step = 0; step < 60; step++)
+		{
+			a.step(duration);
+			b.step(duration);
+		}
+		bool failed = false;
+		for (int k = 0; k < 3; k++)
+		{
+			failed = failed || a.particles.position[k] != b.particles.position[k] || a.particles.velocity[k] != b.particles.velocity[k];
+		}
+		printf("check 1 thread vs %u threads  %s\n", std::max(threads, 4u), failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//計測(全ての布を1回ずつ進めることを1ステップとする)
+	//布が1枚の場合は布の中の処理を、複数の場合は布ごとにジョブに分ける
+	JobSystem jobs(threads);
+	std::vector<Cloth> cloths(cloth_count);
+	for (UINT c = 0; c < cloth_count; c++)
+	{
+		setup(&cloths[c], mesh, &sphere, &floor);
+		cloths[c].set_jobs(cloth_count > 1 ? 0 : &jobs);
+	}
+	printf("cloths %u, constraints %u (stretch %u, shear %u, bend %u), colors %u, substeps %u, iterations %u, threads %u\n",
+		cloth_count, cloths[0].constraints.size(), cloths[0].stretch_count, cloths[0].shear_count, cloths[0].bend_count,
+		(cloths[0].constraints.build(), cloths[0].constraints.color_count()), cloths[0].substeps, cloths[0].constraints.iterations, threads);
+
+	Clock::time_point start = Clock::now();
+	for (UINT step = 0; step < steps; step++)
+	{
+		step_cloths(cloths.data(), cloth_count, duration, &jobs);
+	}
+	double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	printf("%8.3f ms/step (%8.3f ms per cloth, %u vertices each)\n", ms / steps, ms / steps / cloth_count, cloths[0].vertex_count());
+
+	FLOAT stretch = max_stretch(cloths[0]);
+	bool failed = !is_finite(cloths[0]) || stretch > 0.2f;
+	printf("after %u steps: max stretch %g, self contacts %u%s\n", steps, stretch, cloths[0].self_collision.contacts, failed ? "  FAILED" : "");
+	if (failed) result = 1;
+	return result;
+}
@@ -0,0 +1,224 @@
+//ParticleConstraints(XPBDによる距離拘束の一括処理)の計測
+//格子状の網(隣り合う質点を棒でつなぎ、対角をケーブルでつなぐ)に重力を加えて解き、
+//Particle::Rod・Particle::Cableの仮想関数による1本ずつの処理と拘束の処理速度(constraints/s)を比較する
+//
+//使い方:ConstraintBenchmark [一辺の質点数] [ステップ数] [スレッド数]
+//計測の前に、SIMDの各実装とスレッド数の違いで結果が(ビット単位で)一致することと、
+//反復回数を増やすと伸びが小さくなることを確認し、満たさない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../Particle.h"
+#include "../ParticleSystem.h"
+#include "../ParticleConstraints.h"
+#include "../JobSystem.h"
+
+//再現性のある乱数(線形合同法)
+static UINT random_state = 12345;
+static FLOAT random_float(FLOAT min, FLOAT max)
+{
+	random_state = random_state * 1664525 + 1013904223;
+	return min + (max - min) * ((random_state >> 8) / 16777216.0f);
+}
+
+//一辺side個の質点の網を作り、1辺を固定して吊るす(質点の位置を少しずらして、最初から拘束が満たされていない状態にする)
+static void setup(ParticleSystem *system, ParticleConstraints *constraints, UINT side)
+{
+	random_state = 12345;
+	system->clear();
+	constraints->clear();
+	const FLOAT spacing = 0.1f;
+	for (UINT y = 0; y < side; y++)
+	{
+		for (UINT x = 0; x < side; x++)
+		{
+			//奥の辺の質点は動かさない
+			FLOAT m = random_float(0.5f, 2);
+			system->spawn(y == 0 ? FLT_MAX : m, vec3(x * spacing, 0, y * spacing));
+		}
+	}
+	for (UINT y = 0; y < side; y++)
+	{
+		for (UINT x = 0; x < side; x++)
+		{
+			UINT i = y * side + x;
+			if (x + 1 < side) constraints->add(i, i + 1, spacing);
+			if (y + 1 < side) constraints->add(i, i + side, spacing);
+			if (x + 1 < side && y + 1 < side) constraints->add(i, i + side + 1, spacing * sqrtf(2.0f), 0, true);
+		}
+	}
+	for (UINT i = side; i < system->size(); i++)
+	{
+		system->position[1][i] += random_float(-0.02f, 0.02f);
+	}
+}
+
+//棒の最大の相対的な伸び
+static FLOAT max_stretch(const ParticleSystem &system, const ParticleConstraints &constraints)
+{
+	FLOAT e = 0;
+	for (UINT k = 0; k < constraints.size(); k++)
+	{
+		vec3 d = system.get_position(constraints.second[k]) - system.get_position(constraints.first[k]);
+		FLOAT stretch = length(d) / constraints.length[k] - 1;
+		if (constraints.unilateral[k]) stretch = std::max(stretch, 0.0f);
+		e = std::max(e, fabsf(stretch));
+	}
+	return e;
+}
+
+static bool equal(const ParticleSystem &a, const ParticleSystem &b)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		if (a.position[k] != b.position[k] || a.velocity[k] != b.velocity[k]) return false;
+	}
+	return true;
+}
+
+static const char *level_name(SIMD_LEVEL level)
+{
+	switch (level)
+	{
+	case SIMD_AVX2: return "avx2";
+	case SIMD_SSE: return "sse";
+	default: return "scalar";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT side = argc > 1 ? (UINT)atoi(argv[1]) : 300;
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 20;
+	const UINT threads = argc > 3 ? (UINT)atoi(argv[3]) : hardware_thread_count();
+	const FLOAT duration = 1.0f / 60;
+	const vec3 g(0, -9.8f, 0);
+	const SIMD_LEVEL supported = detect_simd_level();
+	typedef std::chrono::high_resolution_clock Clock;
+	int result = 0;
+
+	//一致の確認(スカラー・1スレッドを基準とする、1色あたりの拘束が複数のスレッドに分かれる大きさの網で比較する)
+	{
+		ParticleSystem reference;
+		ParticleConstraints reference_constraints;
+		setup(&reference, &reference_constraints, 256);
+		reference_constraints.simd_level = SIMD_SCALAR;
+		for (int step = 0; step < 5; step++)
+		{
+			reference.add_gravity(g);
+			reference.integrate(duration);
+			reference_constraints.solve(&reference, duration);
+		}
+		JobSystem jobs(4);
+		for (int level = SIMD_SCALAR; level <= supported; level++)
+		{
+			ParticleSystem system;
+			ParticleConstraints constraints;
+			setup(&system, &constraints, 256);
+			constraints.simd_level = (SIMD_LEVEL)level;
+			constraints.jobs = &jobs;
+			for (int step = 0; step < 5; step++)
+			{
+				system.add_gravity(g);
+				system.integrate(duration);
+				constraints.solve(&system, duration);
+			}
+			bool failed = !equal(system, reference);
+			printf("check %-6s 4 threads vs scalar 1 thread  %s\n", level_name((SIMD_LEVEL)level), failed ? "FAILED" : "ok");
+			if (failed) result = 1;
+		}
+	}
+
+	//収束の確認(反復回数を増やすと伸びが小さくなる)
+	{
+		FLOAT previous = FLT_MAX;
+		UINT counts[] = { 1, 4, 16, 64 };
+		for (int c = 0; c < 4; c++)
+		{
+			ParticleSystem system;
+			ParticleConstraints constraints;
+			setup(&system, &constraints, 64);
+			constraints.iterations = counts[c];
+			system.add_gravity(g);
+			system.integrate(duration);
+			constraints.solve(&system, duration);
+			FLOAT e = max_stretch(system, constraints);
+			bool failed = e >= previous;
+			printf("iterations %2u  max stretch %g%s\n", counts[c], e, failed ? "  FAILED" : "");
+			if (failed) result = 1;
+			previous = e;
+		}
+	}
+
+	//計測(拘束1本を1回解くことを1回とする)
+	ParticleSystem system;
+	ParticleConstraints constraints;
+	setup(&system, &constraints, side);
+	constraints.build();
+	printf("particles %u, constraints %u, colors %u, iterations %u, threads %u\n",
+		system.size(), constraints.size(), constraints.color_count(), constraints.iterations, threads);
+	{
+		//同じ網をParticle::Rod・Particle::Cableで作る
+		std::vector<Particle> particles(system.size());
+		for (UINT i = 0; i < system.size(); i++)
+		{
+			particles[i].mass = system.mass[i];
+			particles[i].position = system.get_position(i);
+		}
+		std::vector<Particle::Constraint *> legacy;
+		for (UINT k = 0; k < constraints.size(); k++)
+		{
+			Particle *p = &particles[constraints.first[k]], *q = &particles[constraints.second[k]];
+			if (constraints.unilateral[k]) legacy.push_back(new Particle::Cable(p, q));
+			else legacy.push_back(new Particle::Rod(p, q));
+		}
+		Clock::time_point start = Clock::now();
+		for (UINT step = 0; step < steps; step++)
+		{
+			for (size_t i = 0; i < particles.size(); i++)
+			{
+				if (particles[i].mass < FLT_MAX) particles[i].add_force(particles[i].mass * g);
+				particles[i].integrate(duration);
+			}
+			for (UINT iteration = 0; iteration < constraints.iterations; iteration++)
+			{
+				for (size_t k = 0; k < legacy.size(); k++)
+				{
+					legacy[k]->resolve(duration);
+				}
+			}
+		}
+		double s = std::chrono::duration<double>(Clock::now() - start).count();
+		printf("%-28s %8.1f M constraints/s, %8.2f ms/step\n", "Particle::Rod/Cable",
+			(double)legacy.size() * constraints.iterations * steps / s * 1e-6, s * 1e3 / steps);
+		for (size_t k = 0; k < legacy.size(); k++)
+		{
+			delete legacy[k];
+		}
+	}
+	for (int level = SIMD_SCALAR; level <= supported; level++)
+	{
+		for (UINT t = 1; t <= threads; t = t < threads ? std::min(t * 2, threads) : threads + 1)
+		{
+			JobSystem jobs(t);
+			setup(&system, &constraints, side);
+			constraints.simd_level = (SIMD_LEVEL)level;
+			constraints.jobs = &jobs;
+			Clock::time_point start = Clock::now();
+			for (UINT step = 0; step < steps; step++)
+			{
+				system.add_gravity(g);
+				system.integrate(duration);
+				constraints.solve(&system, duration);
+			}
+			double s = std::chrono::duration<double>(Clock::now() - start).count();
+			printf("ParticleConstraints %-6s %2u %8.1f M constraints/s, %8.2f ms/step\n", level_name((SIMD_LEVEL)level), t,
+				(double)constraints.size() * constraints.iterations * steps / s * 1e-6, s * 1e3 / steps);
+		}
+	}
+	return result;
+}
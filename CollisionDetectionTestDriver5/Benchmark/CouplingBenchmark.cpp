@@ -0,0 +1,231 @@
+//ParticleRigidCouplingの計測
+//床の平面の上に球体と直方体を並べ、その周りに質点をばらまいた状態でresolveを呼び、1回あたりの時間を出力する
+//
+//使い方:CouplingBenchmark [最大の質点数] [剛体数] [反復回数] [スレッド数]
+//質点数を最大の質点数まで倍々に増やして計測し、質点1個あたりの時間が質点数によらずほぼ一定であることを確認できるようにする
+//計測の前に、結果がcollide_sphere_*とParticle::collideによる総当たりの判定と丸め誤差の範囲で一致すること、
+//スレッド数を変えても結果が(ビット単位で)一致することを確認し、満たさない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../ParticleRigidCoupling.h"
+#include "../Particle.h"
+#include "../JobSystem.h"
+
+static const FLOAT RADIUS = 0.05f;	//質点の半径
+static const FLOAT SPACING = 2.0f;	//剛体を並べる間隔
+
+//床の平面と、一辺sideの正方形の範囲に球体と直方体を交互にcount個並べる
+//剛体どうしと床は質点の直径より離し、1個の質点が2個以上の剛体に同時に接触しないようにする
+static void build_world(RigidWorld *world, UINT count, std::mt19937 *random)
+{
+	std::uniform_real_distribution<FLOAT> uniform(-1, 1);
+	world->create_plane(vec3(0, 1, 0), 0);
+	const UINT side = (UINT)ceilf(sqrtf((FLOAT)count));
+	for (UINT i = 0; i < count; i++)
+	{
+		vec3 center((i % side) * SPACING, 1.0f, (i / side) * SPACING);
+		RigidBodyRef body = world->body(i % 2 == 0 ?
+			world->create_sphere(0.5f, 1) :
+			world->create_box(vec3(0.5f, 0.3f, 0.4f), 1));
+		body.set_position(center);
+		vec3 axis(uniform(*random), uniform(*random), uniform(*random));
+		quat q;
+		q = quat_from_axis_angle(axis, uniform(*random) * 3);
+		body.set_orientation(q);
+		body.set_linear_velocity(vec3(uniform(*random), uniform(*random), uniform(*random)));
+		body.set_angular_velocity(vec3(uniform(*random), uniform(*random), uniform(*random)));
+	}
+}
+
+//剛体を並べた範囲の、床から高さ2までの範囲に質点をばらまく
+static void scatter(ParticleSystem *system, UINT n, UINT bodies, std::mt19937 *random)
+{
+	const FLOAT side = ceilf(sqrtf((FLOAT)bodies)) * SPACING;
+	std::uniform_real_distribution<FLOAT> x(-SPACING / 2, side - SPACING / 2), y(-0.1f, 2.0f), v(-3, 3);
+	system->clear();
+	system->reserve(n);
+	for (UINT i = 0; i < n; i++)
+	{
+		system->spawn(1.0f, vec3(x(*random), y(*random), x(*random)), vec3(v(*random), v(*random), v(*random)));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT max_particles = argc > 1 ? (UINT)atoi(argv[1]) : 1000000;
+	const UINT body_count = argc > 2 ? (UINT)atoi(argv[2]) : 1000;
+	const UINT iterations = argc > 3 ? (UINT)atoi(argv[3]) : 5;
+	const UINT threads = argc > 4 ? (UINT)atoi(argv[4]) : hardware_thread_count();
+	const FLOAT duration = 1.0f / 60;
+	typedef std::chrono::high_resolution_clock Clock;
+	int result = 0;
+
+	JobSystem jobs(threads);
+
+	//総当たりの判定と一致すること
+	//(collide_sphere_boxは中心が箱の中にある球を、collide_sphere_planeは中心が平面の裏にある球を判定しないため、そのような質点は除く)
+	//(中心が剛体の表面にごく近い質点は、法線の向きが丸め誤差で大きく変わるため除く)
+	{
+		const UINT m = 64;
+		std::mt19937 random(1);
+		RigidWorld world;
+		build_world(&world, m, &random);
+		world.update_transforms();
+		ParticleSystem scattered, system;
+		scatter(&scattered, 50000, m, &random);
+		for (UINT i = 0; i < scattered.size(); i++)
+		{
+			vec3 p = scattered.get_position(i);
+			bool inside = p.y <= 0;
+			for (UINT b = 1; b < world.size(); b++)
+			{
+				vec3 d = p - world.get_position(b);
+				FLOAT outside = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					vec3 axis(world.rotation[3 * k][b], world.rotation[3 * k + 1][b], world.rotation[3 * k + 2][b]);
+					outside = std::max(outside, fabsf(dot(d, axis)) - world.dimension[k][b]);
+				}
+				inside = inside || outside <= 2e-3f || (world.shape[b] == SHAPE_SPHERE && length(d) <= world.dimension[0][b] + 2e-3f);
+			}
+			if (!inside) system.spawn(scattered.mass[i], p, scattered.get_velocity(i));
+		}
+		const UINT n = system.size();
+
+		std::vector<Particle> expected(n);
+		std::vector<vec3> force(world.size(), vec3(0, 0, 0)), torque(world.size(), vec3(0, 0, 0));
+		for (UINT i = 0; i < n; i++)
+		{
+			Particle &particle = expected[i];
+			particle.mass = system.mass[i];
+			particle.position = system.get_position(i);
+			particle.velocity = system.get_velocity(i);
+			for (UINT b = 0; b < world.size(); b++)
+			{
+				const vec3 center = world.get_position(b);
+				const quat orientation = world.get_orientation(b);
+				ContactPoint contact;
+				INT hit = 0;
+				switch (world.shape[b])
+				{
+				case SHAPE_SPHERE:
+					hit = collide_sphere_sphere(particle.position, RADIUS, center, world.dimension[0][b], &contact);
+					break;
+				case SHAPE_BOX:
+					hit = collide_sphere_box(particle.position, RADIUS, center, orientation, world.get_dimension(b), &contact);
+					break;
+				case SHAPE_PLANE:
+					hit = collide_sphere_plane(particle.position, RADIUS, center, orientation, &contact);
+					break;
+				}
+				if (!hit) continue;
+
+				//剛体の接触点の速度に対する相対速度でParticle::collideを呼ぶ
+				vec3 arm = contact.point - center, spin, angular_velocity = world.get_angular_velocity(b);
+				spin = cross(angular_velocity, arm);
+				vec3 body_velocity = world.get_linear_velocity(b) + spin;
+				vec3 before = particle.velocity;
+				particle.velocity -= body_velocity;
+				particle.collide(contact.normal, 0.5f, contact.penetration);
+				particle.velocity += body_velocity;
+				if (world.inverse_mass[b] > 0)
+				{
+					vec3 f = -particle.mass * (particle.velocity - before) / duration, t;
+					t = cross(arm, f);
+					force[b] += f;
+					torque[b] += t;
+				}
+			}
+		}
+
+		ParticleRigidCoupling coupling(RADIUS, 0.5f);
+		coupling.jobs = &jobs;
+		coupling.resolve(&system, &world, duration);
+
+		//collide_sphere_boxは回転行列でローカル座標に変換して戻すため、箱の表面の近くでは法線の向きに丸め誤差が大きく出る
+		//(速度と力は位置より緩い誤差で比べる)
+		FLOAT position_error = 0, velocity_error = 0, force_error = 0, force_scale = 0;
+		for (UINT i = 0; i < n; i++)
+		{
+			vec3 dp = system.get_position(i) - expected[i].position, dv = system.get_velocity(i) - expected[i].velocity;
+			position_error = std::max(position_error, length(dp));
+			velocity_error = std::max(velocity_error, length(dv));
+		}
+		for (UINT b = 0; b < world.size(); b++)
+		{
+			vec3 actual_force(world.accumulated_force[0][b], world.accumulated_force[1][b], world.accumulated_force[2][b]);
+			vec3 actual_torque(world.accumulated_torque[0][b], world.accumulated_torque[1][b], world.accumulated_torque[2][b]);
+			vec3 df = actual_force - force[b], dt = actual_torque - torque[b];
+			force_error = std::max(force_error, std::max(length(df), length(dt)));
+			force_scale = std::max(force_scale, std::max(length(force[b]), length(torque[b])));
+		}
+		bool failed = position_error > 1e-4f || velocity_error > 1e-2f || force_error > 1e-3f * force_scale || coupling.contacts == 0;
+		printf("check vs brute force  %u particles, %u contacts  position %g  velocity %g  force %g (max %g)  %s\n",
+			n, coupling.contacts, position_error, velocity_error, force_error, force_scale, failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//スレッド数によらず結果が一致すること
+	{
+		const UINT n = 100000, m = 256;
+		const UINT many = std::max(threads, 4u);
+		JobSystem many_jobs(many);
+		std::mt19937 random(2);
+		RigidWorld worlds[2];
+		build_world(&worlds[0], m, &random);
+		worlds[1] = worlds[0];
+		ParticleSystem systems[2];
+		scatter(&systems[0], n, m, &random);
+		systems[1] = systems[0];
+		for (int k = 0; k < 2; k++)
+		{
+			ParticleRigidCoupling coupling(RADIUS);
+			coupling.jobs = k == 0 ? 0 : &many_jobs;
+			for (int step = 0; step < 3; step++)
+			{
+				coupling.resolve(&systems[k], &worlds[k], duration);
+				systems[k].integrate(duration);
+			}
+		}
+		bool failed = false;
+		for (int k = 0; k < 3; k++)
+		{
+			failed = failed || systems[0].position[k] != systems[1].position[k] || systems[0].velocity[k] != systems[1].velocity[k];
+			failed = failed || worlds[0].accumulated_force[k] != worlds[1].accumulated_force[k] || worlds[0].accumulated_torque[k] != worlds[1].accumulated_torque[k];
+		}
+		printf("check 1 thread vs %u threads  %s\n", many, failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//計測(質点数を倍々に増やす)
+	printf("threads %u, bodies %u, radius %g\n", threads, body_count, RADIUS);
+	for (UINT n = std::min(max_particles, 125000u); n <= max_particles; n *= 2)
+	{
+		std::mt19937 random(3);
+		RigidWorld world;
+		build_world(&world, body_count, &random);
+		ParticleSystem system;
+		scatter(&system, n, body_count, &random);
+		ParticleRigidCoupling coupling(RADIUS);
+		coupling.jobs = &jobs;
+		coupling.resolve(&system, &world, duration);
+
+		double best = 1e30;
+		for (UINT iteration = 0; iteration < iterations; iteration++)
+		{
+			Clock::time_point start = Clock::now();
+			coupling.resolve(&system, &world, duration);
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		printf("%8u particles  %6u contacts  %9.3f ms/resolve  %7.1f ns/particle\n", n, coupling.contacts, best, best * 1e6 / n);
+		if (n == max_particles) break;
+		if (n * 2 > max_particles) n = max_particles / 2;
+	}
+	return result;
+}
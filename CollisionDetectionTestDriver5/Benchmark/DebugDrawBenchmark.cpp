@@ -0,0 +1,520 @@
+//デバッグ表示のまとめ描き(DebugDrawBatch)とスレッドごとの記録(DebugDrawRecorder)の計測
+//接触ごとに十字と線分を追加して描くフレームを、要素ごとに描画を呼ぶ従来の方法(要素ごとの仮想関数とdraw_lines)と比較する
+//描画はNullDebugDrawBackendで数えるだけなので、時間は記録と展開の費用(Direct3D 9の呼び出しごとの費用は含まない)
+//記録は、記録しない種類のDEBUG_DRAWの費用、複数のスレッドからの記録とmergeの費用、RigidWorld::stepで記録する場合としない場合のステップの時間を計る
+//
+//使い方:DebugDrawBenchmark [接触数] [フレーム数]
+//計測の前に展開した頂点数・位置・色、表示時間による取り除き、描画呼び出しの回数と、
+//複数のスレッドから記録した要素が全てmergeで集まること(終了したスレッドの登録を外すこと)、写したバッチを何フレームでも描けること、種類による選択、RigidWorldが判定した接触が全て記録されることを確認し、
+//一致しない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "../DebugDraw.h"
+#include "../JobSystem.h"
+#include "../Headless/HeadlessScenes.h"
+
+static const DebugColor WHITE = 0xFFFFFFFF, RED = 0xFFFF0000;
+
+//再現性のある乱数(線形合同法)
+static UINT random_state = 12345;
+static FLOAT random_float(FLOAT min, FLOAT max)
+{
+	random_state = random_state * 1664525 + 1013904223;
+	return min + (max - min) * ((random_state >> 8) / 16777216.0f);
+}
+
+struct SampleContact
+{
+	vec3 point, normal;
+	FLOAT penetration;
+};
+static std::vector<SampleContact> make_contacts(UINT n)
+{
+	random_state = 12345;
+	std::vector<SampleContact> contacts(n);
+	for (UINT i = 0; i < n; i++)
+	{
+		contacts[i].point = vec3(random_float(-50, 50), random_float(0, 20), random_float(-50, 50));
+		vec3 normal(random_float(-1, 1), random_float(0.5f, 1), random_float(-1, 1));
+		contacts[i].normal = normalize(normal);
+		contacts[i].penetration = random_float(0, 0.01f);
+	}
+	return contacts;
+}
+
+static vec3 position(const DebugVertex &v)
+{
+	return vec3(v.x, v.y, v.z);
+}
+static bool near(FLOAT a, FLOAT b)
+{
+	return fabsf(a - b) <= 1e-4f * (1 + fabsf(b));
+}
+
+static bool report(const char *name, bool ok)
+{
+	printf("check %-30s %s\n", name, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static bool check()
+{
+	bool ok = true;
+	NullDebugDrawBackend backend(true);
+	DebugDrawBatch batch;
+	const vec3 p0(1, 2, 3), n(1, 2, 3);
+
+	//種類ごとの頂点数と描画呼び出しの回数(線で描く要素は全てで1回)
+	{
+		const mat4 o = mat4_from_rotation_translation(quat_from_yaw_pitch_roll(0.3f, 0.2f, 0.1f), vec3(0, 0, 0));
+		batch.add_line(p0, n, WHITE);
+		batch.add_triangle(p0, n, vec3(0, 0, 0), WHITE);
+		batch.add_cross(p0, 1, WHITE);
+		batch.add_circle(p0, n, 2, WHITE);
+		batch.add_sphere(p0, 2, WHITE);
+		batch.add_plane(vec3(0, 1, 0), -2, 50, WHITE);
+		batch.add_aabb(vec3(-1, -2, -3), vec3(1, 2, 3), WHITE);
+		batch.add_obb(o, vec3(1, 2, 3), WHITE);
+		batch.add_arrow(p0, 0.1f, 0.2f, 0.3f, 1, WHITE);
+		batch.add_point(p0, 1, WHITE);
+		batch.add_vector(n, p0, 0.1f, 0.2f, WHITE);
+		batch.add_string(10, 10, "contacts", WHITE);
+		const UINT expected = DebugDrawBatch::LINE_VERTICES + DebugDrawBatch::TRIANGLE_VERTICES + DebugDrawBatch::CROSS_VERTICES +
+			DebugDrawBatch::CIRCLE_VERTICES + DebugDrawBatch::SPHERE_VERTICES + DebugDrawBatch::PLANE_VERTICES +
+			DebugDrawBatch::BOX_VERTICES * 2 + DebugDrawBatch::ARROW_VERTICES;
+		batch.flush(&backend, 0);
+		ok = report("vertex count", backend.vertices == expected && batch.last_stats().vertices == expected) && ok;
+		ok = report("draw calls", backend.draw_calls == 1 && backend.meshes == 2 && backend.strings == 1 && batch.last_stats().draw_calls == 4) && ok;
+		ok = report("expired after one frame", batch.size() == 0 && batch.line_vertex_count() == 0) && ok;
+	}
+
+	//位置:円は中心から半径の距離で法線に垂直、球は中心から半径の距離、AABBの頂点は角、十字は各軸の両側
+	{
+		backend.reset();
+		batch.add_circle(p0, n, 2, WHITE);
+		batch.flush(&backend, 0);
+		bool circle = backend.last.size() == DebugDrawBatch::CIRCLE_VERTICES;
+		vec3 axis;
+		axis = normalize(n);
+		for (size_t i = 0; i < backend.last.size(); i++)
+		{
+			vec3 d = position(backend.last[i]) - p0;
+			circle = circle && near(length(d), 2) && fabsf(dot(d, axis)) < 1e-4f;
+		}
+		ok = report("circle geometry", circle) && ok;
+
+		batch.add_circle(p0, vec3(0, -3, 0), 2, WHITE);	//法線がy軸に平行な場合
+		batch.flush(&backend, 0);
+		bool vertical = backend.last.size() == DebugDrawBatch::CIRCLE_VERTICES;
+		for (size_t i = 0; i < backend.last.size(); i++)
+		{
+			vec3 d = position(backend.last[i]) - p0;
+			vertical = vertical && near(length(d), 2) && fabsf(d.y) < 1e-4f;
+		}
+		ok = report("circle geometry (normal y)", vertical) && ok;
+
+		batch.add_sphere(p0, 2, WHITE);
+		batch.flush(&backend, 0);
+		bool sphere = backend.last.size() == DebugDrawBatch::SPHERE_VERTICES;
+		for (size_t i = 0; i < backend.last.size(); i++)
+		{
+			vec3 d = position(backend.last[i]) - p0;
+			sphere = sphere && near(length(d), 2);
+		}
+		ok = report("sphere geometry", sphere) && ok;
+
+		const vec3 min(-1, -2, -3), max(1, 2, 3);
+		batch.add_aabb(min, max, WHITE);
+		const mat4 t = mat4_from_rotation_translation(quat(0, 0, 0, 1), vec3(5, 6, 7));
+		batch.add_obb(t, max - min, WHITE);
+		batch.flush(&backend, 0);
+		bool box = backend.last.size() == DebugDrawBatch::BOX_VERTICES * 2;
+		for (size_t i = 0; box && i < backend.last.size(); i += 2)
+		{
+			vec3 a = position(backend.last[i]), b = position(backend.last[i + 1]);
+			if (i >= DebugDrawBatch::BOX_VERTICES)
+			{
+				a -= vec3(5, 6, 7);
+				b -= vec3(5, 6, 7);
+			}
+			//辺は1つの軸だけが変わり、両端は角
+			int changed = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const FLOAT ak = a[k], bk = b[k];
+				const FLOAT lo = min[k], hi = max[k];
+				box = box && (near(ak, lo) || near(ak, hi)) && (near(bk, lo) || near(bk, hi));
+				if (!near(ak, bk)) changed++;
+			}
+			box = box && changed == 1;
+		}
+		ok = report("aabb/obb geometry", box) && ok;
+
+		batch.add_cross(p0, 0.5f, WHITE);
+		batch.flush(&backend, 0);
+		bool cross = backend.last.size() == DebugDrawBatch::CROSS_VERTICES;
+		for (size_t i = 0; cross && i < backend.last.size(); i += 2)
+		{
+			vec3 mid = 0.5f * (position(backend.last[i]) + position(backend.last[i + 1]));
+			vec3 d = position(backend.last[i + 1]) - position(backend.last[i]);
+			cross = cross && near(mid.x, p0.x) && near(mid.y, p0.y) && near(mid.z, p0.z) && near(length(d), 1) && near(d[i / 2], 1);
+		}
+		ok = report("cross geometry", cross) && ok;
+	}
+
+	//表示時間:0は1回だけ、1秒は経過0.4秒ずつで3回描いて取り除く(残る要素の順序は保つ)
+	{
+		backend.reset();
+		batch.add_line(vec3(0, 0, 0), vec3(1, 0, 0), WHITE, 0);
+		batch.add_line(vec3(0, 0, 0), vec3(2, 0, 0), RED, 1.0f);
+		batch.add_line(vec3(0, 0, 0), vec3(3, 0, 0), WHITE, 0.5f);
+		UINT drawn[4];
+		bool order = true;
+		for (int frame = 0; frame < 4; frame++)
+		{
+			batch.flush(&backend, 0.4f);
+			drawn[frame] = (UINT)backend.last.size() / 2;
+			if (frame == 1) order = backend.last.size() == 4 && backend.last[1].x == 2 && backend.last[1].color == RED && backend.last[3].x == 3;
+			backend.last.clear();
+		}
+		ok = report("duration", drawn[0] == 3 && drawn[1] == 2 && drawn[2] == 1 && drawn[3] == 0 && order && batch.size() == 0) && ok;
+	}
+
+	//接触ごとの十字と線分は1回の描画呼び出しにまとまり、頂点ごとの色を持つ
+	{
+		backend.reset();
+		std::vector<SampleContact> contacts = make_contacts(1000);
+		for (size_t i = 0; i < contacts.size(); i++)
+		{
+			batch.add_cross(contacts[i].point, 1, WHITE);
+			batch.add_line(contacts[i].point, contacts[i].point + contacts[i].penetration * 100 * contacts[i].normal, RED);
+		}
+		batch.flush(&backend, 0);
+		UINT red = 0, white = 0;
+		for (size_t i = 0; i < backend.last.size(); i++)
+		{
+			if (backend.last[i].color == RED) red++;
+			if (backend.last[i].color == WHITE) white++;
+		}
+		ok = report("contacts in one draw call", backend.draw_calls == 1 && backend.vertices == 8000 && red == 2000 && white == 6000) && ok;
+	}
+	return ok;
+}
+
+//全ての可動オブジェクトに重力を加える
+static void apply_gravity(RigidWorld *world)
+{
+	for (UINT i = 0; i < world->size(); i++)
+	{
+		if (world->inverse_mass[i] > 0) world->accumulated_force[1][i] += -9.8f / world->inverse_mass[i];
+	}
+}
+
+static bool check_recorder()
+{
+	bool ok = true;
+	DebugDrawRecorder &recorder = DebugDrawRecorder::I();
+	NullDebugDrawBackend backend;
+	DebugDrawBatch merged;
+	JobSystem jobs(4);
+
+	//4スレッドから記録した要素が全て集まる
+	{
+		const UINT n = 20000;
+		std::vector<SampleContact> contacts = make_contacts(n);
+		recorder.set_categories(DEBUG_DRAW_CONTACTS);
+		jobs.parallel_for(n, 64, [&contacts](UINT begin, UINT end)
+		{
+			for (UINT i = begin; i < end; i++)
+			{
+				DEBUG_DRAW(DEBUG_DRAW_CONTACTS, add_cross(contacts[i].point, 1, WHITE));
+				DEBUG_DRAW(DEBUG_DRAW_CONTACTS, add_line(contacts[i].point, contacts[i].point + contacts[i].normal, RED));
+			}
+		});
+		recorder.merge(&merged);
+		const bool all = merged.size() == 2 * n && merged.line_vertex_count() == 8 * n;
+		merged.flush(&backend, 0);
+		ok = report("recorded from threads", all && backend.draw_calls == 1 && backend.vertices == 8 * n) && ok;
+		recorder.merge(&merged);
+		ok = report("merge empties buffers", merged.size() == 0) && ok;
+	}
+
+	//終了したスレッドのバッファは登録を外す(記録は次のmergeで読み出せる)
+	{
+		const UINT registered = recorder.thread_count();
+		recorder.set_categories(DEBUG_DRAW_CONTACTS);
+		for (int round = 0; round < 100; round++)
+		{
+			std::thread thread([]() { DEBUG_DRAW(DEBUG_DRAW_CONTACTS, add_cross(vec3(0, 0, 0), 1, WHITE)); });
+			thread.join();
+		}
+		recorder.set_categories(0);
+		recorder.merge(&merged);
+		ok = report("exited threads unregistered", recorder.thread_count() == registered && merged.size() == 100) && ok;
+		merged.clear();
+	}
+
+	//写す場合は元のバッチが残り、何フレームでも同じ要素を描ける
+	{
+		DebugDrawBatch kept;
+		kept.add_cross(vec3(0, 0, 0), 1, WHITE);
+		kept.add_aabb(vec3(0, 0, 0), vec3(1, 1, 1), WHITE);
+		bool same = true;
+		for (int frame = 0; frame < 3; frame++)
+		{
+			backend.reset();
+			merged.append(kept);
+			merged.flush(&backend, 1.0f / 60);
+			same = same && backend.vertices == DebugDrawBatch::CROSS_VERTICES + DebugDrawBatch::BOX_VERTICES && merged.size() == 0;
+		}
+		ok = report("copied batch drawn every frame", same && kept.size() == 2) && ok;
+	}
+
+	//記録しない種類は追加しない
+	{
+		recorder.set_categories(DEBUG_DRAW_AABBS);
+		jobs.parallel_for(1000, 16, [](UINT begin, UINT end)
+		{
+			for (UINT i = begin; i < end; i++)
+			{
+				DEBUG_DRAW(DEBUG_DRAW_CONTACTS, add_cross(vec3(0, 0, 0), 1, WHITE));
+				DEBUG_DRAW(DEBUG_DRAW_AABBS, add_aabb(vec3(0, 0, 0), vec3(1, 1, 1), WHITE));
+			}
+		});
+		recorder.merge(&merged);
+		ok = report("category filter", merged.size() == 1000 && merged.line_vertex_count() == 1000 * DebugDrawBatch::BOX_VERTICES) && ok;
+		merged.clear();
+		recorder.set_categories(0);
+		DEBUG_DRAW(DEBUG_DRAW_AABBS, add_aabb(vec3(0, 0, 0), vec3(1, 1, 1), WHITE));
+		recorder.merge(&merged);
+		ok = report("disabled records nothing", merged.size() == 0) && ok;
+	}
+
+	//並列のstepで判定した接触が全て記録される(接触ごとに十字と線分)、AABBは平面以外の剛体ごとに1つ
+	{
+		RigidWorld world;
+		headless_scenes[1].build(&world, 2000, 0);
+		world.jobs = &jobs;
+		UINT planes = 0;
+		for (UINT i = 0; i < world.size(); i++) planes += world.shape[i] == SHAPE_PLANE;
+		bool contacts = true, aabbs = true;
+		for (int step = 0; step < 60; step++)
+		{
+			recorder.set_categories(step % 2 ? DEBUG_DRAW_CONTACTS : DEBUG_DRAW_AABBS);
+			world.store_poses();
+			apply_gravity(&world);
+			world.step(1.0f / 60);
+			recorder.merge(&merged);
+			if (step % 2) contacts = contacts && merged.size() == 2 * world.contacts.size();
+			else aabbs = aabbs && merged.size() == world.size() - planes;
+			merged.clear();
+		}
+		recorder.set_categories(0);
+		ok = report("RigidWorld contacts recorded", contacts) && ok;
+		ok = report("RigidWorld aabbs recorded", aabbs) && ok;
+	}
+	return ok;
+}
+
+//従来の方法:要素ごとに仮想関数を持つオブジェクトを確保してリストにつなぎ、要素ごとに描画を呼ぶ
+struct LegacyPrimitive
+{
+	LegacyPrimitive *next;
+	LegacyPrimitive() : next(0) {}
+	virtual ~LegacyPrimitive() {}
+	virtual void draw(DebugDrawBackend *backend) = 0;
+};
+struct LegacyLine : public LegacyPrimitive
+{
+	vec3 p0, p1;
+	DebugColor c;
+	LegacyLine(const vec3 &p0, const vec3 &p1, DebugColor c) : p0(p0), p1(p1), c(c) {}
+	void draw(DebugDrawBackend *backend)
+	{
+		DebugVertex v[2] = { { p0.x, p0.y, p0.z, c }, { p1.x, p1.y, p1.z, c } };
+		backend->draw_lines(v, 2);
+	}
+};
+struct LegacyCross : public LegacyPrimitive
+{
+	vec3 p0;
+	FLOAT s;
+	DebugColor c;
+	LegacyCross(const vec3 &p0, FLOAT s, DebugColor c) : p0(p0), s(s), c(c) {}
+	void draw(DebugDrawBackend *backend)
+	{
+		DebugVertex v[6] =
+		{
+			{ p0.x - s, p0.y, p0.z, c }, { p0.x + s, p0.y, p0.z, c },
+			{ p0.x, p0.y - s, p0.z, c }, { p0.x, p0.y + s, p0.z, c },
+			{ p0.x, p0.y, p0.z - s, c }, { p0.x, p0.y, p0.z + s, c },
+		};
+		backend->draw_lines(v, 6);
+	}
+};
+
+typedef std::chrono::high_resolution_clock Clock;
+static double elapsed_us(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT n = argc > 1 ? (UINT)atoi(argv[1]) : 10000;
+	const UINT frames = argc > 2 ? (UINT)atoi(argv[2]) : 100;
+
+	printf("contacts %u, frames %u\n", n, frames);
+	if (!check() || !check_recorder()) return 1;
+
+	std::vector<SampleContact> contacts = make_contacts(n);
+
+	//計測(フレームごとの記録と描画の時間の最小値)
+	double legacy_us = 1e30, batched_us = 1e30;
+	UINT legacy_calls = 0, batched_calls = 0;
+	{
+		NullDebugDrawBackend backend;
+		for (UINT frame = 0; frame < frames; frame++)
+		{
+			backend.reset();
+			Clock::time_point start = Clock::now();
+			LegacyPrimitive *head = 0, **tail = &head;
+			for (UINT i = 0; i < n; i++)
+			{
+				const SampleContact &c = contacts[i];
+				*tail = new LegacyCross(c.point, 1, WHITE);
+				tail = &(*tail)->next;
+				*tail = new LegacyLine(c.point, c.point + c.penetration * 100 * c.normal, RED);
+				tail = &(*tail)->next;
+			}
+			while (head)
+			{
+				LegacyPrimitive *o = head;
+				o->draw(&backend);
+				head = o->next;
+				delete o;
+			}
+			legacy_us = std::min(legacy_us, elapsed_us(start));
+			legacy_calls = backend.draw_calls;
+		}
+	}
+	{
+		NullDebugDrawBackend backend;
+		DebugDrawBatch batch;
+		for (UINT frame = 0; frame < frames; frame++)
+		{
+			backend.reset();
+			Clock::time_point start = Clock::now();
+			for (UINT i = 0; i < n; i++)
+			{
+				const SampleContact &c = contacts[i];
+				batch.add_cross(c.point, 1, WHITE);
+				batch.add_line(c.point, c.point + c.penetration * 100 * c.normal, RED);
+			}
+			batch.flush(&backend, 0);
+			batched_us = std::min(batched_us, elapsed_us(start));
+			batched_calls = backend.draw_calls;
+		}
+	}
+	printf("%-30s %10s %12s\n", "", "us/frame", "draw calls");
+	printf("%-30s %10.1f %12u\n", "per primitive (legacy)", legacy_us, legacy_calls);
+	printf("%-30s %10.1f %12u\n", "DebugDrawBatch", batched_us, batched_calls);
+
+	//記録しない種類のDEBUG_DRAWの費用(呼び出し1回あたり)
+	DebugDrawRecorder &recorder = DebugDrawRecorder::I();
+	{
+		const UINT calls = n * 100;
+		double disabled_us = 1e30, enabled_us = 1e30;
+		DebugDrawBatch merged;
+		for (UINT r = 0; r < 5; r++)
+		{
+			recorder.set_categories(DEBUG_DRAW_AABBS);
+			Clock::time_point start = Clock::now();
+			for (UINT i = 0; i < calls; i++)
+			{
+				DEBUG_DRAW(DEBUG_DRAW_CONTACTS, add_cross(contacts[i % n].point, 1, WHITE));
+			}
+			disabled_us = std::min(disabled_us, elapsed_us(start));
+			recorder.set_categories(DEBUG_DRAW_CONTACTS);
+			start = Clock::now();
+			for (UINT i = 0; i < calls; i++)
+			{
+				DEBUG_DRAW(DEBUG_DRAW_CONTACTS, add_cross(contacts[i % n].point, 1, WHITE));
+			}
+			enabled_us = std::min(enabled_us, elapsed_us(start));
+			recorder.clear();
+		}
+		recorder.set_categories(0);
+		printf("DEBUG_DRAW disabled           %10.2f ns/call\n", disabled_us * 1000 / calls);
+		printf("DEBUG_DRAW enabled            %10.2f ns/call\n", enabled_us * 1000 / calls);
+	}
+
+	//4スレッドから記録してmergeする費用(フレームあたり)
+	{
+		JobSystem jobs(4);
+		DebugDrawBatch merged;
+		NullDebugDrawBackend backend;
+		double record_us = 1e30, merge_us = 1e30;
+		recorder.set_categories(DEBUG_DRAW_CONTACTS);
+		for (UINT frame = 0; frame < frames; frame++)
+		{
+			Clock::time_point start = Clock::now();
+			jobs.parallel_for(n, 64, [&contacts](UINT begin, UINT end)
+			{
+				for (UINT i = begin; i < end; i++)
+				{
+					const SampleContact &c = contacts[i];
+					DEBUG_DRAW(DEBUG_DRAW_CONTACTS, add_cross(c.point, 1, WHITE));
+					DEBUG_DRAW(DEBUG_DRAW_CONTACTS, add_line(c.point, c.point + c.penetration * 100 * c.normal, RED));
+				}
+			});
+			record_us = std::min(record_us, elapsed_us(start));
+			start = Clock::now();
+			recorder.merge(&merged);
+			merge_us = std::min(merge_us, elapsed_us(start));
+			merged.flush(&backend, 0);
+		}
+		recorder.set_categories(0);
+		printf("record from 4 threads         %10.1f us/frame\n", record_us);
+		char label[64];
+		snprintf(label, sizeof(label), "merge (%u threads)", recorder.thread_count());
+		printf("%-29s %10.1f us/frame\n", label, merge_us);
+	}
+
+	//RigidWorld::step(gridシーン、4スレッド)で記録しない場合と記録する場合
+	{
+		JobSystem jobs(4);
+		const UINT masks[3] = { 0, DEBUG_DRAW_CONTACTS, DEBUG_DRAW_CONTACTS | DEBUG_DRAW_AABBS | DEBUG_DRAW_ISLANDS };
+		const char *names[3] = { "step (recording off)", "step (contacts)", "step (contacts+aabbs+islands)" };
+		for (int m = 0; m < 3; m++)
+		{
+			RigidWorld world;
+			headless_scenes[1].build(&world, 4000, 0);
+			world.jobs = &jobs;
+			DebugDrawBatch merged;
+			double step_us = 1e30, primitives = 0;
+			recorder.set_categories(masks[m]);
+			for (UINT step = 0; step < frames; step++)
+			{
+				world.store_poses();
+				apply_gravity(&world);
+				Clock::time_point start = Clock::now();
+				world.step(1.0f / 60);
+				step_us = std::min(step_us, elapsed_us(start));
+				recorder.merge(&merged);
+				primitives += merged.size();
+				merged.clear();
+			}
+			recorder.set_categories(0);
+			printf("%-29s %10.1f us/step  %10.1f primitives/step\n", names[m], step_us, primitives / frames);
+		}
+	}
+	return 0;
+}
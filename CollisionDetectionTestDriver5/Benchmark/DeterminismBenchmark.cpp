@@ -0,0 +1,158 @@
+//RigidWorld::deterministic(決定的モード)の確認と計測
+//
+//使い方:DeterminismBenchmark [剛体数] [ステップ数] [最大のスレッド数]
+//計測の前に、決定的モードのステップごとのstate_hashがjobsを与えない場合と、スレッド数・SIMD命令セットを変えても一致すること、
+//1つの剛体の速度を1ulpずらすとハッシュが変わることを確認し、満たさない場合は終了コード1を返す
+//計測は、jobsを与えたstepの1ステップあたりの時間を、決定的モードとそうでない場合で比べて出力する
+//(反復の回数をそろえるため、どちらもsolver_budgetを十分に大きくする)
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../JobSystem.h"
+#include "../RigidWorld.h"
+
+//床の平面の上に球体と直方体を交互にcount個、少しずつ傾けて格子状に積む
+static void build_world(RigidWorld *world, UINT count)
+{
+	world->create_plane(vec3(0, 1, 0), 0);
+	const UINT side = (UINT)ceilf(sqrtf((FLOAT)count / 4));
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT x = i % side, z = i / side % side, y = i / (side * side);
+		RigidBodyRef body = world->body(i % 2 == 0 ?
+			world->create_sphere(0.5f, 1) :
+			world->create_box(vec3(0.5f, 0.5f, 0.5f), 1));
+		body.set_position(vec3(x * 1.05f + 0.1f * (y % 3), 0.55f + y * 1.05f, z * 1.05f));
+		quat q;
+		q = quat_from_yaw_pitch_roll(0.1f * (i % 7), 0.05f * (i % 5), 0);
+		body.set_orientation(q);
+	}
+	world->deterministic = TRUE;
+	world->store_poses();
+}
+
+static void step_world(RigidWorld *world, FLOAT duration)
+{
+	const vec3 g(0, -9.8f, 0);
+	for (UINT i = 0; i < world->size(); i++)
+	{
+		if (world->inverse_mass[i] == 0) continue;
+		RigidBodyRef body = world->body(world->handle(i));
+		body.add_force(body.inertial_mass() * g);
+	}
+	world->step(duration);
+}
+
+//ステップごとのstate_hashの列
+static std::vector<unsigned long long> run_hashes(UINT count, UINT steps, JobSystem *jobs, SIMD_LEVEL level)
+{
+	RigidWorld world;
+	build_world(&world, count);
+	world.jobs = jobs;
+	world.simd_level = level;
+	std::vector<unsigned long long> hashes;
+	for (UINT step = 0; step < steps; step++)
+	{
+		step_world(&world, 1.0f / 60);
+		hashes.push_back(world.state_hash);
+	}
+	return hashes;
+}
+
+//最初に食い違ったステップ(一致する場合は-1)
+static int first_divergence(const std::vector<unsigned long long> &a, const std::vector<unsigned long long> &b)
+{
+	for (size_t k = 0; k < std::min(a.size(), b.size()); k++)
+	{
+		if (a[k] != b[k]) return (int)k;
+	}
+	return a.size() == b.size() ? -1 : (int)std::min(a.size(), b.size());
+}
+
+//決定的モードかどうかを指定して、jobsを与えたstepの最短の時間(ミリ秒)を求める
+static double time_steps(UINT count, UINT steps, JobSystem *jobs, BOOL deterministic)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	RigidWorld world;
+	build_world(&world, count);
+	world.deterministic = deterministic;
+	world.solver_budget = 1e9f;
+	world.jobs = jobs;
+	for (int step = 0; step < 10; step++) step_world(&world, 1.0f / 60);
+	double best = 1e30;
+	for (UINT step = 0; step < steps; step++)
+	{
+		Clock::time_point start = Clock::now();
+		step_world(&world, 1.0f / 60);
+		best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT body_count = argc > 1 ? (UINT)atoi(argv[1]) : 20000;
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 20;
+	const UINT max_threads = argc > 3 ? (UINT)atoi(argv[3]) : hardware_thread_count();
+	int result = 0;
+
+	//基準(jobsなし、スカラー実装)のステップごとのハッシュ
+	const UINT check_bodies = 5000, check_steps = 120;
+	const std::vector<unsigned long long> expected = run_hashes(check_bodies, check_steps, 0, SIMD_SCALAR);
+
+	//スレッド数を変えても全てのステップのハッシュが一致すること
+	for (UINT threads = 1; threads <= std::max(max_threads, 4u); threads *= 2)
+	{
+		JobSystem jobs(threads);
+		int step = first_divergence(expected, run_hashes(check_bodies, check_steps, &jobs, detect_simd_level()));
+		printf("check %u threads vs serial (%u steps)  ", threads, check_steps);
+		if (step < 0) printf("ok\n");
+		else printf("FAILED at step %d\n", step);
+		if (step >= 0) result = 1;
+	}
+
+	//SIMD命令セットを変えても一致すること(実行中のCPUで使用できるものまで)
+	const char *level_names[] = { "scalar", "sse", "avx2" };
+	for (int level = SIMD_SSE; level <= (int)detect_simd_level(); level++)
+	{
+		int step = first_divergence(expected, run_hashes(check_bodies, check_steps, 0, (SIMD_LEVEL)level));
+		printf("check %s vs scalar  ", level_names[level]);
+		if (step < 0) printf("ok\n");
+		else printf("FAILED at step %d\n", step);
+		if (step >= 0) result = 1;
+	}
+
+	//1つの剛体の速度を1ulpずらすとハッシュが変わり、戻すと元に戻ること(stepの直後に求めれば、食い違ったステップで検出できる)
+	{
+		RigidWorld world;
+		build_world(&world, check_bodies);
+		for (UINT step = 0; step < 30; step++) step_world(&world, 1.0f / 60);
+		const unsigned long long h = world.compute_state_hash();
+		FLOAT &v = world.linear_velocity[0][check_bodies / 2];
+		const FLOAT original = v;
+		v = nextafterf(v, FLT_MAX);
+		bool failed = h != world.state_hash || world.compute_state_hash() == h;
+		v = original;
+		failed = failed || world.compute_state_hash() != h;
+		printf("check 1ulp perturbation changes the hash  %s\n", failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//計測
+	printf("bodies %u\n", body_count);
+	printf("threads  %12s  %12s  %8s\n", "default ms", "determ. ms", "overhead");
+	for (UINT threads = 1; threads <= max_threads; threads *= 2)
+	{
+		JobSystem jobs(threads);
+		double fast = time_steps(body_count, steps, &jobs, FALSE);
+		double exact = time_steps(body_count, steps, &jobs, TRUE);
+		printf("%7u  %12.3f  %12.3f  %7.1f%%\n", threads, fast, exact, (exact / fast - 1) * 100);
+		if (threads < max_threads && threads * 2 > max_threads) threads = max_threads / 2;
+	}
+	return result;
+}
@@ -0,0 +1,158 @@
+//GranularSystemの計測
+//平面5枚の箱に粒を格子状に積んで落とした状態でstepを呼び、1回の時間刻みあたりの時間を出力する
+//
+//使い方:GranularBenchmark [最大の粒の数] [時間刻みの数] [スレッド数]
+//粒の数を最大の粒の数まで倍々に増やして計測し、粒1個あたりの時間が粒の数によらずほぼ一定であることを確認できるようにする
+//計測の前に、接触のモデルが解析解と合うこと(2粒の正面衝突の反発係数、床の上で静止した粒の重なり、床を滑る球が転がりに移るときの速度)と、
+//スレッド数を変えても結果が(ビット単位で)一致することを確認し、満たさない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../GranularSystem.h"
+#include "../JobSystem.h"
+
+static const FLOAT RADIUS = 0.005f;	//粒の半径
+static const FLOAT DENSITY = 2500;	//粒の密度(ガラス)
+
+//底面が一辺width、奥行きdepthの箱
+struct Container
+{
+	Plane floor, left, right, front, back;
+
+	Container(FLOAT width, FLOAT depth) :
+		floor(vec3(0, 1, 0), 0),
+		left(vec3(1, 0, 0), 0), right(vec3(-1, 0, 0), -width),
+		front(vec3(0, 0, 1), 0), back(vec3(0, 0, -1), -depth)
+	{
+	}
+	void attach(GranularSystem *system) const
+	{
+		const Plane *walls[] = { &floor, &left, &right, &front, &back };
+		system->planes.assign(walls, walls + 5);
+	}
+};
+
+//幅width(x方向)の箱にcount個の粒を間隔2.2 * RADIUSの格子に積み、奥行きを返す(粒の半径は格子ごとに少しずつ変える)
+static FLOAT fill(GranularSystem *system, UINT count, FLOAT width)
+{
+	const FLOAT spacing = 2.2f * RADIUS;
+	const UINT nx = (UINT)(width / spacing);
+	const UINT nz = std::max(1u, (UINT)sqrtf((FLOAT)count / nx));
+	system->clear();
+	system->reserve(count);
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT x = i % nx, z = i / nx % nz, y = i / (nx * nz);
+		FLOAT r = RADIUS * (0.9f + 0.1f * ((i * 7919u) % 11) / 10);
+		system->spawn(r, DENSITY, vec3((x + 0.5f) * spacing, (y + 0.5f) * spacing, (z + 0.5f) * spacing),
+			vec3(0.01f * ((i % 3) - 1.0f), 0, 0.01f * ((i % 5) - 2.0f)));
+	}
+	return nz * spacing;
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT max_grains = argc > 1 ? (UINT)atoi(argv[1]) : 1000000;
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 10;
+	const UINT threads = argc > 3 ? (UINT)atoi(argv[3]) : hardware_thread_count();
+	typedef std::chrono::high_resolution_clock Clock;
+	int result = 0;
+
+	//2粒の正面衝突:離れた後の相対速度 / 衝突前の相対速度が反発係数になること
+	//(引き合う力を0に切り捨てるため、ばねが伸びきる前に離れて指定値よりわずかに大きくなる)
+	{
+		GranularSystem system;
+		system.gravity = vec3(0, 0, 0);
+		system.restitution = 0.5f;
+		system.spawn(RADIUS, DENSITY, vec3(-2 * RADIUS, 0, 0), vec3(1, 0, 0));
+		system.spawn(RADIUS, DENSITY, vec3(2 * RADIUS, 0, 0), vec3(-1, 0, 0));
+		for (int step = 0; step < 100; step++) system.step(1e-4f);
+		FLOAT separation = fabsf(system.velocity[0][0] - system.velocity[0][1]);
+		bool failed = fabsf(separation / 2 - system.restitution) > 0.05f * system.restitution;
+		printf("check restitution  %g (expected %g)  %s\n", separation / 2, system.restitution, failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//床の上で静止した粒:重なりが重さ / ばね定数になること
+	{
+		GranularSystem system;
+		Plane floor(vec3(0, 1, 0), 0);
+		system.planes.assign(1, &floor);
+		system.spawn(RADIUS, DENSITY, vec3(0, RADIUS * 2, 0));
+		for (int step = 0; step < 500; step++) system.step(1e-3f);
+		FLOAT mass = 1.0f / system.inverse_mass[0];
+		FLOAT overlap = RADIUS - system.position[1][0], expected = mass * -system.gravity.y / system.stiffness;
+		bool failed = fabsf(overlap - expected) > 0.01f * expected;
+		printf("check resting overlap  %g (expected %g)  %s\n", overlap, expected, failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//床を滑る球:摩擦で回転が加わり、速度が初速の5/7になったところで滑らずに転がる
+	{
+		GranularSystem system;
+		Plane floor(vec3(0, 1, 0), 0);
+		system.planes.assign(1, &floor);
+		const FLOAT v0 = 0.5f;
+		system.spawn(RADIUS, DENSITY, vec3(0, RADIUS, 0), vec3(v0, 0, 0));
+		for (int step = 0; step < 500; step++) system.step(1e-3f);
+		FLOAT v = system.velocity[0][0], rolling = -system.angular_velocity[2][0] * system.radius[0];
+		bool failed = fabsf(v - v0 * 5 / 7) > 0.01f * v0 || fabsf(rolling - v) > 0.01f * v0;
+		printf("check slide to roll  velocity %g (expected %g), surface speed %g  %s\n", v, v0 * 5 / 7, rolling, failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//スレッド数によらず結果が一致すること
+	{
+		const UINT n = 20000;
+		const FLOAT width = 60 * RADIUS;
+		const UINT many = std::max(threads, 4u);
+		JobSystem jobs(many);
+		GranularSystem systems[2];
+		Container container(width, fill(&systems[0], n, width));
+		fill(&systems[1], n, width);
+		for (int k = 0; k < 2; k++)
+		{
+			container.attach(&systems[k]);
+			systems[k].jobs = k == 0 ? 0 : &jobs;
+			for (int step = 0; step < 20; step++) systems[k].step(1e-3f);
+		}
+		bool failed = systems[0].id != systems[1].id;
+		for (int k = 0; k < 3; k++)
+		{
+			failed = failed || systems[0].position[k] != systems[1].position[k] || systems[0].velocity[k] != systems[1].velocity[k] ||
+				systems[0].angular_velocity[k] != systems[1].angular_velocity[k];
+		}
+		printf("check 1 thread vs %u threads  %s\n", many, failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//計測(粒の数を倍々に増やす、箱の幅は粒の数の立方根に比例させて粒の山をほぼ立方体に保つ)
+	printf("threads %u, radius %g, stiffness %g\n", threads, RADIUS, GranularSystem().stiffness);
+	JobSystem jobs(threads);
+	for (UINT n = std::min(max_grains, 125000u); n <= max_grains; n *= 2)
+	{
+		GranularSystem system;
+		const FLOAT width = 2.2f * RADIUS * ceilf(cbrtf((FLOAT)n));
+		Container container(width, fill(&system, n, width));
+		container.attach(&system);
+		system.jobs = &jobs;
+		const FLOAT dt = system.stable_timestep();
+		for (int step = 0; step < 100; step++) system.step(dt);
+
+		double best = 1e30;
+		for (UINT step = 0; step < steps; step++)
+		{
+			Clock::time_point start = Clock::now();
+			system.step(dt);
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		printf("%8u grains  %9.3f ms/step  %7.1f ns/grain (dt %g)\n", n, best, best * 1e6 / n, dt);
+		if (n == max_grains) break;
+		if (n * 2 > max_grains) n = max_grains / 2;
+	}
+	return result;
+}
@@ -0,0 +1,217 @@
+//RigidWorld::integrate(SoA一括インテグレーション)の計測
+//RigidBody::integrate(オブジェクトごとの仮想関数呼び出し)と、スカラー・SSE・AVX2の各実装を比較する
+//
+//使い方:IntegratorBenchmark [剛体数] [ステップ数]
+//計測の前に各実装の結果がスカラー実装(およびRigidBody::integrate)と許容誤差内で一致することを確認し、
+//一致しない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../RigidWorld.h"
+
+static const FLOAT PI = 3.14159265f;
+
+//再現性のある乱数(線形合同法)
+static UINT random_state = 12345;
+static FLOAT random_float(FLOAT min, FLOAT max)
+{
+	random_state = random_state * 1664525 + 1013904223;
+	return min + (max - min) * ((random_state >> 8) / 16777216.0f);
+}
+
+//剛体を配置する(8個に1個は不動オブジェクトにする)
+static void setup(RigidWorld *world, std::vector<RigidBody *> *legacy, UINT n)
+{
+	random_state = 12345;
+	for (UINT i = 0; i < n; i++)
+	{
+		vec3 half_size(random_float(0.5f, 2), random_float(0.5f, 2), random_float(0.5f, 2));
+		vec3 p(random_float(-100, 100), random_float(0, 100), random_float(-100, 100));
+		vec3 v(random_float(-5, 5), random_float(-5, 5), random_float(-5, 5));
+		vec3 w(random_float(-3, 3), random_float(-3, 3), random_float(-3, 3));
+		quat q;
+		q = quat_from_yaw_pitch_roll(random_float(-PI, PI), random_float(-PI, PI), random_float(-PI, PI));
+		bool movable = i % 8 != 7;
+
+		RigidBodyRef body = world->body(movable ? world->create_box(half_size, 0.1f) : world->create_plane(vec3(0, 1, 0), 0));
+		body.set_position(p);
+		body.set_orientation(q);
+		if (movable)
+		{
+			body.set_linear_velocity(v);
+			body.set_angular_velocity(w);
+		}
+
+		if (legacy)
+		{
+			RigidBody *b = movable ? (RigidBody *)new Box(half_size, 0.1f) : (RigidBody *)new Plane(vec3(0, 1, 0), 0);
+			b->position = p;
+			b->orientation = q;
+			if (movable)
+			{
+				b->linear_velocity = v;
+				b->angular_velocity = w;
+			}
+			legacy->push_back(b);
+		}
+	}
+}
+
+//重力と一定のトルクを加える
+static void apply_forces(RigidWorld *world)
+{
+	for (UINT i = 0; i < world->size(); i++)
+	{
+		if (world->inverse_mass[i] == 0) continue;
+		FLOAT m = 1.0f / world->inverse_mass[i];
+		world->accumulated_force[1][i] += m * -9.8f;
+		world->accumulated_torque[0][i] += 0.5f;
+		world->accumulated_torque[2][i] += -0.25f;
+	}
+}
+static void apply_forces(std::vector<RigidBody *> *legacy)
+{
+	for (size_t i = 0; i < legacy->size(); i++)
+	{
+		RigidBody *b = (*legacy)[i];
+		if (!b->is_movable()) continue;
+		b->add_force(vec3(0, b->inertial_mass * -9.8f, 0));
+		b->add_torque(vec3(0.5f, 0, -0.25f));
+	}
+}
+
+//相対誤差の最大値
+static FLOAT relative_error(FLOAT a, FLOAT b)
+{
+	return fabsf(a - b) / (1 + fabsf(b));
+}
+static FLOAT compare(const RigidWorld &a, const RigidWorld &b)
+{
+	FLOAT e = 0;
+	for (UINT i = 0; i < a.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			e = std::max(e, relative_error(a.position[k][i], b.position[k][i]));
+			e = std::max(e, relative_error(a.linear_velocity[k][i], b.linear_velocity[k][i]));
+			e = std::max(e, relative_error(a.angular_velocity[k][i], b.angular_velocity[k][i]));
+		}
+		for (int k = 0; k < 4; k++)
+		{
+			e = std::max(e, relative_error(a.orientation[k][i], b.orientation[k][i]));
+		}
+	}
+	return e;
+}
+static FLOAT compare(const RigidWorld &a, const std::vector<RigidBody *> &b)
+{
+	FLOAT e = 0;
+	for (UINT i = 0; i < a.size(); i++)
+	{
+		const RigidBody *r = b[i];
+		for (int k = 0; k < 3; k++)
+		{
+			e = std::max(e, relative_error(a.position[k][i], r->position[k]));
+			e = std::max(e, relative_error(a.linear_velocity[k][i], r->linear_velocity[k]));
+			e = std::max(e, relative_error(a.angular_velocity[k][i], r->angular_velocity[k]));
+		}
+		e = std::max(e, relative_error(a.orientation[0][i], r->orientation.x));
+		e = std::max(e, relative_error(a.orientation[1][i], r->orientation.y));
+		e = std::max(e, relative_error(a.orientation[2][i], r->orientation.z));
+		e = std::max(e, relative_error(a.orientation[3][i], r->orientation.w));
+	}
+	return e;
+}
+
+static const char *level_name(SIMD_LEVEL level)
+{
+	switch (level)
+	{
+	case SIMD_AVX2: return "avx2";
+	case SIMD_SSE: return "sse";
+	default: return "scalar";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT n = argc > 1 ? (UINT)atoi(argv[1]) : 10000;
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 1000;
+	const FLOAT duration = 1.0f / 60;
+	const FLOAT tolerance = 1e-4f;
+	const SIMD_LEVEL supported = detect_simd_level();
+
+	printf("bodies %u, steps %u, detected %s\n", n, steps, level_name(supported));
+
+	//一致の確認(100ステップ)
+	int result = 0;
+	{
+		RigidWorld reference;
+		std::vector<RigidBody *> legacy;
+		setup(&reference, &legacy, n);
+		reference.simd_level = SIMD_SCALAR;
+		for (int step = 0; step < 100; step++)
+		{
+			apply_forces(&reference);
+			reference.integrate(duration);
+			apply_forces(&legacy);
+			for (size_t i = 0; i < legacy.size(); i++) legacy[i]->integrate(duration);
+		}
+		FLOAT e = compare(reference, legacy);
+		printf("check %-8s vs RigidBody::integrate  max relative error %g%s\n", "scalar", e, e > tolerance ? "  FAILED" : "");
+		if (e > tolerance) result = 1;
+
+		for (int level = SIMD_SSE; level <= supported; level++)
+		{
+			RigidWorld world;
+			setup(&world, 0, n);
+			world.simd_level = (SIMD_LEVEL)level;
+			for (int step = 0; step < 100; step++)
+			{
+				apply_forces(&world);
+				world.integrate(duration);
+			}
+			FLOAT e = compare(world, reference);
+			printf("check %-8s vs scalar                 max relative error %g%s\n", level_name((SIMD_LEVEL)level), e, e > tolerance ? "  FAILED" : "");
+			if (e > tolerance) result = 1;
+		}
+		for (size_t i = 0; i < legacy.size(); i++) delete legacy[i];
+	}
+
+	//計測
+	typedef std::chrono::high_resolution_clock Clock;
+	double legacy_ns;
+	{
+		RigidWorld dummy;
+		std::vector<RigidBody *> legacy;
+		setup(&dummy, &legacy, n);
+		Clock::time_point start = Clock::now();
+		for (UINT step = 0; step < steps; step++)
+		{
+			apply_forces(&legacy);
+			for (size_t i = 0; i < legacy.size(); i++) legacy[i]->integrate(duration);
+		}
+		legacy_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		printf("%-24s %8.2f ns/body-step\n", "RigidBody::integrate", legacy_ns / ((double)n * steps));
+		for (size_t i = 0; i < legacy.size(); i++) delete legacy[i];
+	}
+	for (int level = SIMD_SCALAR; level <= supported; level++)
+	{
+		RigidWorld world;
+		setup(&world, 0, n);
+		world.simd_level = (SIMD_LEVEL)level;
+		Clock::time_point start = Clock::now();
+		for (UINT step = 0; step < steps; step++)
+		{
+			apply_forces(&world);
+			world.integrate(duration);
+		}
+		double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		printf("RigidWorld %-13s %8.2f ns/body-step  (x%.2f)\n", level_name((SIMD_LEVEL)level), ns / ((double)n * steps), legacy_ns / ns);
+	}
+	return result;
+}
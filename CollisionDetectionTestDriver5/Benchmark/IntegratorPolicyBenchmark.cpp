@@ -0,0 +1,188 @@
+//インテグレータのポリシー(Integrator.h)ごとのエネルギーのずれと1ステップのコストの計測
+//
+//使い方:IntegratorPolicyBenchmark [剛体数]
+//1. 外力のない細長い直方体を中間軸付近の大きな角速度で回転させ、10秒後の回転エネルギーと角運動量の相対誤差を
+//   ステップ幅ごとに求める(厳密解ではどちらも保存される)
+//2. 重力下の質点(Particle::integrate<INTEGRATOR>)の力学的エネルギーの相対誤差を求める
+//3. ばね(F = -kx、周期1秒)につながれた剛体をRigidWorldの参照を通したstepで10秒進め、力学的エネルギーの最大の相対誤差を求める
+//   (位置で変わる力でエネルギーが増え続けないこと、VelocityVerletとRungeKutta4は許容値を超えた場合に失敗とする)
+//4. BasicRigidWorld<INTEGRATOR>をRigidWorldの参照を通してjobsで並列にstepした結果が、INTEGRATOR::integrateで進めた結果と一致することを確認する
+//5. 回転する剛体(剛体数)の1ステップのコストをns/body-stepで求める
+//確認に失敗した場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#include "../RigidWorld.h"
+#include "../Particle.h"
+
+static const FLOAT PI = 3.14159265f;
+
+//回転エネルギー 0.5 * w・L と角運動量 L
+template <typename WORLD> static void rotational_state(WORLD &world, UINT i, double *energy, vec3 *L)
+{
+	mat3 inertia;
+	inverse(world.inverse_inertia_tensor(i), &inertia);
+	vec3 w = world.get_angular_velocity(i);
+	*L = w * inertia;
+	*energy = 0.5 * dot(w, *L);
+}
+
+template <typename INTEGRATOR> static void tumbling(const char *name, FLOAT duration)
+{
+	BasicRigidWorld<INTEGRATOR> world;
+	RigidBodyHandle handle = world.create_box(vec3(0.25f, 1, 2), 1);
+	world.body(handle).set_angular_velocity(vec3(0.05f, 10, 0.05f));
+
+	double e0, e1;
+	vec3 L0, L1;
+	rotational_state(world, 0, &e0, &L0);
+	const int steps = (int)(10 / duration + 0.5f);
+	for (int step = 0; step < steps; step++)
+	{
+		world.integrate(duration);
+		world.update_transforms();
+	}
+	rotational_state(world, 0, &e1, &L1);
+	vec3 dL = L1 - L0;
+	printf("  %-18s dt=1/%-4.0f energy %+10.3e  angular momentum %10.3e\n", name, 1 / duration, (e1 - e0) / e0, length(dL) / length(L0));
+}
+
+template <typename INTEGRATOR> static void projectile(const char *name, FLOAT duration)
+{
+	Particle p;
+	p.mass = 1;
+	p.velocity = vec3(3, 20, 0);
+	const FLOAT g = 9.8f;
+	double e0 = 0.5 * length_sq(p.velocity) + g * p.position.y;
+	const int steps = (int)(4 / duration + 0.5f);
+	for (int step = 0; step < steps; step++)
+	{
+		p.add_force(vec3(0, -g * p.mass, 0));
+		p.integrate<INTEGRATOR>(duration);
+	}
+	double e1 = 0.5 * length_sq(p.velocity) + g * p.position.y;
+	printf("  %-18s dt=1/%-4.0f energy %+10.3e\n", name, 1 / duration, (e1 - e0) / e0);
+}
+
+//位置で変わる力(ばね)で進めたときの力学的エネルギーの最大の相対誤差(toleranceが負の場合は確認しない)
+template <typename INTEGRATOR> static bool spring(const char *name, FLOAT duration, double tolerance)
+{
+	BasicRigidWorld<INTEGRATOR> policy_world;
+	RigidWorld &world = policy_world;
+	RigidBodyRef body = world.body(world.create_sphere(0.5f, 1));
+	body.set_position(vec3(1, 0, 0));
+	const FLOAT m = body.inertial_mass();
+	const FLOAT k = m * 4 * PI * PI;
+	const double e0 = 0.5 * k;
+	double drift = 0;
+	const int steps = (int)(10 / duration + 0.5f);
+	for (int step = 0; step < steps; step++)
+	{
+		const vec3 x = body.get_position();
+		body.add_force(-k * x);
+		world.step(duration);
+		const vec3 p = body.get_position(), v = body.get_linear_velocity();
+		const double e = 0.5 * m * length_sq(v) + 0.5 * k * length_sq(p);
+		drift = std::max(drift, fabs(e - e0) / e0);
+	}
+	const bool ok = tolerance < 0 || drift <= tolerance;
+	printf("  %-18s dt=1/%-4.0f energy %10.3e%s\n", name, 1 / duration, drift, ok ? "" : "  FAILED");
+	return ok;
+}
+
+//回転する剛体をcount個並べる
+static void spinning_bodies(RigidWorld *world, UINT count)
+{
+	for (UINT i = 0; i < count; i++)
+	{
+		RigidBodyRef body = world->body(world->create_box(vec3(0.5f, 1, 1.5f), 1));
+		body.set_position(vec3((FLOAT)(i % 64) * 4, 10, (FLOAT)(i / 64) * 4));
+		body.set_angular_velocity(vec3(1, 2, 3) * (FLOAT)(1 + i % 7));
+	}
+}
+
+//RigidWorldの参照を通したstep(jobsによるタスクグラフ)がINTEGRATORで積分することを確認する
+template <typename INTEGRATOR> static bool policy_step(const char *name, JobSystem *jobs)
+{
+	BasicRigidWorld<INTEGRATOR> policy_world;
+	RigidWorld &world = policy_world;
+	RigidWorld reference;
+	spinning_bodies(&world, 5000);
+	spinning_bodies(&reference, 5000);
+	world.jobs = jobs;
+	for (int step = 0; step < 20; step++)
+	{
+		for (UINT i = 0; i < world.size(); i++)
+		{
+			world.accumulated_force[1][i] = -9.8f / world.inverse_mass[i];
+			reference.accumulated_force[1][i] = -9.8f / reference.inverse_mass[i];
+		}
+		world.step(1.0f / 60);
+		INTEGRATOR::integrate(&reference, 0, reference.size(), 1.0f / 60);
+		reference.collide();
+	}
+	const bool ok = world.compute_state_hash() == reference.compute_state_hash();
+	printf("  %-18s %s\n", name, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+template <typename INTEGRATOR> static void cost(const char *name, UINT n)
+{
+	BasicRigidWorld<INTEGRATOR> world;
+	spinning_bodies(&world, n);
+	const UINT steps = 200;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (UINT step = 0; step < steps; step++)
+	{
+		for (UINT i = 0; i < n; i++) world.accumulated_torque[1][i] = 0.1f;
+		world.integrate(1.0f / 60);
+	}
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("  %-18s %8.2f ns/body-step\n", name, ns / ((double)n * steps));
+}
+
+#define FOR_EACH_INTEGRATOR(F, ...) \
+	F<SemiImplicitEuler>("SemiImplicitEuler", __VA_ARGS__); \
+	F<VelocityVerlet>("VelocityVerlet", __VA_ARGS__); \
+	F<RungeKutta4>("RungeKutta4", __VA_ARGS__); \
+	F<ExponentialMap>("ExponentialMap", __VA_ARGS__)
+
+int main(int argc, char *argv[])
+{
+	const UINT n = argc > 1 ? (UINT)atoi(argv[1]) : 10000;
+	const FLOAT durations[] = { 1.0f / 240, 1.0f / 120, 1.0f / 60, 1.0f / 30 };
+	//ばねの力学的エネルギーの許容値(速度ベルレ法の誤差はステップ幅の2乗に比例し、増え続けない)
+	const double spring_tolerance = 0.05;
+	bool ok = true;
+
+	printf("torque-free box, relative drift after 10 s\n");
+	for (int k = 0; k < 4; k++)
+	{
+		FOR_EACH_INTEGRATOR(tumbling, durations[k]);
+	}
+	printf("particle under gravity, relative drift after 4 s\n");
+	for (int k = 0; k < 4; k++)
+	{
+		FOR_EACH_INTEGRATOR(projectile, durations[k]);
+	}
+	printf("spring (period 1 s) through RigidWorld::step, max relative energy error over 10 s\n");
+	for (int k = 0; k < 4; k++)
+	{
+		spring<SemiImplicitEuler>("SemiImplicitEuler", durations[k], -1);
+		ok = spring<VelocityVerlet>("VelocityVerlet", durations[k], spring_tolerance) && ok;
+		ok = spring<RungeKutta4>("RungeKutta4", durations[k], spring_tolerance) && ok;
+		spring<ExponentialMap>("ExponentialMap", durations[k], -1);
+	}
+	printf("policy used by RigidWorld::step with jobs\n");
+	JobSystem jobs(4);
+	ok = policy_step<SemiImplicitEuler>("SemiImplicitEuler", &jobs) && ok;
+	ok = policy_step<VelocityVerlet>("VelocityVerlet", &jobs) && ok;
+	ok = policy_step<RungeKutta4>("RungeKutta4", &jobs) && ok;
+	ok = policy_step<ExponentialMap>("ExponentialMap", &jobs) && ok;
+	printf("cost, %u spinning bodies\n", n);
+	FOR_EACH_INTEGRATOR(cost, n);
+	return ok ? 0 : 1;
+}
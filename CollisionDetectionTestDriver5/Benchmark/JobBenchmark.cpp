@@ -0,0 +1,198 @@
+//JobSystemとTaskGraph、RigidWorld::step(jobsを与えた場合)の計測
+//
+//使い方:JobBenchmark [剛体数] [ステップ数] [最大のスレッド数]
+//計測の前に、parallel_forが全ての番号をちょうど1回ずつ処理すること(入れ子の呼び出しを含む)、
+//TaskGraphが依存関係の順に実行すること、jobsを与えたRigidWorld::stepの結果が与えない場合と(ビット単位で)一致することを確認し、
+//満たさない場合は終了コード1を返す
+//計測は、空のジョブを分割して実行するparallel_forの1ジョブあたりの時間と、剛体を並べたRigidWorldの1ステップの時間をスレッド数ごとに出力する
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../JobSystem.h"
+#include "../RigidWorld.h"
+
+//床の平面の上に球体と直方体を交互にcount個、格子状に積む
+static void build_world(RigidWorld *world, UINT count)
+{
+	world->create_plane(vec3(0, 1, 0), 0);
+	const UINT side = (UINT)ceilf(sqrtf((FLOAT)count / 4));
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT x = i % side, z = i / side % side, y = i / (side * side);
+		RigidBodyRef body = world->body(i % 2 == 0 ?
+			world->create_sphere(0.5f, 1) :
+			world->create_box(vec3(0.5f, 0.5f, 0.5f), 1));
+		body.set_position(vec3(x * 1.5f + 0.1f * (y % 3), 0.6f + y * 1.2f, z * 1.5f));
+	}
+	world->solver_budget = 0;
+	world->store_poses();
+}
+
+static void step_world(RigidWorld *world, FLOAT duration)
+{
+	const vec3 g(0, -9.8f, 0);
+	for (UINT i = 0; i < world->size(); i++)
+	{
+		if (world->inverse_mass[i] == 0) continue;
+		RigidBodyRef body = world->body(world->handle(i));
+		body.add_force(body.inertial_mass() * g);
+	}
+	world->step(duration);
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT body_count = argc > 1 ? (UINT)atoi(argv[1]) : 20000;
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 20;
+	const UINT max_threads = argc > 3 ? (UINT)atoi(argv[3]) : hardware_thread_count();
+	const FLOAT duration = 1.0f / 60;
+	typedef std::chrono::high_resolution_clock Clock;
+	int result = 0;
+
+	//parallel_forが全ての番号をちょうど1回ずつ処理すること(1スレッドと複数スレッド、入れ子の呼び出し)
+	{
+		const UINT thread_counts[] = { 1, std::max(max_threads, 4u) };
+		const UINT counts[] = { 0, 1, 7, 1000, 100003 };
+		const UINT grains[] = { 0, 1, 64 };
+		bool failed = false;
+		for (UINT t = 0; t < 2; t++)
+		{
+			JobSystem jobs(thread_counts[t]);
+			for (UINT c = 0; c < 5; c++)
+			for (UINT g = 0; g < 3; g++)
+			{
+				std::vector<std::atomic<UINT> > visits(counts[c]);
+				for (UINT i = 0; i < counts[c]; i++) visits[i].store(0);
+				jobs.parallel_for(counts[c], grains[g], [&](UINT begin, UINT end)
+				{
+					for (UINT i = begin; i < end; i++) visits[i].fetch_add(1);
+				});
+				for (UINT i = 0; i < counts[c]; i++) failed = failed || visits[i].load() != 1;
+			}
+			std::atomic<UINT> nested(0);
+			jobs.parallel_for(64, 1, [&](UINT begin, UINT end)
+			{
+				for (UINT i = begin; i < end; i++)
+				{
+					jobs.parallel_for(1000, 16, [&](UINT b, UINT e) { nested.fetch_add(e - b); });
+				}
+			});
+			failed = failed || nested.load() != 64000;
+		}
+		printf("check parallel_for  %s\n", failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//TaskGraphが依存関係の順に実行すること(同じグラフを繰り返し実行する)
+	{
+		JobSystem jobs(std::max(max_threads, 4u));
+		TaskGraph graph;
+		const UINT n = 200;
+		std::atomic<UINT> clock(0);
+		std::vector<UINT> started(n), finished(n);
+		for (UINT k = 0; k < n; k++)
+		{
+			graph.add([&, k]()
+			{
+				started[k] = clock.fetch_add(1);
+				for (volatile int spin = 0; spin < 1000; spin++) {}
+				finished[k] = clock.fetch_add(1);
+			});
+		}
+		//各タスクは番号の小さいいくつかのタスクに依存する(ひし形と鎖が混ざったグラフ)
+		std::vector<std::pair<UINT, UINT> > edges;
+		for (UINT k = 1; k < n; k++)
+		{
+			edges.push_back(std::make_pair(k / 2, k));
+			if (k % 3 == 0) edges.push_back(std::make_pair(k - 1, k));
+		}
+		for (size_t e = 0; e < edges.size(); e++) graph.precede(edges[e].first, edges[e].second);
+		bool failed = false;
+		for (int repeat = 0; repeat < 20; repeat++)
+		{
+			graph.run(&jobs);
+			for (size_t e = 0; e < edges.size(); e++)
+			{
+				failed = failed || finished[edges[e].first] > started[edges[e].second];
+			}
+		}
+		printf("check task graph order  %s\n", failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//jobsを与えたstepの結果が与えない場合と一致すること
+	{
+		const UINT n = 5000;
+		const UINT many = std::max(max_threads, 4u);
+		RigidWorld serial, parallel;
+		build_world(&serial, n);
+		build_world(&parallel, n);
+		JobSystem jobs(many);
+		parallel.jobs = &jobs;
+		for (int step = 0; step < 60; step++)
+		{
+			step_world(&serial, duration);
+			step_world(&parallel, duration);
+		}
+		bool failed = serial.contacts.size() != parallel.contacts.size();
+		for (int k = 0; k < 3; k++)
+		{
+			failed = failed || serial.position[k] != parallel.position[k] || serial.linear_velocity[k] != parallel.linear_velocity[k];
+		}
+		for (int k = 0; k < 4; k++)
+		{
+			failed = failed || serial.orientation[k] != parallel.orientation[k];
+		}
+		printf("check step with %u threads vs serial  %s\n", many, failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//計測
+	printf("bodies %u\n", body_count);
+	printf("threads  parallel_for ns/job  step ms (serial %s)\n", "/ jobs");
+	double serial_ms = 1e30;
+	{
+		RigidWorld world;
+		build_world(&world, body_count);
+		for (int step = 0; step < 10; step++) step_world(&world, duration);
+		for (UINT step = 0; step < steps; step++)
+		{
+			Clock::time_point start = Clock::now();
+			step_world(&world, duration);
+			serial_ms = std::min(serial_ms, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+	}
+	for (UINT threads = 1; threads <= max_threads; threads *= 2)
+	{
+		JobSystem jobs(threads);
+
+		//空のジョブを1個ずつに分割したparallel_for(分割・キュー・盗みの合計の時間)
+		const UINT count = 100000;
+		double job_ns = 1e30;
+		for (int repeat = 0; repeat < 5; repeat++)
+		{
+			Clock::time_point start = Clock::now();
+			jobs.parallel_for(count, 1, [](UINT, UINT) {});
+			job_ns = std::min(job_ns, std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count);
+		}
+
+		RigidWorld world;
+		build_world(&world, body_count);
+		world.jobs = &jobs;
+		for (int step = 0; step < 10; step++) step_world(&world, duration);
+		double best = 1e30;
+		for (UINT step = 0; step < steps; step++)
+		{
+			Clock::time_point start = Clock::now();
+			step_world(&world, duration);
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		printf("%7u  %19.1f  %9.3f / %.3f\n", threads, job_ns, serial_ms, best);
+		if (threads < max_threads && threads * 2 > max_threads) threads = max_threads / 2;
+	}
+	return result;
+}
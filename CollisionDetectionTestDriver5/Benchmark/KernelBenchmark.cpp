@@ -0,0 +1,422 @@
+//衝突判定・接触の解消・インテグレーションのカーネルのマイクロベンチマーク
+//
+//使い方:KernelBenchmark [--json 出力ファイル] [--filter 名前の一部] [--samples 計測回数] [--seed 乱数の種]
+//
+//カーネルごとに乱数の種から決まる配置をCOUNT個ずつ作り、衝突判定は衝突する配置(hit)と衝突しない配置(miss)に分けて計測する
+//1回の計測はCOUNT個の配置を順に1回ずつ呼び出す時間で、samples回の計測の中央値からns/call・cycles/call・calls/secを求める
+//(cycles/callはタイムスタンプカウンタ(TSC)の値で、CPUの実際のクロックではなく一定の基準クロックで数える)
+//--jsonを指定した場合は結果をJSONで出力する(compare_benchmarks.pyで2つの結果を比較する)
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "../RigidBody.h"
+#include "../Particle.h"
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define HAS_TSC 1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define HAS_TSC 1
+#else
+#define HAS_TSC 0
+#endif
+
+static const UINT COUNT = 1024;	//1回の計測で呼び出す配置の数
+
+static unsigned long long read_tsc()
+{
+#if HAS_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static UINT seed = 12345;
+static FLOAT random(FLOAT a, FLOAT b)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return a + (b - a) * ((seed >> 8) / 16777216.0f);
+}
+static vec3 random_vector(FLOAT a, FLOAT b)
+{
+	FLOAT x = random(a, b), y = random(a, b);
+	return vec3(x, y, random(a, b));
+}
+static quat random_orientation()
+{
+	FLOAT x = random(-1, 1), y = random(-1, 1), z = random(-1, 1);
+	quat q(x, y, z, random(-1, 1));
+	q = normalize(q);
+	return q;
+}
+
+struct Result
+{
+	std::string name;
+	std::string variant;	//hit, miss, all
+	UINT calls;	//1回の計測の呼び出し回数
+	double ns_per_call;	//中央値
+	double min_ns_per_call;
+	double cycles_per_call;	//中央値(TSCがない場合は0)
+};
+static std::vector<Result> results;
+static const char *filter = 0;
+static UINT samples = 50;
+static volatile FLOAT sink;	//結果を使い、最適化で呼び出しが消えないようにする
+
+//prepare()で計測対象の状態を戻してから(計測に含めない)run(0)～run(calls - 1)を呼び出す時間をsamples回計測する
+template <typename PREPARE, typename RUN> static void measure(const char *name, const char *variant, UINT calls, PREPARE prepare, RUN run)
+{
+	if (filter && !strstr(name, filter)) return;
+	if (calls == 0)
+	{
+		printf("%-32s %-5s  (no configurations)\n", name, variant);
+		return;
+	}
+	typedef std::chrono::steady_clock Clock;
+	std::vector<double> ns, cycles;
+	for (UINT s = 0; s <= samples; s++)
+	{
+		prepare();
+		Clock::time_point start = Clock::now();
+		unsigned long long tsc = read_tsc();
+		for (UINT i = 0; i < calls; i++) run(i);
+		unsigned long long tsc_end = read_tsc();
+		Clock::time_point end = Clock::now();
+		if (s == 0) continue;	//1回目はキャッシュを温めるために捨てる
+		ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / calls);
+		cycles.push_back((double)(tsc_end - tsc) / calls);
+	}
+	std::sort(ns.begin(), ns.end());
+	std::sort(cycles.begin(), cycles.end());
+	Result r;
+	r.name = name;
+	r.variant = variant;
+	r.calls = calls;
+	r.ns_per_call = ns[ns.size() / 2];
+	r.min_ns_per_call = ns[0];
+	r.cycles_per_call = cycles[cycles.size() / 2];
+	results.push_back(r);
+	printf("%-32s %-5s %10.2f %10.2f %10.1f %14.0f\n", name, variant, r.ns_per_call, r.min_ns_per_call, r.cycles_per_call, 1e9 / r.ns_per_call);
+}
+
+//衝突判定の配置をhitとmissにCOUNT個ずつ分ける(generateは配置を1個作り、衝突する場合は真を返す)
+template <typename CONFIG, typename GENERATE> static void split_configurations(std::vector<CONFIG> *hit, std::vector<CONFIG> *miss, GENERATE generate)
+{
+	for (UINT attempt = 0; attempt < COUNT * 1000 && (hit->size() < COUNT || miss->size() < COUNT); attempt++)
+	{
+		CONFIG config;
+		std::vector<CONFIG> *bucket = generate(&config) ? hit : miss;
+		if (bucket->size() < COUNT) bucket->push_back(config);
+	}
+}
+
+static void write_json(const char *path, UINT initial_seed)
+{
+	FILE *file = fopen(path, "w");
+	if (!file)
+	{
+		printf("cannot open %s\n", path);
+		return;
+	}
+	fprintf(file, "{\n  \"benchmark\": \"KernelBenchmark\",\n  \"seed\": %u,\n  \"samples\": %u,\n  \"tsc\": %s,\n  \"results\": [\n", initial_seed, samples, HAS_TSC ? "true" : "false");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result &r = results[i];
+		fprintf(file, "    {\"name\": \"%s\", \"case\": \"%s\", \"calls\": %u, \"ns_per_call\": %.4f, \"min_ns_per_call\": %.4f, \"cycles_per_call\": %.2f, \"calls_per_sec\": %.1f}%s\n",
+			r.name.c_str(), r.variant.c_str(), r.calls, r.ns_per_call, r.min_ns_per_call, r.cycles_per_call, 1e9 / r.ns_per_call, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+	printf("wrote %s\n", path);
+}
+
+//剛体の組の配置(generate_contact_*に渡す剛体で、hitとmissは形状のみの衝突判定(collide_*)で分ける)
+struct SphereSphere { Sphere s0, s1; SphereSphere() : s0(1, 1), s1(1, 1) {} };
+struct SpherePlane { Sphere sphere; Plane plane; SpherePlane() : sphere(1, 1), plane(vec3(0, 1, 0), 0) {} };
+struct SphereBox { Sphere sphere; Box box; SphereBox() : sphere(1, 1), box(vec3(1, 1, 1), 1) {} };
+struct BoxPlane { Box box; Plane plane; BoxPlane() : box(vec3(1, 1, 1), 1), plane(vec3(0, 1, 0), 0) {} };
+struct BoxBox { Box b0, b1; BoxBox() : b0(vec3(1, 1, 1), 1), b1(vec3(1, 1, 1), 1) {} };
+
+static OBB make_obb(const Box &box)
+{
+	const mat3 m = mat3_from_quat(box.orientation);
+	OBB obb;
+	obb.c = box.position;
+	obb.u[0] = m.r[0];
+	obb.u[1] = m.r[1];
+	obb.u[2] = m.r[2];
+	obb.e = box.half_size;
+	return obb;
+}
+
+//generate_contact_*のhitとmissを計測する
+template <typename CONFIG, typename GENERATE_CONTACT> static void measure_generate(const char *name, std::vector<CONFIG> *hit, std::vector<CONFIG> *miss, GENERATE_CONTACT generate_contact)
+{
+	std::vector<Contact> contacts;
+	contacts.reserve(16);
+	std::vector<CONFIG> *sets[2] = { hit, miss };
+	const char *variants[2] = { "hit", "miss" };
+	for (int k = 0; k < 2; k++)
+	{
+		std::vector<CONFIG> &set = *sets[k];
+		measure(name, variants[k], (UINT)set.size(), [] {}, [&](UINT i)
+		{
+			contacts.clear();
+			generate_contact(&set[i], &contacts);
+			if (!contacts.empty()) sink = contacts[0].penetration;
+		});
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *json = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		const bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--json") == 0 && has_value) json = argv[++i];
+		else if (strcmp(argv[i], "--filter") == 0 && has_value) filter = argv[++i];
+		else if (strcmp(argv[i], "--samples") == 0 && has_value) samples = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--seed") == 0 && has_value) seed = (UINT)strtoul(argv[++i], 0, 10);
+		else
+		{
+			printf("usage: KernelBenchmark [--json file] [--filter name] [--samples n] [--seed n]\n");
+			return 2;
+		}
+	}
+	const UINT initial_seed = seed;
+	const FLOAT restitution = 0.4f;
+	printf("%-32s %-5s %10s %10s %10s %14s\n", "kernel", "case", "ns/call", "min ns", "cycles", "calls/sec");
+
+	//CPUのクロックが上がるまで(約0.2秒)空回りしてから計測を始める
+	{
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+		FLOAT x = 0;
+		while (Clock::now() - start < std::chrono::milliseconds(200)) x = x * 0.5f + 1;
+		sink = x;
+	}
+
+	//球体と球体
+	{
+		std::vector<SphereSphere> hit, miss;
+		split_configurations(&hit, &miss, [](SphereSphere *c)
+		{
+			c->s0 = Sphere(random(0.5f, 2), 1);
+			c->s1 = Sphere(random(0.5f, 2), 1);
+			c->s0.position = random_vector(-3, 3);
+			c->s1.position = random_vector(-3, 3);
+			ContactPoint p;
+			return collide_sphere_sphere(c->s0.position, c->s0.r, c->s1.position, c->s1.r, &p) > 0;
+		});
+		measure_generate("generate_contact_sphere_sphere", &hit, &miss, [=](SphereSphere *c, std::vector<Contact> *contacts)
+		{
+			generate_contact_sphere_sphere(&c->s0, &c->s1, contacts, restitution);
+		});
+	}
+
+	//球体と平面
+	{
+		std::vector<SpherePlane> hit, miss;
+		split_configurations(&hit, &miss, [](SpherePlane *c)
+		{
+			c->plane = Plane(random_vector(-1, 1), random(-2, 2));
+			c->sphere = Sphere(random(0.5f, 2), 1);
+			c->sphere.position = random_vector(-4, 4);
+			ContactPoint p;
+			return collide_sphere_plane(c->sphere.position, c->sphere.r, c->plane.position, c->plane.orientation, &p) > 0;
+		});
+		measure_generate("generate_contact_sphere_plane", &hit, &miss, [=](SpherePlane *c, std::vector<Contact> *contacts)
+		{
+			generate_contact_sphere_plane(&c->sphere, &c->plane, contacts, restitution);
+		});
+	}
+
+	//球体と直方体
+	std::vector<SphereBox> sphere_box_hit;
+	{
+		std::vector<SphereBox> miss;
+		split_configurations(&sphere_box_hit, &miss, [](SphereBox *c)
+		{
+			c->sphere = Sphere(random(0.5f, 2), 1);
+			c->box = Box(random_vector(0.5f, 2), 1);
+			c->sphere.position = random_vector(-4, 4);
+			c->box.position = random_vector(-1, 1);
+			c->box.orientation = random_orientation();
+			ContactPoint p;
+			return collide_sphere_box(c->sphere.position, c->sphere.r, c->box.position, c->box.orientation, c->box.half_size, &p) > 0;
+		});
+		measure_generate("generate_contact_sphere_box", &sphere_box_hit, &miss, [=](SphereBox *c, std::vector<Contact> *contacts)
+		{
+			generate_contact_sphere_box(&c->sphere, &c->box, contacts, restitution);
+		});
+	}
+
+	//直方体と平面
+	{
+		std::vector<BoxPlane> hit, miss;
+		split_configurations(&hit, &miss, [](BoxPlane *c)
+		{
+			c->plane = Plane(random_vector(-1, 1), random(-2, 2));
+			c->box = Box(random_vector(0.5f, 2), 1);
+			c->box.position = random_vector(-4, 4);
+			c->box.orientation = random_orientation();
+			ContactPoint p[8];
+			return collide_box_plane(c->box.position, c->box.orientation, c->box.half_size, c->plane.position, c->plane.orientation, p) > 0;
+		});
+		measure_generate("generate_contact_box_plane", &hit, &miss, [=](BoxPlane *c, std::vector<Contact> *contacts)
+		{
+			generate_contact_box_plane(&c->box, &c->plane, contacts, restitution);
+		});
+	}
+
+	//直方体と直方体(sat_obb_obbも同じ配置で計測する)
+	std::vector<BoxBox> box_box_hit;
+	{
+		std::vector<BoxBox> miss;
+		split_configurations(&box_box_hit, &miss, [](BoxBox *c)
+		{
+			c->b0 = Box(random_vector(0.5f, 2), 1);
+			c->b1 = Box(random_vector(0.5f, 2), 1);
+			c->b0.position = random_vector(-3, 3);
+			c->b1.position = random_vector(-3, 3);
+			c->b0.orientation = random_orientation();
+			c->b1.orientation = random_orientation();
+			ContactPoint p;
+			return collide_box_box(c->b0.position, c->b0.orientation, c->b0.half_size, c->b1.position, c->b1.orientation, c->b1.half_size, &p) > 0;
+		});
+		measure_generate("generate_contact_box_box", &box_box_hit, &miss, [=](BoxBox *c, std::vector<Contact> *contacts)
+		{
+			generate_contact_box_box(&c->b0, &c->b1, contacts, restitution);
+		});
+
+		//sat_obb_obbの結果でhitとmissを分け直す(collide_box_boxは分離軸判定の後に接触点が求まらない場合もmissになる)
+		std::vector<std::pair<OBB, OBB> > sat_sets[2];
+		std::vector<BoxBox> *configs[2] = { &box_box_hit, &miss };
+		for (int k = 0; k < 2; k++)
+		{
+			for (size_t i = 0; i < configs[k]->size(); i++)
+			{
+				OBB a = make_obb((*configs[k])[i].b0), b = make_obb((*configs[k])[i].b1);
+				FLOAT penetration;
+				INT axis[2];
+				SAT_TYPE type;
+				sat_sets[sat_obb_obb(a, b, penetration, axis, type) ? 0 : 1].push_back(std::make_pair(a, b));
+			}
+		}
+		const char *variants[2] = { "hit", "miss" };
+		for (int k = 0; k < 2; k++)
+		{
+			std::vector<std::pair<OBB, OBB> > &set = sat_sets[k];
+			measure("sat_obb_obb", variants[k], (UINT)set.size(), [] {}, [&](UINT i)
+			{
+				FLOAT penetration;
+				INT axis[2];
+				SAT_TYPE type;
+				if (sat_obb_obb(set[i].first, set[i].second, penetration, axis, type)) sink = penetration;
+			});
+		}
+	}
+
+	//ベクトルの回転
+	{
+		std::vector<quat> q(COUNT);
+		std::vector<vec3> v(COUNT), out(COUNT);
+		for (UINT i = 0; i < COUNT; i++)
+		{
+			q[i] = random_orientation();
+			v[i] = random_vector(-10, 10);
+		}
+		measure("rotate_vector_by_quaternion", "all", COUNT, [] {}, [&](UINT i)
+		{
+			rotate_vector_by_quaternion(&out[i], q[i], v[i]);
+		});
+		sink = out[COUNT / 2].x;
+	}
+
+	//接触の解消(球体と直方体、直方体と直方体のhitの配置から求めた接触、計測ごとに剛体の状態を戻す)
+	{
+		std::vector<Contact> contacts;
+		for (size_t i = 0; i < sphere_box_hit.size(); i++)
+		{
+			sphere_box_hit[i].sphere.linear_velocity = random_vector(-5, 5);
+			sphere_box_hit[i].box.angular_velocity = random_vector(-2, 2);
+			generate_contact_sphere_box(&sphere_box_hit[i].sphere, &sphere_box_hit[i].box, &contacts, restitution);
+		}
+		for (size_t i = 0; i < box_box_hit.size(); i++)
+		{
+			box_box_hit[i].b0.linear_velocity = random_vector(-5, 5);
+			box_box_hit[i].b1.angular_velocity = random_vector(-2, 2);
+			generate_contact_box_box(&box_box_hit[i].b0, &box_box_hit[i].b1, &contacts, restitution);
+		}
+		//めり込み量が0の接触は解消の対象にならないため除く
+		contacts.erase(std::remove_if(contacts.begin(), contacts.end(), [](const Contact &c) { return !(c.penetration > 0); }), contacts.end());
+		if (contacts.size() > COUNT) contacts.resize(COUNT);
+		const std::vector<SphereBox> sphere_box_initial = sphere_box_hit;
+		const std::vector<BoxBox> box_box_initial = box_box_hit;
+		measure("Contact::resolve", "all", (UINT)contacts.size(), [&]
+		{
+			std::copy(sphere_box_initial.begin(), sphere_box_initial.end(), sphere_box_hit.begin());
+			std::copy(box_box_initial.begin(), box_box_initial.end(), box_box_hit.begin());
+		}, [&](UINT i)
+		{
+			contacts[i].resolve();
+		});
+		sink = box_box_hit[0].b0.linear_velocity.x;
+	}
+
+	//剛体のインテグレーション(直方体、計測ごとに力とトルクを加え直す)
+	{
+		std::vector<Box> boxes;
+		for (UINT i = 0; i < COUNT; i++)
+		{
+			Box box(random_vector(0.5f, 2), 1);
+			box.position = random_vector(-10, 10);
+			box.orientation = random_orientation();
+			box.linear_velocity = random_vector(-5, 5);
+			box.angular_velocity = random_vector(-2, 2);
+			boxes.push_back(box);
+		}
+		measure("RigidBody::integrate", "all", COUNT, [&]
+		{
+			for (UINT i = 0; i < COUNT; i++)
+			{
+				boxes[i].add_force(vec3(0, -9.8f * boxes[i].inertial_mass, 0));
+				boxes[i].add_torque(vec3(0.1f, 0.2f, 0.3f));
+			}
+		}, [&](UINT i)
+		{
+			boxes[i].integrate(1.0f / 60);
+		});
+		sink = boxes[COUNT / 2].position.y;
+	}
+
+	//パーティクルのインテグレーション(計測ごとに力を加え直す)
+	{
+		std::vector<Particle> particles(COUNT);
+		for (UINT i = 0; i < COUNT; i++)
+		{
+			particles[i].mass = random(0.5f, 2);
+			particles[i].position = random_vector(-10, 10);
+			particles[i].velocity = random_vector(-5, 5);
+		}
+		measure("Particle::integrate", "all", COUNT, [&]
+		{
+			for (UINT i = 0; i < COUNT; i++) particles[i].add_force(vec3(0, -9.8f * particles[i].mass, 0));
+		}, [&](UINT i)
+		{
+			particles[i].integrate(1.0f / 60);
+		});
+		sink = particles[COUNT / 2].position.y;
+	}
+
+	if (json) write_json(json, initial_seed);
+	return 0;
+}
@@ -0,0 +1,319 @@
+//VectorMath.h(vec3, quat, mat3, mat4)の演算の確認と計測
+//
+//使い方:MathBenchmark [反復回数]
+//計測の前に、各演算の結果が成分ごとに書き下した参照実装(以前にD3DXの関数で求めていた値と同じ式)と許容誤差内で一致すること
+//(回転は以前のrotate_vector_by_quaternionとビット単位で一致すること)を確認し、一致しない場合は終了コード1を返す
+//計測は、同じ入力の配列に対して、参照実装とVectorMath.hの演算の1回あたりの時間を出力する
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../PhysicsMath.h"
+
+static const UINT COUNT = 4096;
+
+static UINT seed = 12345;
+static FLOAT random(FLOAT a, FLOAT b)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return a + (b - a) * ((seed >> 8) / 16777216.0f);
+}
+
+//参照実装(成分ごとに書き下したスカラーの式)
+//以前のRigidBody.cppのrotate_vector_by_quaternion
+static vec3 reference_rotate(const quat &q, const vec3 &v)
+{
+	vec3 p;
+	p.x = 2.0f * (q.x * v.x + q.y * v.y + q.z * v.z) * q.x + (q.w * q.w - (q.x * q.x + q.y * q.y + q.z * q.z)) * v.x + 2.0f * q.w * (q.y * v.z - q.z * v.y);
+	p.y = 2.0f * (q.x * v.x + q.y * v.y + q.z * v.z) * q.y + (q.w * q.w - (q.x * q.x + q.y * q.y + q.z * q.z)) * v.y + 2.0f * q.w * (q.z * v.x - q.x * v.z);
+	p.z = 2.0f * (q.x * v.x + q.y * v.y + q.z * v.z) * q.z + (q.w * q.w - (q.x * q.x + q.y * q.y + q.z * q.z)) * v.z + 2.0f * q.w * (q.x * v.y - q.y * v.x);
+	return p;
+}
+static vec3 reference_cross(const vec3 &a, const vec3 &b)
+{
+	return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+static vec3 reference_normalize(const vec3 &a)
+{
+	FLOAT l = sqrtf(a.x * a.x + a.y * a.y + a.z * a.z);
+	return l > 0 ? vec3(a.x / l, a.y / l, a.z / l) : vec3(0, 0, 0);
+}
+//aの回転の後にbの回転を行うクォータニオン
+static quat reference_multiply(const quat &a, const quat &b)
+{
+	return quat(
+		b.w * a.x + b.x * a.w + b.y * a.z - b.z * a.y,
+		b.w * a.y - b.x * a.z + b.y * a.w + b.z * a.x,
+		b.w * a.z + b.x * a.y - b.y * a.x + b.z * a.w,
+		b.w * a.w - b.x * a.x - b.y * a.y - b.z * a.z);
+}
+static quat reference_normalize(const quat &q)
+{
+	FLOAT l = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	return quat(q.x / l, q.y / l, q.z / l, q.w / l);
+}
+//回転行列(行ベクトルの規約、各行がローカル軸)
+static mat3 reference_rotation(const quat &q)
+{
+	mat3 m;
+	m.r[0] = vec3(1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y + q.z * q.w), 2 * (q.x * q.z - q.y * q.w));
+	m.r[1] = vec3(2 * (q.x * q.y - q.z * q.w), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z + q.x * q.w));
+	m.r[2] = vec3(2 * (q.x * q.z + q.y * q.w), 2 * (q.y * q.z - q.x * q.w), 1 - 2 * (q.x * q.x + q.y * q.y));
+	return m;
+}
+//ロール(z軸)・ピッチ(x軸)・ヨー(y軸)の順の回転行列 Rz * Rx * Ry
+static mat3 reference_yaw_pitch_roll(FLOAT yaw, FLOAT pitch, FLOAT roll)
+{
+	FLOAT cy = cosf(yaw), sy = sinf(yaw), cp = cosf(pitch), sp = sinf(pitch), cr = cosf(roll), sr = sinf(roll);
+	mat3 m;
+	m.r[0] = vec3(cr * cy + sr * sp * sy, sr * cp, -cr * sy + sr * sp * cy);
+	m.r[1] = vec3(-sr * cy + cr * sp * sy, cr * cp, sr * sy + cr * sp * cy);
+	m.r[2] = vec3(cp * sy, -sp, cp * cy);
+	return m;
+}
+static void reference_multiply(const FLOAT *a, const FLOAT *b, FLOAT *out, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			FLOAT s = 0;
+			for (int k = 0; k < n; k++) s += a[i * n + k] * b[k * n + j];
+			out[i * n + j] = s;
+		}
+	}
+}
+static vec3 reference_transform_coord(const vec3 &v, const mat4 &m)
+{
+	FLOAT p[4];
+	for (int j = 0; j < 4; j++) p[j] = v.x * m.r[0][j] + v.y * m.r[1][j] + v.z * m.r[2][j] + m.r[3][j];
+	return vec3(p[0] / p[3], p[1] / p[3], p[2] / p[3]);
+}
+static vec3 reference_transform_normal(const vec3 &v, const mat4 &m)
+{
+	return vec3(v.x * m.r[0].x + v.y * m.r[1].x + v.z * m.r[2].x, v.x * m.r[0].y + v.y * m.r[1].y + v.z * m.r[2].y, v.x * m.r[0].z + v.y * m.r[1].z + v.z * m.r[2].z);
+}
+//n x n行列の逆行列(部分ピボット選択のガウス・ジョルダン法、倍精度)
+static void reference_inverse(const FLOAT *m, FLOAT *out, int n)
+{
+	double a[4][8];
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			a[i][j] = m[i * n + j];
+			a[i][n + j] = i == j ? 1 : 0;
+		}
+	}
+	for (int c = 0; c < n; c++)
+	{
+		int pivot = c;
+		for (int i = c + 1; i < n; i++) if (fabs(a[i][c]) > fabs(a[pivot][c])) pivot = i;
+		for (int j = 0; j < 2 * n; j++) std::swap(a[c][j], a[pivot][j]);
+		double d = a[c][c];
+		for (int j = 0; j < 2 * n; j++) a[c][j] /= d;
+		for (int i = 0; i < n; i++)
+		{
+			if (i == c) continue;
+			double f = a[i][c];
+			for (int j = 0; j < 2 * n; j++) a[i][j] -= f * a[c][j];
+		}
+	}
+	for (int i = 0; i < n; i++) for (int j = 0; j < n; j++) out[i * n + j] = (FLOAT)a[i][n + j];
+}
+
+//a(参照実装)とb(VectorMath)のn成分の最大の差(bの成分の大きさとの比、1未満の大きさは1とみなす)
+static FLOAT difference(const FLOAT *a, const FLOAT *b, UINT n)
+{
+	FLOAT d = 0;
+	for (UINT k = 0; k < n; k++)
+	{
+		d = std::max(d, fabsf(a[k] - b[k]) / std::max(1.0f, fabsf(b[k])));
+	}
+	return d;
+}
+
+static int result = 0;
+static void check(const char *name, FLOAT error, FLOAT tolerance)
+{
+	bool ok = error <= tolerance;
+	printf("check %-24s max error %.2e  %s\n", name, error, ok ? "ok" : "FAILED");
+	if (!ok) result = 1;
+}
+
+//f(i)を全ての入力に対してrepeat回実行した、1回あたりの最短の時間(ナノ秒)
+template <typename F> static double time_op(UINT repeat, F f)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	double best = 1e30;
+	for (UINT r = 0; r < repeat; r++)
+	{
+		Clock::time_point start = Clock::now();
+		for (UINT i = 0; i < COUNT; i++) f(i);
+		best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - start).count() / COUNT);
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT repeat = argc > 1 ? (UINT)atoi(argv[1]) : 200;
+#if defined(VECTOR_MATH_AVX)
+	printf("backend avx\n");
+#elif defined(VECTOR_MATH_SSE)
+	printf("backend sse\n");
+#elif defined(VECTOR_MATH_NEON)
+	printf("backend neon\n");
+#else
+	printf("backend scalar\n");
+#endif
+
+	//入力(単位クォータニオン、ベクトル、回転と平行移動と拡大縮小を合わせた正則な行列、対角の慣性テンソル)
+	std::vector<vec3> v(COUNT), w(COUNT), d(COUNT);
+	std::vector<quat> q(COUNT), r(COUNT);
+	std::vector<mat4> m(COUNT), n(COUNT);
+	for (UINT i = 0; i < COUNT; i++)
+	{
+		v[i] = vec3(random(-10, 10), random(-10, 10), random(-10, 10));
+		w[i] = vec3(random(-10, 10), random(-10, 10), random(-10, 10));
+		d[i] = vec3(random(0.1f, 10), random(0.1f, 10), random(0.1f, 10));
+		q[i] = reference_normalize(quat(random(-1, 1), random(-1, 1), random(-1, 1), random(-1, 1)));
+		r[i] = reference_normalize(quat(random(-1, 1), random(-1, 1), random(-1, 1), random(-1, 1)));
+		const mat3 a = reference_rotation(q[i]), b = reference_rotation(r[i]);
+		const FLOAT s[3] = { random(0.5f, 2), random(0.5f, 2), random(0.5f, 2) };
+		for (int k = 0; k < 3; k++)
+		{
+			m[i].r[k] = vec4(a.r[k] * s[k], 0);
+			n[i].r[k] = vec4(b.r[k], 0);
+		}
+		m[i].r[3] = vec4(random(-10, 10), random(-10, 10), random(-10, 10), 1);
+		n[i].r[3] = vec4(random(-10, 10), random(-10, 10), random(-10, 10), 1);
+	}
+
+	//参照実装との一致
+	{
+		FLOAT e_dot = 0, e_cross = 0, e_normalize = 0, e_qmul = 0, e_qnorm = 0, e_rotation = 0, e_ypr = 0, e_mmul = 0, e_coord = 0, e_normal = 0, e_inverse = 0, e_transpose = 0;
+		FLOAT e_inertia = 0, e_inverse3 = 0, e_rotate = 0;
+		for (UINT i = 0; i < COUNT; i++)
+		{
+			const vec3 &a = v[i], &b = w[i];
+			FLOAT d0 = a.x * b.x + a.y * b.y + a.z * b.z, d1 = dot(a, b);
+			e_dot = std::max(e_dot, difference(&d0, &d1, 1));
+
+			vec3 c0 = reference_cross(a, b), c1 = cross(a, b);
+			e_cross = std::max(e_cross, difference(&c0.x, &c1.x, 3));
+
+			c0 = reference_normalize(a);
+			c1 = normalize(a);
+			e_normalize = std::max(e_normalize, difference(&c0.x, &c1.x, 3));
+
+			quat q0 = reference_multiply(q[i], r[i]), q1 = q[i] * r[i];
+			e_qmul = std::max(e_qmul, difference(&q0.x, &q1.x, 4));
+
+			const quat unnormalized = q[i] * 3.0f;
+			q0 = reference_normalize(unnormalized);
+			q1 = normalize(unnormalized);
+			e_qnorm = std::max(e_qnorm, difference(&q0.x, &q1.x, 4));
+
+			mat3 r0 = reference_rotation(q[i]), r1 = mat3_from_quat(q[i]);
+			e_rotation = std::max(e_rotation, difference(&r0.r[0].x, &r1.r[0].x, 9));
+
+			const FLOAT yaw = v[i].x * 0.3f, pitch = v[i].y * 0.3f, roll = v[i].z * 0.3f;
+			r0 = reference_yaw_pitch_roll(yaw, pitch, roll);
+			r1 = mat3_from_quat(quat_from_yaw_pitch_roll(yaw, pitch, roll));
+			e_ypr = std::max(e_ypr, difference(&r0.r[0].x, &r1.r[0].x, 9));
+
+			mat4 m0, m1 = m[i] * n[i];
+			reference_multiply(&m[i].r[0].x, &n[i].r[0].x, &m0.r[0].x, 4);
+			e_mmul = std::max(e_mmul, difference(&m0.r[0].x, &m1.r[0].x, 16));
+
+			c0 = reference_transform_coord(a, m[i]);
+			c1 = transform_coord(a, m[i]);
+			e_coord = std::max(e_coord, difference(&c0.x, &c1.x, 3));
+
+			c0 = reference_transform_normal(a, m[i]);
+			c1 = transform_normal(a, m[i]);
+			e_normal = std::max(e_normal, difference(&c0.x, &c1.x, 3));
+
+			reference_inverse(&m[i].r[0].x, &m0.r[0].x, 4);
+			inverse(m[i], &m1);
+			e_inverse = std::max(e_inverse, difference(&m0.r[0].x, &m1.r[0].x, 16));
+
+			m1 = transpose(m[i]);
+			for (int j = 0; j < 4; j++) for (int k = 0; k < 4; k++) m0.r[j][k] = m[i].r[k][j];
+			e_transpose = std::max(e_transpose, difference(&m0.r[0].x, &m1.r[0].x, 16));
+
+			//慣性テンソルの変換 R^T * I^-1 * R(RigidBody::inverse_inertia_tensorの式)
+			const mat3 rotation = mat3_from_quat(q[i]), diagonal = mat3_diagonal(d[i]);
+			mat3 transposed, t0, i0;
+			for (int j = 0; j < 3; j++) for (int k = 0; k < 3; k++) transposed.r[j][k] = rotation.r[k][j];
+			reference_multiply(&transposed.r[0].x, &diagonal.r[0].x, &t0.r[0].x, 3);
+			reference_multiply(&t0.r[0].x, &rotation.r[0].x, &i0.r[0].x, 3);
+			const mat3 i1 = transpose(rotation) * diagonal * rotation;
+			e_inertia = std::max(e_inertia, difference(&i0.r[0].x, &i1.r[0].x, 9));
+
+			mat3 inverse0, inverse1;
+			reference_inverse(&i0.r[0].x, &inverse0.r[0].x, 3);
+			inverse(i1, &inverse1);
+			e_inverse3 = std::max(e_inverse3, difference(&inverse0.r[0].x, &inverse1.r[0].x, 9));
+
+			c0 = reference_rotate(q[i], a);
+			c1 = rotate(q[i], a);
+			e_rotate = std::max(e_rotate, memcmp(&c0, &c1, sizeof(c1)) == 0 ? 0.0f : 1.0f);
+		}
+		//参照実装とは演算の順序が異なる場合があるため、数ulpの差を許す(逆行列は倍精度の参照実装との差)
+		check("dot", e_dot, 1e-6f);
+		check("cross", e_cross, 1e-6f);
+		check("normalize", e_normalize, 1e-6f);
+		check("quat multiply", e_qmul, 1e-6f);
+		check("quat normalize", e_qnorm, 1e-6f);
+		check("mat3_from_quat", e_rotation, 1e-6f);
+		check("quat_from_yaw_pitch_roll", e_ypr, 1e-5f);
+		check("mat4 multiply", e_mmul, 1e-6f);
+		check("transform_coord", e_coord, 1e-6f);
+		check("transform_normal", e_normal, 1e-6f);
+		check("mat4 inverse", e_inverse, 1e-5f);
+		check("mat4 transpose", e_transpose, 0);
+		check("mat3 inertia transform", e_inertia, 1e-5f);
+		check("mat3 inverse", e_inverse3, 1e-4f);
+		check("rotate (bit-exact)", e_rotate, 0);
+	}
+
+	//計測(結果は出力の配列に書き、最適化で消えないようにする)
+	std::vector<vec3> v_out(COUNT), a_out(COUNT);
+	std::vector<quat> q_out(COUNT), b_out(COUNT);
+	std::vector<mat4> m_out(COUNT), c_out(COUNT);
+
+	printf("%-20s  %10s  %10s\n", "ns/op", "reference", "vector math");
+	double t0, t1;
+	t0 = time_op(repeat, [&](UINT i) { v_out[i] = reference_normalize(v[i]); });
+	t1 = time_op(repeat, [&](UINT i) { a_out[i] = normalize(v[i]); });
+	printf("%-20s  %10.2f  %10.2f\n", "normalize", t0, t1);
+	t0 = time_op(repeat, [&](UINT i) { v_out[i] = reference_cross(v[i], w[i]); });
+	t1 = time_op(repeat, [&](UINT i) { a_out[i] = cross(v[i], w[i]); });
+	printf("%-20s  %10.2f  %10.2f\n", "cross", t0, t1);
+	t0 = time_op(repeat, [&](UINT i) { v_out[i] = reference_rotate(q[i], v[i]); });
+	t1 = time_op(repeat, [&](UINT i) { a_out[i] = rotate(q[i], v[i]); });
+	printf("%-20s  %10.2f  %10.2f\n", "rotate", t0, t1);
+	t0 = time_op(repeat, [&](UINT i) { q_out[i] = reference_multiply(q[i], r[i]); });
+	t1 = time_op(repeat, [&](UINT i) { b_out[i] = q[i] * r[i]; });
+	printf("%-20s  %10.2f  %10.2f\n", "quat multiply", t0, t1);
+	t0 = time_op(repeat, [&](UINT i) { v_out[i] = reference_transform_coord(v[i], m[i]); });
+	t1 = time_op(repeat, [&](UINT i) { a_out[i] = transform_coord(v[i], m[i]); });
+	printf("%-20s  %10.2f  %10.2f\n", "transform_coord", t0, t1);
+	t0 = time_op(repeat, [&](UINT i) { reference_multiply(&m[i].r[0].x, &n[i].r[0].x, &m_out[i].r[0].x, 4); });
+	t1 = time_op(repeat, [&](UINT i) { c_out[i] = m[i] * n[i]; });
+	printf("%-20s  %10.2f  %10.2f\n", "mat4 multiply", t0, t1);
+	t0 = time_op(repeat, [&](UINT i) { reference_inverse(&m[i].r[0].x, &m_out[i].r[0].x, 4); });
+	t1 = time_op(repeat, [&](UINT i) { inverse(m[i], &c_out[i]); });
+	printf("%-20s  %10.2f  %10.2f\n", "mat4 inverse", t0, t1);
+
+	//出力の一部を使う
+	FLOAT sink = v_out[COUNT / 2].x + a_out[COUNT / 2].x + q_out[COUNT / 2].x + b_out[COUNT / 2].x + m_out[COUNT / 2].r[0].x + c_out[COUNT / 2].r[0].x;
+	printf("(%g)\n", sink);
+	return result;
+}
@@ -0,0 +1,107 @@
+//RigidWorld::generate_contacts(並列の衝突判定)の計測
+//床の上に球体と直方体を積んで崩した状態でbroadphaseまで進め、generate_contactsだけを繰り返し呼んで、1回あたりの時間をスレッド数ごとに出力する
+//
+//使い方:NarrowphaseBenchmark [剛体数] [反復回数] [最大のスレッド数]
+//計測の前に、スレッド数を変えても接触の並びがjobsを与えない場合と(ビット単位で)一致すること、
+//組が剛体番号の組の順に並ぶことを確認し、満たさない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../RigidWorld.h"
+
+//床の平面の上に球体と直方体を交互にcount個、格子状に積む(直方体は少しずつ傾ける)
+static void build_world(RigidWorld *world, UINT count)
+{
+	world->create_plane(vec3(0, 1, 0), 0);
+	const UINT side = (UINT)ceilf(sqrtf((FLOAT)count / 4));
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT x = i % side, z = i / side % side, y = i / (side * side);
+		RigidBodyRef body = world->body(i % 2 == 0 ?
+			world->create_sphere(0.5f, 1) :
+			world->create_box(vec3(0.5f, 0.5f, 0.5f), 1));
+		body.set_position(vec3(x * 1.05f + 0.1f * (y % 3), 0.55f + y * 1.05f, z * 1.05f));
+		quat q;
+		q = quat_from_yaw_pitch_roll(0.1f * (i % 7), 0.05f * (i % 5), 0);
+		body.set_orientation(q);
+	}
+	world->solver_budget = 0;
+	world->store_poses();
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT body_count = argc > 1 ? (UINT)atoi(argv[1]) : 50000;
+	const UINT iterations = argc > 2 ? (UINT)atoi(argv[2]) : 10;
+	const UINT max_threads = argc > 3 ? (UINT)atoi(argv[3]) : hardware_thread_count();
+	typedef std::chrono::high_resolution_clock Clock;
+	int result = 0;
+
+	RigidWorld world;
+	build_world(&world, body_count);
+	const vec3 g(0, -9.8f, 0);
+	for (int step = 0; step < 20; step++)
+	{
+		for (UINT i = 0; i < world.size(); i++)
+		{
+			if (world.inverse_mass[i] == 0) continue;
+			RigidBodyRef body = world.body(world.handle(i));
+			body.add_force(body.inertial_mass() * g);
+		}
+		world.step(1.0f / 60);
+	}
+	world.update_transforms();
+	world.update_bounds();
+	world.broadphase();
+
+	//組が剛体番号の組の順に並ぶこと
+	bool sorted = true;
+	for (size_t k = 1; k < world.pairs.size(); k++)
+	{
+		const RigidWorld::Pair &a = world.pairs[k - 1], &b = world.pairs[k];
+		sorted = sorted && (a.body[0] < b.body[0] || (a.body[0] == b.body[0] && a.body[1] < b.body[1]));
+	}
+	printf("check pairs sorted by body pair  %s\n", sorted ? "ok" : "FAILED");
+	if (!sorted) result = 1;
+
+	//基準(jobsなし)の接触
+	world.jobs = 0;
+	world.generate_contacts();
+	const std::vector<RigidWorld::Contact> expected = world.contacts;
+	double serial_ms = 1e30;
+	for (UINT iteration = 0; iteration < iterations; iteration++)
+	{
+		Clock::time_point start = Clock::now();
+		world.generate_contacts();
+		serial_ms = std::min(serial_ms, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	}
+
+	printf("bodies %u, pairs %u, contacts %u\n", world.size(), (UINT)world.pairs.size(), (UINT)expected.size());
+	printf("threads  %10s  %10s  %8s  %s\n", "ms", "ns/pair", "speedup", "same contacts");
+	printf("%7s  %10.3f  %10.1f  %8.2f\n", "serial", serial_ms, serial_ms * 1e6 / world.pairs.size(), 1.0);
+	for (UINT threads = 1; threads <= std::max(max_threads, 4u); threads *= 2)
+	{
+		JobSystem jobs(threads);
+		world.jobs = &jobs;
+		double best = 1e30;
+		bool same = true;
+		for (UINT iteration = 0; iteration < iterations; iteration++)
+		{
+			Clock::time_point start = Clock::now();
+			world.generate_contacts();
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			same = same && world.contacts.size() == expected.size() &&
+				memcmp(world.contacts.data(), expected.data(), sizeof(RigidWorld::Contact) * expected.size()) == 0;
+		}
+		printf("%7u  %10.3f  %10.1f  %8.2f  %s\n", threads, best, best * 1e6 / world.pairs.size(), serial_ms / best, same ? "ok" : "FAILED");
+		if (!same) result = 1;
+		if (threads < max_threads && threads * 2 > max_threads) threads = max_threads / 2;
+	}
+	world.jobs = 0;
+	return result;
+}
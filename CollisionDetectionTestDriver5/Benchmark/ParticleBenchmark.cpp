@@ -0,0 +1,142 @@
+//ParticleSystem::integrate(SoA一括インテグレーション)の計測
+//Particle::integrate(オブジェクトごと)と、スカラー・SSE・AVX2の各実装の1コアあたりの処理速度(particles/s)を比較する
+//
+//使い方:ParticleBenchmark [質点数] [ステップ数]
+//計測の前に各実装の結果がParticle::integrateと(ビット単位で)一致することを確認し、一致しない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../Particle.h"
+#include "../ParticleSystem.h"
+
+//再現性のある乱数(線形合同法)
+static UINT random_state = 12345;
+static FLOAT random_float(FLOAT min, FLOAT max)
+{
+	random_state = random_state * 1664525 + 1013904223;
+	return min + (max - min) * ((random_state >> 8) / 16777216.0f);
+}
+
+static void setup(ParticleSystem *system, std::vector<Particle> *particles, UINT n)
+{
+	random_state = 12345;
+	system->clear();
+	system->reserve(n);
+	for (UINT i = 0; i < n; i++)
+	{
+		FLOAT m = random_float(0.1f, 2);
+		vec3 p(random_float(-10, 10), random_float(0, 10), random_float(-10, 10));
+		vec3 v(random_float(-1, 1), random_float(0, 5), random_float(-1, 1));
+		system->spawn(m, p, v);
+		if (particles)
+		{
+			Particle particle;
+			particle.mass = m;
+			particle.position = p;
+			particle.velocity = v;
+			particles->push_back(particle);
+		}
+	}
+}
+
+static const char *level_name(SIMD_LEVEL level)
+{
+	switch (level)
+	{
+	case SIMD_AVX2: return "avx2";
+	case SIMD_SSE: return "sse";
+	default: return "scalar";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT n = argc > 1 ? (UINT)atoi(argv[1]) : 1000000;
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 100;
+	const FLOAT duration = 1.0f / 60;
+	const vec3 g(0, -9.8f, 0);
+	const SIMD_LEVEL supported = detect_simd_level();
+	typedef std::chrono::high_resolution_clock Clock;
+
+	printf("particles %u, steps %u, detected %s\n", n, steps, level_name(supported));
+
+	//一致の確認(10ステップ、演算の順序が同じなので結果は一致する)
+	int result = 0;
+	for (int level = SIMD_SCALAR; level <= supported; level++)
+	{
+		ParticleSystem system;
+		std::vector<Particle> particles;
+		setup(&system, &particles, std::min(n, 10000u));
+		system.simd_level = (SIMD_LEVEL)level;
+		for (int step = 0; step < 10; step++)
+		{
+			system.add_gravity(g);
+			system.integrate(duration);
+			for (size_t i = 0; i < particles.size(); i++)
+			{
+				particles[i].add_force(particles[i].mass * g);
+				particles[i].integrate(duration);
+			}
+		}
+		FLOAT e = 0;
+		for (UINT i = 0; i < system.size(); i++)
+		{
+			vec3 dp = system.get_position(i) - particles[i].position;
+			vec3 dv = system.get_velocity(i) - particles[i].velocity;
+			e = std::max(e, std::max(length(dp), length(dv)));
+		}
+		printf("check %-8s vs Particle::integrate  max error %g%s\n", level_name((SIMD_LEVEL)level), e, e > 0 ? "  FAILED" : "");
+		if (e > 0) result = 1;
+	}
+
+	//計測(重力を加えてインテグレーションする1ステップを1回とする)
+	{
+		ParticleSystem dummy;
+		std::vector<Particle> particles;
+		setup(&dummy, &particles, n);
+		Clock::time_point start = Clock::now();
+		for (UINT step = 0; step < steps; step++)
+		{
+			for (size_t i = 0; i < particles.size(); i++)
+			{
+				particles[i].add_force(particles[i].mass * g);
+				particles[i].integrate(duration);
+			}
+		}
+		double s = std::chrono::duration<double>(Clock::now() - start).count();
+		printf("%-26s %8.1f M particles/s per core\n", "Particle::integrate", (double)n * steps / s * 1e-6);
+	}
+	for (int level = SIMD_SCALAR; level <= supported; level++)
+	{
+		ParticleSystem system;
+		setup(&system, 0, n);
+		system.simd_level = (SIMD_LEVEL)level;
+		Clock::time_point start = Clock::now();
+		for (UINT step = 0; step < steps; step++)
+		{
+			system.add_gravity(g);
+			system.integrate(duration);
+		}
+		double s = std::chrono::duration<double>(Clock::now() - start).count();
+		printf("ParticleSystem %-11s %8.1f M particles/s per core\n", level_name((SIMD_LEVEL)level), (double)n * steps / s * 1e-6);
+	}
+
+	//生成と削除(末尾との入れ替え)のコスト
+	{
+		ParticleSystem system;
+		setup(&system, 0, n);
+		Clock::time_point start = Clock::now();
+		for (UINT i = 0; i < n; i++)
+		{
+			system.kill((i * 7919u) % system.size());
+			system.spawn(1, vec3(0, 0, 0));
+		}
+		double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		printf("%-26s %8.2f ns per kill + spawn\n", "ParticleSystem", ns / n);
+	}
+	return result;
+}
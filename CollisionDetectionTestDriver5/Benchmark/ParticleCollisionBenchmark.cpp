@@ -0,0 +1,143 @@
+//ParticleCollision(空間ハッシュによる質点同士の衝突)の計測
+//箱の中に質点を詰めて重力で落とし、1ステップ(重力、インテグレーション、衝突の解消)あたりの時間と接触の数を出力する
+//
+//使い方:ParticleCollisionBenchmark [質点数] [ステップ数] [スレッド数]
+//計測の前に、孤立した1組の結果がParticle::collideと一致すること、
+//スレッド数を変えても結果が(ビット単位で)一致することを確認し、一致しない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../Particle.h"
+#include "../ParticleSystem.h"
+#include "../ParticleCollision.h"
+#include "../JobSystem.h"
+
+//再現性のある乱数(線形合同法)
+static UINT random_state = 12345;
+static FLOAT random_float(FLOAT min, FLOAT max)
+{
+	random_state = random_state * 1664525 + 1013904223;
+	return min + (max - min) * ((random_state >> 8) / 16777216.0f);
+}
+
+//一辺sizeの箱に質点を詰める(平均の間隔は直径程度)
+static void setup(ParticleSystem *system, UINT n, FLOAT radius)
+{
+	random_state = 12345;
+	system->clear();
+	system->reserve(n);
+	FLOAT size = 2 * radius * powf((FLOAT)n, 1.0f / 3);
+	for (UINT i = 0; i < n; i++)
+	{
+		vec3 p(random_float(0, size), random_float(0, size), random_float(0, size));
+		vec3 v(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1));
+		system->spawn(random_float(0.5f, 2), p, v);
+	}
+}
+
+//箱の床と壁で質点を跳ね返す
+static void contain(ParticleSystem *system, FLOAT size)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		FLOAT *p = system->position[k].data();
+		FLOAT *v = system->velocity[k].data();
+		for (UINT i = 0; i < system->size(); i++)
+		{
+			if (p[i] < 0) { p[i] = 0; if (v[i] < 0) v[i] = -0.5f * v[i]; }
+			if (p[i] > size) { p[i] = size; if (v[i] > 0) v[i] = -0.5f * v[i]; }
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT n = argc > 1 ? (UINT)atoi(argv[1]) : 1000000;
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 20;
+	const UINT threads = argc > 3 ? (UINT)atoi(argv[3]) : hardware_thread_count();
+	const FLOAT radius = 0.05f;
+	const FLOAT duration = 1.0f / 60;
+	const vec3 g(0, -9.8f, 0);
+	typedef std::chrono::high_resolution_clock Clock;
+
+	printf("particles %u, steps %u, threads %u\n", n, steps, threads);
+	int result = 0;
+
+	//孤立した1組がParticle::collideと一致すること(正規化の方法が違うため丸め誤差の範囲で比較する)
+	{
+		Particle p, q;
+		p.mass = 1.5f; p.position = vec3(0, 0, 0); p.velocity = vec3(1, 0.2f, 0);
+		q.mass = 0.5f; q.position = vec3(0.07f, 0.03f, -0.02f); q.velocity = vec3(-1, 0, 0.3f);
+		ParticleSystem system;
+		system.spawn(p.mass, p.position, p.velocity);
+		system.spawn(q.mass, q.position, q.velocity);
+		ParticleCollision collision(radius, 0.5f);
+		collision.resolve(&system);
+
+		vec3 d = q.position - p.position;
+		Particle::collide(&p, &q, 0.5f, 2 * radius - length(d));
+		//resolveで質点が並べ替えられるため、質量でpとqを見分ける
+		UINT a = system.mass[0] == p.mass ? 0 : 1, b = 1 - a;
+		vec3 e1 = system.get_position(a) - p.position, e2 = system.get_position(b) - q.position;
+		vec3 e3 = system.get_velocity(a) - p.velocity, e4 = system.get_velocity(b) - q.velocity;
+		FLOAT e = std::max(std::max(length(e1), length(e2)), std::max(length(e3), length(e4)));
+		bool failed = e > 1e-6f || collision.contacts != 1;
+		printf("check pair vs Particle::collide     max error %g, contacts %u%s\n", e, collision.contacts, failed ? "  FAILED" : "");
+		if (failed) result = 1;
+	}
+
+	//スレッド数によらず結果が一致すること
+	{
+		const UINT m = std::min(n, 20000u);
+		ParticleSystem a, b;
+		setup(&a, m, radius);
+		setup(&b, m, radius);
+		const UINT many = std::max(threads, 4u);
+		JobSystem jobs(many);
+		ParticleCollision ca(radius), cb(radius);
+		cb.jobs = &jobs;
+		for (int step = 0; step < 5; step++)
+		{
+			ca.resolve(&a);
+			cb.resolve(&b);
+		}
+		bool failed = ca.contacts != cb.contacts;
+		for (int k = 0; k < 3; k++)
+		{
+			failed = failed || a.position[k] != b.position[k] || a.velocity[k] != b.velocity[k];
+		}
+		printf("check 1 thread vs %u threads        contacts %u / %u%s\n", many, ca.contacts, cb.contacts, failed ? "  FAILED" : "");
+		if (failed) result = 1;
+	}
+
+	//計測
+	{
+		ParticleSystem system;
+		setup(&system, n, radius);
+		const FLOAT size = 2 * radius * powf((FLOAT)n, 1.0f / 3);
+		JobSystem jobs(threads);
+		ParticleCollision collision(radius);
+		collision.jobs = &jobs;
+		double integrate = 0, resolve = 0;
+		UINT contacts = 0;
+		for (UINT step = 0; step < steps; step++)
+		{
+			Clock::time_point t0 = Clock::now();
+			system.add_gravity(g);
+			system.integrate(duration);
+			contain(&system, size);
+			Clock::time_point t1 = Clock::now();
+			collision.resolve(&system);
+			Clock::time_point t2 = Clock::now();
+			integrate += std::chrono::duration<double, std::milli>(t1 - t0).count();
+			resolve += std::chrono::duration<double, std::milli>(t2 - t1).count();
+			contacts += collision.contacts;
+		}
+		printf("integrate %8.2f ms/step, resolve %8.2f ms/step, %u contacts/step\n", integrate / steps, resolve / steps, contacts / steps);
+	}
+	return result;
+}
@@ -0,0 +1,253 @@
+//剛体の一括生成・削除(RigidWorld::create_spheres, destroy(handles, count))と記憶域のプールの計測
+//1個ずつのcreate_sphere・destroyと、new Sphere・deleteによるオブジェクトごとの確保と比較する
+//Particle::Rodの確保はnew・deleteとBlockPoolで比較する
+//
+//使い方:PoolBenchmark [剛体数] [繰り返し回数]
+//計測の前に一括生成・削除の結果(成分配列・ハンドル・再利用されるハンドル)が1個ずつの処理と一致することを確認し、
+//一致しない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../RigidWorld.h"
+#include "../Particle.h"
+
+//再現性のある乱数(線形合同法)
+static UINT random_state = 12345;
+static UINT random_uint()
+{
+	random_state = random_state * 1664525 + 1013904223;
+	return random_state >> 8;
+}
+
+template <typename V> static bool same_array(const V &a, const V &b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) == 0);
+}
+//成分配列とハンドルがビット単位で一致するか
+static bool same(const RigidWorld &a, const RigidWorld &b)
+{
+	if (a.size() != b.size() || !same_array(a.shape, b.shape) || !same_array(a.inverse_mass, b.inverse_mass)) return false;
+	for (int k = 0; k < 3; k++)
+	{
+		if (!same_array(a.position[k], b.position[k]) || !same_array(a.previous_position[k], b.previous_position[k])) return false;
+		if (!same_array(a.linear_velocity[k], b.linear_velocity[k]) || !same_array(a.angular_velocity[k], b.angular_velocity[k])) return false;
+		if (!same_array(a.accumulated_force[k], b.accumulated_force[k]) || !same_array(a.accumulated_torque[k], b.accumulated_torque[k])) return false;
+		if (!same_array(a.inverse_inertia[k], b.inverse_inertia[k]) || !same_array(a.dimension[k], b.dimension[k])) return false;
+	}
+	for (int k = 0; k < 4; k++)
+	{
+		if (!same_array(a.orientation[k], b.orientation[k]) || !same_array(a.previous_orientation[k], b.previous_orientation[k])) return false;
+	}
+	for (int k = 0; k < 9; k++)
+	{
+		if (!same_array(a.rotation[k], b.rotation[k])) return false;
+	}
+	for (UINT i = 0; i < a.size(); i++)
+	{
+		if (a.handle(i) != b.handle(i)) return false;
+	}
+	return true;
+}
+
+//剛体番号の順に位置を与える(削除後の並びを比べるため)
+static void number_bodies(RigidWorld *world)
+{
+	for (UINT i = 0; i < world->size(); i++)
+	{
+		world->position[0][i] = (FLOAT)i;
+	}
+}
+
+//handlesのうち、およそfraction(1/256単位)の割合を選ぶ
+static std::vector<RigidBodyHandle> pick(const std::vector<RigidBodyHandle> &handles, UINT fraction)
+{
+	std::vector<RigidBodyHandle> picked;
+	for (size_t k = 0; k < handles.size(); k++)
+	{
+		if (random_uint() % 256 < fraction) picked.push_back(handles[k]);
+	}
+	return picked;
+}
+
+//1個ずつのdestroyを剛体番号の大きい順に呼ぶ
+static void destroy_descending(RigidWorld *world, const std::vector<RigidBodyHandle> &handles)
+{
+	std::vector<RigidBodyHandle> sorted = handles;
+	std::sort(sorted.begin(), sorted.end(), [world](RigidBodyHandle a, RigidBodyHandle b) { return world->slot(a) > world->slot(b); });
+	for (size_t k = 0; k < sorted.size(); k++)
+	{
+		world->destroy(sorted[k]);
+	}
+}
+
+static bool check(UINT n)
+{
+	RigidWorld single, bulk;
+	std::vector<RigidBodyHandle> single_handles(n), bulk_handles(n);
+
+	//生成(球と箱を半分ずつ)
+	for (UINT i = 0; i < n / 2; i++) single_handles[i] = single.create_sphere(0.5f, 1);
+	for (UINT i = n / 2; i < n; i++) single_handles[i] = single.create_box(vec3(0.5f, 1, 2), 1);
+	bulk.create_spheres(n / 2, 0.5f, 1, &bulk_handles[0]);
+	bulk.create_boxes(n - n / 2, vec3(0.5f, 1, 2), 1, &bulk_handles[n / 2]);
+	number_bodies(&single);
+	number_bodies(&bulk);
+	bool ok = same(single, bulk) && single_handles == bulk_handles;
+	printf("check create            %s\n", ok ? "ok" : "FAILED");
+	if (!ok) return false;
+
+	//削除と、削除したハンドル番号の再利用を3回繰り返す
+	random_state = 777;
+	for (int round = 0; round < 3; round++)
+	{
+		std::vector<RigidBodyHandle> victims = pick(single_handles, 64 + round * 64);
+		destroy_descending(&single, victims);
+		bulk.destroy(victims.data(), (UINT)victims.size());
+		ok = same(single, bulk);
+		for (size_t k = 0; k < victims.size(); k++)
+		{
+			ok = ok && !single.is_valid(victims[k]) && !bulk.is_valid(victims[k]);
+		}
+		printf("check destroy %-9u %s\n", (UINT)victims.size(), ok ? "ok" : "FAILED");
+		if (!ok) return false;
+
+		std::vector<RigidBodyHandle> single_new(victims.size()), bulk_new(victims.size());
+		for (size_t k = 0; k < victims.size(); k++) single_new[k] = single.create_sphere(0.25f, 2);
+		if (!victims.empty()) bulk.create_spheres((UINT)victims.size(), 0.25f, 2, &bulk_new[0]);
+		ok = same(single, bulk) && single_new == bulk_new;
+		printf("check reuse %-11u %s\n", (UINT)victims.size(), ok ? "ok" : "FAILED");
+		if (!ok) return false;
+
+		//次の回のために現在の全ハンドルを集める
+		single_handles.resize(single.size());
+		for (UINT i = 0; i < single.size(); i++) single_handles[i] = single.handle(i);
+	}
+	return true;
+}
+
+typedef std::chrono::high_resolution_clock Clock;
+static double elapsed_us(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT n = argc > 1 ? (UINT)atoi(argv[1]) : 10000;
+	const UINT repeats = argc > 2 ? (UINT)atoi(argv[2]) : 20;
+
+	printf("bodies %u, repeats %u\n", n, repeats);
+	if (!check(std::min<UINT>(n, 4096))) return 1;
+
+	//計測(繰り返しの最小値、生成・削除を繰り返すため2回目以降は容量を再利用する)
+	double legacy_create = 1e30, legacy_destroy = 1e30;
+	double single_create = 1e30, single_destroy = 1e30;
+	double bulk_create = 1e30, bulk_destroy = 1e30;
+	{
+		std::vector<Sphere *> legacy(n);	//削除は具象型のまま行う
+		for (UINT r = 0; r < repeats; r++)
+		{
+			Clock::time_point start = Clock::now();
+			for (UINT i = 0; i < n; i++) legacy[i] = new Sphere(0.5f, 1);
+			legacy_create = std::min(legacy_create, elapsed_us(start));
+			start = Clock::now();
+			for (UINT i = 0; i < n; i++) delete legacy[i];
+			legacy_destroy = std::min(legacy_destroy, elapsed_us(start));
+		}
+	}
+	{
+		RigidWorld world;
+		std::vector<RigidBodyHandle> handles(n);
+		for (UINT r = 0; r < repeats; r++)
+		{
+			Clock::time_point start = Clock::now();
+			for (UINT i = 0; i < n; i++) handles[i] = world.create_sphere(0.5f, 1);
+			single_create = std::min(single_create, elapsed_us(start));
+			//削除は生成と逆の順(毎回末尾の剛体を削除する最も安い順)
+			start = Clock::now();
+			for (UINT i = n; i-- > 0;) world.destroy(handles[i]);
+			single_destroy = std::min(single_destroy, elapsed_us(start));
+		}
+	}
+	{
+		RigidWorld world;
+		std::vector<RigidBodyHandle> handles(n);
+		for (UINT r = 0; r < repeats; r++)
+		{
+			Clock::time_point start = Clock::now();
+			world.create_spheres(n, 0.5f, 1, handles.data());
+			bulk_create = std::min(bulk_create, elapsed_us(start));
+			start = Clock::now();
+			world.destroy(handles.data(), n);
+			bulk_destroy = std::min(bulk_destroy, elapsed_us(start));
+		}
+	}
+	printf("%-28s %10s %10s\n", "", "create us", "destroy us");
+	printf("%-28s %10.1f %10.1f\n", "new Sphere / delete", legacy_create, legacy_destroy);
+	printf("%-28s %10.1f %10.1f\n", "create_sphere / destroy", single_create, single_destroy);
+	printf("%-28s %10.1f %10.1f\n", "create_spheres / destroy[]", bulk_create, bulk_destroy);
+
+	//一部だけの削除(削除しない剛体を詰める費用を含む、1個ずつの場合は剛体番号の大きい順に削除する)
+	{
+		RigidWorld single, bulk;
+		std::vector<RigidBodyHandle> handles(n * 4);
+		single.create_spheres(n * 4, 0.5f, 1, handles.data());
+		bulk.create_spheres(n * 4, 0.5f, 1, handles.data());
+		random_state = 4321;
+		std::vector<RigidBodyHandle> victims = pick(handles, 64);
+		Clock::time_point start = Clock::now();
+		destroy_descending(&single, victims);
+		double single_us = elapsed_us(start);
+		start = Clock::now();
+		bulk.destroy(victims.data(), (UINT)victims.size());
+		double bulk_us = elapsed_us(start);
+		printf("destroy %u of %u bodies     %10.1f us (destroy)  %10.1f us (destroy[])\n", (UINT)victims.size(), n * 4, single_us, bulk_us);
+	}
+
+	//Particle::Rod(仮想関数を持つ拘束)の確保
+	{
+		std::vector<Particle> particles(n + 1);
+		for (UINT i = 0; i <= n; i++) particles[i].position = vec3((FLOAT)i, 0, 0);
+		std::vector<Particle::Rod *> rods(n);	//削除は具象型のまま行う
+		double heap = 1e30, pooled = 1e30;
+		BlockPool pool(sizeof(Particle::Rod));
+		for (UINT r = 0; r < repeats; r++)
+		{
+			Clock::time_point start = Clock::now();
+			for (UINT i = 0; i < n; i++) rods[i] = new Particle::Rod(&particles[i], &particles[i + 1]);
+			for (UINT i = 0; i < n; i++) delete rods[i];
+			heap = std::min(heap, elapsed_us(start));
+			start = Clock::now();
+			for (UINT i = 0; i < n; i++) rods[i] = new(pool.allocate()) Particle::Rod(&particles[i], &particles[i + 1]);
+			for (UINT i = 0; i < n; i++)
+			{
+				rods[i]->~Rod();
+				pool.deallocate(rods[i]);
+			}
+			pooled = std::min(pooled, elapsed_us(start));
+		}
+		printf("Particle::Rod new/delete     %10.1f us\n", heap);
+		printf("Particle::Rod BlockPool      %10.1f us  (%.1f KB in pool)\n", pooled, pool.memory_bytes() / 1024.0);
+	}
+
+	//1ステップ後の記憶域の使用量
+	{
+		RigidWorld world;
+		std::vector<RigidBodyHandle> handles(n);
+		world.create_spheres(n, 0.5f, 1, handles.data());
+		for (UINT i = 0; i < n; i++)
+		{
+			world.body(handles[i]).set_position(vec3((FLOAT)(i % 100) * 0.9f, (FLOAT)(i / 100 % 10) * 0.9f, (FLOAT)(i / 1000) * 0.9f));
+		}
+		world.create_plane(vec3(0, 1, 0), -0.4f);
+		world.step(1.0f / 60);
+		RigidWorld::MemoryUsage usage = world.memory_usage();
+		printf("memory after 1 step (KB)     bodies %.1f  handles %.1f  pairs %.1f  contacts %.1f  scratch %.1f  total %.1f\n",
+			usage.bodies / 1024.0, usage.handles / 1024.0, usage.pairs / 1024.0, usage.contacts / 1024.0, usage.scratch / 1024.0, usage.total() / 1024.0);
+	}
+	return 0;
+}
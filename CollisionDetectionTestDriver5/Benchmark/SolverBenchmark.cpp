@@ -0,0 +1,142 @@
+//RigidWorld::resolve_contactsの反復(アイランドごとの時間の予算付きの反復)の確認と計測
+//
+//使い方:SolverBenchmark [剛体数] [ステップ数]
+//原点から離れた位置(FAR_OFFSET)の床の平面の上に球体と直方体を積み、重力を加えてステップ数だけ進める
+//全てのステップの後に、不動オブジェクト(平面)の位置・姿勢・速度・角速度が変わらないこと(全てのアイランドが共有する平面に
+//反復の撃力が積み重ならないこと)と、全ての剛体の位置・姿勢・速度・角速度が有限であることを確認し、
+//満たさない場合は最初のステップを出力して終了コード1を返す
+//計測は、反復なし(solver_budget = 0)と既定の予算での1ステップあたりの時間と、反復の回数・残った接近速度を出力する
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include "../RigidWorld.h"
+
+//剛体を積む位置(接触点が平面の位置から遠いほど、平面に撃力を与えた場合の角速度が大きくなる)
+static const FLOAT FAR_OFFSET = 1000;
+
+//床の平面の上に、FAR_OFFSETを中心として球体と直方体を交互にcount個、格子状に積む(平面の剛体番号は0)
+static void build_world(RigidWorld *world, UINT count)
+{
+	world->create_plane(vec3(0, 1, 0), 0);
+	const UINT side = (UINT)ceilf(sqrtf((FLOAT)count / 4));
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT x = i % side, z = i / side % side, y = i / (side * side);
+		RigidBodyRef body = world->body(i % 2 == 0 ?
+			world->create_sphere(0.5f, 1) :
+			world->create_box(vec3(0.5f, 0.5f, 0.5f), 1));
+		body.set_position(vec3(FAR_OFFSET + x * 1.05f + 0.1f * (y % 3), 0.55f + y * 1.05f, FAR_OFFSET + z * 1.05f));
+	}
+	world->store_poses();
+}
+
+static void step_world(RigidWorld *world, FLOAT duration)
+{
+	const vec3 g(0, -9.8f, 0);
+	for (UINT i = 0; i < world->size(); i++)
+	{
+		if (world->inverse_mass[i] == 0) continue;
+		RigidBodyRef body = world->body(world->handle(i));
+		body.add_force(body.inertial_mass() * g);
+	}
+	world->step(duration);
+}
+
+//位置・姿勢・速度・角速度が全て有限か
+static bool is_finite_state(const RigidWorld &world)
+{
+	for (UINT i = 0; i < world.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			if (!isfinite(world.position[k][i]) || !isfinite(world.linear_velocity[k][i]) || !isfinite(world.angular_velocity[k][i])) return false;
+		}
+		for (int k = 0; k < 4; k++)
+		{
+			if (!isfinite(world.orientation[k][i])) return false;
+		}
+	}
+	return true;
+}
+
+//剛体番号iの位置・姿勢・速度・角速度がstateと一致するか
+static bool same_state(const RigidWorld &world, UINT i, const FLOAT state[13])
+{
+	const FLOAT current[13] =
+	{
+		world.position[0][i], world.position[1][i], world.position[2][i],
+		world.orientation[0][i], world.orientation[1][i], world.orientation[2][i], world.orientation[3][i],
+		world.linear_velocity[0][i], world.linear_velocity[1][i], world.linear_velocity[2][i],
+		world.angular_velocity[0][i], world.angular_velocity[1][i], world.angular_velocity[2][i],
+	};
+	for (int k = 0; k < 13; k++)
+	{
+		if (current[k] != state[k]) return false;
+	}
+	return true;
+}
+
+//反復の予算を指定してstepsステップ進め、確認の結果を返す(計測の結果をms_per_stepなどに書き込む)
+static bool run(UINT count, UINT steps, FLOAT budget, double *ms_per_step, double *iterations_per_step, FLOAT *max_residual)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	RigidWorld world;
+	build_world(&world, count);
+	//反復を時間で打ち切らず、実行する環境によらず同じ回数だけ反復する
+	world.deterministic = TRUE;
+	world.solver_budget = budget;
+	const FLOAT plane[13] =
+	{
+		world.position[0][0], world.position[1][0], world.position[2][0],
+		world.orientation[0][0], world.orientation[1][0], world.orientation[2][0], world.orientation[3][0],
+		0, 0, 0, 0, 0, 0,
+	};
+
+	double total = 0, iterations = 0;
+	*max_residual = 0;
+	int static_step = -1, finite_step = -1;
+	for (UINT step = 0; step < steps; step++)
+	{
+		Clock::time_point start = Clock::now();
+		step_world(&world, 1.0f / 60);
+		total += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		iterations += world.solver_stats.iterations;
+		*max_residual = std::max(*max_residual, world.solver_stats.residual);
+		if (static_step < 0 && !same_state(world, 0, plane)) static_step = (int)step;
+		if (finite_step < 0 && !is_finite_state(world)) finite_step = (int)step;
+	}
+	*ms_per_step = total / steps;
+	*iterations_per_step = iterations / steps;
+
+	printf("check budget %-6g plane unchanged  ", budget);
+	if (static_step < 0) printf("ok\n");
+	else printf("FAILED at step %d (angular velocity %g %g %g)\n", static_step, world.angular_velocity[0][0], world.angular_velocity[1][0], world.angular_velocity[2][0]);
+	printf("check budget %-6g finite state     ", budget);
+	if (finite_step < 0) printf("ok\n");
+	else printf("FAILED at step %d\n", finite_step);
+	return static_step < 0 && finite_step < 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT count = argc > 1 ? (UINT)atoi(argv[1]) : 1000;
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 900;
+	printf("bodies %u at (%g, 0, %g), steps %u\n", count, FAR_OFFSET, FAR_OFFSET, steps);
+
+	const FLOAT budgets[2] = { 0, 200 };
+	double ms[2], iterations[2];
+	FLOAT residual[2];
+	bool ok = true;
+	for (int b = 0; b < 2; b++)
+	{
+		ok = run(count, steps, budgets[b], &ms[b], &iterations[b], &residual[b]) && ok;
+	}
+	printf("%-10s %10s %14s %14s\n", "budget us", "ms/step", "iterations", "max residual");
+	for (int b = 0; b < 2; b++)
+	{
+		printf("%-10g %10.3f %14.1f %14.4f\n", budgets[b], ms[b], iterations[b], residual[b]);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+//SphFluidの計測
+//平面5枚の水槽に箱の障害物を置き、片側に積んだ水柱を崩す(ダムブレイク)状態でstepを呼び、1ステップあたりの時間を出力する
+//
+//使い方:SphBenchmark [最大の粒子数] [ステップ数] [スレッド数]
+//粒子数を最大の粒子数まで倍々に増やして計測し、粒子1個あたりの時間が粒子数によらずほぼ一定であることを確認できるようにする
+//計測の前に、SIMDの実装がscalarと丸め誤差の範囲で一致すること、スレッド数を変えても結果が(ビット単位で)一致すること、
+//しばらく進めた後に粒子が水槽の中にあり密度が静止密度に近いことを確認し、満たさない場合は終了コード1を返す
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../SphFluid.h"
+#include "../JobSystem.h"
+
+static const FLOAT H = 0.1f;	//核関数の半径
+static const FLOAT SPACING = H / 2;	//粒子の初期の間隔
+static const FLOAT WIDTH = 4.0f;	//水槽の大きさ(x方向、奥行きは粒子数に合わせる)
+
+struct Tank
+{
+	Plane floor, left, right, front, back;
+	Box obstacle;
+
+	Tank(FLOAT depth) :
+		floor(vec3(0, 1, 0), 0),
+		left(vec3(1, 0, 0), 0), right(vec3(-1, 0, 0), -WIDTH),
+		front(vec3(0, 0, 1), 0), back(vec3(0, 0, -1), -depth),
+		obstacle(vec3(0.2f, 0.3f, depth), 1)
+	{
+		obstacle.position = vec3(WIDTH * 0.6f, 0.3f, depth / 2);
+	}
+	void attach(SphFluid *fluid) const
+	{
+		const Plane *walls[] = { &floor, &left, &right, &front, &back };
+		fluid->planes.assign(walls, walls + 5);
+		fluid->boxes.assign(1, &obstacle);
+	}
+};
+
+//水槽の左側にcount個の粒子を高さ:幅 = 2:1の柱に積む(奥行きは粒子数から決める)
+static FLOAT fill(ParticleSystem *system, const SphFluid &fluid, UINT count)
+{
+	const UINT nx = (UINT)(WIDTH / 4 / SPACING);
+	const UINT ny = 2 * nx;
+	const UINT nz = std::max(1u, (count + nx * ny - 1) / (nx * ny));
+	system->clear();
+	system->reserve(count);
+	const FLOAT m = fluid.particle_mass(SPACING);
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT x = i % nx, y = i / nx % ny, z = i / (nx * ny);
+		system->spawn(m, vec3((x + 0.5f) * SPACING, (y + 0.5f) * SPACING, (z + 0.5f) * SPACING));
+	}
+	return nz * SPACING;
+}
+
+int main(int argc, char *argv[])
+{
+	const UINT max_particles = argc > 1 ? (UINT)atoi(argv[1]) : 500000;
+	const UINT steps = argc > 2 ? (UINT)atoi(argv[2]) : 3;
+	const UINT threads = argc > 3 ? (UINT)atoi(argv[3]) : hardware_thread_count();
+	const FLOAT duration = 1.0f / 60;
+	typedef std::chrono::high_resolution_clock Clock;
+	int result = 0;
+
+	//SIMDの実装がscalarと丸め誤差の範囲で一致すること(同じ状態から1ステップ進めて比較する)
+	{
+		const UINT n = 20000;
+		ParticleSystem systems[3];
+		SphFluid fluid(H);
+		FLOAT depth = fill(&systems[0], fluid, n);
+		Tank tank(depth);
+		tank.attach(&fluid);
+		for (int step = 0; step < 20; step++) fluid.step(&systems[0], duration);
+		systems[1] = systems[0];
+		systems[2] = systems[0];
+		const char *names[] = { "scalar", "sse", "avx2" };
+		std::vector<FLOAT> density[3];
+		for (int level = 0; level < 3; level++)
+		{
+			fluid.simd_level = (SIMD_LEVEL)level;
+			fluid.substeps = 1;
+			fluid.step(&systems[level], duration);
+			density[level] = std::vector<FLOAT>(fluid.density.begin(), fluid.density.end());
+		}
+		for (int level = 1; level < 3; level++)
+		{
+			FLOAT density_error = 0, position_error = 0;
+			for (UINT i = 0; i < n; i++)
+			{
+				density_error = std::max(density_error, fabsf(density[level][i] - density[0][i]) / density[0][i]);
+				vec3 d = systems[level].get_position(i) - systems[0].get_position(i);
+				position_error = std::max(position_error, length(d));
+			}
+			bool failed = density_error > 1e-5f || position_error > 1e-5f;
+			printf("check %-6s vs scalar  density %g  position %g  %s\n", names[level], density_error, position_error, failed ? "FAILED" : "ok");
+			if (failed) result = 1;
+		}
+	}
+
+	//スレッド数によらず結果が一致すること
+	{
+		const UINT n = 20000;
+		JobSystem many_jobs(std::max(threads, 4u));
+		ParticleSystem a, b;
+		SphFluid fa(H), fb(H);
+		Tank tank(fill(&a, fa, n));
+		fill(&b, fb, n);
+		tank.attach(&fa);
+		tank.attach(&fb);
+		fb.jobs = &many_jobs;
+		for (int step = 0; step < 10; step++)
+		{
+			fa.step(&a, duration);
+			fb.step(&b, duration);
+		}
+		bool failed = false;
+		for (int k = 0; k < 3; k++)
+		{
+			failed = failed || a.position[k] != b.position[k] || a.velocity[k] != b.velocity[k];
+		}
+		printf("check 1 thread vs %u threads  %s\n", std::max(threads, 4u), failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	JobSystem jobs(threads);
+
+	//しばらく進めた後も粒子が水槽の中にあり、密度が静止密度から大きく外れないこと
+	{
+		const UINT n = 20000;
+		ParticleSystem system;
+		SphFluid fluid(H);
+		FLOAT depth = fill(&system, fluid, n);
+		Tank tank(depth);
+		tank.attach(&fluid);
+		fluid.jobs = &jobs;
+		for (int step = 0; step < 180; step++) fluid.step(&system, duration);
+		UINT outside = 0;
+		FLOAT max_density = 0, max_speed = 0;
+		for (UINT i = 0; i < n; i++)
+		{
+			vec3 p = system.get_position(i), v = system.get_velocity(i);
+			const FLOAT margin = SPACING;
+			if (!(p.x > -margin && p.x < WIDTH + margin && p.y > -margin && p.y < 10 && p.z > -margin && p.z < depth + margin)) outside++;
+			max_density = std::max(max_density, fluid.density[i]);
+			max_speed = std::max(max_speed, length(v));
+		}
+		bool failed = outside > 0 || !(max_density < 2 * fluid.rest_density) || !(max_speed < 20);
+		printf("after 180 steps: outside %u, max density %g (rest %g), max speed %g  %s\n",
+			outside, max_density, fluid.rest_density, max_speed, failed ? "FAILED" : "ok");
+		if (failed) result = 1;
+	}
+
+	//計測(粒子数を倍々に増やす)
+	printf("threads %u, substeps %u, h %g\n", threads, SphFluid(H).substeps, H);
+	for (UINT n = std::min(max_particles, 62500u); n <= max_particles; n *= 2)
+	{
+		ParticleSystem system;
+		SphFluid fluid(H);
+		Tank tank(fill(&system, fluid, n));
+		tank.attach(&fluid);
+		fluid.jobs = &jobs;
+		fluid.step(&system, duration);
+
+		Clock::time_point start = Clock::now();
+		for (UINT step = 0; step < steps; step++)
+		{
+			fluid.step(&system, duration);
+		}
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / steps;
+		printf("%8u particles  %9.3f ms/step  %7.1f ns/particle/substep\n", n, ms, ms * 1e6 / n / fluid.substeps);
+		if (n == max_particles) break;
+		if (n * 2 > max_particles) n = max_particles / 2;
+	}
+	return result;
+}
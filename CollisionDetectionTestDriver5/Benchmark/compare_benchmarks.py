@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# KernelBenchmark --jsonの2つの結果(基準と今回)を比較し、ns/callが閾値より遅くなったカーネルを報告する
+#
+# 使い方:compare_benchmarks.py 基準.json 今回.json [--threshold 割合(%)] [--metric ns_per_call|min_ns_per_call|cycles_per_call]
+#
+# 比較は(name, case)ごとに行い、(今回 - 基準) / 基準が閾値を超えた場合はREGRESSION、-閾値を下回った場合はIMPROVEMENTとする
+# REGRESSIONが1つでもある場合は終了コード1を返す(片方にしかない項目は表示するだけで判定に含めない)
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return {(r["name"], r["case"]): r for r in data["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare two KernelBenchmark JSON results.")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0, help="regression threshold in percent (default 10)")
+    parser.add_argument("--metric", default="ns_per_call", choices=["ns_per_call", "min_ns_per_call", "cycles_per_call"])
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = 0
+    print("%-32s %-5s %12s %12s %9s" % ("kernel", "case", "baseline", "current", "change"))
+    for key in sorted(set(baseline) | set(current)):
+        if key not in baseline or key not in current:
+            print("%-32s %-5s %s" % (key[0], key[1], "only in " + ("current" if key in current else "baseline")))
+            continue
+        old = baseline[key][args.metric]
+        new = current[key][args.metric]
+        if old <= 0:
+            print("%-32s %-5s %12.2f %12.2f %9s" % (key[0], key[1], old, new, "n/a"))
+            continue
+        change = (new - old) / old * 100
+        status = ""
+        if change > args.threshold:
+            status = "REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            status = "IMPROVEMENT"
+        print("%-32s %-5s %12.2f %12.2f %+8.1f%% %s" % (key[0], key[1], old, new, change, status))
+
+    if regressions:
+        print("%d regression(s) over %.1f%% in %s" % (regressions, args.threshold, args.metric))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
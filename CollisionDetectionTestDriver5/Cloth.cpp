@@ -0,0 +1,379 @@
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <algorithm>
+#include <set>
+#include <string>
+#include "Cloth.h"
+
+//形状との衝突で1つのジョブが処理する頂点数の下限(これより小さく分けるとジョブの分割と待ちの方が高くつく)
+static const UINT VERTICES_PER_JOB = 1024;
+
+//文字列sの位置iから次の数値を読む(数値以外の文字(区切りの;や,)は読み飛ばす)
+static bool read_number(const std::string &s, size_t *i, double *value)
+{
+	while (*i < s.size())
+	{
+		char c = s[*i];
+		if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.')
+		{
+			char *end;
+			*value = strtod(s.c_str() + *i, &end);
+			*i = end - s.c_str();
+			return true;
+		}
+		(*i)++;
+	}
+	return false;
+}
+
+bool ClothMesh::load_x(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file) return false;
+	std::string text;
+	char buffer[4096];
+	size_t size;
+	while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		text.append(buffer, size);
+	}
+	fclose(file);
+
+	//"Mesh"の後に名前または{が続くものを探す(MeshNormalsなどは除く)
+	size_t i = 0;
+	for (;;)
+	{
+		i = text.find("Mesh", i);
+		if (i == std::string::npos) return false;
+		char before = i > 0 ? text[i - 1] : ' ';
+		char after = i + 4 < text.size() ? text[i + 4] : ' ';
+		i += 4;
+		if ((before == ' ' || before == '\t' || before == '\n' || before == '\r') &&
+			(after == ' ' || after == '\t' || after == '\r' || after == '\n' || after == '{')) break;
+	}
+	i = text.find('{', i);
+	if (i == std::string::npos) return false;
+
+	vertices.clear();
+	polygon_sizes.clear();
+	polygon_indices.clear();
+
+	double value;
+	if (!read_number(text, &i, &value)) return false;
+	const UINT vertex_count = (UINT)value;
+	vertices.resize(vertex_count);
+	for (UINT v = 0; v < vertex_count; v++)
+	{
+		double x, y, z;
+		if (!read_number(text, &i, &x) || !read_number(text, &i, &y) || !read_number(text, &i, &z)) return false;
+		vertices[v] = vec3((FLOAT)x, (FLOAT)y, (FLOAT)z);
+	}
+	if (!read_number(text, &i, &value)) return false;
+	const UINT polygon_count = (UINT)value;
+	for (UINT f = 0; f < polygon_count; f++)
+	{
+		if (!read_number(text, &i, &value)) return false;
+		UINT n = (UINT)value;
+		polygon_sizes.push_back(n);
+		for (UINT k = 0; k < n; k++)
+		{
+			if (!read_number(text, &i, &value) || (UINT)value >= vertex_count) return false;
+			polygon_indices.push_back((UINT)value);
+		}
+	}
+	return true;
+}
+
+void ClothMesh::weld(FLOAT epsilon)
+{
+	assert(epsilon > 0);
+
+	//位置をepsilon単位に丸めた値で頂点を並べ、同じ値の頂点を最初の1つにまとめる
+	const UINT n = (UINT)vertices.size();
+	std::vector<long long> key(3 * n);
+	for (UINT v = 0; v < n; v++)
+	{
+		key[3 * v + 0] = (long long)floor(vertices[v].x / epsilon + 0.5);
+		key[3 * v + 1] = (long long)floor(vertices[v].y / epsilon + 0.5);
+		key[3 * v + 2] = (long long)floor(vertices[v].z / epsilon + 0.5);
+	}
+	std::vector<UINT> order(n);
+	for (UINT v = 0; v < n; v++) order[v] = v;
+	std::sort(order.begin(), order.end(), [&key](UINT a, UINT b)
+	{
+		return std::lexicographical_compare(&key[3 * a], &key[3 * a + 3], &key[3 * b], &key[3 * b + 3]);
+	});
+
+	std::vector<UINT> remap(n);
+	std::vector<vec3> welded;
+	for (UINT k = 0; k < n; k++)
+	{
+		UINT v = order[k];
+		if (k == 0 || !std::equal(&key[3 * v], &key[3 * v + 3], &key[3 * order[k - 1]]))
+		{
+			welded.push_back(vertices[v]);
+		}
+		remap[v] = (UINT)welded.size() - 1;
+	}
+
+	//頂点番号を付け替え、まとめたことで隣り合って重複した頂点を多角形から除く
+	std::vector<UINT> sizes, indices;
+	UINT offset = 0;
+	for (size_t f = 0; f < polygon_sizes.size(); f++)
+	{
+		UINT count = 0;
+		for (UINT k = 0; k < polygon_sizes[f]; k++)
+		{
+			UINT v = remap[polygon_indices[offset + k]];
+			if (count > 0 && indices.back() == v) continue;
+			indices.push_back(v);
+			count++;
+		}
+		if (count > 1 && indices.back() == indices[indices.size() - count])
+		{
+			indices.pop_back();
+			count--;
+		}
+		if (count < 3)
+		{
+			indices.resize(indices.size() - count);
+		}
+		else
+		{
+			sizes.push_back(count);
+		}
+		offset += polygon_sizes[f];
+	}
+	vertices.swap(welded);
+	polygon_sizes.swap(sizes);
+	polygon_indices.swap(indices);
+}
+
+//辺の両端の頂点番号を1つの値にする(小さい方を上位に置く)
+static unsigned long long edge_key(UINT a, UINT b)
+{
+	return a < b ? (unsigned long long)a << 32 | b : (unsigned long long)b << 32 | a;
+}
+
+Cloth::Cloth() :
+	self_collision(0.01f, 0), stretch_count(0), shear_count(0), bend_count(0),
+	gravity(0, -9.8f, 0), thickness(0.01f), friction(0.5f), substeps(2), self_collision_enabled(true),
+	jobs(0)
+{
+	self_collision.reorder = false;
+}
+
+void Cloth::create(const ClothMesh &mesh, const mat4 &transform, FLOAT mass,
+	FLOAT stretch_compliance, FLOAT shear_compliance, FLOAT bend_compliance)
+{
+	assert(mass > 0);
+
+	const UINT n = (UINT)mesh.vertices.size();
+	particles.clear();
+	constraints.clear();
+	triangles.clear();
+
+	std::vector<vec3> position(n);
+	for (UINT v = 0; v < n; v++)
+	{
+		position[v] = transform_coord(mesh.vertices[v], transform);
+	}
+
+	//多角形を扇形に三角形分割し、辺ごとに(辺, 反対側の頂点)を記録する
+	std::set<unsigned long long> stretch, shear;
+	std::vector<std::pair<unsigned long long, UINT> > opposite;
+	UINT offset = 0;
+	for (size_t f = 0; f < mesh.polygon_sizes.size(); f++)
+	{
+		const UINT count = mesh.polygon_sizes[f];
+		const UINT *polygon = &mesh.polygon_indices[offset];
+		for (UINT k = 0; k < count; k++)
+		{
+			stretch.insert(edge_key(polygon[k], polygon[(k + 1) % count]));
+			for (UINT l = k + 2; l < count; l++)
+			{
+				if (k == 0 && l == count - 1) continue;
+				shear.insert(edge_key(polygon[k], polygon[l]));
+			}
+		}
+		for (UINT k = 1; k + 1 < count; k++)
+		{
+			UINT a = polygon[0], b = polygon[k], c = polygon[k + 1];
+			triangles.push_back(a);
+			triangles.push_back(b);
+			triangles.push_back(c);
+			opposite.push_back(std::make_pair(edge_key(a, b), c));
+			opposite.push_back(std::make_pair(edge_key(b, c), a));
+			opposite.push_back(std::make_pair(edge_key(c, a), b));
+		}
+		offset += count;
+	}
+
+	//頂点の質量は周囲の三角形の面積の1/3ずつの和に比例させる
+	std::vector<FLOAT> area(n, 0);
+	FLOAT total_area = 0;
+	for (size_t t = 0; t < triangles.size(); t += 3)
+	{
+		vec3 e1 = position[triangles[t + 1]] - position[triangles[t]];
+		vec3 e2 = position[triangles[t + 2]] - position[triangles[t]];
+		vec3 normal;
+		normal = cross(e1, e2);
+		FLOAT a = 0.5f * length(normal);
+		for (int k = 0; k < 3; k++)
+		{
+			area[triangles[t + k]] += a / 3;
+		}
+		total_area += a;
+	}
+	particles.reserve(n);
+	for (UINT v = 0; v < n; v++)
+	{
+		FLOAT m = total_area > 0 && area[v] > 0 ? mass * area[v] / total_area : mass / n;
+		particles.spawn(m, position[v]);
+	}
+
+	//伸び・せん断・曲げの順に拘束を追加する(同じ頂点の組は最初の種類だけに入れる)
+	FLOAT total_length = 0;
+	for (std::set<unsigned long long>::const_iterator e = stretch.begin(); e != stretch.end(); ++e)
+	{
+		UINT k = constraints.add_rod(particles, (UINT)(*e >> 32), (UINT)*e, stretch_compliance);
+		total_length += constraints.length[k];
+	}
+	stretch_count = constraints.size();
+	for (std::set<unsigned long long>::const_iterator e = shear.begin(); e != shear.end(); ++e)
+	{
+		if (stretch.count(*e)) continue;
+		constraints.add_rod(particles, (UINT)(*e >> 32), (UINT)*e, shear_compliance);
+	}
+	shear_count = constraints.size() - stretch_count;
+
+	//多角形の辺(伸びの拘束)を共有する2つの三角形の反対側の頂点どうしを曲げの拘束でつなぐ
+	std::sort(opposite.begin(), opposite.end());
+	std::set<unsigned long long> bend;
+	for (size_t k = 0; k + 1 < opposite.size(); k++)
+	{
+		if (opposite[k].first != opposite[k + 1].first) continue;
+		if (k + 2 < opposite.size() && opposite[k + 2].first == opposite[k].first) continue;	//3つ以上の三角形が共有する辺は除く
+		if (k > 0 && opposite[k - 1].first == opposite[k].first) continue;
+		if (!stretch.count(opposite[k].first)) continue;
+		UINT a = opposite[k].second, b = opposite[k + 1].second;
+		if (a == b) continue;
+		unsigned long long e = edge_key(a, b);
+		if (stretch.count(e) || shear.count(e) || !bend.insert(e).second) continue;
+		constraints.add_rod(particles, a, b, bend_compliance);
+	}
+	bend_count = constraints.size() - stretch_count - shear_count;
+
+	//自己衝突の半径は、拘束でつながった隣の頂点とは接触しない大きさにする
+	if (stretch_count > 0)
+	{
+		self_collision.radius = 0.45f * total_length / stretch_count;
+	}
+	set_jobs(jobs);
+}
+
+void Cloth::pin(UINT vertex)
+{
+	particles.mass[vertex] = FLT_MAX;
+	for (int k = 0; k < 3; k++)
+	{
+		particles.velocity[k][vertex] = 0;
+	}
+}
+
+void Cloth::set_jobs(JobSystem *job_system)
+{
+	jobs = job_system;
+	constraints.jobs = job_system;
+	self_collision.jobs = job_system;
+}
+
+//形状から押し出し、形状に向かう相対速度を取り除いて接線方向の相対速度をfrictionだけ減衰させる
+static inline void push_out(vec3 *position, vec3 *velocity, const ContactPoint &contact, const vec3 &body_velocity, FLOAT friction)
+{
+	*position += contact.penetration * contact.normal;
+	vec3 relative = *velocity - body_velocity;
+	FLOAT vn = dot(relative, contact.normal);
+	if (vn < 0)
+	{
+		vec3 tangent = relative - vn * contact.normal;
+		*velocity = body_velocity + (1 - friction) * tangent;
+	}
+}
+
+void Cloth::collide_shapes(UINT begin, UINT end)
+{
+	for (UINT i = begin; i < end; i++)
+	{
+		if (particles.mass[i] == FLT_MAX) continue;
+		vec3 p = particles.get_position(i);
+		vec3 v = particles.get_velocity(i);
+		ContactPoint contact;
+		for (size_t k = 0; k < spheres.size(); k++)
+		{
+			const Sphere *sphere = spheres[k];
+			if (collide_sphere_sphere(p, thickness, sphere->position, sphere->r, &contact))
+			{
+				push_out(&p, &v, contact, sphere->linear_velocity, friction);
+			}
+		}
+		for (size_t k = 0; k < boxes.size(); k++)
+		{
+			const Box *box = boxes[k];
+			if (collide_sphere_box(p, thickness, box->position, box->orientation, box->half_size, &contact))
+			{
+				push_out(&p, &v, contact, box->linear_velocity, friction);
+			}
+		}
+		for (size_t k = 0; k < planes.size(); k++)
+		{
+			const Plane *plane = planes[k];
+			if (collide_sphere_plane(p, thickness, plane->position, plane->orientation, &contact, TRUE))
+			{
+				push_out(&p, &v, contact, plane->linear_velocity, friction);
+			}
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			particles.position[k][i] = p[k];
+			particles.velocity[k][i] = v[k];
+		}
+	}
+}
+
+void Cloth::step(FLOAT duration)
+{
+	assert(substeps > 0);
+
+	const FLOAT h = duration / substeps;
+	const bool has_shapes = !spheres.empty() || !boxes.empty() || !planes.empty();
+	for (UINT s = 0; s < substeps; s++)
+	{
+		particles.add_gravity(gravity);
+		particles.integrate(h);
+		constraints.solve(&particles, h);
+		if (has_shapes)
+		{
+			parallel_for(jobs, particles.size(), VERTICES_PER_JOB, [this](UINT begin, UINT end) { collide_shapes(begin, end); });
+		}
+		if (self_collision_enabled)
+		{
+			self_collision.resolve(&particles);
+		}
+	}
+}
+
+void step_cloths(Cloth *cloths, UINT count, FLOAT duration, JobSystem *jobs)
+{
+	parallel_for(jobs, count, 1, [cloths, duration](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; c++)
+		{
+			cloths[c].step(duration);
+		}
+	});
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include "RigidBody.h"
+#include "ParticleSystem.h"
+#include "ParticleConstraints.h"
+#include "ParticleCollision.h"
+
+//布のトポロジーとなる多角形メッシュ
+struct ClothMesh
+{
+	std::vector<vec3> vertices;	//頂点の位置
+	std::vector<UINT> polygon_sizes;	//多角形ごとの頂点数
+	std::vector<UINT> polygon_indices;	//多角形の頂点番号(polygon_sizesの順に連続して並べる)
+
+	//テキスト形式のXファイル(Grid.xなど)の最初のMeshから頂点と面を読み込む(Frameの変換行列は適用しない)
+	//D3Dデバイスを必要としないため、ヘッドレスの実行でも使用できる
+	bool load_x(const char *path);
+
+	//位置がepsilon以内の頂点を1つにまとめる
+	//Xファイルのメッシュは面ごとに頂点を持つ(Grid.xは961面で3844頂点)ため、布にする前に溶接して面どうしをつなぐ
+	void weld(FLOAT epsilon = 1e-4f);
+};
+
+//多角形メッシュから作る布
+//メッシュの頂点を質点(ParticleSystem)とし、次の距離拘束(ParticleConstraints)をXPBDで解く
+//・伸び:多角形の辺
+//・せん断:多角形の対角線
+//・曲げ:多角形の辺を共有する2つの三角形(多角形を扇形に分割したもの)の、辺の反対側の頂点どうし
+//拘束の数は頂点数に比例し、拘束・形状との衝突・自己衝突はいずれもジョブに分けて並列に処理する
+struct Cloth
+{
+	ParticleSystem particles;	//頂点(質点)
+	ParticleConstraints constraints;	//伸び・せん断・曲げの拘束(この順に並ぶ)
+	ParticleCollision self_collision;	//自己衝突(空間ハッシュ、質点の並べ替えはしない)
+	std::vector<UINT> triangles;	//描画用の三角形の頂点番号
+
+	UINT stretch_count;	//伸びの拘束の数
+	UINT shear_count;	//せん断の拘束の数
+	UINT bend_count;	//曲げの拘束の数
+
+	vec3 gravity;	//重力加速度
+	FLOAT thickness;	//形状との衝突で使う布の厚さの半分
+	FLOAT friction;	//形状との接触での接線方向の速度の減衰率(0～1)
+	UINT substeps;	//1回のstepの分割数
+	bool self_collision_enabled;	//自己衝突を解くか
+
+	//衝突する形状(布の外で管理し、stepの間は変更しない)
+	std::vector<const Sphere *> spheres;
+	std::vector<const Box *> boxes;
+	std::vector<const Plane *> planes;
+
+	Cloth();
+
+	//メッシュから布を作る
+	//transformで頂点を変換し、mass(布全体の質量)を各頂点の周囲の面積に応じて配分する
+	void create(const ClothMesh &mesh, const mat4 &transform, FLOAT mass,
+		FLOAT stretch_compliance = 0, FLOAT shear_compliance = 1e-6f, FLOAT bend_compliance = 1e-4f);
+
+	UINT vertex_count() const
+	{
+		return particles.size();
+	}
+	//頂点を固定する(質量をFLT_MAXにする)
+	void pin(UINT vertex);
+	//全ての処理(拘束・形状との衝突・自己衝突)を並列に処理するジョブシステムを設定する(0の場合は呼び出し元のスレッドで処理する)
+	void set_jobs(JobSystem *jobs);
+
+	//durationだけ進める(substeps回に分割して、重力・インテグレーション・拘束・衝突の順に処理する)
+	void step(FLOAT duration);
+
+private:
+	//頂点番号[begin, end)を形状との衝突から押し出す
+	void collide_shapes(UINT begin, UINT end);
+	JobSystem *jobs;
+};
+
+//複数の布をdurationだけ進める
+//1枚の布の拘束のバッチはジョブに分けるほど大きくないことが多いため、布ごとにジョブに分けて並列に進める
+//(各布のjobsは0のままでも、同じjobsを設定してもよい(入れ子のparallel_forになる)、布どうしが同じ形状を参照するのはよい)
+void step_cloths(Cloth *cloths, UINT count, FLOAT duration, JobSystem *jobs);
@@ -1,51 +1,54 @@
+#include "D3DXConvert.h"
 #include "Particle.h"
 #include "RigidBody.h"
+#include "RigidWorld.h"
 
 class CollisionDetectionTestDriver : public Scene
 {
 	LPD3DXMESH box, sphere;
 
-	Sphere *sphere_body[3];
-	Box *box_body[3];
-	Plane *plane_body;
-	std::vector<Contact> contacts;
+	//物理のステップを実行するジョブシステム(スレッド数を1にすると全てメッセージループのスレッドで実行する)
+	JobSystem jobs;
+	RigidWorld world;
+	RigidBodyHandle sphere_body[3];
+	RigidBodyHandle box_body[3];
+	RigidBodyHandle plane_body;
+	//最後に完了したステップで記録したデバッグ表示(次のステップまで毎フレーム描く)
+	DebugDrawBatch step_draw;
 
 public:
-	CollisionDetectionTestDriver(LPDIRECT3DDEVICE9 d3dd) : sphere(0), box(0)
+	CollisionDetectionTestDriver(LPDIRECT3DDEVICE9 d3dd) : sphere(0), box(0), jobs(hardware_thread_count(), FALSE)
 	{
 		D3DXCreateBox(d3dd, 1, 1, 1, &box, 0);
 		D3DXCreateSphere(d3dd, 1.0f, 12, 12, &sphere, 0);
 
-		sphere_body[0] = new Sphere(2, 0.1f);
-		sphere_body[0]->position = D3DXVECTOR3(1, 10, 0);
-		sphere_body[1] = new Sphere(2, 0.1f);
-		sphere_body[1]->position = D3DXVECTOR3(1, 20, 0);
-		sphere_body[2] = new Sphere(2, 0.1f);
-		sphere_body[2]->position = D3DXVECTOR3(1, 30, 0);
-
-		box_body[0] = new Box(D3DXVECTOR3(2.0f, 2.0f, 2.0f), 0.1f);
-		box_body[0]->position = D3DXVECTOR3(5, 5, 10);
-		box_body[1] = new Box(D3DXVECTOR3(2.0f, 2.0f, 2.0f), 0.1f);
-		box_body[1]->position = D3DXVECTOR3(5, 15, 10);
-		box_body[2] = new Box(D3DXVECTOR3(2.0f, 2.0f, 2.0f), 0.1f);
-		box_body[2]->position = D3DXVECTOR3(5, 25, 10);
-
-		plane_body = new Plane(D3DXVECTOR3(0, 1, 0), -2);
+		world.jobs = &jobs;
+		world.restitution = 0.4f;
+		world.solver_budget = 500;
+		world.solver_focus_distance = 20;
+
+		sphere_body[0] = world.create_sphere(2, 0.1f);
+		world.body(sphere_body[0]).set_position(vec3(1, 10, 0));
+		sphere_body[1] = world.create_sphere(2, 0.1f);
+		world.body(sphere_body[1]).set_position(vec3(1, 20, 0));
+		sphere_body[2] = world.create_sphere(2, 0.1f);
+		world.body(sphere_body[2]).set_position(vec3(1, 30, 0));
+
+		box_body[0] = world.create_box(vec3(2.0f, 2.0f, 2.0f), 0.1f);
+		world.body(box_body[0]).set_position(vec3(5, 5, 10));
+		box_body[1] = world.create_box(vec3(2.0f, 2.0f, 2.0f), 0.1f);
+		world.body(box_body[1]).set_position(vec3(5, 15, 10));
+		box_body[2] = world.create_box(vec3(2.0f, 2.0f, 2.0f), 0.1f);
+		world.body(box_body[2]).set_position(vec3(5, 25, 10));
+
+		plane_body = world.create_plane(vec3(0, 1, 0), -2);
+
+		world.store_poses();
 	}
 	~CollisionDetectionTestDriver()
 	{
 		if (box) box->Release();
 		if (sphere) sphere->Release();
-
-		for (int i = 0; i < 3; i++)
-		{
-			if (sphere_body[i]) delete sphere_body[i];
-		}
-		for (int i = 0; i < 3; i++)
-		{
-			if (box_body[i]) delete box_body[i];
-		}
-		if (plane_body) delete plane_body;
 	}
 	void Update(FLOAT duration)
 	{
@@ -55,58 +58,51 @@ public:
 		if (GetKeyState('S') < 0) pitch -= duration * 0.5f;
 		if (GetKeyState('A') < 0) roll += duration * 0.5f;
 		if (GetKeyState('D') < 0) roll -= duration * 0.5f;
-		D3DXQuaternionRotationYawPitchRoll(&plane_body->orientation, 0, pitch, roll);
-
-		if (GetKeyState(VK_LEFT) < 0) box_body[0]->position.x -= 0.1f;
-		if (GetKeyState(VK_RIGHT) < 0) box_body[0]->position.x += 0.1f;
-		if (GetKeyState(VK_UP) < 0) box_body[0]->position.z += 0.1f;
-		if (GetKeyState(VK_DOWN) < 0) box_body[0]->position.z -= 0.1f;
-
-		D3DXVECTOR3 g(0, -9.8f, 0);
-		for (int i = 0; i < 3; i++)
-		{
-			sphere_body[i]->add_force(sphere_body[i]->inertial_mass * g);
-			box_body[i]->add_force(box_body[i]->inertial_mass * g);
-		}
-
-		for (int i = 0; i < 3; i++)
-		{
-			sphere_body[i]->integrate(duration);
-			box_body[i]->integrate(duration);
-		}
-		plane_body->integrate(duration);
+		world.body(plane_body).set_orientation(quat_from_yaw_pitch_roll(0, pitch, roll));
+
+		RigidBodyRef box0 = world.body(box_body[0]);
+		vec3 box0_position = box0.get_position();
+		if (GetKeyState(VK_LEFT) < 0) box0_position.x -= 0.1f;
+		if (GetKeyState(VK_RIGHT) < 0) box0_position.x += 0.1f;
+		if (GetKeyState(VK_UP) < 0) box0_position.z += 0.1f;
+		if (GetKeyState(VK_DOWN) < 0) box0_position.z -= 0.1f;
+		box0.set_position(box0_position);
+
+		//カメラに近い接触の反復を優先する
+		world.solver_focus = to_vec3(comera_position * comera_distance);
+
+		//デバッグ表示の種類(1で接触、2でAABB、3でアイランドの表示を切り替える、接触だけが最初から表示される)
+		UINT categories = 0;
+		if (!(GetKeyState('1') & 1)) categories |= DEBUG_DRAW_CONTACTS;
+		if (GetKeyState('2') & 1) categories |= DEBUG_DRAW_AABBS;
+		if (GetKeyState('3') & 1) categories |= DEBUG_DRAW_ISLANDS;
+		DebugDrawRecorder::I().set_categories(categories);
+	}
+	void Step(FLOAT duration, UINT substeps)
+	{
+		world.store_poses();
 
-		for (int i = 0; i < 3; i++)
-		{
-			generate_contact_sphere_plane(sphere_body[i], plane_body, &contacts, 0.4f);
-			for (int j = i + 1; j < 3; j++)
-			{
-				generate_contact_sphere_sphere(sphere_body[i], sphere_body[j], &contacts, 0.4f);
-			}
-			for (int j = 0; j < 3; j++)
-			{
-				generate_contact_sphere_box(sphere_body[i], box_body[j], &contacts, 0.4f);
-			}
-		}
-		for (int i = 0; i < 3; i++)
+		vec3 g(0, -9.8f, 0);
+		for (UINT n = 0; n < substeps; n++)
 		{
-			generate_contact_box_plane(box_body[i], plane_body, &contacts, 0.4f);
-			for (int j = i + 1; j < 3; j++)
+			for (int i = 0; i < 3; i++)
 			{
-				generate_contact_box_box(box_body[i], box_body[j], &contacts, 0.4f);
+				RigidBodyRef s = world.body(sphere_body[i]);
+				s.add_force(s.inertial_mass() * g);
+				RigidBodyRef b = world.body(box_body[i]);
+				b.add_force(b.inertial_mass() * g);
 			}
-		}
 
-		for (unsigned i = 0; i < contacts.size(); i++)
-		{
-			contacts[i].resolve();
-			_DDM::I().AddCross(contacts[i].point, 1, _DDM::WHITE, 0);
-			_DDM::I().AddLine(contacts[i].point, contacts[i].point + contacts[i].penetration * 100 * contacts[i].normal, _DDM::RED, 0);
+			//最後のサブステップの記録(接触など)だけを描く
+			DebugDrawRecorder::I().clear();
+			world.step(duration / substeps);
 		}
-		contacts.clear();
+		//ステップを実行しないフレームでも消えないように、次のステップまでstep_drawに残す
+		step_draw.clear();
+		DebugDrawRecorder::I().merge(&step_draw);
 	}
 
-	void Render(LPDIRECT3DDEVICE9 d3dd)
+	void Render(LPDIRECT3DDEVICE9 d3dd, FLOAT alpha)
 	{
 		{
 			D3DXMATRIX V;
@@ -146,7 +142,7 @@ public:
 			d3dd->SetMaterial(&m);
 			//d3dd->SetRenderState( D3DRS_FILLMODE, D3DFILL_SOLID ); 
 			d3dd->SetRenderState(D3DRS_FILLMODE, D3DFILL_WIREFRAME);
-			RenderRigidBody(d3dd, sphere_body[i]);
+			RenderRigidBody(d3dd, sphere_body[i], alpha);
 		}
 
 		for (int i = 0; i < 3; i++)
@@ -155,58 +151,48 @@ public:
 			d3dd->SetMaterial(&m);
 			//d3dd->SetRenderState( D3DRS_FILLMODE, D3DFILL_SOLID ); 
 			d3dd->SetRenderState(D3DRS_FILLMODE, D3DFILL_WIREFRAME);
-			RenderRigidBody(d3dd, box_body[i]);
+			RenderRigidBody(d3dd, box_body[i], alpha);
 		}
 
 		m.Ambient = m.Diffuse = D3DXCOLOR(0.6f, 0.6f, 0.0f, 0.0f);
 		d3dd->SetMaterial(&m);
 		d3dd->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
 		//d3dd->SetRenderState(D3DRS_FILLMODE, D3DFILL_WIREFRAME);
-		RenderRigidBody(d3dd, plane_body);
+		RenderRigidBody(d3dd, plane_body, alpha);
 
+		//接触はワーカースレッドが判定のときに記録したもの(RigidWorld::collide_pair)を、最後に完了したステップの分だけまとめて描く
+		_DDM::I().AddBatch(step_draw);
 		_DDM::I().DrawQ(d3dd);
 	}
-	void RenderRigidBody(LPDIRECT3DDEVICE9 d3dd, RigidBody *body)
+	void RenderRigidBody(LPDIRECT3DDEVICE9 d3dd, RigidBodyHandle handle, FLOAT alpha)
 	{
-		D3DXMATRIX M, R, S, T;
+		D3DXMATRIX M, R, S;
 
-		Box *box_shape = dynamic_cast<Box *>(body);
-		if (box_shape)
-		{
-			D3DXMatrixScaling(&S, box_shape->half_size.x * 2, box_shape->half_size.y * 2, box_shape->half_size.z * 2);
-			D3DXMatrixRotationQuaternion(&R, &box_shape->orientation);
-			M = S * R;
-			M._41 = box_shape->position.x;
-			M._42 = box_shape->position.y;
-			M._43 = box_shape->position.z;
-			d3dd->SetTransform(D3DTS_WORLD, &M);
-			box->DrawSubset(0);
-		}
-		Sphere *sphere_shape = dynamic_cast<Sphere *>(body);
-		if (sphere_shape)
-		{
-			FLOAT r = sphere_shape->r;
-			D3DXMatrixScaling(&S, r, r, r);
-			D3DXMatrixRotationQuaternion(&R, &body->orientation);
-			M = S * R;
-			M._41 = body->position.x;
-			M._42 = body->position.y;
-			M._43 = body->position.z;
-			d3dd->SetTransform(D3DTS_WORLD, &M);
-			sphere->DrawSubset(0);
-		}
-		Plane *plane_shape = dynamic_cast<Plane *>(body);
-		if (plane_shape)
+		RigidBodyRef body = world.body(handle);
+		vec3 dimension = body.get_dimension();
+		switch (body.get_shape())
 		{
+		case SHAPE_BOX:
+			D3DXMatrixScaling(&S, dimension.x * 2, dimension.y * 2, dimension.z * 2);
+			break;
+		case SHAPE_SPHERE:
+			D3DXMatrixScaling(&S, dimension.x, dimension.x, dimension.x);
+			break;
+		case SHAPE_PLANE:
 			D3DXMatrixScaling(&S, 50, 0, 50);
-			D3DXMatrixRotationQuaternion(&R, &body->orientation);
-			M = S * R;
-			M._41 = body->position.x;
-			M._42 = body->position.y;
-			M._43 = body->position.z;
-			d3dd->SetTransform(D3DTS_WORLD, &M);
-			box->DrawSubset(0);
+			break;
 		}
+		//直前のステップと現在のステップの間を補間した姿勢で描画する
+		D3DXQUATERNION orientation = to_d3dx(body.get_interpolated_orientation(alpha));
+		D3DXMatrixRotationQuaternion(&R, &orientation);
+		M = S * R;
+		vec3 position = body.get_interpolated_position(alpha);
+		M._41 = position.x;
+		M._42 = position.y;
+		M._43 = position.z;
+		d3dd->SetTransform(D3DTS_WORLD, &M);
+		if (body.get_shape() == SHAPE_SPHERE) sphere->DrawSubset(0);
+		else box->DrawSubset(0);
 	}
 };
 
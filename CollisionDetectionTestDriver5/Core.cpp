@@ -19,6 +19,7 @@
 #include <time.h>
 
 #include "DebugDrawManager.h"
+#include "FixedTimestep.h"
 
 POINTS mouse_dragged;
 BOOL mouse_captured = FALSE;
@@ -54,7 +55,10 @@ public:
 			mouse_wheel = 0;
 		}
 	}
-	virtual void Render(LPDIRECT3DDEVICE9 d3dd) = 0;
+	//固定ステップ幅(duration)で1ステップ進める(substeps回に分割する)
+	virtual void Step(FLOAT duration, UINT substeps) {}
+	//alphaは直前のステップと現在のステップの間の補間の割合(FixedTimestep::alpha)
+	virtual void Render(LPDIRECT3DDEVICE9 d3dd, FLOAT alpha) = 0;
 };
 
 #include "CollisionDetectionTestDriver.h"
@@ -143,6 +147,8 @@ INT WINAPI wWinMain(HINSTANCE hInst, HINSTANCE, LPWSTR, INT)
 	ShowWindow(hWnd, SW_SHOWDEFAULT);
 	UpdateWindow(hWnd);
 
+	FixedTimestep timestep(1.0f / 60.0f, 1, 5);
+
 	MSG msg;
 	ZeroMemory(&msg, sizeof(msg));
 	while (msg.message != WM_QUIT)
@@ -154,15 +160,28 @@ INT WINAPI wWinMain(HINSTANCE hInst, HINSTANCE, LPWSTR, INT)
 		}
 		else
 		{
-			static DWORD last = timeGetTime();
-			DWORD elapse = timeGetTime() - last;
-			if (scene && elapse > 0) scene->Update((FLOAT)elapse / 1000.0f);
-			last += elapse;
+			//経過時間を高分解能カウンタで測り、固定幅のステップに変換する
+			static LARGE_INTEGER frequency, last;
+			if (!frequency.QuadPart)
+			{
+				QueryPerformanceFrequency(&frequency);
+				QueryPerformanceCounter(&last);
+			}
+			LARGE_INTEGER now;
+			QueryPerformanceCounter(&now);
+			FLOAT elapse = (FLOAT)((double)(now.QuadPart - last.QuadPart) / frequency.QuadPart);
+			last = now;
+
+			if (scene)
+			{
+				scene->Update(elapse);
+				for (UINT n = timestep.advance(elapse); n > 0; n--) scene->Step(timestep.step, timestep.substeps);
+			}
 
 			d3dd->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, D3DCOLOR_XRGB(0, 0, 0), 1.0f, 0);
 			if (SUCCEEDED(d3dd->BeginScene()))
 			{
-				if (scene) scene->Render(d3dd);
+				if (scene) scene->Render(d3dd, timestep.alpha());
 				d3dd->EndScene();
 			}
 			d3dd->Present(0, 0, 0, 0);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <d3dx9.h>
+#include "PhysicsMath.h"
+
+//Win32の描画の境界で使う、D3DXの型とVectorMath.hの型の変換(メモリ配置は同じ)
+//物理のコアはVectorMath.hの型だけを使うため、D3DXで描画する側(Core.cpp, CollisionDetectionTestDriver.h, DebugDrawManager.h)で変換する
+inline vec3 to_vec3(CONST D3DXVECTOR3 &v)
+{
+	return vec3(v.x, v.y, v.z);
+}
+inline quat to_quat(CONST D3DXQUATERNION &q)
+{
+	return quat(q.x, q.y, q.z, q.w);
+}
+inline mat4 to_mat4(CONST D3DXMATRIX &m)
+{
+	mat4 o;
+	o.r[0] = vec4(m._11, m._12, m._13, m._14);
+	o.r[1] = vec4(m._21, m._22, m._23, m._24);
+	o.r[2] = vec4(m._31, m._32, m._33, m._34);
+	o.r[3] = vec4(m._41, m._42, m._43, m._44);
+	return o;
+}
+inline D3DXVECTOR3 to_d3dx(const vec3 &v)
+{
+	return D3DXVECTOR3(v.x, v.y, v.z);
+}
+inline D3DXQUATERNION to_d3dx(const quat &q)
+{
+	return D3DXQUATERNION(q.x, q.y, q.z, q.w);
+}
+inline D3DXMATRIX to_d3dx(const mat4 &m)
+{
+	return D3DXMATRIX(
+		m.r[0].x, m.r[0].y, m.r[0].z, m.r[0].w,
+		m.r[1].x, m.r[1].y, m.r[1].z, m.r[1].w,
+		m.r[2].x, m.r[2].y, m.r[2].z, m.r[2].w,
+		m.r[3].x, m.r[3].y, m.r[3].z, m.r[3].w);
+}
@@ -0,0 +1,366 @@
+#include <assert.h>
+#include <stdio.h>
+#include "DebugDraw.h"
+#include "Profiler.h"
+
+//単位円上の点(sin, cos)(円と球の展開で共有する)
+struct UnitCircle
+{
+	FLOAT s[DebugDrawBatch::CIRCLE_SEGMENTS + 1], c[DebugDrawBatch::CIRCLE_SEGMENTS + 1];
+	UnitCircle()
+	{
+		for (UINT i = 0; i < DebugDrawBatch::CIRCLE_SEGMENTS; i++)
+		{
+			s[i] = sinf(360.0f / DebugDrawBatch::CIRCLE_SEGMENTS * 0.01745f * i);
+			c[i] = cosf(360.0f / DebugDrawBatch::CIRCLE_SEGMENTS * 0.01745f * i);
+		}
+		s[DebugDrawBatch::CIRCLE_SEGMENTS] = s[0];
+		c[DebugDrawBatch::CIRCLE_SEGMENTS] = c[0];
+	}
+};
+static const UnitCircle unit_circle;
+
+//直方体の辺(頂点番号のビット0, 1, 2がそれぞれx, y, zの最大側)
+static const BYTE box_edges[12][2] =
+{
+	{ 0, 1 }, { 1, 5 }, { 5, 4 }, { 4, 0 },
+	{ 2, 3 }, { 3, 7 }, { 7, 6 }, { 6, 2 },
+	{ 0, 2 }, { 1, 3 }, { 5, 7 }, { 4, 6 },
+};
+
+//矢印の輪郭(xz平面上、大きさ1)
+static const FLOAT arrow_outline[8][2] =
+{
+	{ 0.0f, 1.0f }, { 1.0f, 0.0f }, { 0.5f, 0.0f }, { 0.5f, -1.0f },
+	{ -0.5f, -1.0f }, { -0.5f, 0.0f }, { -1.0f, 0.0f }, { 0.0f, 1.0f },
+};
+
+static inline DebugVertex *emit(DebugVertex *v, const vec3 &p, DebugColor c)
+{
+	v->x = p.x;
+	v->y = p.y;
+	v->z = p.z;
+	v->color = c;
+	return v + 1;
+}
+
+//nに垂直な単位ベクトルu, v(nは正規化していなくてよい)
+static void perpendicular_basis(const vec3 &n, vec3 *u, vec3 *v)
+{
+	vec3 axis;
+	axis = normalize(n);
+	const vec3 reference = fabsf(axis.y) < 0.9f ? vec3(0, 1, 0) : vec3(1, 0, 0);
+	*u = cross(reference, axis);
+	*u = normalize(*u);
+	*v = cross(axis, *u);
+}
+
+//中心p0、直交する半径ベクトルu, vの円を線分に展開する
+static DebugVertex *emit_circle(DebugVertex *out, const vec3 &p0, const vec3 &u, const vec3 &v, DebugColor c)
+{
+	vec3 previous = p0 + unit_circle.s[0] * u + unit_circle.c[0] * v;
+	for (UINT i = 1; i <= DebugDrawBatch::CIRCLE_SEGMENTS; i++)
+	{
+		const vec3 p = p0 + unit_circle.s[i] * u + unit_circle.c[i] * v;
+		out = emit(out, previous, c);
+		out = emit(out, p, c);
+		previous = p;
+	}
+	return out;
+}
+
+//表示時間からelapsedを引き、0以下になった要素を取り除く(残る要素の順序は保つ)
+template <typename T> static void expire(std::vector<T> &elements, FLOAT elapsed)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < elements.size(); i++)
+	{
+		elements[i].duration -= elapsed;
+		if (elements[i].duration > 0)
+		{
+			if (kept != i) elements[kept] = elements[i];
+			kept++;
+		}
+	}
+	elements.resize(kept);
+}
+
+//fromの要素をtoの末尾に移す
+template <typename T> static void move_elements(std::vector<T> &to, std::vector<T> &from)
+{
+	to.insert(to.end(), from.begin(), from.end());
+	from.clear();
+}
+
+//fromの要素をtoの末尾に写す
+template <typename T> static void copy_elements(std::vector<T> &to, const std::vector<T> &from)
+{
+	to.insert(to.end(), from.begin(), from.end());
+}
+
+void DebugDrawBatch::add_string(INT x, INT y, const char *s, DebugColor c, FLOAT duration)
+{
+	String e;
+	e.x = x;
+	e.y = y;
+	e.c = c;
+	e.duration = duration;
+	snprintf(e.s, sizeof(e.s), "%s", s);
+	strings.push_back(e);
+}
+
+UINT DebugDrawBatch::size() const
+{
+	return (UINT)(lines.size() + triangles.size() + crosses.size() + circles.size() + spheres.size() + planes.size() +
+		aabbs.size() + obbs.size() + arrows.size() + points.size() + vectors.size() + strings.size());
+}
+
+UINT DebugDrawBatch::line_vertex_count() const
+{
+	return (UINT)(lines.size() * LINE_VERTICES + triangles.size() * TRIANGLE_VERTICES + crosses.size() * CROSS_VERTICES +
+		circles.size() * CIRCLE_VERTICES + spheres.size() * SPHERE_VERTICES + planes.size() * PLANE_VERTICES +
+		(aabbs.size() + obbs.size()) * BOX_VERTICES + arrows.size() * ARROW_VERTICES);
+}
+
+//線で描く要素をverticesに展開する
+void DebugDrawBatch::expand()
+{
+	vertices.resize(line_vertex_count());
+	if (vertices.empty()) return;
+	DebugVertex *out = &vertices[0];
+
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		const Line &e = lines[i];
+		out = emit(out, e.p0, e.c);
+		out = emit(out, e.p1, e.c);
+	}
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		const Triangle &e = triangles[i];
+		for (int k = 0; k < 3; k++)
+		{
+			out = emit(out, e.p[k], e.c);
+			out = emit(out, e.p[(k + 1) % 3], e.c);
+		}
+	}
+	for (size_t i = 0; i < crosses.size(); i++)
+	{
+		const Cross &e = crosses[i];
+		out = emit(out, vec3(e.p0.x - e.s, e.p0.y, e.p0.z), e.c);
+		out = emit(out, vec3(e.p0.x + e.s, e.p0.y, e.p0.z), e.c);
+		out = emit(out, vec3(e.p0.x, e.p0.y - e.s, e.p0.z), e.c);
+		out = emit(out, vec3(e.p0.x, e.p0.y + e.s, e.p0.z), e.c);
+		out = emit(out, vec3(e.p0.x, e.p0.y, e.p0.z - e.s), e.c);
+		out = emit(out, vec3(e.p0.x, e.p0.y, e.p0.z + e.s), e.c);
+	}
+	for (size_t i = 0; i < circles.size(); i++)
+	{
+		const Circle &e = circles[i];
+		vec3 u, v;
+		perpendicular_basis(e.n, &u, &v);
+		out = emit_circle(out, e.p0, e.r * u, e.r * v, e.c);
+	}
+	for (size_t i = 0; i < spheres.size(); i++)
+	{
+		const Sphere &e = spheres[i];
+		out = emit_circle(out, e.p0, vec3(e.r, 0, 0), vec3(0, e.r, 0), e.c);
+		out = emit_circle(out, e.p0, vec3(e.r, 0, 0), vec3(0, 0, e.r), e.c);
+		out = emit_circle(out, e.p0, vec3(0, e.r, 0), vec3(0, 0, e.r), e.c);
+	}
+	for (size_t i = 0; i < planes.size(); i++)
+	{
+		const Plane &e = planes[i];
+		vec3 u, v;
+		perpendicular_basis(e.n, &u, &v);
+		const vec3 center = e.d * e.n;
+		const vec3 corner[4] = { center - e.s * u - e.s * v, center + e.s * u - e.s * v, center + e.s * u + e.s * v, center - e.s * u + e.s * v };
+		for (int k = 0; k < 4; k++)
+		{
+			out = emit(out, corner[k], e.c);
+			out = emit(out, corner[(k + 1) % 4], e.c);
+		}
+	}
+	for (size_t i = 0; i < aabbs.size(); i++)
+	{
+		const Aabb &e = aabbs[i];
+		vec3 corner[8];
+		for (int k = 0; k < 8; k++)
+		{
+			corner[k] = vec3(k & 1 ? e.max.x : e.min.x, k & 2 ? e.max.y : e.min.y, k & 4 ? e.max.z : e.min.z);
+		}
+		for (int k = 0; k < 12; k++)
+		{
+			out = emit(out, corner[box_edges[k][0]], e.c);
+			out = emit(out, corner[box_edges[k][1]], e.c);
+		}
+	}
+	for (size_t i = 0; i < obbs.size(); i++)
+	{
+		const Obb &e = obbs[i];
+		vec3 corner[8];
+		for (int k = 0; k < 8; k++)
+		{
+			const vec3 local(k & 1 ? 0.5f * e.s.x : -0.5f * e.s.x, k & 2 ? 0.5f * e.s.y : -0.5f * e.s.y, k & 4 ? 0.5f * e.s.z : -0.5f * e.s.z);
+			corner[k] = transform_coord(local, e.transform);
+		}
+		for (int k = 0; k < 12; k++)
+		{
+			out = emit(out, corner[box_edges[k][0]], e.c);
+			out = emit(out, corner[box_edges[k][1]], e.c);
+		}
+	}
+	for (size_t i = 0; i < arrows.size(); i++)
+	{
+		const Arrow &e = arrows[i];
+		vec3 p[8];
+		for (int k = 0; k < 8; k++)
+		{
+			const vec3 local(arrow_outline[k][0] * e.s, 0, arrow_outline[k][1] * e.s);
+			p[k] = transform_coord(local, e.transform);
+		}
+		for (int k = 0; k < 7; k++)
+		{
+			out = emit(out, p[k], e.c);
+			out = emit(out, p[k + 1], e.c);
+		}
+	}
+	assert(out == &vertices[0] + vertices.size());
+}
+
+void DebugDrawBatch::flush(DebugDrawBackend *backend, FLOAT elapsed)
+{
+	PROFILE_SCOPE("debug draw");
+	stats.primitives = size();
+	stats.draw_calls = 0;
+
+	expand();
+	stats.vertices = (UINT)vertices.size();
+	if (!vertices.empty())
+	{
+		backend->draw_lines(&vertices[0], (UINT)vertices.size());
+		stats.draw_calls++;
+	}
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		backend->draw_point(points[i].p, points[i].r, points[i].c);
+	}
+	for (size_t i = 0; i < vectors.size(); i++)
+	{
+		backend->draw_vector(vectors[i].v, vectors[i].p, vectors[i].r, vectors[i].h, vectors[i].c);
+	}
+	for (size_t i = 0; i < strings.size(); i++)
+	{
+		backend->draw_string(strings[i].x, strings[i].y, strings[i].s, strings[i].c);
+	}
+	stats.draw_calls += (UINT)(points.size() + vectors.size() + strings.size());
+
+	expire(lines, elapsed);
+	expire(triangles, elapsed);
+	expire(crosses, elapsed);
+	expire(circles, elapsed);
+	expire(spheres, elapsed);
+	expire(planes, elapsed);
+	expire(aabbs, elapsed);
+	expire(obbs, elapsed);
+	expire(arrows, elapsed);
+	expire(points, elapsed);
+	expire(vectors, elapsed);
+	expire(strings, elapsed);
+}
+
+void DebugDrawBatch::clear()
+{
+	lines.clear();
+	triangles.clear();
+	crosses.clear();
+	circles.clear();
+	spheres.clear();
+	planes.clear();
+	aabbs.clear();
+	obbs.clear();
+	arrows.clear();
+	points.clear();
+	vectors.clear();
+	strings.clear();
+}
+
+void DebugDrawBatch::append(DebugDrawBatch *source)
+{
+	move_elements(lines, source->lines);
+	move_elements(triangles, source->triangles);
+	move_elements(crosses, source->crosses);
+	move_elements(circles, source->circles);
+	move_elements(spheres, source->spheres);
+	move_elements(planes, source->planes);
+	move_elements(aabbs, source->aabbs);
+	move_elements(obbs, source->obbs);
+	move_elements(arrows, source->arrows);
+	move_elements(points, source->points);
+	move_elements(vectors, source->vectors);
+	move_elements(strings, source->strings);
+}
+
+void DebugDrawBatch::append(const DebugDrawBatch &source)
+{
+	copy_elements(lines, source.lines);
+	copy_elements(triangles, source.triangles);
+	copy_elements(crosses, source.crosses);
+	copy_elements(circles, source.circles);
+	copy_elements(spheres, source.spheres);
+	copy_elements(planes, source.planes);
+	copy_elements(aabbs, source.aabbs);
+	copy_elements(obbs, source.obbs);
+	copy_elements(arrows, source.arrows);
+	copy_elements(points, source.points);
+	copy_elements(vectors, source.vectors);
+	copy_elements(strings, source.strings);
+}
+
+std::atomic<UINT> DebugDrawRecorder::categories(0);
+
+DebugDrawBatch *DebugDrawRecorder::register_thread()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	buffers.push_back(std::unique_ptr<DebugDrawBatch>(new DebugDrawBatch()));
+	return buffers.back().get();
+}
+
+void DebugDrawRecorder::unregister_thread(DebugDrawBatch *batch)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		if (buffers[i].get() != batch) continue;
+		retired.append(batch);
+		buffers.erase(buffers.begin() + i);
+		break;
+	}
+}
+
+void DebugDrawRecorder::merge(DebugDrawBatch *target)
+{
+	PROFILE_SCOPE("debug draw merge");
+	std::lock_guard<std::mutex> lock(mutex);
+	target->append(&retired);
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		target->append(buffers[i].get());
+	}
+}
+
+void DebugDrawRecorder::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	retired.clear();
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		buffers[i]->clear();
+	}
+}
+
+UINT DebugDrawRecorder::thread_count() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (UINT)buffers.size();
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "PhysicsMath.h"
+
+//デバッグ表示の描画要素をフレームごとにまとめて描く
+//
+//使い方:
+//	DebugDrawBatch batch;
+//	batch.add_cross(contact.point, 1, 0xFFFFFFFF);	//種類ごとの配列に追加するだけ(描画はしない)
+//	batch.add_line(p0, p1, 0xFFFF0000);
+//	batch.flush(&backend, elapsed);	//線で描く要素を全て1つの線分リスト(頂点ごとの色)に展開し、backendで描く
+//
+//線で描く要素(線分・三角形・十字・円・球・平面・AABB・OBB・矢印)はflushのたびに1つの頂点配列に展開し、
+//DebugDrawBackend::draw_linesを1回だけ呼ぶ(要素の数によらず描画呼び出しは1回)
+//メッシュで描く要素(点・ベクトル)と文字列は要素ごとにbackendを呼ぶ(数が少ない前提)
+//
+//要素は追加したときの表示時間(duration、秒)の間残り、flushのたびに経過時間を引いて0以下になったものを取り除く
+//(表示時間が0の要素は次のflushで1回だけ描く)
+//種類ごとの配列と頂点配列は容量を保持するため、要素の最大数に達した後はヒープから確保しない
+//スレッドセーフではない(追加とflushは同じスレッドで行う、複数のスレッドから追加する場合は下のDebugDrawRecorderを使う)
+
+//色(0xAARRGGBB、Direct3D 9のD3DCOLORと同じ)
+typedef DWORD DebugColor;
+
+//線分リストの頂点(Direct3D 9のD3DFVF_XYZ | D3DFVF_DIFFUSEと同じ配置)
+struct DebugVertex
+{
+	FLOAT x, y, z;
+	DebugColor color;
+};
+
+//描画の実装(Direct3D 9の実装はDebugDrawManager.h)
+class DebugDrawBackend
+{
+public:
+	virtual ~DebugDrawBackend() {}
+	//線分のリスト(2頂点で1本、countは頂点数)を描く
+	virtual void draw_lines(const DebugVertex *vertices, UINT count) = 0;
+	//半径rの点(球のメッシュ)
+	virtual void draw_point(const vec3 &p, FLOAT r, DebugColor c) {}
+	//pからp + vへのベクトル(半径rの円柱と大きさhの円錐のメッシュ)
+	virtual void draw_vector(const vec3 &v, const vec3 &p, FLOAT r, FLOAT h, DebugColor c) {}
+	//画面上の位置(x, y)の文字列
+	virtual void draw_string(INT x, INT y, const char *s, DebugColor c) {}
+};
+
+//何も描かず、描画呼び出しの回数と頂点数だけを数える(描画のない環境でまとめ方を確かめるため)
+class NullDebugDrawBackend : public DebugDrawBackend
+{
+public:
+	UINT draw_calls;	//draw_linesの回数
+	UINT vertices;	//draw_linesに渡した頂点の総数
+	UINT meshes;	//draw_point, draw_vectorの回数
+	UINT strings;	//draw_stringの回数
+	std::vector<DebugVertex> last;	//最後のdraw_linesに渡した頂点(keep_verticesが真の場合だけ)
+	bool keep_vertices;
+
+	NullDebugDrawBackend(bool keep_vertices = false) : draw_calls(0), vertices(0), meshes(0), strings(0), keep_vertices(keep_vertices) {}
+
+	void reset()
+	{
+		draw_calls = vertices = meshes = strings = 0;
+		last.clear();
+	}
+	void draw_lines(const DebugVertex *v, UINT count)
+	{
+		draw_calls++;
+		vertices += count;
+		if (keep_vertices) last.assign(v, v + count);
+	}
+	void draw_point(const vec3 &p, FLOAT r, DebugColor c) { meshes++; }
+	void draw_vector(const vec3 &v, const vec3 &p, FLOAT r, FLOAT h, DebugColor c) { meshes++; }
+	void draw_string(INT x, INT y, const char *s, DebugColor c) { strings++; }
+};
+
+class DebugDrawBatch
+{
+public:
+	static const UINT CIRCLE_SEGMENTS = 36;	//円と球(3つの円)の分割数
+
+	//1つの要素を展開した頂点数
+	enum
+	{
+		LINE_VERTICES = 2,
+		TRIANGLE_VERTICES = 6,
+		CROSS_VERTICES = 6,
+		CIRCLE_VERTICES = CIRCLE_SEGMENTS * 2,
+		SPHERE_VERTICES = CIRCLE_SEGMENTS * 2 * 3,
+		PLANE_VERTICES = 8,
+		BOX_VERTICES = 24,
+		ARROW_VERTICES = 14,
+	};
+
+	//直前のflushの内容
+	struct Stats
+	{
+		UINT primitives;	//描いた要素の数
+		UINT vertices;	//線分リストの頂点数
+		UINT draw_calls;	//backendの呼び出し回数
+	};
+
+	DebugDrawBatch() { stats.primitives = stats.vertices = stats.draw_calls = 0; }
+
+	void add_line(const vec3 &p0, const vec3 &p1, DebugColor c, FLOAT duration = 0)
+	{
+		Line e = { p0, p1, c, duration };
+		lines.push_back(e);
+	}
+	void add_triangle(const vec3 &p0, const vec3 &p1, const vec3 &p2, DebugColor c, FLOAT duration = 0)
+	{
+		Triangle e = { { p0, p1, p2 }, c, duration };
+		triangles.push_back(e);
+	}
+	//p0を中心とする各軸方向に長さ2sの十字
+	void add_cross(const vec3 &p0, FLOAT s, DebugColor c, FLOAT duration = 0)
+	{
+		Cross e = { p0, s, c, duration };
+		crosses.push_back(e);
+	}
+	//p0を中心とする法線nの面上の半径rの円
+	void add_circle(const vec3 &p0, const vec3 &n, FLOAT r, DebugColor c, FLOAT duration = 0)
+	{
+		Circle e = { p0, n, r, c, duration };
+		circles.push_back(e);
+	}
+	//p0を中心とする半径rの球(座標軸に垂直な3つの円)
+	void add_sphere(const vec3 &p0, FLOAT r, DebugColor c, FLOAT duration = 0)
+	{
+		Sphere e = { p0, r, c, duration };
+		spheres.push_back(e);
+	}
+	//平面n・x = d上の、n * dを中心とする一辺2sの正方形
+	void add_plane(const vec3 &n, FLOAT d, FLOAT s, DebugColor c, FLOAT duration = 0)
+	{
+		Plane e = { n, d, s, c, duration };
+		planes.push_back(e);
+	}
+	void add_aabb(const vec3 &min, const vec3 &max, DebugColor c, FLOAT duration = 0)
+	{
+		Aabb e = { min, max, c, duration };
+		aabbs.push_back(e);
+	}
+	//原点を中心とする大きさsの直方体を姿勢oで変換したもの
+	void add_obb(const mat4 &o, const vec3 &s, DebugColor c, FLOAT duration = 0)
+	{
+		Obb e = { o, s, c, duration };
+		obbs.push_back(e);
+	}
+	//p0に置いた(yaw, pitch, roll)の向きの大きさsの矢印(xz平面上の輪郭)
+	void add_arrow(const vec3 &p0, FLOAT yaw, FLOAT pitch, FLOAT roll, FLOAT s, DebugColor c, FLOAT duration = 0)
+	{
+		Arrow e;
+		e.transform = mat4_from_rotation_translation(quat_from_yaw_pitch_roll(yaw, pitch, roll), p0);
+		e.s = s;
+		e.c = c;
+		e.duration = duration;
+		arrows.push_back(e);
+	}
+	void add_point(const vec3 &p, FLOAT r, DebugColor c, FLOAT duration = 0)
+	{
+		Point e = { p, r, c, duration };
+		points.push_back(e);
+	}
+	void add_vector(const vec3 &v, const vec3 &p, FLOAT r, FLOAT h, DebugColor c, FLOAT duration = 0)
+	{
+		Vector e = { v, p, r, h, c, duration };
+		vectors.push_back(e);
+	}
+	//長い文字列は切り詰める
+	void add_string(INT x, INT y, const char *s, DebugColor c, FLOAT duration = 0);
+
+	//線で描く要素を展開してbackendで描き、elapsed(秒)を引いて表示時間の過ぎた要素を取り除く
+	void flush(DebugDrawBackend *backend, FLOAT elapsed);
+	//全ての要素を取り除く(容量は保持する)
+	void clear();
+	//sourceの要素を全てこのバッチの末尾に移す(sourceは空になり、容量は保持する)
+	void append(DebugDrawBatch *source);
+	//sourceの要素を全てこのバッチの末尾に写す(sourceは変えない、同じ記録を何フレームも描く場合に使う)
+	void append(const DebugDrawBatch &source);
+
+	//追加済みの要素の数
+	UINT size() const;
+	//線で描く要素を展開した頂点数(次のflushでdraw_linesに渡す数)
+	UINT line_vertex_count() const;
+	const Stats &last_stats() const { return stats; }
+
+private:
+	struct Line { vec3 p0, p1; DebugColor c; FLOAT duration; };
+	struct Triangle { vec3 p[3]; DebugColor c; FLOAT duration; };
+	struct Cross { vec3 p0; FLOAT s; DebugColor c; FLOAT duration; };
+	struct Circle { vec3 p0, n; FLOAT r; DebugColor c; FLOAT duration; };
+	struct Sphere { vec3 p0; FLOAT r; DebugColor c; FLOAT duration; };
+	struct Plane { vec3 n; FLOAT d, s; DebugColor c; FLOAT duration; };
+	struct Aabb { vec3 min, max; DebugColor c; FLOAT duration; };
+	struct Obb { mat4 transform; vec3 s; DebugColor c; FLOAT duration; };
+	struct Arrow { mat4 transform; FLOAT s; DebugColor c; FLOAT duration; };
+	struct Point { vec3 p; FLOAT r; DebugColor c; FLOAT duration; };
+	struct Vector { vec3 v, p; FLOAT r, h; DebugColor c; FLOAT duration; };
+	struct String { INT x, y; DebugColor c; FLOAT duration; char s[192]; };
+
+	std::vector<Line> lines;
+	std::vector<Triangle> triangles;
+	std::vector<Cross> crosses;
+	std::vector<Circle> circles;
+	std::vector<Sphere> spheres;
+	std::vector<Plane> planes;
+	std::vector<Aabb> aabbs;
+	std::vector<Obb> obbs;
+	std::vector<Arrow> arrows;
+	std::vector<Point> points;
+	std::vector<Vector> vectors;
+	std::vector<String> strings;
+
+	std::vector<DebugVertex> vertices;	//線分リスト(flushのたびに作り直す)
+	Stats stats;
+
+	void expand();
+};
+
+//DebugDrawRecorderで記録する種類(ビットの組み合わせで選ぶ)
+enum DEBUG_DRAW_CATEGORY
+{
+	DEBUG_DRAW_CONTACTS = 1 << 0,	//接触点(十字)と法線方向のめり込み(線分)
+	DEBUG_DRAW_AABBS = 1 << 1,	//剛体のAABB
+	DEBUG_DRAW_ISLANDS = 1 << 2,	//ソルバーのアイランドの範囲(アイランドごとの色のAABB)
+	DEBUG_DRAW_BVH = 1 << 3,	//BVHのノード(BVHを使う判定のため、現在のRigidWorldは記録しない)
+	DEBUG_DRAW_ALL = 0xFFFFFFFF
+};
+
+//スレッドごとのデバッグ表示の記録(ワーカースレッドを含むどのスレッドからでも描画要素を追加し、フレームの終わりにまとめる)
+//
+//使い方:
+//	DebugDrawRecorder::I().set_categories(DEBUG_DRAW_CONTACTS | DEBUG_DRAW_AABBS);	//記録する種類(既定は0で何も記録しない)
+//	DEBUG_DRAW(DEBUG_DRAW_CONTACTS, add_cross(contact.point, 1, 0xFFFFFFFF));	//呼び出したスレッドのバッファに追加する
+//	world.step(duration);
+//	DebugDrawRecorder::I().merge(&batch);	//全てのスレッドの記録をbatchに移す
+//	batch.flush(&backend, elapsed);
+//
+//記録は呼び出したスレッドのDebugDrawBatch(最初の記録で作って登録する)に追加するだけで、ロックも原子的な更新も使わない
+//スレッドが終了するとバッファの登録を外して解放する(残っていた記録は次のmergeまでretiredに移す)ため、
+//スレッドを作っては終了させる使い方でもバッファは増え続けない
+//種類は記録するときに選ぶため、記録しない種類のDEBUG_DRAWの費用は分岐1つ
+//merge・clearは記録しているスレッドがない間(ジョブの完了を待ったstepの後など)に呼ぶこと
+//PHYSICS_DEBUG_DRAWを0に定義するとDEBUG_DRAWは何も生成しない
+#ifndef PHYSICS_DEBUG_DRAW
+#define PHYSICS_DEBUG_DRAW 1
+#endif
+
+class DebugDrawRecorder
+{
+public:
+	static DebugDrawRecorder &I()
+	{
+		static DebugDrawRecorder i;
+		return i;
+	}
+
+	static bool is_enabled(UINT category)
+	{
+		return (categories.load(std::memory_order_relaxed) & category) != 0;
+	}
+	//記録する種類(DEBUG_DRAW_CATEGORYの組み合わせ)
+	void set_categories(UINT mask)
+	{
+		categories.store(mask, std::memory_order_relaxed);
+	}
+	UINT enabled_categories() const
+	{
+		return categories.load(std::memory_order_relaxed);
+	}
+
+	//呼び出したスレッドのバッファ(最初の呼び出しで作って登録し、スレッドの終了で登録を外す)
+	static DebugDrawBatch *thread_batch()
+	{
+		static thread_local ThreadBuffer buffer;
+		if (!buffer.batch) buffer.batch = I().register_thread();
+		return buffer.batch;
+	}
+
+	//終了したスレッドの記録と、登録しているスレッドのバッファの要素を登録した順にtargetの末尾に移す
+	void merge(DebugDrawBatch *target);
+	//全てのスレッドのバッファの要素を捨てる
+	void clear();
+	//登録しているスレッド(記録したことがあり、まだ終了していないスレッド)の数
+	UINT thread_count() const;
+
+private:
+	static std::atomic<UINT> categories;
+
+	//スレッドの終了で登録を外す
+	struct ThreadBuffer
+	{
+		DebugDrawBatch *batch;
+		ThreadBuffer() : batch(0) {}
+		~ThreadBuffer()
+		{
+			if (batch) I().unregister_thread(batch);
+		}
+	};
+
+	mutable std::mutex mutex;	//buffersとretiredの追加・削除を保護する
+	std::vector<std::unique_ptr<DebugDrawBatch> > buffers;	//登録しているスレッドのバッファ
+	DebugDrawBatch retired;	//終了したスレッドの最後の記録(次のmergeで読み出す)
+
+	DebugDrawRecorder() {}
+	DebugDrawRecorder(const DebugDrawRecorder &);
+	DebugDrawRecorder &operator=(const DebugDrawRecorder &);
+	DebugDrawBatch *register_thread();
+	void unregister_thread(DebugDrawBatch *batch);
+};
+
+//categoryを記録する場合だけ、呼び出したスレッドのDebugDrawBatchのcallを呼ぶ(DEBUG_DRAW(DEBUG_DRAW_AABBS, add_aabb(min, max, color)))
+//まとめて記録する場合はDEBUG_DRAW_ENABLEDで1回だけ調べ、DebugDrawRecorder::thread_batch()に追加する
+#if PHYSICS_DEBUG_DRAW
+#define DEBUG_DRAW_ENABLED(category) DebugDrawRecorder::is_enabled(category)
+#define DEBUG_DRAW(category, call) do { if (DebugDrawRecorder::is_enabled(category)) DebugDrawRecorder::thread_batch()->call; } while (0)
+#else
+#define DEBUG_DRAW_ENABLED(category) false
+#define DEBUG_DRAW(category, call) do {} while (0)
+#endif
@@ -1,8 +1,9 @@
 #pragma once
 
 #include <stdio.h>
-#include <d3dx9.h>
-#include <list>
+#include <string.h>
+#include "D3DXConvert.h"
+#include "DebugDraw.h"
 
 struct _DDM
 {
@@ -389,72 +390,75 @@ struct _DDM
 		f.p->DrawTextA( 0, s, -1, &rect, DT_CALCRECT, 0 );
 		f.p->DrawTextA( 0, s, -1, &rect, DT_LEFT | DT_BOTTOM, c );
 	}
+	//追加した要素は表示時間(duration、秒)が過ぎるまでDrawQのたびに描く
+	//線で描く要素は全てまとめて1回のDrawPrimitiveで描く(点・ベクトル・文字列は要素ごと)
+	//DEBUG_DRAWで各スレッドが記録した要素(DebugDrawRecorder)もここでまとめて描く(物理のジョブが止まっている間に呼ぶこと)
 	void DrawQ( LPDIRECT3DDEVICE9 d3dd )
 	{
 		static DWORD last = timeGetTime();
 		DWORD elapse = timeGetTime() - last;
-		std::list< _O * >::iterator i;
-		for ( i = _Q.begin(); i != _Q.end(); )
-		{
-			(*i)->Draw( d3dd );
-			(*i)->duration -= ( ( FLOAT )elapse / 1000.0f );
-			if( (*i)->duration <= 0.0f )
-			{
-				delete *i;
-				i = _Q.erase( i );
-				continue;
-			}
-			i++;
-		}
+		DebugDrawRecorder::I().merge( &_Q );
+		_B.d3dd = d3dd;
+		_Q.flush( &_B, ( FLOAT )elapse / 1000.0f );
 		last += elapse;
 	}
+	//batchの要素を写して次のDrawQで描く(batchは変えないため、同じ記録を毎フレーム描ける)
+	void AddBatch( CONST DebugDrawBatch &batch )
+	{
+		_Q.append( batch );
+	}
 	void AddLine( CONST D3DXVECTOR3 &p0, CONST D3DXVECTOR3 &p1, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _LINE( p0, p1, c, duration ) );
+		_Q.add_line( to_vec3( p0 ), to_vec3( p1 ), c, duration );
 	}
 	void AddTriangle( CONST D3DXVECTOR3 &p0, CONST D3DXVECTOR3 &p1, CONST D3DXVECTOR3 &p2, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _TRIANGLE( p0, p1, p2, c, duration ) );
+		_Q.add_triangle( to_vec3( p0 ), to_vec3( p1 ), to_vec3( p2 ), c, duration );
 	}
 	void AddCross( CONST D3DXVECTOR3 &p0, FLOAT s, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _CROSS( p0, s, c, duration ) );
+		_Q.add_cross( to_vec3( p0 ), s, c, duration );
 	}
 	void AddCircle( CONST D3DXVECTOR3 &p0, CONST D3DXVECTOR3 &n, FLOAT r, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _CIRCLE( p0, n, r, c, duration ) );
+		_Q.add_circle( to_vec3( p0 ), to_vec3( n ), r, c, duration );
 	}
 	void AddSphere( CONST D3DXVECTOR3 &p0, FLOAT r, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _SPHERE( p0, r, c, duration ) );
+		_Q.add_sphere( to_vec3( p0 ), r, c, duration );
 	}	
 	void AddPlane( CONST D3DXVECTOR3 &n, FLOAT d, FLOAT s, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _PLANE( n, d, s, c, duration ) );
+		_Q.add_plane( to_vec3( n ), d, s, c, duration );
 	}		
 	void AddAABB( CONST D3DXVECTOR3 &min, CONST D3DXVECTOR3 &max, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _AABB( min, max, c, duration ) );
+		_Q.add_aabb( to_vec3( min ), to_vec3( max ), c, duration );
 	}	
 	void AddOBB( CONST D3DXMATRIX &o, CONST D3DXVECTOR3 &s, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _OBB( o, s, c, duration ) );
+		_Q.add_obb( to_mat4( o ), to_vec3( s ), c, duration );
 	}
 	void AddArrow( CONST D3DXVECTOR3 &p0, FLOAT yaw, FLOAT pitch, FLOAT roll, FLOAT s /*size*/, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _ARROW( p0, yaw, pitch, roll, s, c, duration ) );
+		_Q.add_arrow( to_vec3( p0 ), yaw, pitch, roll, s, c, duration );
 	}
 	void AddVector( CONST D3DXVECTOR3 &v, CONST D3DXVECTOR3 &p, FLOAT r, FLOAT h, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _VECTOR( v, p, r, h, c, duration ) );
+		_Q.add_vector( to_vec3( v ), to_vec3( p ), r, h, c, duration );
 	}
 	void AddPoint( CONST D3DXVECTOR3 &p, FLOAT r, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _POINT( p, r, c, duration ) );
+		_Q.add_point( to_vec3( p ), r, c, duration );
 	}
 	void AddString( LONG x, LONG y, LPCSTR s, D3DCOLOR c = WHITE, FLOAT duration = 0.0f  )
 	{
-		_Q.push_back( new _STRING( x, y, c, s, duration ) );
+		_Q.add_string( x, y, s, c, duration );
+	}
+	//直前のDrawQで描いた要素の数・頂点数・描画呼び出しの回数
+	CONST DebugDrawBatch::Stats &LastStats() CONST
+	{
+		return _Q.last_stats();
 	}
 	static LPCSTR FormatString( LPCSTR format, ... )
 	{
@@ -480,162 +484,65 @@ private:
 	}
 	virtual ~_DDM() 
 	{
-		for( std::list< _O * >::iterator i = _Q.begin(); i != _Q.end(); i++ )
-		{
-		   delete *i;
-		}
-		_Q.clear();
 	}
-	struct _O
-	{
-		FLOAT duration;
-		_O( FLOAT duration ) : duration( duration ) {}
-		virtual ~_O() {}
-		virtual void Draw(  LPDIRECT3DDEVICE9 d3dd ) = 0;
-	};
-	std::list< _O * > _Q;
-	struct _LINE : public _O
-	{
-		D3DXVECTOR3 p0, p1;
-		D3DCOLOR c;
-		_LINE( CONST D3DXVECTOR3 &p0, CONST D3DXVECTOR3 &p1, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), p0( p0 ), p1( p1 ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
-		{
-			DrawLine( d3dd, p0, p1, c );
-		}
-	};
-	struct _TRIANGLE : public _O
-	{
-		D3DXVECTOR3 p0, p1, p2;
-		D3DCOLOR c;
-		_TRIANGLE( CONST D3DXVECTOR3 &p0, CONST D3DXVECTOR3 &p1, CONST D3DXVECTOR3 &p2, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), p0( p0 ), p1( p1 ), p2( p2 ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
-		{
-			DrawTriangle( d3dd, p0, p1, p2, c );
-		}
-	};
-	struct _CROSS : public _O
-	{
-		D3DXVECTOR3 p0;
-		FLOAT s;
-		D3DCOLOR c;
-		_CROSS( CONST D3DXVECTOR3 &p0, FLOAT s, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), p0( p0 ), s( s ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
-		{
-			DrawCross( d3dd, p0, s, c );
-		}
-	};
-	struct _CIRCLE : public _O
-	{
-		D3DXVECTOR3 p0, n;
-		FLOAT r;
-		D3DCOLOR c;
-		_CIRCLE( CONST D3DXVECTOR3 &p0, CONST D3DXVECTOR3 &n, FLOAT r, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), p0( p0 ), n( n ), r( r ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
-		{
-			DrawCircle( d3dd, p0, n, r, c );
-		}
-	};
-	struct _SPHERE : public _O
-	{
-		D3DXVECTOR3 p0;
-		FLOAT r;
-		D3DCOLOR c;
-		_SPHERE( CONST D3DXVECTOR3 &p0, FLOAT r, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), p0( p0 ), r( r ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
+	//描画要素は種類ごとの配列に追加し、DrawQで線分を1つの動的頂点バッファにまとめて描く(DebugDraw.h)
+	DebugDrawBatch _Q;
+	struct _BACKEND : public DebugDrawBackend
+	{
+		LPDIRECT3DDEVICE9 d3dd;
+		LPDIRECT3DVERTEXBUFFER9 vb;
+		UINT capacity;	//vbの頂点数
+		UINT max_lines;	//1回のDrawPrimitiveで描ける線分の数(D3DCAPS9::MaxPrimitiveCount)
+		_BACKEND() : d3dd( 0 ), vb( 0 ), capacity( 0 ), max_lines( 0 ) {}
+		virtual ~_BACKEND() { if( vb ) vb->Release(); }
+		void draw_lines( CONST DebugVertex *vertices, UINT count )
 		{
-			DrawSphere( d3dd, p0, r, c );
-		}
-	};
-	struct _PLANE : public _O
-	{
-		D3DXVECTOR3 n;
-		FLOAT d;
-		FLOAT s;
-		D3DCOLOR c;
-		_PLANE( CONST D3DXVECTOR3 &n, FLOAT d, FLOAT s, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), n( n ), d( d ), s( s ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
-		{
-			DrawPlane( d3dd, n, d, s, c );
-		}
-	};
-	struct _AABB : public _O
-	{
-		D3DXVECTOR3 min, max;
-		D3DCOLOR c;
-		_AABB( CONST D3DXVECTOR3 &min, CONST D3DXVECTOR3 &max, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), min( min ), max( max ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
-		{
-			DrawAABB( d3dd, min, max, c );
-		}
-	};
-	struct _OBB : public _O
-	{
-		D3DXMATRIX o;
-		D3DXVECTOR3 s;
-		D3DCOLOR c;
-		_OBB( CONST D3DXMATRIX &o, CONST D3DXVECTOR3 &s, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), o( o ), s( s ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
-		{
-			DrawOBB( d3dd, o, s, c );
-		}
-	};
-	struct _ARROW : public _O
-	{
-		D3DXVECTOR3 p0;
-		FLOAT yaw, pitch, roll;
-		FLOAT s;
-		D3DCOLOR c;
-		_ARROW( CONST D3DXVECTOR3 &p0, FLOAT yaw, FLOAT pitch, FLOAT roll, FLOAT s, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), p0( p0 ), yaw( yaw ), pitch( pitch ), roll( roll ), s( s ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
-		{
-			DrawArrow( d3dd, p0, yaw, pitch, roll, s, c );
+			//足りない場合は2倍ずつ大きくして作り直す(フレームごとには作らない)
+			if( count > capacity )
+			{
+				if( vb ) vb->Release();
+				vb = 0;
+				capacity = 0;
+				UINT n = 4096;
+				while( n < count ) n *= 2;
+				if( FAILED( d3dd->CreateVertexBuffer( n * sizeof( DebugVertex ), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, D3DFVF_XYZ | D3DFVF_DIFFUSE, D3DPOOL_DEFAULT, &vb, NULL ) ) ) return;
+				capacity = n;
+				D3DCAPS9 caps;
+				d3dd->GetDeviceCaps( &caps );
+				max_lines = caps.MaxPrimitiveCount;
+			}
+			void *p;
+			if( FAILED( vb->Lock( 0, count * sizeof( DebugVertex ), &p, D3DLOCK_DISCARD ) ) ) return;
+			memcpy( p, vertices, count * sizeof( DebugVertex ) );
+			vb->Unlock();
+
+			//頂点の色で描く(ライティングは切り、描いた後に戻す)
+			DWORD lighting;
+			d3dd->GetRenderState( D3DRS_LIGHTING, &lighting );
+			d3dd->SetRenderState( D3DRS_LIGHTING, FALSE );
+			d3dd->SetFVF( D3DFVF_XYZ | D3DFVF_DIFFUSE );
+			d3dd->SetStreamSource( 0, vb, 0, sizeof( DebugVertex ) );
+			d3dd->SetTransform( D3DTS_WORLD, &D3DXMATRIX( 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 ) );
+			//MaxPrimitiveCountを超える場合だけ分けて描く
+			for( UINT first = 0; first < count / 2; first += max_lines )
+			{
+				d3dd->DrawPrimitive( D3DPT_LINELIST, first * 2, count / 2 - first < max_lines ? count / 2 - first : max_lines );
+			}
+			d3dd->SetRenderState( D3DRS_LIGHTING, lighting );
 		}
-	};
-	struct _VECTOR : public _O
-	{
-		D3DXVECTOR3 v, p;
-		FLOAT r, h;
-		D3DCOLOR c;
-		_VECTOR( CONST D3DXVECTOR3 &v, CONST D3DXVECTOR3 &p, FLOAT r, FLOAT h, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), v( v ), p( p ), r( r ), h( h ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
+		void draw_point( CONST vec3 &p, FLOAT r, DebugColor c )
 		{
-			DrawVector( d3dd, v, p, r, h, c );
+			DrawPoint( d3dd, to_d3dx( p ), r, c );
 		}
-	};
-	struct _POINT : public _O
-	{
-		D3DXVECTOR3 p;
-		FLOAT r;
-		D3DCOLOR c;
-		_POINT( CONST D3DXVECTOR3 &p, FLOAT r, D3DCOLOR c, FLOAT duration )
-			: _O( duration ), p( p ), r( r ), c( c ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
+		void draw_vector( CONST vec3 &v, CONST vec3 &p, FLOAT r, FLOAT h, DebugColor c )
 		{
-			DrawPoint( d3dd, p, r, c );
+			DrawVector( d3dd, to_d3dx( v ), to_d3dx( p ), r, h, c );
 		}
-	};
-	struct _STRING : public _O
-	{
-		LONG x, y;
-		D3DCOLOR c;
-		std::string s;
-		_STRING( LONG x, LONG y, D3DCOLOR c, LPCSTR s, FLOAT duration ) : _O( duration ), x( x ), y( y ), c( c ), s( s ) {}
-		void Draw( LPDIRECT3DDEVICE9 d3dd )
+		void draw_string( INT x, INT y, CONST CHAR *s, DebugColor c )
 		{
-			DrawString( d3dd, x, y, s.c_str(), c );
+			DrawString( d3dd, x, y, s, c );
 		}
-	};
+	} _B;
 	struct _VB
 	{
 		LPDIRECT3DVERTEXBUFFER9 p;
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "PhysicsMath.h"
+
+//経過時間(実時間)を固定幅のステップに変換するステップ制御
+//
+//使い方:
+//	for (UINT n = timestep.advance(elapsed); n > 0; n--)
+//	{
+//		world.store_poses();
+//		for (UINT s = 0; s < timestep.substeps; s++) world.step(timestep.substep());
+//	}
+//	描画では alpha() で直前のステップと現在のステップの姿勢を補間する
+struct FixedTimestep
+{
+	FLOAT step;	//1ステップの時間幅(秒)
+	UINT substeps;	//1ステップあたりのサブステップ数
+	UINT max_steps;	//1回のadvanceで進める最大ステップ数(処理落ちで遅れが増え続けるのを防ぐ)
+	FLOAT accumulator;	//まだステップに変換していない経過時間
+	UINT dropped_steps;	//max_stepsを超えたため切り捨てたステップ数(累計)
+
+	FixedTimestep(FLOAT step = 1.0f / 60.0f, UINT substeps = 1, UINT max_steps = 5) :
+		step(step), substeps(substeps), max_steps(max_steps), accumulator(0), dropped_steps(0) {}
+
+	//経過時間を加え、今回進めるステップ数を返す
+	UINT advance(FLOAT elapsed)
+	{
+		accumulator += elapsed;
+		UINT steps = (UINT)(accumulator / step);
+		if (steps > max_steps)
+		{
+			//進められない分の時間は捨てる(シミュレーションは実時間より遅れる)
+			dropped_steps += steps - max_steps;
+			steps = max_steps;
+			accumulator = (FLOAT)steps * step;
+		}
+		accumulator -= (FLOAT)steps * step;
+		if (accumulator < 0) accumulator = 0;
+		return steps;
+	}
+	//サブステップの時間幅
+	FLOAT substep() const
+	{
+		return step / (FLOAT)substeps;
+	}
+	//直前のステップから現在時刻までの割合[0, 1)(描画時の姿勢の補間に使用する)
+	FLOAT alpha() const
+	{
+		return accumulator / step;
+	}
+};
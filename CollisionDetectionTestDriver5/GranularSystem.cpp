@@ -0,0 +1,414 @@
+#define NOMINMAX
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include "GranularSystem.h"
+
+static const FLOAT PI = 3.14159265f;
+//1つのジョブで処理する粒の数の下限(これより小さく分けるとジョブの分割と待ちの方が高くつく)
+static const UINT GRAINS_PER_JOB = 1024;
+
+GranularSystem::GranularSystem(FLOAT stiffness) :
+	stiffness(stiffness), tangential_stiffness(stiffness * 2 / 7), restitution(0.5f), friction(0.5f),
+	gravity(0, -9.8f, 0), jobs(0), cell_size(0)
+{
+}
+
+void GranularSystem::reserve(UINT n)
+{
+	for_each_array([n](FloatArray &a) { a.reserve(n); });
+	id.reserve(n);
+	springs.reserve((size_t)n * MAX_CONTACTS);
+}
+
+UINT GranularSystem::push(FLOAT r, FLOAT m, FLOAT inertia, const vec3 &p, const vec3 &v, const vec3 &w)
+{
+	assert(r > 0 && m > 0 && inertia > 0);
+	assert(springs.size() / MAX_CONTACTS < Spring::WALL);
+
+	radius.push_back(r);
+	//不動の粒(質量FLT_MAX)は逆数を0にする
+	inverse_mass.push_back(m < FLT_MAX ? 1.0f / m : 0);
+	inverse_inertia.push_back(inertia < FLT_MAX ? 1.0f / inertia : 0);
+	for (int k = 0; k < 3; k++)
+	{
+		position[k].push_back(p[k]);
+		velocity[k].push_back(v[k]);
+		angular_velocity[k].push_back(w[k]);
+	}
+
+	//idは生成順の番号(接触の履歴の位置)
+	UINT g = (UINT)(springs.size() / MAX_CONTACTS);
+	id.push_back(g);
+	Spring empty = { Spring::EMPTY, { 0, 0, 0 } };
+	springs.resize(springs.size() + MAX_CONTACTS, empty);
+	return g;
+}
+
+UINT GranularSystem::spawn(FLOAT r, FLOAT density, const vec3 &p, const vec3 &v)
+{
+	//慣性質量と慣性モーメントはSphereのコンストラクタと同じ
+	FLOAT m = 4.0f * 3.14159265358979f * r * r * r / 3.0f * density;
+	return push(r, m, 0.4f * m * r * r, p, v, vec3(0, 0, 0));
+}
+
+UINT GranularSystem::spawn(const Sphere &sphere)
+{
+	return push(sphere.r, sphere.inertial_mass, sphere.inertia_tensor.r[0].x, sphere.position, sphere.linear_velocity, sphere.angular_velocity);
+}
+
+void GranularSystem::clear()
+{
+	for_each_array([](FloatArray &a) { a.clear(); });
+	id.clear();
+	springs.clear();
+}
+
+FLOAT GranularSystem::stable_timestep() const
+{
+	//粒どうしの接触の換算質量は最小で最も軽い粒の半分、固有周期は2π * sqrt(換算質量 / ばね定数)
+	FLOAT m = FLT_MAX;
+	const UINT n = size();
+	for (UINT i = 0; i < n; i++)
+	{
+		if (inverse_mass[i] > 0) m = std::min(m, 1.0f / inverse_mass[i]);
+	}
+	if (m == FLT_MAX) return FLT_MAX;
+	FLOAT k = std::max(stiffness, tangential_stiffness * 3.5f);
+	return 2 * PI * sqrtf(0.5f * m / k) / 30;
+}
+
+void GranularSystem::build()
+{
+	const UINT n = size();
+
+	//セルの一辺は最大の粒の直径(接触する粒は必ず周囲27セルに入る)
+	FLOAT largest = 0;
+	for (UINT i = 0; i < n; i++)
+	{
+		largest = std::max(largest, radius[i]);
+	}
+	cell_size = 2 * largest;
+
+	//ハッシュ表の大きさは粒の数の2倍以上の2のべき乗
+	UINT table_size = 1;
+	while (table_size < 2 * n) table_size <<= 1;
+	cell_start.assign(table_size + 1, 0);
+	cell_of_grain.resize(n);
+	sorted.resize(n);
+
+	Pass hash;
+	hash.mask = table_size - 1;
+	const FLOAT inverse_cell = 1.0f / cell_size;
+	const FLOAT *px = position[0].data(), *py = position[1].data(), *pz = position[2].data();
+	UINT *cell = cell_of_grain.data();
+	parallel_for(jobs, n, GRAINS_PER_JOB, [&](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; i++)
+		{
+			cell[i] = hash.cell_hash((INT)floorf(px[i] * inverse_cell), (INT)floorf(py[i] * inverse_cell), (INT)floorf(pz[i] * inverse_cell));
+		}
+	});
+
+	//計数ソートで粒の番号をハッシュ表の番号順に並べる(SphFluid::buildと同じ)
+	for (UINT i = 0; i < n; i++)
+	{
+		cell_start[cell[i] + 1]++;
+	}
+	for (UINT c = 0; c < table_size; c++)
+	{
+		cell_start[c + 1] += cell_start[c];
+	}
+	for (UINT i = n; i > 0; i--)
+	{
+		UINT c = cell[i - 1];
+		sorted[--cell_start[c + 1]] = i - 1;
+	}
+	for (UINT c = 0; c < table_size; c++)
+	{
+		cell_start[c] = cell_start[c + 1];
+	}
+	cell_start[table_size] = n;
+
+	//粒の全ての配列とidをsortedの順に並べ替える(接触の履歴はidで引くため動かさない)
+	scratch.resize(n);
+	scratch_id.resize(n);
+	const UINT *order = sorted.data();
+	JobSystem *const job_system = jobs;
+	FloatArray &temporary = scratch;
+	for_each_array([order, n, job_system, &temporary](FloatArray &a)
+	{
+		const FLOAT *source = a.data();
+		FLOAT *destination = temporary.data();
+		parallel_for(job_system, n, GRAINS_PER_JOB, [&](UINT begin, UINT end)
+		{
+			for (UINT s = begin; s < end; s++)
+			{
+				destination[s] = source[order[s]];
+			}
+		});
+		a.swap(temporary);
+	});
+	for (UINT s = 0; s < n; s++)
+	{
+		scratch_id[s] = id[order[s]];
+	}
+	id.swap(scratch_id);
+}
+
+void GranularSystem::integrate(UINT begin, UINT end, FLOAT dt)
+{
+	//半陰的オイラー法(RigidBody::integrateと同じ順に速度、位置の順で更新する)
+	//球なので姿勢は持たず、角速度だけを更新する
+	const FLOAT *im = inverse_mass.data(), *ii = inverse_inertia.data();
+	for (int k = 0; k < 3; k++)
+	{
+		FLOAT *p = position[k].data(), *v = velocity[k].data(), *w = angular_velocity[k].data();
+		const FLOAT *f = force[k].data(), *t = torque[k].data();
+		const FLOAT g = gravity[k];
+		for (UINT i = begin; i < end; i++)
+		{
+			if (im[i] == 0) continue;
+			v[i] += (im[i] * f[i] + g) * dt;
+			p[i] += v[i] * dt;
+			w[i] += ii[i] * t[i] * dt;
+		}
+	}
+}
+
+void GranularSystem::step(FLOAT duration)
+{
+	assert(stiffness > 0 && tangential_stiffness >= 0);
+	const UINT n = size();
+	if (n == 0) return;
+
+	//平面の法線(姿勢で回転したy軸)と原点からの距離を求めておく(SphFluidと同じ)
+	wall_normal.resize(planes.size());
+	wall_offset.resize(planes.size());
+	wall_velocity.resize(planes.size());
+	for (size_t k = 0; k < planes.size(); k++)
+	{
+		wall_normal[k] = mat3_from_quat(planes[k]->orientation).r[1];
+		wall_offset[k] = dot(wall_normal[k], planes[k]->position);
+		wall_velocity[k] = planes[k]->linear_velocity;
+	}
+
+	//反発係数eから減衰比を求める(線形のばねとダッシュポットで、正面衝突の反発係数がeになる値)
+	FLOAT damping = 1;
+	if (restitution > 0)
+	{
+		FLOAT l = logf(std::min(restitution, 1.0f));
+		damping = -l / sqrtf(PI * PI + l * l);
+	}
+
+	const UINT substeps = std::max(1u, (UINT)ceilf(duration / stable_timestep()));
+	const FLOAT dt = duration / substeps;
+	for (int k = 0; k < 3; k++)
+	{
+		force[k].resize(n);
+		torque[k].resize(n);
+	}
+	for (UINT s = 0; s < substeps; s++)
+	{
+		//近傍探索(粒はハッシュ表の順に並び替わる)
+		build();
+
+		Pass pass;
+		for (int k = 0; k < 3; k++)
+		{
+			pass.position[k] = position[k].data();
+			pass.velocity[k] = velocity[k].data();
+			pass.angular_velocity[k] = angular_velocity[k].data();
+			pass.force[k] = force[k].data();
+			pass.torque[k] = torque[k].data();
+		}
+		pass.radius = radius.data();
+		pass.inverse_mass = inverse_mass.data();
+		pass.id = id.data();
+		pass.springs = springs.data();
+		pass.cell_start = cell_start.data();
+		pass.mask = (UINT)cell_start.size() - 2;
+		pass.inverse_cell = 1.0f / cell_size;
+		pass.dt = dt;
+		pass.stiffness = stiffness;
+		pass.tangential_stiffness = tangential_stiffness;
+		pass.friction = friction;
+		pass.damping = damping;
+		pass.wall_normal = wall_normal.data();
+		pass.wall_offset = wall_offset.data();
+		pass.wall_velocity = wall_velocity.data();
+		pass.wall_count = (UINT)wall_normal.size();
+
+		//全ての粒の力を求めてから進める(力のパスは近傍の粒の位置と速度を参照するため、パスごとに全てのジョブを待つ)
+		parallel_for(jobs, n, GRAINS_PER_JOB, [&](UINT begin, UINT end) { granular_force(pass, begin, end); });
+		parallel_for(jobs, n, GRAINS_PER_JOB, [&](UINT begin, UINT end) { integrate(begin, end, dt); });
+	}
+}
+
+//粒iの近傍の粒の範囲[ranges[r][0], ranges[r][1])を求め、範囲の数(最大27)を返す(SphFluidと同じ)
+static inline UINT neighbour_ranges(const GranularSystem::Pass &pass, UINT i, UINT (*ranges)[2])
+{
+	//周囲27セルを、x方向に並ぶ3セルずつ(ハッシュ表で連続する範囲)9列に分けて探す
+	INT cx = (INT)floorf(pass.position[0][i] * pass.inverse_cell), cy = (INT)floorf(pass.position[1][i] * pass.inverse_cell), cz = (INT)floorf(pass.position[2][i] * pass.inverse_cell);
+	UINT rows[9];
+	UINT row_count = 0;
+	for (INT z = cz - 1; z <= cz + 1; z++)
+	for (INT y = cy - 1; y <= cy + 1; y++)
+	{
+		rows[row_count++] = pass.cell_hash(cx - 1, y, z);
+	}
+	UINT count = 0;
+	for (UINT r = 0; r < 9; r++)
+	{
+		//ハッシュの衝突で前の列と範囲が重なる場合と、表の末尾で折り返す場合は、セルごとに重複を除く
+		bool overlapped = rows[r] + 2 > pass.mask;
+		for (UINT q = 0; q < r; q++)
+		{
+			if (((rows[r] - rows[q] + 2) & pass.mask) <= 4) overlapped = true;
+		}
+		if (!overlapped)
+		{
+			ranges[count][0] = pass.cell_start[rows[r]];
+			ranges[count][1] = pass.cell_start[rows[r] + 3];
+			if (ranges[count][0] < ranges[count][1]) count++;
+			continue;
+		}
+		for (UINT b = 0; b < 3; b++)
+		{
+			UINT c = (rows[r] + b) & pass.mask;
+			bool duplicated = false;
+			for (UINT q = 0; q < r; q++)
+			{
+				if (((c - rows[q]) & pass.mask) <= 2) duplicated = true;
+			}
+			if (duplicated || pass.cell_start[c] == pass.cell_start[c + 1]) continue;
+			ranges[count][0] = pass.cell_start[c];
+			ranges[count][1] = pass.cell_start[c + 1];
+			count++;
+		}
+	}
+	return count;
+}
+
+//1つの接触の力を求めてf,tauに加え、接線方向のばねの変位を履歴に記録する
+//normalは相手から粒へ向かう単位ベクトル、relativeは接触点での相手に対する粒の速度、armは粒の中心から接触点へのベクトル
+static inline void add_contact(const GranularSystem::Pass &pass, const vec3 &normal, FLOAT overlap, const vec3 &relative,
+	FLOAT reduced_mass, UINT partner, const GranularSystem::Spring *previous, GranularSystem::Spring *history, UINT *stored,
+	const vec3 &arm, vec3 *f, vec3 *tau)
+{
+	const FLOAT kn = pass.stiffness, kt = pass.tangential_stiffness;
+	FLOAT vn = dot(relative, normal);
+	vec3 vt = relative - vn * normal;
+
+	//法線方向:ばねとダッシュポット(離れる向きの力だけを加え、引き合わない)
+	FLOAT fn = kn * overlap - 2 * pass.damping * sqrtf(kn * reduced_mass) * vn;
+	if (fn < 0) fn = 0;
+
+	//接線方向:前回の変位を今回の接平面に回して(長さは保つ)、接線方向の相対速度で伸ばす
+	vec3 s(0, 0, 0);
+	for (UINT k = 0; k < GranularSystem::MAX_CONTACTS; k++)
+	{
+		if (previous[k].partner == partner)
+		{
+			s = vec3(previous[k].displacement[0], previous[k].displacement[1], previous[k].displacement[2]);
+			FLOAT length = ::length(s);
+			s -= dot(s, normal) * normal;
+			FLOAT projected = ::length(s);
+			if (projected > FLT_EPSILON * length) s *= length / projected;
+			break;
+		}
+	}
+	s += pass.dt * vt;
+	FLOAT gt = 2 * pass.damping * sqrtf(kt * reduced_mass);
+	vec3 ft = -kt * s - gt * vt;
+
+	//クーロン摩擦:接線方向の力がfriction * fnを超える場合は滑り、ばねの変位を摩擦力に釣り合う長さに縮める
+	FLOAT limit = pass.friction * fn;
+	FLOAT ft2 = length_sq(ft);
+	if (ft2 > limit * limit)
+	{
+		ft *= limit / sqrtf(ft2);
+		s = kt > 0 ? -(ft + gt * vt) / kt : vec3(0, 0, 0);
+	}
+
+	*f += fn * normal + ft;
+	vec3 t;
+	t = cross(arm, ft);
+	*tau += t;
+
+	if (*stored < GranularSystem::MAX_CONTACTS)
+	{
+		GranularSystem::Spring &spring = history[(*stored)++];
+		spring.partner = partner;
+		spring.displacement[0] = s.x;
+		spring.displacement[1] = s.y;
+		spring.displacement[2] = s.z;
+	}
+}
+
+void granular_force(const GranularSystem::Pass &pass, UINT begin, UINT end)
+{
+	const UINT M = GranularSystem::MAX_CONTACTS;
+	const FLOAT *px = pass.position[0], *py = pass.position[1], *pz = pass.position[2];
+	UINT ranges[27][2];
+	GranularSystem::Spring previous[M];
+	for (UINT i = begin; i < end; i++)
+	{
+		//粒iの履歴は前回の分を写してから上書きする(履歴は粒ごとに自分の分だけを書き込む)
+		GranularSystem::Spring *history = pass.springs + (size_t)pass.id[i] * M;
+		memcpy(previous, history, sizeof(previous));
+		UINT stored = 0;
+
+		const vec3 p(px[i], py[i], pz[i]);
+		const vec3 v(pass.velocity[0][i], pass.velocity[1][i], pass.velocity[2][i]);
+		const vec3 w(pass.angular_velocity[0][i], pass.angular_velocity[1][i], pass.angular_velocity[2][i]);
+		const FLOAT r = pass.radius[i], im = pass.inverse_mass[i];
+		vec3 f(0, 0, 0), tau(0, 0, 0);
+
+		const UINT range_count = neighbour_ranges(pass, i, ranges);
+		for (UINT q = 0; q < range_count; q++)
+		{
+			for (UINT j = ranges[q][0]; j < ranges[q][1]; j++)
+			{
+				const FLOAT reach = r + pass.radius[j];
+				vec3 d(p.x - px[j], p.y - py[j], p.z - pz[j]);
+				FLOAT l2 = length_sq(d);
+				if (l2 >= reach * reach || j == i) continue;
+				const FLOAT inverse_sum = im + pass.inverse_mass[j];
+				if (inverse_sum == 0) continue;
+
+				//collide_sphere_sphereと同じく、法線は相手から粒へ向かい、重なりはreach - 距離
+				FLOAT l = sqrtf(l2);
+				vec3 n = l > 0 ? d / l : vec3(0, 1, 0);
+				vec3 arm = -r * n, other_arm = pass.radius[j] * n, spin, other_spin;
+				const vec3 wj(pass.angular_velocity[0][j], pass.angular_velocity[1][j], pass.angular_velocity[2][j]);
+				spin = cross(w, arm);
+				other_spin = cross(wj, other_arm);
+				vec3 relative = v + spin - vec3(pass.velocity[0][j], pass.velocity[1][j], pass.velocity[2][j]) - other_spin;
+				add_contact(pass, n, reach - l, relative, 1.0f / inverse_sum, pass.id[j], previous, history, &stored, arm, &f, &tau);
+			}
+		}
+		if (im > 0)
+		{
+			for (UINT k = 0; k < pass.wall_count; k++)
+			{
+				//平面の裏側は全て壁の中とみなす(SphFluidの境界と同じ)
+				const vec3 &n = pass.wall_normal[k];
+				FLOAT distance = dot(n, p) - pass.wall_offset[k];
+				if (distance >= r) continue;
+				vec3 arm = -r * n, spin;
+				spin = cross(w, arm);
+				vec3 relative = v + spin - pass.wall_velocity[k];
+				add_contact(pass, n, r - distance, relative, 1.0f / im, GranularSystem::Spring::WALL | k, previous, history, &stored, arm, &f, &tau);
+			}
+		}
+		for (UINT k = stored; k < M; k++)
+		{
+			history[k].partner = GranularSystem::Spring::EMPTY;
+		}
+
+		pass.force[0][i] = f.x; pass.force[1][i] = f.y; pass.force[2][i] = f.z;
+		pass.torque[0][i] = tau.x; pass.torque[1][i] = tau.y; pass.torque[2][i] = tau.z;
+	}
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+#include "AlignedAllocator.h"
+#include "RigidBody.h"
+#include "JobSystem.h"
+
+//球体の粒と不動の平面だけを扱う、粒状体(砂・粉体など)向けの個別要素法(DEM)のソルバー
+//接触はインパルスで解かずに、重なりに応じた力(ソフトコンタクト)として求める
+//・法線方向:ばね(stiffness * 重なり)とダッシュポット(反発係数から求める減衰)
+//・接線方向:接触が続く間の接線方向の変位を履歴として保持するばねとダッシュポットで、クーロン摩擦(friction * 法線力)で頭打ちにする
+//接触の幾何(法線・重なり・接触点)はcollide_sphere_sphere、collide_sphere_planeと同じ(平面は裏側を全て壁の中とみなす)
+//
+//粒は成分ごとの配列(SoA)で保持し、stepのたびに近傍探索の格子(ParticleCollisionと同じハッシュ表)の順に並べ替える
+//力のパスは粒ごとに自分の力・トルク・接触の履歴だけを書き込む(接触の組の力は両方の粒で1回ずつ求める)ため、
+//範囲ごとにジョブに分けて並列に処理しても結果はスレッド数によらない
+//粒の番号はstepで並べ替えられるため、粒を識別し続ける場合はidを使う
+struct GranularSystem
+{
+	typedef std::vector<FLOAT, AlignedAllocator<FLOAT, 32> > FloatArray;
+
+	//粒の状態
+	FloatArray position[3];	//位置(x, y, z)
+	FloatArray velocity[3];	//並進速度
+	FloatArray angular_velocity[3];	//角速度
+	FloatArray radius;	//半径
+	FloatArray inverse_mass;	//慣性質量の逆数(不動の粒は0)
+	FloatArray inverse_inertia;	//慣性モーメントの逆数(球なので1成分)
+	std::vector<UINT> id;	//spawnで返した番号(stepで粒と一緒に並べ替える)
+
+	//接触のパラメータ
+	FLOAT stiffness;	//法線方向のばね定数
+	FLOAT tangential_stiffness;	//接線方向のばね定数
+	FLOAT restitution;	//反発係数(法線方向と接線方向のダッシュポットの減衰比を決める)
+	FLOAT friction;	//クーロン摩擦係数
+	vec3 gravity;	//重力加速度
+	JobSystem *jobs;	//並列に処理するジョブシステム(0の場合は呼び出し元のスレッドで処理する)
+
+	//境界の平面(粒の外で管理し、stepの間は変更しない)
+	std::vector<const Plane *> planes;
+
+	GranularSystem(FLOAT stiffness = 1e5f);
+
+	UINT size() const
+	{
+		return (UINT)radius.size();
+	}
+	//配列の容量を確保する(spawnでの再確保を避ける)
+	void reserve(UINT n);
+
+	//半径r、密度densityの粒を追加し、そのidを返す(Sphereのコンストラクタと同じ質量・慣性モーメント)
+	UINT spawn(FLOAT r, FLOAT density, const vec3 &p, const vec3 &v = vec3(0, 0, 0));
+	//球体の剛体と同じ状態(位置・速度・角速度・半径・質量)の粒を追加し、そのidを返す(inertial_mass == FLT_MAXの場合は不動の粒)
+	UINT spawn(const Sphere &sphere);
+	void clear();
+
+	vec3 get_position(UINT i) const { return vec3(position[0][i], position[1][i], position[2][i]); }
+	vec3 get_velocity(UINT i) const { return vec3(velocity[0][i], velocity[1][i], velocity[2][i]); }
+	vec3 get_angular_velocity(UINT i) const { return vec3(angular_velocity[0][i], angular_velocity[1][i], angular_velocity[2][i]); }
+
+	//ばねの振動を安定して積分できる時間刻み(最も軽い粒の固有周期の1/30程度)
+	FLOAT stable_timestep() const;
+
+	//durationだけ進める(stable_timestep以下の時間刻みに分割し、近傍探索・力・インテグレーションの順に処理する)
+	//粒は近傍探索の格子の順に並べ替えられる
+	void step(FLOAT duration);
+
+	//粒ごとに保持する接触の履歴の数(これを超えた接触は接線方向のばねを持たずに毎回0から始める)
+	static const UINT MAX_CONTACTS = 12;
+
+	//接触の相手のidごとの接線方向のばねの変位
+	//相手が平面の場合はWALL | 平面の番号、空きはEMPTY
+	struct Spring
+	{
+		enum { WALL = 0x80000000u, EMPTY = 0xffffffffu };
+		UINT partner;
+		FLOAT displacement[3];
+	};
+
+	//力のパスが参照する配列と定数(配列は全てハッシュ表の順に並べ替えた後のもの)
+	struct Pass
+	{
+		const FLOAT *position[3];
+		const FLOAT *velocity[3];
+		const FLOAT *angular_velocity[3];
+		const FLOAT *radius;
+		const FLOAT *inverse_mass;
+		const UINT *id;
+		Spring *springs;	//idごとにMAX_CONTACTS個
+		FLOAT *force[3];
+		FLOAT *torque[3];
+		const UINT *cell_start;	//ハッシュ表の番号ごとの粒の開始位置(末尾に番兵を持つ)
+		UINT mask;	//ハッシュ表の大きさ - 1
+		FLOAT inverse_cell;
+		FLOAT dt;
+		FLOAT stiffness, tangential_stiffness, friction;
+		FLOAT damping;	//減衰比(ダッシュポットの係数は2 * damping * sqrt(ばね定数 * 換算質量))
+
+		//平面の法線、原点からの距離、速度
+		const vec3 *wall_normal;
+		const FLOAT *wall_offset;
+		const vec3 *wall_velocity;
+		UINT wall_count;
+
+		UINT cell_hash(INT x, INT y, INT z) const
+		{
+			return (((UINT)y * 19349663u ^ (UINT)z * 83492791u) + (UINT)x) & mask;
+		}
+	};
+
+private:
+	FloatArray force[3];	//力のパスで求めた力
+	FloatArray torque[3];	//力のパスで求めたトルク
+	std::vector<Spring> springs;	//接触の履歴(idごとにMAX_CONTACTS個、粒の並べ替えでは動かさない)
+
+	std::vector<UINT> cell_of_grain;	//粒ごとのハッシュ表の番号
+	std::vector<UINT> cell_start;
+	std::vector<UINT> sorted;	//ハッシュ表の番号順に並べた粒の番号
+	FloatArray scratch;	//並べ替えの作業用の配列
+	std::vector<UINT> scratch_id;
+	FLOAT cell_size;	//近傍探索のセルの一辺(最大の粒の直径)
+
+	std::vector<vec3> wall_normal;
+	std::vector<FLOAT> wall_offset;
+	std::vector<vec3> wall_velocity;
+
+	UINT push(FLOAT r, FLOAT m, FLOAT inertia, const vec3 &p, const vec3 &v, const vec3 &w);
+	void build();
+	void integrate(UINT begin, UINT end, FLOAT dt);
+
+	template <typename F> void for_each_array(F f)
+	{
+		f(radius);
+		f(inverse_mass);
+		f(inverse_inertia);
+		for (int k = 0; k < 3; k++)
+		{
+			f(position[k]);
+			f(velocity[k]);
+			f(angular_velocity[k]);
+		}
+	}
+};
+
+//粒[begin, end)が近傍の粒と平面から受ける力とトルクを求め、接触の履歴を更新する
+void granular_force(const GranularSystem::Pass &pass, UINT begin, UINT end);
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "../RigidWorld.h"
+
+//physics_headlessで実行するシーン(描画を持たず、RigidWorldに剛体を配置するだけ)
+//重力は実行側がステップごとに全ての可動オブジェクトに加える(CollisionDetectionTestDriver::Stepと同じ)
+struct HeadlessScene
+{
+	const char *name;
+	const char *description;
+	UINT default_count;	//剛体数を指定しない場合の剛体数(0の場合は剛体数を変えられない)
+	//count個の可動オブジェクトを配置する(sizeはシーンごとの大きさ:塔の高さ、ピラミッドの底辺の個数、0の場合は既定値)
+	void (*build)(RigidWorld *world, UINT count, UINT size);
+	//ステップごとに重力を加える前に呼ぶ(count, sizeはbuildと同じ、0の場合は呼ばない)
+	void (*update)(RigidWorld *world, UINT count, UINT size);
+};
+
+//塔の高さとピラミッドの底辺の既定値
+static const UINT DEFAULT_SCENE_SIZE = 10;
+
+//CollisionDetectionTestDriverと同じ配置(球体3個・直方体3個・平面1枚、平面は傾けない)
+inline void build_driver_scene(RigidWorld *world, UINT, UINT)
+{
+	world->restitution = 0.4f;
+	world->solver_budget = 500;
+	world->solver_focus_distance = 20;
+	world->solver_focus = vec3(10, 20, -15) * 2.5f;
+
+	for (int i = 0; i < 3; i++)
+	{
+		world->body(world->create_sphere(2, 0.1f)).set_position(vec3(1, 10.0f + 10 * i, 0));
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		world->body(world->create_box(vec3(2.0f, 2.0f, 2.0f), 0.1f)).set_position(vec3(5, 5.0f + 10 * i, 10));
+	}
+	world->create_plane(vec3(0, 1, 0), -2);
+	world->store_poses();
+}
+
+//床の平面の上に球体と直方体を交互にcount個、格子状に積む(JobBenchmarkと同じ配置)
+inline void build_grid_scene(RigidWorld *world, UINT count, UINT)
+{
+	world->restitution = 0.4f;
+	world->solver_budget = 500;
+
+	world->create_plane(vec3(0, 1, 0), 0);
+	const UINT side = (UINT)ceilf(sqrtf((FLOAT)count / 4));
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT x = i % side, z = i / side % side, y = i / (side * side);
+		RigidBodyRef body = world->body(i % 2 == 0 ?
+			world->create_sphere(0.5f, 1) :
+			world->create_box(vec3(0.5f, 0.5f, 0.5f), 1));
+		body.set_position(vec3(x * 1.5f + 0.1f * (y % 3), 0.6f + y * 1.2f, z * 1.5f));
+	}
+	world->store_poses();
+}
+
+//以下のシーンは10～100000個程度まで剛体数を変えて、規模に対する時間とメモリの変化を計測する(physics_headless --sweep)
+//塔やピラミッドは正方形の格子状に並べ、剛体数が1つ分に満たない端数は最後の1つを下の段から途中まで積む
+
+//高さsizeの直方体の塔を並べる
+inline void build_tower_scene(RigidWorld *world, UINT count, UINT size)
+{
+	const UINT height = size ? size : DEFAULT_SCENE_SIZE;
+	world->restitution = 0.0f;
+	world->solver_budget = 500;
+
+	world->create_plane(vec3(0, 1, 0), 0);
+	const UINT towers = (count + height - 1) / height;
+	const UINT side = (UINT)ceilf(sqrtf((FLOAT)towers));
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT tower = i / height, level = i % height;
+		RigidBodyRef body = world->body(world->create_box(vec3(0.5f, 0.5f, 0.5f), 1));
+		body.set_position(vec3((tower % side) * 3.0f, 0.5f + level * 1.01f, (tower / side) * 3.0f));
+	}
+	world->store_poses();
+}
+
+//底辺がsize個の直方体のピラミッド(xy平面内の三角形、1段ごとに1個ずつ減らし半個分ずらして積む)を並べる
+inline void build_pyramid_scene(RigidWorld *world, UINT count, UINT size)
+{
+	const UINT base = size ? size : DEFAULT_SCENE_SIZE;
+	const UINT per_pyramid = base * (base + 1) / 2;
+	world->restitution = 0.0f;
+	world->solver_budget = 500;
+
+	world->create_plane(vec3(0, 1, 0), 0);
+	const UINT pyramids = (count + per_pyramid - 1) / per_pyramid;
+	const UINT side = (UINT)ceilf(sqrtf((FLOAT)pyramids));
+	const FLOAT spacing = base * 1.05f + 2.0f;
+	for (UINT p = 0, placed = 0; p < pyramids; p++)
+	{
+		const FLOAT x0 = (p % side) * spacing, z0 = (p / side) * 3.0f;
+		for (UINT level = 0; level < base && placed < count; level++)
+		{
+			for (UINT k = 0; k < base - level && placed < count; k++, placed++)
+			{
+				RigidBodyRef body = world->body(world->create_box(vec3(0.5f, 0.5f, 0.5f), 1));
+				body.set_position(vec3(x0 + (k + 0.5f * level) * 1.05f, 0.5f + level * 1.01f, z0));
+			}
+		}
+	}
+	world->store_poses();
+}
+
+//平面の上の正方形の範囲(剛体数に比例する面積)に、高さをずらした球体をcount個降らせる
+inline void build_rain_scene(RigidWorld *world, UINT count, UINT)
+{
+	world->restitution = 0.4f;
+	world->solver_budget = 500;
+
+	world->create_plane(vec3(0, 1, 0), 0);
+	//球はまとめて生成してから配置する
+	std::vector<RigidBodyHandle> spheres(count);
+	if (count > 0) world->create_spheres(count, 0.5f, 1, &spheres[0]);
+	const FLOAT extent = 2.0f * sqrtf((FLOAT)count);
+	UINT seed = 12345;
+	for (UINT i = 0; i < count; i++)
+	{
+		FLOAT r[3];
+		for (int k = 0; k < 3; k++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			r[k] = (seed >> 8) / 16777216.0f;
+		}
+		RigidBodyRef body = world->body(spheres[i]);
+		body.set_position(vec3(r[0] * extent, 2.0f + r[1] * 30.0f, r[2] * extent));
+	}
+	world->store_poses();
+}
+
+//雪崩のシーンの斜面の範囲(x, zとも-AVALANCHE_MARGIN～avalanche_length + AVALANCHE_MARGIN、原点を通る平面の上)
+//剛体を積む範囲(x, zとも0～avalanche_length)の1列外側まで
+static const FLOAT AVALANCHE_MARGIN = 1.2f;
+inline FLOAT avalanche_length(UINT count)
+{
+	return ceilf(sqrtf((FLOAT)count / 4)) * 1.2f;
+}
+//斜面の姿勢(CollisionDetectionTestDriverのW/Sキーと同じ向き(ピッチ)に傾ける)と法線
+inline vec3 avalanche_slope(quat *orientation)
+{
+	*orientation = quat_from_yaw_pitch_roll(0, 0.4f, 0);
+	//回転行列の2行目がローカルのY軸
+	return mat3_from_quat(*orientation).r[1];
+}
+
+//傾けた平面の上に、球体と直方体を交互に格子状に積んで滑り落とす
+//平面は無限に続くため、斜面の範囲から出た剛体はupdate_avalanche_sceneで取り除く(取り除かないと際限なく加速し、範囲も広がり続ける)
+inline void build_avalanche_scene(RigidWorld *world, UINT count, UINT)
+{
+	world->restitution = 0.2f;
+	world->solver_budget = 500;
+
+	RigidBodyRef plane = world->body(world->create_plane(vec3(0, 1, 0), 0));
+	quat orientation;
+	const vec3 n = avalanche_slope(&orientation);
+	plane.set_orientation(orientation);
+
+	const UINT side = (UINT)ceilf(sqrtf((FLOAT)count / 4));
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT x = i % side, z = i / side % side, y = i / (side * side);
+		RigidBodyRef body = world->body(i % 2 == 0 ?
+			world->create_sphere(0.5f, 1) :
+			world->create_box(vec3(0.5f, 0.5f, 0.5f), 1));
+		//平面(原点を通る)の上の高さに積む
+		const FLOAT px = x * 1.2f, pz = z * 1.2f;
+		const FLOAT ground = -(n.x * px + n.z * pz) / n.y;
+		body.set_position(vec3(px, ground + 0.8f + y * 1.2f, pz));
+	}
+	//取り除いた剛体のハンドル番号の表も、ステップの中で確保し直さないようにする
+	world->reserve(world->size());
+	world->store_poses();
+}
+
+//斜面の範囲から出た可動オブジェクトと、斜面の下に抜けた可動オブジェクトを取り除く(位置が有限でない剛体は取り除かない)
+inline void update_avalanche_scene(RigidWorld *world, UINT count, UINT)
+{
+	quat orientation;
+	const vec3 n = avalanche_slope(&orientation);
+	const FLOAT low = -AVALANCHE_MARGIN, high = avalanche_length(count) + AVALANCHE_MARGIN;
+	for (UINT i = world->size(); i-- > 0;)
+	{
+		if (world->inverse_mass[i] == 0) continue;
+		const FLOAT x = world->position[0][i], y = world->position[1][i], z = world->position[2][i];
+		if (x < low || x > high || z < low || z > high || n.x * x + n.y * y + n.z * z < -AVALANCHE_MARGIN) world->destroy(world->handle(i));
+	}
+}
+
+static const HeadlessScene headless_scenes[] =
+{
+	{ "driver", "CollisionDetectionTestDriver (3 spheres, 3 boxes, 1 plane)", 0, build_driver_scene, 0 },
+	{ "grid", "spheres and boxes stacked in a grid on a plane", 1000, build_grid_scene, 0 },
+	{ "tower", "box towers of height size (default 10)", 1000, build_tower_scene, 0 },
+	{ "pyramid", "box pyramids with size boxes at the base (default 10)", 1000, build_pyramid_scene, 0 },
+	{ "rain", "spheres falling onto a plane", 1000, build_rain_scene, 0 },
+	{ "avalanche", "spheres and boxes sliding off a bounded tilted plane (removed when they leave it)", 1000, build_avalanche_scene, update_avalanche_scene },
+};
+static const UINT headless_scene_count = sizeof(headless_scenes) / sizeof(headless_scenes[0]);
+
+//名前でシーンを探す(見つからない場合は0)
+inline const HeadlessScene *find_headless_scene(const char *name)
+{
+	for (UINT i = 0; i < headless_scene_count; i++)
+	{
+		if (strcmp(headless_scenes[i].name, name) == 0) return &headless_scenes[i];
+	}
+	return 0;
+}
@@ -0,0 +1,668 @@
+//描画なしでシーンを固定のステップ幅で実行し、スループットとフェーズごとの時間を出力する(ビルドサーバーでの定期計測用)
+//
+//使い方:physics_headless [--scene 名前|all] [--steps ステップ数] [--dt ステップ幅] [--count 剛体数] [--size 大きさ] [--threads スレッド数]
+//                        [--deterministic] [--no-phases] [--profile] [--counters] [--trace 出力ファイル]
+//                        [--allocations] [--zero-alloc] [--warmup ステップ数] [--debug-draw 種類,...] [--list]
+//        physics_headless --sweep [--scene 名前|all] [--counts 10,100,...] [--csv 出力ファイル] (その他のオプションは上と同じ)
+//
+//シーンごとに2回実行する
+//・stepの計測:RigidWorld::stepを繰り返し、steps/sとbodies*steps/s(剛体数×ステップ数/秒)を求める(jobsによる並列実行を含む)
+//・フェーズの計測:同じシーンを作り直し、stepと同じ順にintegrate → update_transforms → update_bounds → broadphase →
+//  generate_contacts → resolve_contactsを1つずつ呼んで、フェーズごとの時間を求める
+//  (integrate・update_transforms・update_boundsは呼び出し元のスレッドで実行するため、合計はstepの時間より長くなることがある)
+//--deterministicを指定した場合は、2回の実行の最後の状態のハッシュが一致することを確認し、一致しない場合は終了コード1を返す
+//どちらの実行も、ステップごとに全ての剛体の位置・姿勢・速度・角速度が有限であることを確認し、有限でなくなった場合は
+//そのステップと剛体番号を出力してそのシーンの実行を打ち切り、終了コード1を返す(--sweepも同じ)
+//
+//--sweepは剛体数を変えられるシーンを剛体数(--counts、既定は10～100000)ごとにstepの計測だけ行い、
+//ms/step・contacts/step・ピークメモリを剛体数に対する表(--csvを指定した場合はCSVファイルにも)で出力する
+//剛体を取り除くシーン(avalanche)では剛体数がステップごとに減るため、作った直後の剛体数(bodies)に加えてステップごとの剛体数の平均(avg bodies)も出力する
+//(剛体数に対する変化はavg bodiesに対して見る)
+//ピークメモリはプロセスの最大の常駐メモリ(Linuxでは計測ごとに/proc/self/clear_refsで直前の値まで戻す)で、
+//シーンの作成を含む(以前の計測で確保して解放したメモリがプロセスに残っている場合は、その分も含む)
+//
+//--profileはstepの計測の間Profilerを有効にし、PROFILE_SCOPEの区間ごとの1ステップあたりの回数と時間(平均・中央値・99パーセンタイル)を出力する
+//--countersはハードウェアカウンタ(Linuxのperf_event_open)も区間ごとに記録し、1ステップあたりの命令数とIPC、
+//剛体1個(接触を扱う区間では接触1個)あたりのキャッシュミス・分岐予測ミスを出力する(--profileを含む、カウンタを開けない環境では理由を表示して時間だけを計測する)
+//--allocationsはメモリ確保(AllocationTracker)を数え、ステップあたりとフェーズごとの確保の回数・バイト数を出力する
+//(--profileと合わせて指定した場合は区間ごとにも出力する)
+//--zero-allocは--allocationsに加えて、ウォームアップ(--warmup、既定は300ステップ)の後のステップで1回でも確保した場合に終了コード1を返す
+//(stepの計測とフェーズの計測のどちらも調べる)
+//--traceはstepの計測の区間をChromeのトレースの形式(chrome://tracingやPerfettoで開く)でファイルに出力する(--profileを含む)
+//--debug-drawはstepの計測の間、指定した種類(contacts, aabbs, islands, bvh, allのカンマ区切り)のデバッグ表示を各スレッドで記録し、
+//ステップごとにまとめて(DebugDrawRecorder::merge)NullDebugDrawBackendで描き、1ステップあたりの要素数・頂点数・描画呼び出しの回数と
+//まとめて描く時間(ステップの時間には含めない)を出力する
+#define NOMINMAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include "HeadlessScenes.h"
+#include "Profiler.h"
+#include "DebugDraw.h"
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed_ms(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+//プロセスの最大の常駐メモリ(ピークメモリ)の記録を現在の値まで戻す(戻せない環境では何もしない)
+static void reset_peak_memory()
+{
+#if defined(__linux__)
+	FILE *file = fopen("/proc/self/clear_refs", "w");
+	if (file)
+	{
+		fputs("5", file);
+		fclose(file);
+	}
+#endif
+}
+
+//プロセスの最大の常駐メモリ(MB、取得できない場合は負の値)
+static double peak_memory_mb()
+{
+#if defined(__linux__)
+	FILE *file = fopen("/proc/self/status", "r");
+	if (!file) return -1;
+	char line[256];
+	double kb = -1;
+	while (fgets(line, sizeof(line), file))
+	{
+		if (strncmp(line, "VmHWM:", 6) == 0) kb = atof(line + 6);
+	}
+	fclose(file);
+	return kb < 0 ? -1 : kb / 1024;
+#elif defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return -1;
+	return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	return -1;
+#endif
+}
+
+struct Options
+{
+	const char *scene;
+	UINT steps;
+	FLOAT duration;
+	UINT count;	//0の場合はシーンの既定値
+	UINT size;	//0の場合はシーンの既定値
+	UINT threads;
+	BOOL deterministic;
+	BOOL phases;
+	BOOL sweep;
+	BOOL profile;
+	BOOL counters;
+	BOOL allocations;
+	BOOL zero_alloc;
+	UINT warmup;	//確保を調べないはじめのステップ数
+	const char *trace;	//--traceの出力ファイル
+	UINT debug_draw;	//--debug-drawで記録する種類(DEBUG_DRAW_CATEGORYの組み合わせ)
+	std::vector<UINT> counts;	//--sweepの剛体数
+	const char *csv;
+};
+
+//全ての可動オブジェクトに重力を加える
+static void apply_gravity(RigidWorld *world)
+{
+	const vec3 g(0, -9.8f, 0);
+	for (UINT i = 0; i < world->size(); i++)
+	{
+		if (world->inverse_mass[i] == 0) continue;
+		RigidBodyRef body = world->body(world->handle(i));
+		body.add_force(body.inertial_mass() * g);
+	}
+}
+
+//位置・姿勢・速度・角速度のどれかが有限でない最初の剛体番号(全て有限の場合は-1)
+static INT nonfinite_body(const RigidWorld &world)
+{
+	for (UINT i = 0; i < world.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			if (!isfinite(world.position[k][i]) || !isfinite(world.linear_velocity[k][i]) || !isfinite(world.angular_velocity[k][i])) return (INT)i;
+		}
+		for (int k = 0; k < 4; k++)
+		{
+			if (!isfinite(world.orientation[k][i])) return (INT)i;
+		}
+	}
+	return -1;
+}
+
+//stepの計測の結果
+struct StepStats
+{
+	UINT bodies;	//シーンを作った直後の剛体数
+	double body_steps;	//ステップごとの剛体数の合計(剛体を取り除くシーンでは剛体数がステップごとに減る)
+	double total_ms;
+	double max_step_ms;	//最も遅かったステップ
+	double contacts_per_step;
+	double peak_memory_mb;	//取得できない場合は負の値
+	AllocationCounts allocations;	//全てのステップの確保(--allocations)
+	AllocationCounts steady_allocations;	//ウォームアップの後のステップの確保
+	UINT allocating_steps;	//ウォームアップの後で確保したステップの数
+	UINT first_allocating_step;	//ウォームアップの後で最初に確保したステップ
+	double debug_primitives, debug_vertices, debug_draw_calls;	//--debug-drawで描いた数の合計
+	double debug_ms;	//--debug-drawでまとめて描いた時間の合計
+	INT nonfinite_step;	//剛体の状態が最初に有限でなくなったステップ(-1は最後まで有限、その場合はこのステップで打ち切る)
+	INT nonfinite_body;	//そのときの剛体番号
+};
+
+static AllocationCounts operator-(const AllocationCounts &a, const AllocationCounts &b)
+{
+	AllocationCounts d = { a.allocations - b.allocations, a.bytes - b.bytes, a.frees - b.frees };
+	return d;
+}
+static void operator+=(AllocationCounts &a, const AllocationCounts &b)
+{
+	a.allocations += b.allocations;
+	a.bytes += b.bytes;
+	a.frees += b.frees;
+}
+
+//シーンをworldに作り、stepをoptions.steps回繰り返して計測する
+static StepStats run_steps(const HeadlessScene &scene, UINT count, const Options &options, JobSystem *jobs, RigidWorld *world)
+{
+	reset_peak_memory();
+	scene.build(world, count, options.size);
+	world->jobs = jobs;
+	world->deterministic = options.deterministic;
+	StepStats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.bodies = world->size();
+	stats.nonfinite_step = -1;
+	stats.nonfinite_body = -1;
+	double contacts = 0;
+	enable_allocation_tracking(options.allocations != FALSE);
+	if (options.profile)
+	{
+		Profiler::I().reset();
+		Profiler::I().enable(TRUE);
+	}
+	DebugDrawBatch debug_batch;
+	NullDebugDrawBackend debug_backend;
+	DebugDrawRecorder::I().clear();
+	DebugDrawRecorder::I().set_categories(options.debug_draw);
+	for (UINT step = 0; step < options.steps; step++)
+	{
+		const AllocationCounts before = allocation_counts();
+		Clock::time_point start = Clock::now();
+		world->store_poses();
+		if (scene.update) scene.update(world, count, options.size);
+		apply_gravity(world);
+		world->step(options.duration);
+		const double ms = elapsed_ms(start, Clock::now());
+		const AllocationCounts allocated = allocation_counts() - before;
+		stats.total_ms += ms;
+		stats.max_step_ms = std::max(stats.max_step_ms, ms);
+		stats.body_steps += world->size();
+		contacts += world->contacts.size();
+		stats.allocations += allocated;
+		if (step >= options.warmup && allocated.allocations)
+		{
+			if (stats.allocating_steps++ == 0) stats.first_allocating_step = step;
+			stats.steady_allocations += allocated;
+		}
+		//状態の確認、区間の読み出しとデバッグ表示はステップの時間に含めない
+		const INT nonfinite = nonfinite_body(*world);
+		if (nonfinite >= 0)
+		{
+			stats.nonfinite_step = (INT)step;
+			stats.nonfinite_body = nonfinite;
+			break;
+		}
+		if (options.profile) Profiler::I().collect();
+		if (options.debug_draw)
+		{
+			Clock::time_point draw_start = Clock::now();
+			DebugDrawRecorder::I().merge(&debug_batch);
+			debug_batch.flush(&debug_backend, options.duration);
+			stats.debug_ms += elapsed_ms(draw_start, Clock::now());
+			stats.debug_primitives += debug_batch.last_stats().primitives;
+			stats.debug_vertices += debug_batch.last_stats().vertices;
+			stats.debug_draw_calls += debug_batch.last_stats().draw_calls;
+		}
+	}
+	Profiler::I().enable(FALSE);
+	DebugDrawRecorder::I().set_categories(0);
+	enable_allocation_tracking(false);
+	stats.contacts_per_step = contacts / options.steps;
+	stats.peak_memory_mb = peak_memory_mb();
+	return stats;
+}
+
+enum PHASE
+{
+	PHASE_INTEGRATE,
+	PHASE_UPDATE_TRANSFORMS,
+	PHASE_UPDATE_BOUNDS,
+	PHASE_BROADPHASE,
+	PHASE_GENERATE_CONTACTS,
+	PHASE_RESOLVE_CONTACTS,
+	PHASE_COUNT
+};
+static const char *phase_names[PHASE_COUNT] = { "integrate", "update_transforms", "update_bounds", "broadphase", "generate_contacts", "resolve_contacts" };
+
+static UINT scene_count(const HeadlessScene &scene, const Options &options)
+{
+	return scene.default_count == 0 ? 0 : (options.count ? options.count : scene.default_count);
+}
+
+//直前のrun_stepsで記録した区間の統計を出力する
+static void print_profile(const Options &options)
+{
+	Profiler &profiler = Profiler::I();
+	printf("  %-28s  %9s  %10s  %10s  %10s  %10s", "zone", "calls/step", "mean us", "p50 us", "p99 us", "max us");
+	if (options.allocations) printf("  %11s  %11s", "allocs/step", "bytes/step");
+	printf("\n");
+	for (UINT z = 0; z < profiler.zone_count(); z++)
+	{
+		const ProfileStats s = profiler.stats(z);
+		if (s.total_count == 0) continue;
+		printf("  %-28s  %9.1f  %10.2f  %10.2f  %10.2f  %10.2f", profiler.zone_name(z).c_str(), (double)s.total_count / options.steps, s.mean, s.p50, s.p99, s.max);
+		if (options.allocations) printf("  %11.2f  %11.1f", (double)s.allocations / options.steps, (double)s.bytes / options.steps);
+		printf("\n");
+	}
+	if (profiler.dropped_events()) printf("  (%llu events dropped)\n", profiler.dropped_events());
+}
+
+//接触を扱う区間(ミスの数を接触1個あたりで表す)
+static bool is_contact_zone(const std::string &name)
+{
+	return name.compare(0, 11, "narrowphase") == 0 || name == "generate_contacts" || name == "resolve_contacts" || name.compare(0, 6, "solver") == 0;
+}
+
+//直前のrun_stepsで記録した区間ごとのハードウェアカウンタを出力する
+static void print_counters(const Options &options, double bodies_per_step, double contacts_per_step)
+{
+	Profiler &profiler = Profiler::I();
+	printf("  %-28s  %12s  %12s  %5s  %10s  %10s  %10s  %s\n", "zone", "cycles/step", "instr/step", "IPC", "L1d miss", "LLC miss", "br miss", "(per)");
+	for (UINT z = 0; z < profiler.zone_count(); z++)
+	{
+		const ProfileCounters c = profiler.counters(z);
+		if (c.count == 0) continue;
+		const std::string name = profiler.zone_name(z);
+		const bool contact = is_contact_zone(name);
+		const double units = (contact ? contacts_per_step : bodies_per_step) * options.steps;
+		const unsigned long long *v = c.total.value;
+		printf("  %-28s  %12.0f  %12.0f  %5.2f", name.c_str(), (double)v[PERF_CYCLES] / options.steps, (double)v[PERF_INSTRUCTIONS] / options.steps,
+			v[PERF_CYCLES] ? (double)v[PERF_INSTRUCTIONS] / v[PERF_CYCLES] : 0.0);
+		const PERF_COUNTER misses[3] = { PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES };
+		for (int m = 0; m < 3; m++)
+		{
+			if (profiler.counter_available(misses[m]) && units > 0) printf("  %10.2f", v[misses[m]] / units);
+			else printf("  %10s", "n/a");
+		}
+		printf("  %s\n", contact ? "contact" : "body");
+	}
+	if (profiler.counters_error()[0]) printf("  (%s)\n", profiler.counters_error());
+}
+
+//stepの計測の確保を出力する(--zero-allocでウォームアップの後に確保した場合は偽を返す)
+static bool print_allocations(const StepStats &stats, const Options &options)
+{
+	printf("  allocations  %.2f/step  %.1f bytes/step", (double)stats.allocations.allocations / options.steps, (double)stats.allocations.bytes / options.steps);
+	if (options.warmup >= options.steps)
+	{
+		printf("  (no steps after the %u warm-up steps)\n", options.warmup);
+		return true;
+	}
+	printf("  after %u warm-up steps: %llu allocations, %llu bytes", options.warmup, stats.steady_allocations.allocations, stats.steady_allocations.bytes);
+	if (stats.allocating_steps) printf(" in %u steps (first at step %u)", stats.allocating_steps, stats.first_allocating_step);
+	const bool ok = !options.zero_alloc || stats.allocating_steps == 0;
+	printf("%s\n", options.zero_alloc ? (ok ? "  ok" : "  ALLOCATED") : "");
+	return ok;
+}
+
+//1つのシーンを実行して結果を出力する(状態が有限でなくなった場合、ハッシュの食い違いや--zero-allocの失敗があった場合は偽を返す)
+static bool run_scene(const HeadlessScene &scene, const Options &options, JobSystem *jobs)
+{
+	const UINT count = scene_count(scene, options);
+
+	//stepの計測
+	RigidWorld world;
+	const StepStats stats = run_steps(scene, count, options, jobs, &world);
+	const double steps_per_second = options.steps / (stats.total_ms / 1000);
+
+	printf("scene %s: %s\n", scene.name, scene.description);
+	if (stats.nonfinite_step >= 0)
+	{
+		printf("  bodies %u  NON-FINITE state of body %d at step %u, run stopped\n", stats.bodies, stats.nonfinite_body, (UINT)stats.nonfinite_step);
+		return false;
+	}
+	printf("  bodies %u", stats.bodies);
+	if (world.size() != stats.bodies) printf(" (%u left, average %.1f)", world.size(), stats.body_steps / options.steps);
+	printf("  steps %u  dt %g  threads %u%s\n", options.steps, options.duration, jobs ? jobs->thread_count() : 1, options.deterministic ? "  deterministic" : "");
+	printf("  step  %.4f ms/step (max %.4f)  %.1f steps/s  %.0f bodies*steps/s  %.1f contacts/step\n",
+		stats.total_ms / options.steps, stats.max_step_ms, steps_per_second, stats.body_steps / (stats.total_ms / 1000), stats.contacts_per_step);
+	if (stats.peak_memory_mb >= 0) printf("  peak memory %.1f MB\n", stats.peak_memory_mb);
+	const RigidWorld::MemoryUsage usage = world.memory_usage();
+	printf("  world memory %.1f KB  (bodies %.1f  handles %.1f  pairs %.1f  contacts %.1f  scratch %.1f)\n", usage.total() / 1024.0,
+		usage.bodies / 1024.0, usage.handles / 1024.0, usage.pairs / 1024.0, usage.contacts / 1024.0, usage.scratch / 1024.0);
+	if (options.debug_draw)
+	{
+		printf("  debug draw  %.1f primitives/step  %.0f vertices/step  %.1f draw calls/step  merge+flush %.4f ms/step  (%u recording threads)\n",
+			stats.debug_primitives / options.steps, stats.debug_vertices / options.steps, stats.debug_draw_calls / options.steps,
+			stats.debug_ms / options.steps, DebugDrawRecorder::I().thread_count());
+	}
+	const bool allocation_ok = !options.allocations || print_allocations(stats, options);
+	if (options.profile) print_profile(options);
+	if (options.counters) print_counters(options, stats.body_steps / options.steps, stats.contacts_per_step);
+	if (!options.phases)
+	{
+		printf("  state hash %016llx\n", world.compute_state_hash());
+		return allocation_ok;
+	}
+
+	//フェーズの計測
+	RigidWorld phased;
+	scene.build(&phased, count, options.size);
+	phased.jobs = jobs;
+	phased.deterministic = options.deterministic;
+	double phase_ms[PHASE_COUNT] = { 0 };
+	AllocationCounts phase_allocations[PHASE_COUNT];
+	memset(phase_allocations, 0, sizeof(phase_allocations));
+	enable_allocation_tracking(options.allocations != FALSE);
+	for (UINT step = 0; step < options.steps; step++)
+	{
+		phased.store_poses();
+		if (scene.update) scene.update(&phased, count, options.size);
+		apply_gravity(&phased);
+		Clock::time_point t[PHASE_COUNT + 1];
+		AllocationCounts a[PHASE_COUNT + 1];
+		a[0] = allocation_counts();
+		t[0] = Clock::now();
+		phased.integrate(options.duration);
+		t[1] = Clock::now();
+		a[1] = allocation_counts();
+		phased.update_transforms();
+		t[2] = Clock::now();
+		a[2] = allocation_counts();
+		phased.update_bounds();
+		t[3] = Clock::now();
+		a[3] = allocation_counts();
+		phased.broadphase();
+		t[4] = Clock::now();
+		a[4] = allocation_counts();
+		phased.generate_contacts();
+		t[5] = Clock::now();
+		a[5] = allocation_counts();
+		phased.resolve_contacts();
+		t[6] = Clock::now();
+		a[6] = allocation_counts();
+		const INT nonfinite = nonfinite_body(phased);
+		if (nonfinite >= 0)
+		{
+			enable_allocation_tracking(false);
+			printf("  phases  NON-FINITE state of body %d at step %u, run stopped\n", nonfinite, step);
+			return false;
+		}
+		for (int p = 0; p < PHASE_COUNT; p++) phase_ms[p] += elapsed_ms(t[p], t[p + 1]);
+		if (step >= options.warmup)
+		{
+			for (int p = 0; p < PHASE_COUNT; p++) phase_allocations[p] += a[p + 1] - a[p];
+		}
+	}
+	enable_allocation_tracking(false);
+	double phase_total = 0;
+	for (int p = 0; p < PHASE_COUNT; p++) phase_total += phase_ms[p];
+	printf("  %-18s  %10s  %6s", "phase", "ms/step", "%");
+	//フェーズごとの確保はウォームアップの後のステップの合計
+	if (options.allocations) printf("  %12s  %12s", "allocations", "bytes");
+	printf("\n");
+	for (int p = 0; p < PHASE_COUNT; p++)
+	{
+		printf("  %-18s  %10.4f  %6.1f", phase_names[p], phase_ms[p] / options.steps, phase_total > 0 ? 100 * phase_ms[p] / phase_total : 0.0);
+		if (options.allocations) printf("  %12llu  %12llu", phase_allocations[p].allocations, phase_allocations[p].bytes);
+		printf("\n");
+	}
+	printf("  %-18s  %10.4f\n", "total", phase_total / options.steps);
+	unsigned long long phase_allocation_count = 0;
+	for (int p = 0; p < PHASE_COUNT; p++) phase_allocation_count += phase_allocations[p].allocations;
+	const bool phase_allocation_ok = !options.zero_alloc || phase_allocation_count == 0;
+	if (!phase_allocation_ok) printf("  phases  %llu allocations after %u warm-up steps  ALLOCATED\n", phase_allocation_count, options.warmup);
+
+	const unsigned long long hash = world.compute_state_hash(), phased_hash = phased.compute_state_hash();
+	printf("  state hash %016llx", hash);
+	if (!options.deterministic)
+	{
+		printf("\n");
+		return allocation_ok && phase_allocation_ok;
+	}
+	//stepと同じ順に呼んだフェーズの結果は、stepの結果とビット単位で一致する
+	printf("  (phases %016llx)  %s\n", phased_hash, hash == phased_hash ? "ok" : "MISMATCH");
+	return allocation_ok && phase_allocation_ok && hash == phased_hash;
+}
+
+//剛体数を変えられるシーンを剛体数ごとに計測して表にする(状態が有限でなくなった場合や--zero-allocの失敗があった場合は偽を返す)
+static bool run_sweep(const Options &options, JobSystem *jobs, bool all)
+{
+	bool ok = true;
+	FILE *csv = 0;
+	if (options.csv)
+	{
+		csv = fopen(options.csv, "w");
+		if (!csv) printf("cannot open %s\n", options.csv);
+		else fprintf(csv, "scene,bodies,average_bodies,steps,threads,ms_per_step,max_ms_per_step,contacts_per_step,peak_memory_mb\n");
+	}
+	const UINT threads = jobs ? jobs->thread_count() : 1;
+	printf("steps %u  dt %g  threads %u\n", options.steps, options.duration, threads);
+	printf("%-10s %8s %10s %12s %12s %14s %10s\n", "scene", "bodies", "avg bodies", "ms/step", "max ms", "contacts/step", "peak MB");
+	for (UINT s = 0; s < headless_scene_count; s++)
+	{
+		const HeadlessScene &scene = headless_scenes[s];
+		if (all ? scene.default_count == 0 : strcmp(scene.name, options.scene) != 0) continue;
+		for (size_t c = 0; c < options.counts.size(); c++)
+		{
+			RigidWorld world;
+			const StepStats stats = run_steps(scene, options.counts[c], options, jobs, &world);
+			if (stats.nonfinite_step >= 0)
+			{
+				printf("%-10s %8u NON-FINITE state of body %d at step %u, run stopped\n", scene.name, stats.bodies, stats.nonfinite_body, (UINT)stats.nonfinite_step);
+				fflush(stdout);
+				ok = false;
+				continue;
+			}
+			const double average_bodies = stats.body_steps / options.steps;
+			printf("%-10s %8u %10.1f %12.4f %12.4f %14.1f %10.1f\n", scene.name, stats.bodies, average_bodies,
+				stats.total_ms / options.steps, stats.max_step_ms, stats.contacts_per_step, stats.peak_memory_mb);
+			if (options.allocations && stats.allocating_steps)
+			{
+				printf("%-10s %8s %10s %llu allocations (%llu bytes) after %u warm-up steps%s\n", "", "", "", stats.steady_allocations.allocations, stats.steady_allocations.bytes,
+					options.warmup, options.zero_alloc ? "  ALLOCATED" : "");
+				if (options.zero_alloc) ok = false;
+			}
+			fflush(stdout);
+			if (csv)
+			{
+				fprintf(csv, "%s,%u,%.1f,%u,%u,%.4f,%.4f,%.1f,%.1f\n", scene.name, stats.bodies, average_bodies, options.steps, threads,
+					stats.total_ms / options.steps, stats.max_step_ms, stats.contacts_per_step, stats.peak_memory_mb);
+			}
+		}
+	}
+	if (csv)
+	{
+		fclose(csv);
+		printf("wrote %s\n", options.csv);
+	}
+	return ok;
+}
+
+static void usage()
+{
+	printf("usage: physics_headless [--scene name|all] [--steps n] [--dt seconds] [--count bodies] [--size n] [--threads n] [--deterministic] [--no-phases]\n");
+	printf("                        [--profile] [--counters] [--trace file] [--allocations] [--zero-alloc] [--warmup n]\n");
+	printf("                        [--debug-draw contacts,aabbs,islands,bvh|all] [--list]\n");
+	printf("       physics_headless --sweep [--scene name|all] [--counts n,n,...] [--csv file] [options]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	options.scene = "all";
+	options.steps = 1000;
+	options.duration = 1.0f / 60;
+	options.count = 0;
+	options.size = 0;
+	options.threads = hardware_thread_count();
+	options.deterministic = FALSE;
+	options.phases = TRUE;
+	options.sweep = FALSE;
+	options.csv = 0;
+	options.profile = FALSE;
+	options.counters = FALSE;
+	options.allocations = FALSE;
+	options.zero_alloc = FALSE;
+	options.warmup = 300;
+	options.trace = 0;
+	options.debug_draw = 0;
+	const UINT default_counts[] = { 10, 100, 1000, 10000, 100000 };
+	options.counts.assign(default_counts, default_counts + 5);
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (strcmp(arg, "--scene") == 0 && has_value) options.scene = argv[++i];
+		else if (strcmp(arg, "--steps") == 0 && has_value) options.steps = (UINT)atoi(argv[++i]);
+		else if (strcmp(arg, "--dt") == 0 && has_value) options.duration = (FLOAT)atof(argv[++i]);
+		else if (strcmp(arg, "--count") == 0 && has_value) options.count = (UINT)atoi(argv[++i]);
+		else if (strcmp(arg, "--size") == 0 && has_value) options.size = (UINT)atoi(argv[++i]);
+		else if (strcmp(arg, "--threads") == 0 && has_value) options.threads = (UINT)atoi(argv[++i]);
+		else if (strcmp(arg, "--deterministic") == 0) options.deterministic = TRUE;
+		else if (strcmp(arg, "--no-phases") == 0) options.phases = FALSE;
+		else if (strcmp(arg, "--sweep") == 0) options.sweep = TRUE;
+		else if (strcmp(arg, "--csv") == 0 && has_value) options.csv = argv[++i];
+		else if (strcmp(arg, "--profile") == 0) options.profile = TRUE;
+		else if (strcmp(arg, "--allocations") == 0) options.allocations = TRUE;
+		else if (strcmp(arg, "--zero-alloc") == 0)
+		{
+			options.allocations = TRUE;
+			options.zero_alloc = TRUE;
+		}
+		else if (strcmp(arg, "--warmup") == 0 && has_value) options.warmup = (UINT)atoi(argv[++i]);
+		else if (strcmp(arg, "--counters") == 0)
+		{
+			options.counters = TRUE;
+			options.profile = TRUE;
+		}
+		else if (strcmp(arg, "--trace") == 0 && has_value)
+		{
+			options.trace = argv[++i];
+			options.profile = TRUE;
+		}
+		else if (strcmp(arg, "--counts") == 0 && has_value)
+		{
+			options.counts.clear();
+			for (const char *p = argv[++i]; *p; )
+			{
+				UINT n = (UINT)strtoul(p, 0, 10);
+				if (n) options.counts.push_back(n);
+				p = strchr(p, ',');
+				if (!p) break;
+				p++;
+			}
+		}
+		else if (strcmp(arg, "--debug-draw") == 0 && has_value)
+		{
+			static const struct { const char *name; UINT category; } categories[] =
+			{
+				{ "contacts", DEBUG_DRAW_CONTACTS }, { "aabbs", DEBUG_DRAW_AABBS }, { "islands", DEBUG_DRAW_ISLANDS }, { "bvh", DEBUG_DRAW_BVH }, { "all", DEBUG_DRAW_ALL },
+			};
+			for (const char *p = argv[++i]; *p; )
+			{
+				const size_t length = strcspn(p, ",");
+				bool known = false;
+				for (size_t c = 0; c < sizeof(categories) / sizeof(categories[0]); c++)
+				{
+					if (strlen(categories[c].name) == length && strncmp(p, categories[c].name, length) == 0)
+					{
+						options.debug_draw |= categories[c].category;
+						known = true;
+					}
+				}
+				if (!known)
+				{
+					usage();
+					return 2;
+				}
+				p += length;
+				if (*p) p++;
+			}
+		}
+		else if (strcmp(arg, "--list") == 0)
+		{
+			for (UINT s = 0; s < headless_scene_count; s++)
+			{
+				printf("%-10s %s (default bodies: %s)\n", headless_scenes[s].name, headless_scenes[s].description,
+					headless_scenes[s].default_count ? std::to_string(headless_scenes[s].default_count).c_str() : "fixed");
+			}
+			return 0;
+		}
+		else
+		{
+			usage();
+			return 2;
+		}
+	}
+	if (options.steps == 0 || !(options.duration > 0) || options.counts.empty())
+	{
+		usage();
+		return 2;
+	}
+	const bool all = strcmp(options.scene, "all") == 0;
+	const HeadlessScene *selected = all ? 0 : find_headless_scene(options.scene);
+	if (!all && !selected)
+	{
+		printf("unknown scene '%s' (use --list)\n", options.scene);
+		return 2;
+	}
+	if (options.sweep && selected && selected->default_count == 0)
+	{
+		printf("scene '%s' has a fixed number of bodies and cannot be swept\n", options.scene);
+		return 2;
+	}
+
+	//スレッド数が1の場合はジョブシステムを使わず、stepを呼び出し元のスレッドで順に実行する
+	JobSystem *jobs = options.threads > 1 ? new JobSystem(options.threads) : 0;
+	int result = 0;
+	if (options.counters && !Profiler::I().enable_counters(TRUE))
+	{
+		printf("hardware counters unavailable, timing only: %s\n", Profiler::I().counters_error());
+		options.counters = FALSE;
+	}
+	if (options.trace) Profiler::I().start_trace();
+	if (options.sweep)
+	{
+		if (!run_sweep(options, jobs, all)) result = 1;
+	}
+	else
+	{
+		for (UINT s = 0; s < headless_scene_count; s++)
+		{
+			if (!all && strcmp(headless_scenes[s].name, options.scene) != 0) continue;
+			if (!run_scene(headless_scenes[s], options, jobs)) result = 1;
+		}
+	}
+	if (options.trace)
+	{
+		Profiler::I().stop_trace();
+		if (Profiler::I().write_chrome_trace(options.trace)) printf("wrote %s (%u events)\n", options.trace, (UINT)Profiler::I().trace_size());
+		else printf("cannot write %s\n", options.trace);
+	}
+	delete jobs;
+	return result;
+}
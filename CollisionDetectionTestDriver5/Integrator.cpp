@@ -0,0 +1,243 @@
+#include "StrictFloat.h"
+#include <math.h>
+#include "RigidWorld.h"
+
+//ワールド空間のベクトルをローカル空間へ(rは姿勢の回転行列、行がローカル軸)
+static inline vec3 to_local(CONST FLOAT r[9], CONST vec3 &v)
+{
+	return vec3(r[0] * v.x + r[1] * v.y + r[2] * v.z, r[3] * v.x + r[4] * v.y + r[5] * v.z, r[6] * v.x + r[7] * v.y + r[8] * v.z);
+}
+//ローカル空間のベクトルをワールド空間へ
+static inline vec3 to_world(CONST FLOAT r[9], CONST vec3 &v)
+{
+	return vec3(r[0] * v.x + r[3] * v.y + r[6] * v.z, r[1] * v.x + r[4] * v.y + r[7] * v.z, r[2] * v.x + r[5] * v.y + r[8] * v.z);
+}
+//成分ごとの積
+static inline vec3 scale(CONST vec3 &a, CONST vec3 &b)
+{
+	return vec3(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
+//角運動量(L)から角速度を求める w = R^T * I^-1 * R * L
+static inline vec3 angular_velocity_of(CONST quat &q, CONST vec3 &inverse_inertia, CONST vec3 &L)
+{
+	FLOAT r[9];
+	quaternion_to_rotation(q.x, q.y, q.z, q.w, r);
+	return to_world(r, scale(inverse_inertia, to_local(r, L)));
+}
+//角速度(w)から角運動量を求める L = R^T * I * R * w
+static inline vec3 angular_momentum_of(CONST quat &q, CONST vec3 &inverse_inertia, CONST vec3 &w)
+{
+	FLOAT r[9];
+	quaternion_to_rotation(q.x, q.y, q.z, q.w, r);
+	vec3 l = to_local(r, w);
+	return to_world(r, vec3(l.x / inverse_inertia.x, l.y / inverse_inertia.y, l.z / inverse_inertia.z));
+}
+//姿勢の時間微分 0.5 * w * q (RigidBody::integrateと同じ)
+static inline quat orientation_derivative(CONST quat &q, CONST vec3 &w)
+{
+	return 0.5f * (q * quat(w.x, w.y, w.z, 0));
+}
+//角速度wで時間durationだけ回転させる(指数写像 q' = exp(0.5 * w * duration) * q)
+static inline quat rotate(CONST quat &q, CONST vec3 &w, FLOAT duration)
+{
+	FLOAT half_angle = 0.5f * length(w) * duration;
+	//sin(x)/x を小さい角度ではテイラー展開で求める
+	FLOAT s = half_angle < 1e-3f ? 0.5f * duration * (1 - half_angle * half_angle / 6) : sinf(half_angle) / length(w);
+	quat dq(w.x * s, w.y * s, w.z * s, cosf(half_angle));
+	quat result = q * dq;
+	result = normalize(result);
+	return result;
+}
+
+//外力のない回転を時間durationだけ進める(角運動量Lはワールド空間で保存される)
+//ローカル軸x, y, z, y, x の順に各軸まわりの回転を厳密に与える対称な分割で、時間反転可能かつシンプレクティック
+static inline quat free_rotation(quat q, CONST vec3 &inverse_inertia, CONST vec3 &L, FLOAT duration)
+{
+	static const int axes[5] = { 0, 1, 2, 1, 0 };
+	static const FLOAT weights[5] = { 0.5f, 0.5f, 1, 0.5f, 0.5f };
+
+	FLOAT r[9];
+	quaternion_to_rotation(q.x, q.y, q.z, q.w, r);
+	vec3 l = to_local(r, L);
+	FLOAT *m = &l.x;
+	CONST FLOAT *im = &inverse_inertia.x;
+	for (int n = 0; n < 5; n++)
+	{
+		//ローカル軸kまわりに角度angleだけ回転する
+		int k = axes[n], a = (k + 1) % 3, b = (k + 2) % 3;
+		FLOAT angle = m[k] * im[k] * duration * weights[n];
+		FLOAT c = cosf(angle), s = sinf(angle);
+		FLOAT half_angle[4] = { 0, 0, 0, cosf(0.5f * angle) };
+		half_angle[k] = sinf(0.5f * angle);
+		q = quat(half_angle[0], half_angle[1], half_angle[2], half_angle[3]) * q;
+
+		//物体が回転した分、ローカル空間の角運動量は逆向きに回転する
+		FLOAT ma = m[a], mb = m[b];
+		m[a] = c * ma + s * mb;
+		m[b] = -s * ma + c * mb;
+	}
+	q = normalize(q);
+	return q;
+}
+
+//剛体番号iの状態の読み書き
+struct BodyState
+{
+	vec3 position;
+	quat orientation;
+	vec3 linear_velocity;
+	vec3 angular_velocity;
+	vec3 previous_acceleration;
+	vec3 force;
+	vec3 torque;
+	FLOAT inverse_mass;
+	vec3 inverse_inertia;
+
+	BodyState(CONST RigidWorld &world, UINT i) :
+		position(world.get_position(i)),
+		orientation(world.get_orientation(i)),
+		linear_velocity(world.get_linear_velocity(i)),
+		angular_velocity(world.get_angular_velocity(i)),
+		previous_acceleration(world.previous_acceleration[0][i], world.previous_acceleration[1][i], world.previous_acceleration[2][i]),
+		force(world.accumulated_force[0][i], world.accumulated_force[1][i], world.accumulated_force[2][i]),
+		torque(world.accumulated_torque[0][i], world.accumulated_torque[1][i], world.accumulated_torque[2][i]),
+		inverse_mass(world.inverse_mass[i]),
+		inverse_inertia(world.inverse_inertia[0][i], world.inverse_inertia[1][i], world.inverse_inertia[2][i]) {}
+
+	void store(RigidWorld *world, UINT i) const
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			world->position[k][i] = position[k];
+			world->linear_velocity[k][i] = linear_velocity[k];
+			world->angular_velocity[k][i] = angular_velocity[k];
+			world->previous_acceleration[k][i] = previous_acceleration[k];
+		}
+		world->orientation[0][i] = orientation.x;
+		world->orientation[1][i] = orientation.y;
+		world->orientation[2][i] = orientation.z;
+		world->orientation[3][i] = orientation.w;
+	}
+};
+
+//剛体番号[begin, end)の可動オブジェクトのみ状態を更新し、範囲の全剛体のアキュムレータをゼロリセットする
+template <typename F> static void for_each_movable(RigidWorld *world, UINT begin, UINT end, F f)
+{
+	for (UINT i = begin; i < end; i++)
+	{
+		if (world->inverse_mass[i] > 0)
+		{
+			BodyState body(*world, i);
+			f(&body);
+			body.store(world, i);
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			world->accumulated_force[k][i] = 0;
+			world->accumulated_torque[k][i] = 0;
+		}
+	}
+}
+
+void SemiImplicitEuler::integrate(RigidWorld *world, UINT begin, UINT end, FLOAT duration)
+{
+	//SIMD実装(integrate_batch)を使用する
+	integrate_batch(world->arrays(), begin, end, duration, world->simd_level);
+}
+
+void VelocityVerlet::integrate(RigidWorld *world, UINT begin, UINT end, FLOAT duration)
+{
+	for_each_movable(world, begin, end, [duration](BodyState *body)
+	{
+		vec3 acceleration = body->force * body->inverse_mass;
+		integrate(&body->position, &body->linear_velocity, &body->previous_acceleration, acceleration, duration);
+
+		//角運動量を半ステップ進め(トルク)、外力のない回転を1ステップ進め、残りの半ステップを進める
+		vec3 L = angular_momentum_of(body->orientation, body->inverse_inertia, body->angular_velocity);
+		L += 0.5f * body->torque * duration;
+		body->orientation = free_rotation(body->orientation, body->inverse_inertia, L, duration);
+		L += 0.5f * body->torque * duration;
+		body->angular_velocity = angular_velocity_of(body->orientation, body->inverse_inertia, L);
+	});
+}
+
+void RungeKutta4::integrate(RigidWorld *world, UINT begin, UINT end, FLOAT duration)
+{
+	for_each_movable(world, begin, end, [duration](BodyState *body)
+	{
+		vec3 acceleration = body->force * body->inverse_mass;
+		integrate(&body->position, &body->linear_velocity, &body->previous_acceleration, acceleration, duration);
+
+		//回転の状態(姿勢q, 角運動量L)の時間微分は (0.5 * w(q, L) * q, torque)
+		//トルクは一定なので L(t) = L0 + torque * t となり、各段の角運動量は厳密に求まる
+		CONST quat q0 = body->orientation;
+		CONST vec3 L0 = angular_momentum_of(q0, body->inverse_inertia, body->angular_velocity);
+		CONST vec3 L_half = L0 + 0.5f * body->torque * duration;
+		CONST vec3 L1 = L0 + body->torque * duration;
+
+		quat q, k1, k2, k3, k4, step;
+		k1 = orientation_derivative(q0, angular_velocity_of(q0, body->inverse_inertia, L0));
+		step = q0 + k1 * (0.5f * duration);
+		q = normalize(step);
+		k2 = orientation_derivative(q, angular_velocity_of(q, body->inverse_inertia, L_half));
+		step = q0 + k2 * (0.5f * duration);
+		q = normalize(step);
+		k3 = orientation_derivative(q, angular_velocity_of(q, body->inverse_inertia, L_half));
+		step = q0 + k3 * duration;
+		q = normalize(step);
+		k4 = orientation_derivative(q, angular_velocity_of(q, body->inverse_inertia, L1));
+
+		step = q0 + (k1 + 2 * k2 + 2 * k3 + k4) * (duration / 6);
+		body->orientation = normalize(step);
+		body->angular_velocity = angular_velocity_of(body->orientation, body->inverse_inertia, L1);
+	});
+}
+
+void ExponentialMap::integrate(RigidWorld *world, UINT begin, UINT end, FLOAT duration)
+{
+	for_each_movable(world, begin, end, [duration](BodyState *body)
+	{
+		vec3 acceleration = body->force * body->inverse_mass;
+		integrate(&body->position, &body->linear_velocity, &body->previous_acceleration, acceleration, duration);
+
+		FLOAT r[9];
+		quaternion_to_rotation(body->orientation.x, body->orientation.y, body->orientation.z, body->orientation.w, r);
+		vec3 inertia(1 / body->inverse_inertia.x, 1 / body->inverse_inertia.y, 1 / body->inverse_inertia.z);
+
+		//ローカル空間でジャイロ項を陰的に解く
+		//I(w' - w) + duration * w' × Iw' = 0 を w' = w を初期値としたニュートン法1回で近似する
+		//ヤコビ行列 J = I + duration * ([w]I - [Iw]) ([a]はaとの外積を表す行列)
+		vec3 w = to_local(r, body->angular_velocity);
+		vec3 Iw = scale(inertia, w);
+		vec3 f = duration * cross(w, Iw);
+		FLOAT J[3][3];
+		for (int c = 0; c < 3; c++)
+		{
+			//列c = I*e_c + duration * (w × (I*e_c) + e_c × Iw)
+			vec3 e(c == 0 ? 1.0f : 0.0f, c == 1 ? 1.0f : 0.0f, c == 2 ? 1.0f : 0.0f);
+			vec3 Ie = scale(inertia, e);
+			vec3 column = Ie + duration * (cross(w, Ie) + cross(e, Iw));
+			J[0][c] = column.x;
+			J[1][c] = column.y;
+			J[2][c] = column.z;
+		}
+		//J * dw = f をクラメルの公式で解く
+		vec3 c0(J[0][0], J[1][0], J[2][0]), c1(J[0][1], J[1][1], J[2][1]), c2(J[0][2], J[1][2], J[2][2]);
+		vec3 c1_c2 = cross(c1, c2);
+		FLOAT det = dot(c0, c1_c2);
+		if (fabsf(det) > FLT_EPSILON)
+		{
+			vec3 f_c2 = cross(f, c2), c1_f = cross(c1, f);
+			vec3 dw(dot(f, c1_c2), dot(c0, f_c2), dot(c0, c1_f));
+			w -= dw / det;
+		}
+
+		//トルクによる角速度の変化
+		w += scale(body->inverse_inertia, to_local(r, body->torque)) * duration;
+		body->angular_velocity = to_world(r, w);
+
+		//指数写像で姿勢を更新する
+		body->orientation = rotate(body->orientation, body->angular_velocity, duration);
+	});
+}
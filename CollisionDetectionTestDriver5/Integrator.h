@@ -0,0 +1,75 @@
+#pragma once
+
+#include "PhysicsMath.h"
+
+struct RigidWorld;
+
+//インテグレータのポリシー
+//BasicRigidWorld<INTEGRATOR>やParticle::integrate<INTEGRATOR>のテンプレート引数としてコンパイル時に選択する
+//
+//各ポリシーは次の2つの静的関数を持つ
+//	integrate(world, begin, end, duration)	:RigidWorldの剛体番号[begin, end)を1ステップ進める(アキュムレータはゼロリセットする)
+//		(RigidWorld::integratorに設定する関数、範囲ごとに並列に呼び出してよい)
+//	integrate(position, velocity, previous_acceleration, acceleration, duration)	:質点を1ステップ進める
+//		(previous_accelerationは直前のステップの加速度を保持する変数、はじめはNO_PREVIOUS_ACCELERATIONにしておく)
+//力とトルクはステップの開始時の位置・姿勢でアキュムレータに加えられる
+//速度ベルレ法の並進は直前のステップの加速度との平均で速度を更新するが、それ以外はステップ中は一定とみなす(ステップ幅は一定とする)
+
+//previous_accelerationのx成分がこの値の場合は直前のステップがない(はじめのステップ)
+static const FLOAT NO_PREVIOUS_ACCELERATION = FLT_MAX;
+
+//半陰的オイラー法(シンプレクティック・オイラー法)
+//速度を更新してから新しい速度で位置を更新する、最も安価な1次の方法(RigidBody::integrateと同じ計算)
+//姿勢は orientation += 0.5 * w * orientation * duration の後に正規化するため、角速度が大きいと誤差が大きい
+struct SemiImplicitEuler
+{
+	static void integrate(RigidWorld *world, UINT begin, UINT end, FLOAT duration);
+	static void integrate(vec3 *position, vec3 *velocity, vec3 *previous_acceleration, CONST vec3 &acceleration, FLOAT duration)
+	{
+		*velocity += acceleration * duration;
+		*position += *velocity * duration;
+	}
+};
+
+//速度ベルレ法
+//並進は x(t + h) = x(t) + v(t) * h + 0.5 * a(t) * h^2、v(t + h) = v(t) + 0.5 * (a(t) + a(t + h)) * h
+//a(t + h)は次のステップの開始時に分かるため、速度の後半の半ステップは今の加速度で仮に与えておき、
+//次のステップで直前の加速度(previous_acceleration)との差の分を補正する(ばねや接触のように位置で変わる力でもエネルギーが増え続けない)
+//回転は角運動量を半ステップずつ更新し、その間に半ステップ後の角速度で姿勢を厳密に回転させる(ジャイロ効果を含む)
+struct VelocityVerlet
+{
+	static void integrate(RigidWorld *world, UINT begin, UINT end, FLOAT duration);
+	static void integrate(vec3 *position, vec3 *velocity, vec3 *previous_acceleration, CONST vec3 &acceleration, FLOAT duration)
+	{
+		//前のステップで仮に与えた後半の半ステップを、今の位置での加速度による値に置き換える
+		if (previous_acceleration->x != NO_PREVIOUS_ACCELERATION) *velocity += 0.5f * (acceleration - *previous_acceleration) * duration;
+		*position += *velocity * duration + 0.5f * acceleration * duration * duration;
+		*velocity += acceleration * duration;
+		*previous_acceleration = acceleration;
+	}
+};
+
+//4次のルンゲ・クッタ法
+//姿勢と角運動量を4段で積分する、最も高価だが回転の精度が最も高い方法
+//力はステップの開始時に1回しか求まらず途中の段の位置での力を評価できないため、並進(と質点)は速度ベルレ法と同じ
+struct RungeKutta4
+{
+	static void integrate(RigidWorld *world, UINT begin, UINT end, FLOAT duration);
+	static void integrate(vec3 *position, vec3 *velocity, vec3 *previous_acceleration, CONST vec3 &acceleration, FLOAT duration)
+	{
+		VelocityVerlet::integrate(position, velocity, previous_acceleration, acceleration, duration);
+	}
+};
+
+//指数写像による回転と陰的なジャイロ項
+//並進は半陰的オイラー法と同じ
+//角速度はローカル空間でジャイロ項 w × Iw を陰的に(ニュートン法1回で)解き、姿勢は角速度による回転を厳密に与える
+//大きな角速度や細長い物体でも発散せず、安定なステップ幅を大きく取れる
+struct ExponentialMap
+{
+	static void integrate(RigidWorld *world, UINT begin, UINT end, FLOAT duration);
+	static void integrate(vec3 *position, vec3 *velocity, vec3 *previous_acceleration, CONST vec3 &acceleration, FLOAT duration)
+	{
+		SemiImplicitEuler::integrate(position, velocity, previous_acceleration, acceleration, duration);
+	}
+};
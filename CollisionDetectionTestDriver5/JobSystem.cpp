@@ -0,0 +1,216 @@
+#include <assert.h>
+#include "JobSystem.h"
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//実行中のスレッドがワーカースレッドの場合の、所属するジョブシステムとキューの番号
+struct WorkerIdentity
+{
+	const JobSystem *system;
+	UINT index;
+};
+static thread_local WorkerIdentity worker_identity = { 0, 0 };
+
+//スレッドを論理CPU cpuに固定する(対応していない環境では何もしない)
+static void pin_thread(std::thread &thread, UINT cpu)
+{
+#if defined(_WIN32)
+	SetThreadAffinityMask((HANDLE)thread.native_handle(), (DWORD_PTR)1 << (cpu % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % CPU_SETSIZE, &set);
+	pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+	(void)thread;
+	(void)cpu;
+#endif
+}
+
+JobSystem::JobSystem(UINT thread_count, BOOL pin_threads) : queued(0), sleeping(0), quit(false)
+{
+	if (thread_count == 0) thread_count = 1;
+	for (UINT t = 0; t < thread_count; t++)
+	{
+		queues.push_back(std::unique_ptr<Queue>(new Queue));
+	}
+	//キュー0は外部のスレッドが使い、ワーカースレッドnはキューnを使う
+	const UINT cpus = hardware_thread_count();
+	for (UINT t = 1; t < thread_count; t++)
+	{
+		workers.push_back(std::thread([this, t]() { worker_main(t); }));
+		if (pin_threads) pin_thread(workers.back(), t % cpus);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t t = 0; t < workers.size(); t++)
+	{
+		workers[t].join();
+	}
+}
+
+UINT JobSystem::current_queue() const
+{
+	return worker_identity.system == this ? worker_identity.index : 0;
+}
+
+void JobSystem::submit(const Job &job)
+{
+	job.counter->fetch_add(1);
+	Queue &queue = *queues[current_queue()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.push_back(job);
+	}
+	queued.fetch_add(1);
+
+	//眠っているワーカースレッドがあれば1つ起こす(sleepingはqueuedを確かめる前に増やすため、起こし損ねない)
+	if (sleeping.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+		}
+		wake.notify_one();
+	}
+}
+
+bool JobSystem::pop(UINT self, Job *job)
+{
+	Queue &queue = *queues[self];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.empty()) return false;
+	*job = queue.pop_back();
+	queued.fetch_sub(1);
+	return true;
+}
+
+bool JobSystem::steal(UINT self, Job *job)
+{
+	//自分の次のキューから順に、先頭(最も早く積まれた大きな範囲)のジョブを盗む
+	const UINT n = thread_count();
+	for (UINT k = 1; k < n; k++)
+	{
+		Queue &queue = *queues[(self + k) % n];
+		std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+		if (!lock.owns_lock() || queue.empty()) continue;
+		*job = queue.pop_front();
+		queued.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+bool JobSystem::run_one(UINT self)
+{
+	Job job;
+	if (!pop(self, &job) && !steal(self, &job)) return false;
+	job.function(job.context, job.begin, job.end);
+	job.counter->fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+void JobSystem::wait(std::atomic<UINT> *counter)
+{
+	const UINT self = current_queue();
+	while (counter->load(std::memory_order_acquire) > 0)
+	{
+		//待つ間も自分のキューと他のスレッドのキューのジョブを実行する(残りのジョブが全て実行中の場合は譲る)
+		if (!run_one(self)) std::this_thread::yield();
+	}
+}
+
+void JobSystem::worker_main(UINT index)
+{
+	worker_identity.system = this;
+	worker_identity.index = index;
+	for (;;)
+	{
+		if (run_one(index)) continue;
+
+		//ジョブがなければ、積まれるか終了するまで眠る
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleeping.fetch_add(1);
+		wake.wait(lock, [this]() { return quit || queued.load() > 0; });
+		sleeping.fetch_sub(1);
+		if (quit) return;
+	}
+}
+
+UINT TaskGraph::add(const std::function<void()> &function)
+{
+	Task task;
+	task.function = function;
+	task.predecessors = 0;
+	tasks.push_back(task);
+	return (UINT)tasks.size() - 1;
+}
+
+void TaskGraph::precede(UINT before, UINT after)
+{
+	assert(before < tasks.size() && after < tasks.size() && before != after);
+	tasks[before].successors.push_back(after);
+	tasks[after].predecessors++;
+}
+
+void TaskGraph::clear()
+{
+	tasks.clear();
+}
+
+void TaskGraph::execute(void *context, UINT task, UINT)
+{
+	TaskGraph *graph = (TaskGraph *)context;
+	const Task &t = graph->tasks[task];
+	t.function();
+
+	//後続のタスクのうち、全ての先行タスクが終わったものを積む(自分のカウンタを減らす前に積むため、runが先に終わることはない)
+	for (size_t k = 0; k < t.successors.size(); k++)
+	{
+		UINT next = t.successors[k];
+		if (graph->remaining[next].fetch_sub(1) == 1)
+		{
+			JobSystem::Job job = { &TaskGraph::execute, graph, next, 0, graph->counter };
+			graph->jobs->submit(job);
+		}
+	}
+}
+
+void TaskGraph::run(JobSystem *jobs)
+{
+	const UINT n = size();
+	if (n == 0) return;
+	if (capacity < n)
+	{
+		remaining.reset(new std::atomic<UINT>[n]);
+		capacity = n;
+	}
+	for (UINT k = 0; k < n; k++)
+	{
+		remaining[k].store(tasks[k].predecessors);
+	}
+
+	//先行タスクのないタスクから始める(後に積んだものから実行されるため、番号の大きい順に積む)
+	std::atomic<UINT> pending(0);
+	this->jobs = jobs;
+	this->counter = &pending;
+	for (UINT k = n; k > 0; k--)
+	{
+		if (tasks[k - 1].predecessors > 0) continue;
+		JobSystem::Job job = { &TaskGraph::execute, this, k - 1, 0, &pending };
+		jobs->submit(job);
+	}
+	jobs->wait(&pending);
+	this->jobs = 0;
+	this->counter = 0;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "PhysicsMath.h"
+#include "Parallel.h"
+
+//ワークスティーリングのジョブシステム
+//スレッドごとにジョブの両端キューを持ち、自分のキューは末尾から(後に積んだ順に)取り出し、
+//自分のキューが空になったら他のスレッドのキューの先頭から(分割の大きいジョブを)盗んで実行する
+//
+//ジョブの完了はカウンタで待つ(waitは待つ間も自分でジョブを実行するため、ジョブの中から入れ子にparallel_forを呼んでもよい)
+//thread_countが1の場合はワーカースレッドを作らず、全てのジョブをwaitを呼んだスレッドで実行する
+struct JobSystem
+{
+	//ジョブ(function(context, begin, end)を実行し、終わったらcounterを1減らす)
+	struct Job
+	{
+		void (*function)(void *context, UINT begin, UINT end);
+		void *context;
+		UINT begin, end;
+		std::atomic<UINT> *counter;
+	};
+
+	//thread_countは呼び出し元を含むスレッド数、pin_threadsが真の場合はワーカースレッドnを論理CPU nに固定する
+	JobSystem(UINT thread_count = hardware_thread_count(), BOOL pin_threads = FALSE);
+	~JobSystem();
+
+	UINT thread_count() const
+	{
+		return (UINT)queues.size();
+	}
+
+	//ジョブを呼び出したスレッドのキューに積む(counterは積む前に1増やす)
+	void submit(const Job &job);
+	//counterが0になるまで、ジョブを実行しながら待つ
+	void wait(std::atomic<UINT> *counter);
+
+	//[0, count)を分割してf(begin, end)を並列に呼び出し、全て終わるまで待つ
+	//範囲は二分割を繰り返して後半をキューに積み、grain以下になったら実行する(grainが0の場合はスレッド数の8倍程度の数に分かれる大きさ)
+	template <typename F> void parallel_for(UINT count, UINT grain, F f)
+	{
+		if (count == 0) return;
+		if (grain == 0) grain = count / (thread_count() * 8);
+		if (grain == 0) grain = 1;
+		if (thread_count() <= 1 || count <= grain)
+		{
+			f(0u, count);
+			return;
+		}
+		std::atomic<UINT> counter(0);
+		RangeContext<F> context = { this, &f, grain, &counter };
+		Job job = { &RangeContext<F>::run, &context, 0, count, &counter };
+		submit(job);
+		wait(&counter);
+	}
+
+private:
+	//スレッドごとのジョブのキュー
+	//両端から取り出せるリングバッファで、足りなくなった場合だけ容量を倍にする(std::dequeのようにブロックの境界を行き来するたびに確保・解放しない)
+	struct Queue
+	{
+		std::mutex mutex;
+		std::vector<Job> jobs;	//大きさは2の累乗
+		UINT head, tail;	//[head, tail)が積まれたジョブ(jobsの位置は大きさで割った余り)
+
+		Queue() : jobs(256), head(0), tail(0) {}
+		bool empty() const
+		{
+			return head == tail;
+		}
+		void push_back(const Job &job)
+		{
+			const UINT mask = (UINT)jobs.size() - 1;
+			if (tail - head == jobs.size())
+			{
+				std::vector<Job> grown(jobs.size() * 2);
+				for (UINT k = head; k != tail; k++) grown[k - head] = jobs[k & mask];
+				jobs.swap(grown);
+				tail -= head;
+				head = 0;
+			}
+			jobs[tail++ & ((UINT)jobs.size() - 1)] = job;
+		}
+		Job pop_back()
+		{
+			return jobs[--tail & ((UINT)jobs.size() - 1)];
+		}
+		Job pop_front()
+		{
+			return jobs[head++ & ((UINT)jobs.size() - 1)];
+		}
+	};
+	std::vector<std::unique_ptr<Queue> > queues;	//0番は外部のスレッド(ワーカースレッド以外)が使う
+	std::vector<std::thread> workers;
+
+	std::atomic<UINT> queued;	//全てのキューのジョブの数
+	std::atomic<UINT> sleeping;	//ジョブを待って眠っているワーカースレッドの数
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	bool quit;
+
+	template <typename F> struct RangeContext
+	{
+		JobSystem *jobs;
+		F *f;
+		UINT grain;
+		std::atomic<UINT> *counter;
+
+		static void run(void *context, UINT begin, UINT end)
+		{
+			RangeContext *range = (RangeContext *)context;
+			//後半を盗まれる単位としてキューに積み、前半を自分で続けて分割する
+			while (end - begin > range->grain)
+			{
+				UINT middle = begin + (end - begin) / 2;
+				Job job = { &RangeContext::run, context, middle, end, range->counter };
+				range->jobs->submit(job);
+				end = middle;
+			}
+			(*range->f)(begin, end);
+		}
+	};
+
+	UINT current_queue() const;
+	bool pop(UINT self, Job *job);
+	bool steal(UINT self, Job *job);
+	bool run_one(UINT self);
+	void worker_main(UINT index);
+};
+
+//jobsを与えた場合はjobs->parallel_forで[0, count)を並列に処理し、0の場合は呼び出し元のスレッドでf(0, count)を呼ぶ
+//(質点のソルバーなど、JobSystem *jobsを持ち0なら直列に処理する処理で使う)
+//範囲はスレッド数の8倍程度に分け、grainより小さくは分けない(grain以下の範囲は分けずに呼び出し元のスレッドで処理する)
+template <typename F> void parallel_for(JobSystem *jobs, UINT count, UINT grain, F f)
+{
+	if (count == 0) return;
+	if (!jobs)
+	{
+		f(0u, count);
+		return;
+	}
+	const UINT split = count / (jobs->thread_count() * 8);
+	jobs->parallel_for(count, split > grain ? split : grain, f);
+}
+
+//依存関係を持つタスクの集まり
+//precede(a, b)でタスクaの後にbを実行し、依存関係のないタスクは並列に実行する(runはJobSystemの全スレッドで実行する)
+//グラフは作り直さずに何度でもrunできる
+struct TaskGraph
+{
+	TaskGraph() : capacity(0), jobs(0), counter(0) {}
+
+	//タスクを追加し、その番号を返す
+	UINT add(const std::function<void()> &function);
+	//タスクbeforeが終わるまでタスクafterを開始しない
+	void precede(UINT before, UINT after);
+	void clear();
+	UINT size() const
+	{
+		return (UINT)tasks.size();
+	}
+
+	//全てのタスクを依存関係の順に実行し、全て終わるまで待つ(依存関係は循環してはならない)
+	void run(JobSystem *jobs);
+
+private:
+	struct Task
+	{
+		std::function<void()> function;
+		std::vector<UINT> successors;
+		UINT predecessors;
+	};
+	std::vector<Task> tasks;
+	std::unique_ptr<std::atomic<UINT>[]> remaining;	//タスクごとの未完了の先行タスクの数(runで初期化する)
+	UINT capacity;	//remainingの大きさ
+	JobSystem *jobs;	//実行中のrunの引数
+	std::atomic<UINT> *counter;	//実行中のrunの完了を待つカウンタ
+
+	static void execute(void *context, UINT task, UINT unused);
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <assert.h>
+#include <vector>
+#include "AlignedAllocator.h"
+
+//キャッシュラインの大きさ(プールの領域の境界をそろえる単位)
+static const size_t CACHE_LINE_SIZE = 64;
+
+//同じ大きさのブロックをまとめて(チャンク単位で)確保し、解放したブロックを再利用する記憶域
+//要素ごとのnew/deleteをやめ、使用数が最大値に達した後はヒープから確保しないようにする
+//(ブロックはチャンクを解放するまで移動しない、スレッドセーフではない)
+class BlockPool
+{
+public:
+	//ブロックの大きさはblock_alignmentの倍数に切り上げる(チャンクの先頭はキャッシュラインにそろえる)
+	BlockPool(size_t block_size, size_t blocks_per_chunk = 256, size_t block_alignment = 16)
+		: block_size((block_size + block_alignment - 1) / block_alignment * block_alignment), blocks_per_chunk(blocks_per_chunk), free_list(0), used(0)
+	{
+		if (this->block_size < sizeof(FreeBlock)) this->block_size = (sizeof(FreeBlock) + block_alignment - 1) / block_alignment * block_alignment;
+	}
+	~BlockPool()
+	{
+		for (size_t c = 0; c < chunks.size(); c++)
+		{
+			aligned_free(chunks[c]);
+		}
+	}
+
+	void *allocate()
+	{
+		if (!free_list) add_chunk();
+		FreeBlock *block = free_list;
+		free_list = block->next;
+		used++;
+		return block;
+	}
+	void deallocate(void *p)
+	{
+		if (!p) return;
+		assert(used > 0);
+		FreeBlock *block = static_cast<FreeBlock *>(p);
+		block->next = free_list;
+		free_list = block;
+		used--;
+	}
+	//あらかじめcount個のブロックを使えるようにしておく
+	void reserve(size_t count)
+	{
+		while (capacity() < count) add_chunk();
+	}
+
+	size_t size() const { return used; }	//使用中のブロックの数
+	size_t capacity() const { return chunks.size() * blocks_per_chunk; }
+	size_t memory_bytes() const { return capacity() * block_size; }	//チャンクとして確保したバイト数
+
+private:
+	struct FreeBlock
+	{
+		FreeBlock *next;
+	};
+	size_t block_size, blocks_per_chunk;
+	std::vector<void *> chunks;
+	FreeBlock *free_list;
+	size_t used;
+
+	void add_chunk()
+	{
+		char *chunk = static_cast<char *>(aligned_malloc(block_size * blocks_per_chunk, CACHE_LINE_SIZE));
+		if (!chunk) throw std::bad_alloc();
+		chunks.push_back(chunk);
+		//チャンクの先頭のブロックから順に使われるように、末尾から空きリストに積む
+		for (size_t b = blocks_per_chunk; b > 0; b--)
+		{
+			FreeBlock *block = reinterpret_cast<FreeBlock *>(chunk + (b - 1) * block_size);
+			block->next = free_list;
+			free_list = block;
+		}
+	}
+
+	BlockPool(const BlockPool &);
+	BlockPool &operator=(const BlockPool &);
+};
+
+//一時的な配列を先頭から順に割り当てる記憶域(線形アロケータ)
+//個別には解放せず、resetで全てをO(1)で戻す(デストラクタは呼ばないため、要素はPOD型に限る)
+//割り当ての先頭はキャッシュラインにそろえる
+//ブロックが足りない場合は追加のブロックを確保し、次のresetで使用量の最大値を収める1つのブロックにまとめ直す
+//(使用量が最大値に達した後はヒープから確保しない、スレッドセーフではない、コピーすると空の記憶域になる)
+class LinearArena
+{
+public:
+	LinearArena(size_t initial_size = 64 * 1024) : block(0), block_size(0), used(0), overflow_bytes(0), peak(0), initial_size(initial_size) {}
+	LinearArena(const LinearArena &a) : block(0), block_size(0), used(0), overflow_bytes(0), peak(0), initial_size(a.initial_size) {}
+	LinearArena &operator=(const LinearArena &)
+	{
+		release_overflow();
+		used = 0;
+		return *this;
+	}
+	~LinearArena()
+	{
+		release_overflow();
+		aligned_free(block);
+	}
+
+	//count個のTの領域(初期化しない)
+	template <typename T> T *allocate(size_t count)
+	{
+		return static_cast<T *>(allocate_bytes(count * sizeof(T)));
+	}
+	void *allocate_bytes(size_t bytes)
+	{
+		bytes = (bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+		void *p;
+		if (used + bytes <= block_size)
+		{
+			p = static_cast<char *>(block) + used;
+			used += bytes;
+		}
+		else
+		{
+			//ブロックに収まらない分は個別に確保し、resetまで保持する
+			p = aligned_malloc(bytes, CACHE_LINE_SIZE);
+			if (!p) throw std::bad_alloc();
+			overflow.push_back(p);
+			overflow_bytes += bytes;
+		}
+		if (used + overflow_bytes > peak) peak = used + overflow_bytes;
+		return p;
+	}
+	//割り当てた全ての領域を無効にする
+	void reset()
+	{
+		if (!overflow.empty())
+		{
+			//次からは使用量の最大値が1つのブロックに収まるようにする
+			release_overflow();
+			aligned_free(block);
+			block_size = peak + peak / 2 > initial_size ? peak + peak / 2 : initial_size;
+			block = aligned_malloc(block_size, CACHE_LINE_SIZE);
+			if (!block) throw std::bad_alloc();
+		}
+		used = 0;
+	}
+	//resetの直後に呼び、合計bytesまでの割り当てが1つのブロックに収まるようにする(ブロックが小さい場合だけ確保し直す)
+	void reserve(size_t bytes)
+	{
+		assert(used == 0 && overflow.empty());
+		if (bytes <= block_size) return;
+		aligned_free(block);
+		block_size = bytes;
+		block = aligned_malloc(block_size, CACHE_LINE_SIZE);
+		if (!block) throw std::bad_alloc();
+	}
+
+	size_t used_bytes() const { return used + overflow_bytes; }	//reset以降に割り当てたバイト数
+	size_t peak_bytes() const { return peak; }	//使用量の最大値
+	size_t memory_bytes() const { return block_size + overflow_bytes; }	//確保しているバイト数
+
+private:
+	void *block;
+	size_t block_size, used;
+	std::vector<void *> overflow;	//ブロックに収まらなかった領域
+	size_t overflow_bytes, peak, initial_size;
+
+	void release_overflow()
+	{
+		for (size_t k = 0; k < overflow.size(); k++)
+		{
+			aligned_free(overflow[k]);
+		}
+		overflow.clear();
+		overflow_bytes = 0;
+	}
+};
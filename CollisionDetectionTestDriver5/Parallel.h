@@ -0,0 +1,11 @@
+#pragma once
+
+#include <thread>
+#include "PhysicsMath.h"
+
+//使用できるハードウェアスレッド数(取得できない場合は1)
+inline UINT hardware_thread_count()
+{
+	UINT n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
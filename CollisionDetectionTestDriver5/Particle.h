@@ -1,49 +1,55 @@
 #pragma once
 
-#include <d3dx9.h>
+#include "PhysicsMath.h"
 #include <assert.h>
+#include "Integrator.h"
 
 class Particle
 {
 public:
 	FLOAT mass;
-	D3DXVECTOR3 position;
-	D3DXVECTOR3 velocity;
+	vec3 position;
+	vec3 velocity;
 
 private:
-	D3DXVECTOR3 acceleration;
-	D3DXVECTOR3 resultant;
+	vec3 acceleration;
+	vec3 resultant;
+	vec3 previous_acceleration;	//直前のステップの加速度(速度ベルレ法が使う)
 
 public:
 	Particle() : mass(FLT_MAX), position(0, 0, 0), velocity(0, 0, 0),
-		acceleration(0, 0, 0), resultant(0, 0, 0) {}
+		acceleration(0, 0, 0), resultant(0, 0, 0), previous_acceleration(NO_PREVIOUS_ACCELERATION, 0, 0) {}
 
 	virtual ~Particle() {}
 
 	void integrate(FLOAT duration)
+	{
+		integrate<SemiImplicitEuler>(duration);
+	}
+	//インテグレータ(Integrator.hのポリシー)を指定して1ステップ進める
+	template <typename INTEGRATOR> void integrate(FLOAT duration)
 	{
 		assert(mass > 0);
 
 		acceleration = (resultant / mass);
-		velocity += acceleration * duration;
-		position += velocity * duration;
+		INTEGRATOR::integrate(&position, &velocity, &previous_acceleration, acceleration, duration);
 
-		resultant = D3DXVECTOR3(0, 0, 0);
+		resultant = vec3(0, 0, 0);
 	}
-	void add_force(CONST D3DXVECTOR3 &force)
+	void add_force(CONST vec3 &force)
 	{
 		resultant += force;
 	}
-	const D3DXVECTOR3 &get_acceleration() const
+	const vec3 &get_acceleration() const
 	{
 		return acceleration;
 	}
-	void collide(D3DXVECTOR3 normal, FLOAT restitution, FLOAT penetration)
+	void collide(vec3 normal, FLOAT restitution, FLOAT penetration)
 	{
 		assert(penetration > 0);
 
-		D3DXVec3Normalize(&normal, &normal);
-		FLOAT v = D3DXVec3Dot(&velocity, &normal);
+		normal = normalize(normal);
+		FLOAT v = dot(velocity, normal);
 		if (v < 0)
 		{
 			velocity += -(restitution + 1) * v * normal;
@@ -60,11 +66,11 @@ public:
 		FLOAT e = restitution;
 		FLOAT d = penetration;
 
-		D3DXVECTOR3 n = q->position - p->position;
-		D3DXVec3Normalize(&n, &n);
+		vec3 n = q->position - p->position;
+		n = normalize(n);
 
-		FLOAT v1 = D3DXVec3Dot(&p->velocity, &n);
-		FLOAT v2 = D3DXVec3Dot(&q->velocity, &n);
+		FLOAT v1 = dot(p->velocity, n);
+		FLOAT v2 = dot(q->velocity, n);
 		if (v1 - v2 > 0)
 		{
 			p->velocity += ((m1 * v1 + m2 * v2 + e * m2 * (v2 - v1)) / (m1 + m2) - v1) * n;
@@ -76,26 +82,26 @@ public:
 #else
 	static void collide( Particle *p, Particle *q, FLOAT restitution, FLOAT penetration )
 	{
-		//Q[҂̂߂̕V~[V ̕ p.78-81
-		D3DXVECTOR3 Va = p->velocity;
-		D3DXVECTOR3 Vb = q->velocity;
+		//ゲーム制作者のための物理シミュレーション 剛体編 p.78-81
+		vec3 Va = p->velocity;
+		vec3 Vb = q->velocity;
 		FLOAT ma = p->mass;
 		FLOAT mb = q->mass;
 		FLOAT e = restitution;
 		FLOAT d = penetration;
 
-		D3DXVECTOR3 n = q->position - p->position;
-		D3DXVec3Normalize( &n, &n );
+		vec3 n = q->position - p->position;
+		n = normalize(n);
 
-		D3DXVECTOR3 Vab = Vb - Va;
-		//D3DXVECTOR3 Vn = D3DXVec3Dot( &Vab, &n ) * n;
-		//D3DXVECTOR3 Vt = Vab - Vn;
+		vec3 Vab = Vb - Va;
+		//vec3 Vn = dot(Vab, n) * n;
+		//vec3 Vt = Vab - Vn;
 
-		//if( D3DXVec3Dot( &Vab, &n ) < 0 )
+		//if( dot(Vab, n) < 0 )
 		{
 			FLOAT cd = 30.0f;
-			FLOAT c = ma * mb / ( ma + mb ) * ( ( 1 + e ) * D3DXVec3Dot( &Vab, &n ) - cd * d );
-			//FLOAT c = ma * mb / ( ma + mb ) * ( ( 1 + e ) * D3DXVec3Dot( &Vab, &n ) );
+			FLOAT c = ma * mb / ( ma + mb ) * ( ( 1 + e ) * dot(Vab, n) - cd * d );
+			//FLOAT c = ma * mb / ( ma + mb ) * ( ( 1 + e ) * dot(Vab, n) );
 
 			p->velocity += c * n / ma;
 			q->velocity -= c * n / mb;
@@ -111,7 +117,13 @@ public:
 		Particle *q;
 		FLOAT length;
 
-		Constraint(Particle *p, Particle *q) : p(p), q(q), length(D3DXVec3Length(&(q->position - p->position))) {}
+		Constraint(Particle *p, Particle *q) : p(p), q(q)
+		{
+			vec3 d = q->position - p->position;
+			length = ::length(d);
+		}
+		//派生クラス(Rod, Cable)をConstraint *のまま削除できるようにする
+		virtual ~Constraint() {}
 
 		virtual void resolve(FLOAT duration) = 0;
 	};
@@ -121,12 +133,12 @@ public:
 		void resolve(FLOAT duration)
 		{
 			assert(length > 0);
-			D3DXVECTOR3 n = q->position - p->position;
-			FLOAT l = D3DXVec3Length(&n);
+			vec3 n = q->position - p->position;
+			FLOAT l = ::length(n);
 			FLOAT penetration = length - l;
 			if (fabsf(penetration) > FLT_EPSILON) 
 			{
-				D3DXVec3Normalize(&n, &n);
+				n = normalize(n);
 				p->position -= q->mass / (p->mass + q->mass) * penetration * n;
 				q->position += p->mass / (p->mass + q->mass) * penetration * n;
 			}
@@ -138,11 +150,11 @@ public:
 		void resolve(FLOAT duration)
 		{
 			assert(length > 0);
-			D3DXVECTOR3 n = q->position - p->position;
-			FLOAT l = D3DXVec3Length(&n);
+			vec3 n = q->position - p->position;
+			FLOAT l = ::length(n);
 			if (l - length > FLT_EPSILON)
 			{
-				D3DXVec3Normalize(&n, &n);
+				n = normalize(n);
 				p->position -= q->mass / (p->mass + q->mass) * (length - l) * n;
 				q->position += p->mass / (p->mass + q->mass) * (length - l) * n;
 			}
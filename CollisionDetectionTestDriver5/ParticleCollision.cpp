@@ -0,0 +1,210 @@
+#include <math.h>
+#include <assert.h>
+#include <atomic>
+#include "ParticleCollision.h"
+
+//1つのジョブで処理する質点数の下限(これより小さく分けるとジョブの分割と待ちの方が高くつく)
+static const UINT PARTICLES_PER_JOB = 1024;
+
+ParticleCollision::ParticleCollision(FLOAT radius, FLOAT restitution) :
+	radius(radius), restitution(restitution), jobs(0), reorder(true), contacts(0)
+{
+}
+
+void ParticleCollision::build(const ParticleSystem &system)
+{
+	const UINT n = system.size();
+
+	//ハッシュ表の大きさは質点数の2倍以上の2のべき乗
+	UINT table_size = 1;
+	while (table_size < 2 * n) table_size <<= 1;
+	cell_start.assign(table_size + 1, 0);
+	cell_of_particle.resize(n);
+	sorted.resize(n);
+
+	//質点ごとのハッシュ表の番号を求める
+	const FLOAT inverse_cell = 1.0f / (2 * radius);
+	const FLOAT *px = system.position[0].data(), *py = system.position[1].data(), *pz = system.position[2].data();
+	UINT *cell = cell_of_particle.data();
+	parallel_for(jobs, n, PARTICLES_PER_JOB, [&](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; i++)
+		{
+			cell[i] = cell_hash((INT)floorf(px[i] * inverse_cell), (INT)floorf(py[i] * inverse_cell), (INT)floorf(pz[i] * inverse_cell));
+		}
+	});
+
+	//計数ソートで質点番号をハッシュ表の番号順に並べる
+	for (UINT i = 0; i < n; i++)
+	{
+		cell_start[cell[i] + 1]++;
+	}
+	for (UINT c = 0; c < table_size; c++)
+	{
+		cell_start[c + 1] += cell_start[c];
+	}
+	//cell_start[c + 1]はセルcの終了位置なので、後ろから詰めると同じセル内では質点番号の昇順になる
+	for (UINT i = n; i > 0; i--)
+	{
+		UINT c = cell[i - 1];
+		sorted[--cell_start[c + 1]] = i - 1;
+	}
+	//cell_start[c + 1]はセルcの開始位置まで減ったので、1つずらして開始位置の表にする
+	for (UINT c = 0; c < table_size; c++)
+	{
+		cell_start[c] = cell_start[c + 1];
+	}
+	cell_start[table_size] = n;
+
+	//近傍の質点を連続したメモリから読めるよう、質点の全ての配列をsortedの順に並べ替える
+	sorted_mass.resize(n);
+	for (int k = 0; k < 3; k++)
+	{
+		sorted_position[k].resize(n);
+		sorted_velocity[k].resize(n);
+		sorted_resultant[k].resize(n);
+	}
+	const UINT *order = sorted.data();
+	parallel_for(jobs, n, PARTICLES_PER_JOB, [&](UINT begin, UINT end)
+	{
+		for (UINT s = begin; s < end; s++)
+		{
+			UINT i = order[s];
+			sorted_mass[s] = system.mass[i];
+			for (int k = 0; k < 3; k++)
+			{
+				sorted_position[k][s] = system.position[k][i];
+				sorted_velocity[k][s] = system.velocity[k][i];
+				sorted_resultant[k][s] = system.resultant[k][i];
+			}
+		}
+	});
+}
+
+UINT ParticleCollision::collide_range(UINT begin, UINT end)
+{
+	const FLOAT diameter = 2 * radius;
+	const FLOAT inverse_cell = 1.0f / diameter;
+	const FLOAT e = restitution;
+	const FLOAT *mass = sorted_mass.data();
+	const FLOAT *px = sorted_position[0].data(), *py = sorted_position[1].data(), *pz = sorted_position[2].data();
+	const FLOAT *vx = sorted_velocity[0].data(), *vy = sorted_velocity[1].data(), *vz = sorted_velocity[2].data();
+	const UINT *start = cell_start.data();
+	const UINT mask = (UINT)cell_start.size() - 2;
+	UINT pairs = 0;
+
+	//sortedの順(同じセルの質点が並ぶ順)に処理し、reorderが偽の場合は結果を元の質点番号の位置に書き込む
+	for (UINT s = begin; s < end; s++)
+	{
+		const vec3 p(px[s], py[s], pz[s]);
+		const vec3 v(vx[s], vy[s], vz[s]);
+		const FLOAT m1 = mass[s];
+		vec3 dv(0, 0, 0), dp(0, 0, 0);
+		UINT count = 0;
+
+		//周囲27セルを、x方向に並ぶ3セルずつ(ハッシュ表で連続する範囲)9列に分けて探す
+		INT cx = (INT)floorf(p.x * inverse_cell), cy = (INT)floorf(p.y * inverse_cell), cz = (INT)floorf(p.z * inverse_cell);
+		UINT rows[9];
+		UINT row_count = 0;
+		for (INT z = cz - 1; z <= cz + 1; z++)
+		for (INT y = cy - 1; y <= cy + 1; y++)
+		{
+			rows[row_count++] = cell_hash(cx - 1, y, z);
+		}
+		for (UINT r = 0; r < 9; r++)
+		{
+			//ハッシュの衝突で前の列と範囲が重なる場合と、表の末尾で折り返す場合は、セルごとに重複を除いて調べる
+			bool overlapped = rows[r] + 2 > mask;
+			for (UINT q = 0; q < r; q++)
+			{
+				if (((rows[r] - rows[q] + 2) & mask) <= 4) overlapped = true;
+			}
+			for (UINT b = 0; b < 3; b++)
+			{
+				UINT c = (rows[r] + b) & mask;
+				UINT first = start[c], last = start[c + 1];
+				if (!overlapped)
+				{
+					//重ならない場合は3セルをまとめて1つの範囲として調べる
+					last = start[c + 3];
+					b = 3;
+				}
+				else
+				{
+					bool duplicated = false;
+					for (UINT q = 0; q < r; q++)
+					{
+						if (((c - rows[q]) & mask) <= 2) duplicated = true;
+					}
+					if (duplicated) continue;
+				}
+
+				for (UINT t = first; t < last; t++)
+				{
+					if (t == s) continue;
+					vec3 d(px[t] - p.x, py[t] - p.y, pz[t] - p.z);
+					FLOAT distance_squared = length_sq(d);
+					if (distance_squared >= diameter * diameter || distance_squared == 0) continue;
+
+					//Particle::collideのp側の式(q側の式はnの向きを反転したp側の式と等しい)
+					//((m1 * v1 + m2 * v2 + e * m2 * (v2 - v1)) / (m1 + m2) - v1を質量比で整理し、
+					//不動の質点(mass == FLT_MAX)を含む場合もオーバーフローしないようにする
+					FLOAT distance = sqrtf(distance_squared);
+					vec3 n = d / distance;
+					FLOAT penetration = diameter - distance;
+					FLOAT ratio = mass[t] / (m1 + mass[t]);
+					FLOAT v1 = dot(v, n);
+					FLOAT v2 = vx[t] * n.x + vy[t] * n.y + vz[t] * n.z;
+					if (v1 - v2 > 0)
+					{
+						dv += (1 + e) * ratio * (v2 - v1) * n;
+					}
+					dp -= ratio * penetration * n;
+					count++;
+					if (t > s) pairs++;
+				}
+			}
+		}
+
+		//速度の変化は全ての接触の和、位置の補正は重なりすぎないよう接触の数で平均する
+		if (count > 1) dp /= (FLOAT)count;
+		UINT o = reorder ? s : sorted[s];
+		new_velocity[0][o] = v.x + dv.x;
+		new_velocity[1][o] = v.y + dv.y;
+		new_velocity[2][o] = v.z + dv.z;
+		new_position[0][o] = p.x + dp.x;
+		new_position[1][o] = p.y + dp.y;
+		new_position[2][o] = p.z + dp.z;
+	}
+	return pairs;
+}
+
+void ParticleCollision::resolve(ParticleSystem *system)
+{
+	assert(radius > 0);
+
+	const UINT n = system->size();
+	build(*system);
+	for (int k = 0; k < 3; k++)
+	{
+		new_position[k].resize(n);
+		new_velocity[k].resize(n);
+	}
+
+	//sortedの範囲ごとに並列に処理する(各ジョブは自分の範囲の質点にのみ書き込む)
+	std::atomic<UINT> pairs(0);
+	parallel_for(jobs, n, PARTICLES_PER_JOB, [&](UINT begin, UINT end)
+	{
+		pairs += collide_range(begin, end);
+	});
+	contacts = pairs;
+
+	//解消後の配列をParticleSystemと交換する(reorderが真の場合は質点がsortedの順に並び替わる)
+	if (reorder) system->mass.swap(sorted_mass);
+	for (int k = 0; k < 3; k++)
+	{
+		system->position[k].swap(new_position[k]);
+		system->velocity[k].swap(new_velocity[k]);
+		if (reorder) system->resultant[k].swap(sorted_resultant[k]);
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include "ParticleSystem.h"
+#include "JobSystem.h"
+
+//ParticleSystemの質点同士の衝突
+//質点を半径radiusの球とみなし、一様格子(セルの一辺は直径)のハッシュ表で近傍の質点を探して、
+//Particle::collide(Particle*, Particle*, ...)と同じ運動量の交換の式で衝突を解消する
+//
+//各質点の速度と位置の変化は、その質点から見た全ての接触の寄与を集めて(ヤコビ法)別の配列に書き込むため、
+//sortedの範囲ごとに並列に処理しても同じ質点に複数のスレッドが書き込むことはない
+//(1つの組の寄与は両方の質点で1回ずつ計算されるが、式は対称なのでParticle::collideと同じ結果になる)
+struct ParticleCollision
+{
+	FLOAT radius;	//質点の半径
+	FLOAT restitution;	//反発係数
+	JobSystem *jobs;	//並列に処理するジョブシステム(0の場合は呼び出し元のスレッドで処理する)
+	bool reorder;	//resolveで質点をハッシュ表の順に並べ替えるか(質点番号を保持する場合(ParticleConstraintsなど)は偽にする)
+
+	UINT contacts;	//直前のresolveで見つかった接触している組の数
+
+	ParticleCollision(FLOAT radius, FLOAT restitution = 0.5f);
+
+	//近傍探索のハッシュ表を作り、全ての接触を1回解消する
+	//reorderが真の場合、質点はハッシュ表の順に並べ替えられる(同じ場所の質点が配列でも近くに並ぶため、次のフレーム以降の処理が速くなる)
+	void resolve(ParticleSystem *system);
+
+private:
+	typedef ParticleSystem::FloatArray FloatArray;
+
+	std::vector<UINT> cell_of_particle;	//質点ごとのハッシュ表の番号
+	std::vector<UINT> cell_start;	//ハッシュ表の番号ごとのsortedの開始位置(末尾に番兵を持つ)
+	std::vector<UINT> sorted;	//ハッシュ表の番号順に並べた質点番号
+	FloatArray sorted_mass;	//sortedの順に並べた質量(resolveの最後にParticleSystemの配列と交換する)
+	FloatArray sorted_position[3];	//sortedの順に並べた解消前の位置
+	FloatArray sorted_velocity[3];	//sortedの順に並べた解消前の速度
+	FloatArray sorted_resultant[3];	//sortedの順に並べた力のアキュムレータ(resolveの最後にParticleSystemの配列と交換する)
+	FloatArray new_position[3];	//sortedの順に並べた解消後の位置(resolveの最後にParticleSystemの配列と交換する)
+	FloatArray new_velocity[3];	//sortedの順に並べた解消後の速度
+
+	//x方向に隣り合うセルはハッシュ表でも隣り合うようにする(sortedの順に処理すると近傍の質点がキャッシュに残りやすい)
+	UINT cell_hash(INT x, INT y, INT z) const
+	{
+		return (((UINT)y * 19349663u ^ (UINT)z * 83492791u) + (UINT)x) & (UINT)(cell_start.size() - 2);
+	}
+	void build(const ParticleSystem &system);
+	UINT collide_range(UINT begin, UINT end);
+};
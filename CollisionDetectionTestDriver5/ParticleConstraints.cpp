@@ -0,0 +1,337 @@
+#define NOMINMAX
+#include <math.h>
+#include <assert.h>
+#include <algorithm>
+#include "ParticleConstraints.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PARTICLE_CONSTRAINTS_X86
+#include <immintrin.h>
+#endif
+
+//GCC/ClangではAVX2の関数だけをAVX2向けにコンパイルする(MSVCは指定なしで組み込み関数を使用できる)
+#if defined(PARTICLE_CONSTRAINTS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+//色の数の上限(質点ごとに使用済みの色をビットで記録する)
+static const UINT MAX_COLORS = 64;
+//1つのジョブで解く拘束の数の下限(これ以下のバッチは分けずに呼び出し元のスレッドで解く、小さく分けるとジョブの分割と待ちの方が高くつく)
+static const UINT CONSTRAINTS_PER_JOB = 2048;
+
+ParticleConstraints::ParticleConstraints() :
+	iterations(10), jobs(0), simd_level(detect_simd_level()),
+	built(false), color_start(1, 0), serial_begin(0)
+{
+}
+
+UINT ParticleConstraints::add(UINT p, UINT q, FLOAT rest_length, FLOAT rest_compliance, bool is_unilateral)
+{
+	assert(p != q);
+	assert(rest_length >= 0 && rest_compliance >= 0);
+
+	UINT i = size();
+	first.push_back(p);
+	second.push_back(q);
+	length.push_back(rest_length);
+	compliance.push_back(rest_compliance);
+	unilateral.push_back(is_unilateral ? 1 : 0);
+	built = false;
+	return i;
+}
+
+UINT ParticleConstraints::add_rod(const ParticleSystem &system, UINT p, UINT q, FLOAT rest_compliance)
+{
+	vec3 d = system.get_position(q) - system.get_position(p);
+	return add(p, q, ::length(d), rest_compliance, false);
+}
+
+UINT ParticleConstraints::add_cable(const ParticleSystem &system, UINT p, UINT q, FLOAT rest_compliance)
+{
+	vec3 d = system.get_position(q) - system.get_position(p);
+	return add(p, q, ::length(d), rest_compliance, true);
+}
+
+void ParticleConstraints::clear()
+{
+	first.clear();
+	second.clear();
+	length.clear();
+	compliance.clear();
+	unilateral.clear();
+	built = false;
+}
+
+void ParticleConstraints::build()
+{
+	const UINT n = size();
+
+	//貪欲法で、両端の質点がまだ使っていない最小の色を割り当てる
+	UINT particle_count = 0;
+	for (UINT k = 0; k < n; k++)
+	{
+		particle_count = std::max(particle_count, std::max(first[k], second[k]) + 1);
+	}
+	std::vector<unsigned long long> used(particle_count, 0);
+	std::vector<UINT> color(n);
+	std::vector<UINT> count(MAX_COLORS + 1, 0);
+	for (UINT k = 0; k < n; k++)
+	{
+		unsigned long long mask = used[first[k]] | used[second[k]];
+		UINT c = 0;
+		while (c < MAX_COLORS && (mask >> c & 1)) c++;
+		if (c < MAX_COLORS)
+		{
+			used[first[k]] |= 1ull << c;
+			used[second[k]] |= 1ull << c;
+		}
+		//色が足りない拘束は末尾の直列バッチ(MAX_COLORS)に入れる
+		color[k] = c;
+		count[c]++;
+	}
+
+	//色の順に並べる(同じ色の中では追加順)
+	std::vector<UINT> offset(MAX_COLORS + 2, 0);
+	for (UINT c = 0; c <= MAX_COLORS; c++)
+	{
+		offset[c + 1] = offset[c] + count[c];
+	}
+	color_start.clear();
+	for (UINT c = 0; c < MAX_COLORS && count[c] > 0; c++)
+	{
+		color_start.push_back(offset[c]);
+	}
+	color_start.push_back(offset[MAX_COLORS]);
+	serial_begin = offset[MAX_COLORS];
+
+	batch_first.resize(n);
+	batch_second.resize(n);
+	batch_unilateral.resize(n);
+	batch_length.resize(n);
+	batch_compliance.resize(n);
+	batch_lambda.resize(n);
+	for (UINT k = 0; k < n; k++)
+	{
+		UINT b = offset[color[k]]++;
+		batch_first[b] = first[k];
+		batch_second[b] = second[k];
+		batch_unilateral[b] = unilateral[k] ? 0xffffffffu : 0;
+		batch_length[b] = length[k];
+		batch_compliance[b] = compliance[k];
+	}
+	built = true;
+}
+
+void ParticleConstraints::solve(ParticleSystem *system, FLOAT duration)
+{
+	assert(duration > 0);
+
+	if (!built) build();
+	const UINT n = system->size();
+	const UINT m = size();
+
+	//位置と質量の逆数を質点ごとに4要素ずつ並べる
+	particles.resize(4 * n);
+	for (UINT i = 0; i < n; i++)
+	{
+		particles[4 * i + 0] = system->position[0][i];
+		particles[4 * i + 1] = system->position[1][i];
+		particles[4 * i + 2] = system->position[2][i];
+		//Particleと同じく、質量がFLT_MAXの質点は動かない
+		particles[4 * i + 3] = system->mass[i] < FLT_MAX ? 1.0f / system->mass[i] : 0;
+	}
+	batch_lambda.assign(m, 0);
+
+	Batch batch;
+	batch.first = batch_first.data();
+	batch.second = batch_second.data();
+	batch.length = batch_length.data();
+	batch.compliance = batch_compliance.data();
+	batch.unilateral = batch_unilateral.data();
+	batch.lambda = batch_lambda.data();
+	batch.particles = particles.data();
+	batch.alpha_scale = 1.0f / (duration * duration);
+
+	//実行時に検出した命令セットを超える実装は呼び出さない
+	static const SIMD_LEVEL supported = detect_simd_level();
+	const SIMD_LEVEL level = simd_level > supported ? supported : simd_level;
+	void (*solve_range)(const Batch &, UINT, UINT) = solve_distance_scalar;
+#if defined(PARTICLE_CONSTRAINTS_X86)
+	if (level == SIMD_AVX2) solve_range = solve_distance_avx2;
+	else if (level == SIMD_SSE) solve_range = solve_distance_sse;
+#endif
+
+	for (UINT iteration = 0; iteration < iterations; iteration++)
+	{
+		for (UINT c = 0; c < color_count(); c++)
+		{
+			const UINT begin = color_start[c], count = color_start[c + 1] - begin;
+			parallel_for(jobs, count, CONSTRAINTS_PER_JOB, [&](UINT b, UINT e) { solve_range(batch, begin + b, begin + e); });
+		}
+		//色が足りなかった拘束は質点を共有するため、1本ずつ直列に解く
+		solve_distance_scalar(batch, serial_begin, m);
+	}
+
+	//位置の補正量を速度に加え、補正後の位置を書き戻す
+	const FLOAT inverse_duration = 1.0f / duration;
+	for (int k = 0; k < 3; k++)
+	{
+		FLOAT *p = system->position[k].data(), *v = system->velocity[k].data();
+		for (UINT i = 0; i < n; i++)
+		{
+			FLOAT corrected = particles[4 * i + k];
+			v[i] += (corrected - p[i]) * inverse_duration;
+			p[i] = corrected;
+		}
+	}
+}
+
+void solve_distance_scalar(const ParticleConstraints::Batch &batch, UINT begin, UINT end)
+{
+	for (UINT k = begin; k < end; k++)
+	{
+		FLOAT *pi = batch.particles + 4 * batch.first[k], *pj = batch.particles + 4 * batch.second[k];
+		FLOAT wi = pi[3], wj = pj[3];
+		FLOAT dx = pj[0] - pi[0], dy = pj[1] - pi[1], dz = pj[2] - pi[2];
+		FLOAT l = sqrtf(dx * dx + dy * dy + dz * dz);
+		FLOAT C = l - batch.length[k];
+		FLOAT alpha = batch.compliance[k] * batch.alpha_scale;
+		FLOAT lambda = batch.lambda[k];
+
+		//XPBDの乗数の更新(ケーブルは縮む向きの力を持たないので乗数を0以下に制限する)
+		//両端とも動かない拘束(分母が0)は乗数を変えない
+		FLOAT denominator = wi + wj + alpha;
+		FLOAT new_lambda = lambda + (denominator > 0 ? (-C - alpha * lambda) / denominator : 0);
+		if (batch.unilateral[k] && new_lambda > 0) new_lambda = 0;
+		FLOAT s = l > 0 ? (new_lambda - lambda) / l : 0;
+		batch.lambda[k] = new_lambda;
+
+		pi[0] -= wi * s * dx; pi[1] -= wi * s * dy; pi[2] -= wi * s * dz;
+		pj[0] += wj * s * dx; pj[1] += wj * s * dy; pj[2] += wj * s * dz;
+	}
+}
+
+#if defined(PARTICLE_CONSTRAINTS_X86)
+//SSE2で4本ずつ処理する(演算の順序はsolve_distance_scalarと同じ)
+//4質点分の(x, y, z, w)を読み込み、転置して成分ごとのレジスタにする
+void solve_distance_sse(const ParticleConstraints::Batch &batch, UINT begin, UINT end)
+{
+	FLOAT *q = batch.particles;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 alpha_scale = _mm_set1_ps(batch.alpha_scale);
+
+	UINT k = begin;
+	for (; k + 4 <= end; k += 4)
+	{
+		FLOAT *pi[4] = { q + 4 * batch.first[k], q + 4 * batch.first[k + 1], q + 4 * batch.first[k + 2], q + 4 * batch.first[k + 3] };
+		FLOAT *pj[4] = { q + 4 * batch.second[k], q + 4 * batch.second[k + 1], q + 4 * batch.second[k + 2], q + 4 * batch.second[k + 3] };
+		__m128 xi = _mm_load_ps(pi[0]), yi = _mm_load_ps(pi[1]), zi = _mm_load_ps(pi[2]), wi = _mm_load_ps(pi[3]);
+		__m128 xj = _mm_load_ps(pj[0]), yj = _mm_load_ps(pj[1]), zj = _mm_load_ps(pj[2]), wj = _mm_load_ps(pj[3]);
+		_MM_TRANSPOSE4_PS(xi, yi, zi, wi);
+		_MM_TRANSPOSE4_PS(xj, yj, zj, wj);
+
+		__m128 dx = _mm_sub_ps(xj, xi), dy = _mm_sub_ps(yj, yi), dz = _mm_sub_ps(zj, zi);
+		__m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 C = _mm_sub_ps(l, _mm_loadu_ps(batch.length + k));
+		__m128 alpha = _mm_mul_ps(_mm_loadu_ps(batch.compliance + k), alpha_scale);
+		__m128 lambda = _mm_loadu_ps(batch.lambda + k);
+
+		__m128 numerator = _mm_sub_ps(_mm_xor_ps(C, sign), _mm_mul_ps(alpha, lambda));
+		__m128 denominator = _mm_add_ps(_mm_add_ps(wi, wj), alpha);
+		__m128 new_lambda = _mm_add_ps(lambda, _mm_and_ps(_mm_cmpgt_ps(denominator, zero), _mm_div_ps(numerator, denominator)));
+		__m128 clamp = _mm_and_ps(_mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(batch.unilateral + k))), _mm_cmpgt_ps(new_lambda, zero));
+		new_lambda = _mm_andnot_ps(clamp, new_lambda);
+		__m128 s = _mm_and_ps(_mm_cmpgt_ps(l, zero), _mm_div_ps(_mm_sub_ps(new_lambda, lambda), l));
+		_mm_storeu_ps(batch.lambda + k, new_lambda);
+
+		__m128 si = _mm_mul_ps(wi, s), sj = _mm_mul_ps(wj, s);
+		xi = _mm_sub_ps(xi, _mm_mul_ps(si, dx)); yi = _mm_sub_ps(yi, _mm_mul_ps(si, dy)); zi = _mm_sub_ps(zi, _mm_mul_ps(si, dz));
+		xj = _mm_add_ps(xj, _mm_mul_ps(sj, dx)); yj = _mm_add_ps(yj, _mm_mul_ps(sj, dy)); zj = _mm_add_ps(zj, _mm_mul_ps(sj, dz));
+
+		//転置して質点ごとに書き戻す(同じバッチの拘束は質点を共有しないので競合しない)
+		_MM_TRANSPOSE4_PS(xi, yi, zi, wi);
+		_MM_TRANSPOSE4_PS(xj, yj, zj, wj);
+		_mm_store_ps(pi[0], xi); _mm_store_ps(pi[1], yi); _mm_store_ps(pi[2], zi); _mm_store_ps(pi[3], wi);
+		_mm_store_ps(pj[0], xj); _mm_store_ps(pj[1], yj); _mm_store_ps(pj[2], zj); _mm_store_ps(pj[3], wj);
+	}
+	solve_distance_scalar(batch, k, end);
+}
+
+//4行の(x, y, z, w)を2組まとめて8本分の成分ごとのレジスタに転置する(_MM_TRANSPOSE4_PSの256bit版、128bitの各半分で独立に転置する)
+#define TRANSPOSE4X2(r0, r1, r2, r3) \
+	{ \
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3); \
+		__m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3); \
+		r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)); \
+		r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)); \
+		r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)); \
+		r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2)); \
+	}
+
+//AVX2で8本ずつ処理する(演算の順序はsolve_distance_scalarと同じ)
+//拘束b番目とb + 4番目の質点を256bitレジスタの下位と上位に読み込み、128bitの半分ごとに転置する
+TARGET_AVX2 void solve_distance_avx2(const ParticleConstraints::Batch &batch, UINT begin, UINT end)
+{
+	FLOAT *q = batch.particles;
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	const __m256 alpha_scale = _mm256_set1_ps(batch.alpha_scale);
+
+	UINT k = begin;
+	for (; k + 8 <= end; k += 8)
+	{
+		FLOAT *pi[8], *pj[8];
+		for (int b = 0; b < 8; b++)
+		{
+			pi[b] = q + 4 * batch.first[k + b];
+			pj[b] = q + 4 * batch.second[k + b];
+		}
+#define LOAD_PAIR(p, b) _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(p[b])), _mm_load_ps(p[b + 4]), 1)
+		__m256 xi = LOAD_PAIR(pi, 0), yi = LOAD_PAIR(pi, 1), zi = LOAD_PAIR(pi, 2), wi = LOAD_PAIR(pi, 3);
+		__m256 xj = LOAD_PAIR(pj, 0), yj = LOAD_PAIR(pj, 1), zj = LOAD_PAIR(pj, 2), wj = LOAD_PAIR(pj, 3);
+#undef LOAD_PAIR
+		TRANSPOSE4X2(xi, yi, zi, wi);
+		TRANSPOSE4X2(xj, yj, zj, wj);
+
+		__m256 dx = _mm256_sub_ps(xj, xi), dy = _mm256_sub_ps(yj, yi), dz = _mm256_sub_ps(zj, zi);
+		__m256 l = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+		__m256 C = _mm256_sub_ps(l, _mm256_loadu_ps(batch.length + k));
+		__m256 alpha = _mm256_mul_ps(_mm256_loadu_ps(batch.compliance + k), alpha_scale);
+		__m256 lambda = _mm256_loadu_ps(batch.lambda + k);
+
+		__m256 numerator = _mm256_sub_ps(_mm256_xor_ps(C, sign), _mm256_mul_ps(alpha, lambda));
+		__m256 denominator = _mm256_add_ps(_mm256_add_ps(wi, wj), alpha);
+		__m256 new_lambda = _mm256_add_ps(lambda, _mm256_and_ps(_mm256_cmp_ps(denominator, zero, _CMP_GT_OQ), _mm256_div_ps(numerator, denominator)));
+		__m256 clamp = _mm256_and_ps(_mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(batch.unilateral + k))), _mm256_cmp_ps(new_lambda, zero, _CMP_GT_OQ));
+		new_lambda = _mm256_andnot_ps(clamp, new_lambda);
+		__m256 s = _mm256_and_ps(_mm256_cmp_ps(l, zero, _CMP_GT_OQ), _mm256_div_ps(_mm256_sub_ps(new_lambda, lambda), l));
+		_mm256_storeu_ps(batch.lambda + k, new_lambda);
+
+		__m256 si = _mm256_mul_ps(wi, s), sj = _mm256_mul_ps(wj, s);
+		xi = _mm256_sub_ps(xi, _mm256_mul_ps(si, dx)); yi = _mm256_sub_ps(yi, _mm256_mul_ps(si, dy)); zi = _mm256_sub_ps(zi, _mm256_mul_ps(si, dz));
+		xj = _mm256_add_ps(xj, _mm256_mul_ps(sj, dx)); yj = _mm256_add_ps(yj, _mm256_mul_ps(sj, dy)); zj = _mm256_add_ps(zj, _mm256_mul_ps(sj, dz));
+
+		//転置して質点ごとに書き戻す(同じバッチの拘束は質点を共有しないので競合しない)
+		TRANSPOSE4X2(xi, yi, zi, wi);
+		TRANSPOSE4X2(xj, yj, zj, wj);
+#define STORE_PAIR(p, b, r) _mm_store_ps(p[b], _mm256_castps256_ps128(r)); _mm_store_ps(p[b + 4], _mm256_extractf128_ps(r, 1))
+		STORE_PAIR(pi, 0, xi); STORE_PAIR(pi, 1, yi); STORE_PAIR(pi, 2, zi); STORE_PAIR(pi, 3, wi);
+		STORE_PAIR(pj, 0, xj); STORE_PAIR(pj, 1, yj); STORE_PAIR(pj, 2, zj); STORE_PAIR(pj, 3, wj);
+#undef STORE_PAIR
+	}
+	solve_distance_sse(batch, k, end);
+}
+#undef TRANSPOSE4X2
+#else
+void solve_distance_sse(const ParticleConstraints::Batch &batch, UINT begin, UINT end)
+{
+	solve_distance_scalar(batch, begin, end);
+}
+void solve_distance_avx2(const ParticleConstraints::Batch &batch, UINT begin, UINT end)
+{
+	solve_distance_scalar(batch, begin, end);
+}
+#endif
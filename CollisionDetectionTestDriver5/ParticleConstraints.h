@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include "ParticleSystem.h"
+#include "JobSystem.h"
+
+//ParticleSystemの質点間の距離拘束(Particle::Rod, Particle::Cableに相当)をXPBDでまとめて解くソルバー
+//
+//拘束は成分ごとの配列で保持し、同じ質点を共有しない拘束どうしを色分けしてバッチにまとめる
+//同じ色の拘束は互いに独立なので、ジョブに分けて並列に、またSIMDで4・8本ずつ同時に解いても
+//直列に解いた場合と同じ結果になる
+//
+//使い方:ParticleSystem::integrateで位置を予測した後にsolveを呼ぶ
+//solveは拘束で位置を補正し、補正量/durationを速度に加える(拘束方向の速度も消えるためPBDと同じ振る舞いになる)
+//拘束の追加・削除後は最初のsolveで色分けをやり直す
+//Particleと同じく、質量がFLT_MAXの質点は動かない(固定点として使える)
+//質点番号で拘束を保持するため、質点を並べ替える処理(ParticleSystem::kill、ParticleCollision::resolveのreorderが真の場合)とは併用できない
+struct ParticleConstraints
+{
+	typedef ParticleSystem::FloatArray FloatArray;
+	typedef std::vector<UINT, AlignedAllocator<UINT, 32> > IndexArray;
+
+	//拘束(追加順)
+	IndexArray first;	//一方の質点番号
+	IndexArray second;	//他方の質点番号
+	FloatArray length;	//自然長
+	FloatArray compliance;	//コンプライアンス(剛性の逆数、0で伸びない)
+	IndexArray unilateral;	//0以外の場合は自然長より縮む向きには拘束しない(Cable)
+
+	UINT iterations;	//1回のsolveでの反復回数
+	JobSystem *jobs;	//同じ色の拘束を並列に解くジョブシステム(0の場合は呼び出し元のスレッドで解く)
+	SIMD_LEVEL simd_level;	//使用するSIMD命令セット(既定値は実行中のCPUで使用できる最も広いもの)
+
+	ParticleConstraints();
+
+	UINT size() const
+	{
+		return (UINT)first.size();
+	}
+	//拘束を追加し、その番号を返す
+	UINT add(UINT p, UINT q, FLOAT rest_length, FLOAT rest_compliance = 0, bool is_unilateral = false);
+	//現在の質点間の距離を自然長とする棒(Particle::Rod)・ケーブル(Particle::Cable)を追加する
+	UINT add_rod(const ParticleSystem &system, UINT p, UINT q, FLOAT rest_compliance = 0);
+	UINT add_cable(const ParticleSystem &system, UINT p, UINT q, FLOAT rest_compliance = 0);
+	void clear();
+
+	//色分けをやり直す(solveは必要な場合に自動で呼び出す)
+	void build();
+	//色の数(並列に処理できないバッチの数)
+	UINT color_count() const
+	{
+		return (UINT)color_start.size() - 1;
+	}
+
+	//全ての拘束をiterations回反復して解き、速度を更新する
+	void solve(ParticleSystem *system, FLOAT duration);
+
+	//バッチの配列(色の順に並べた拘束)
+	struct Batch
+	{
+		const UINT *first;
+		const UINT *second;
+		const FLOAT *length;
+		const FLOAT *compliance;
+		const UINT *unilateral;
+		FLOAT *lambda;	//ラグランジュ乗数(solveごとにゼロから累積する)
+		FLOAT *particles;	//質点ごとに(x, y, z, 質量の逆数)の4要素を並べた配列(1回の読み書きで1質点を扱うため)
+		FLOAT alpha_scale;	//compliance / duration^2の係数(1 / duration^2)
+	};
+
+private:
+	bool built;	//色分けが拘束の配列と一致しているか
+	std::vector<UINT> color_start;	//色ごとのバッチの開始位置(末尾に番兵を持つ)
+	UINT serial_begin;	//色が足りなかった拘束の開始位置(ここから末尾までは1スレッドで直列に解く)
+
+	IndexArray batch_first, batch_second, batch_unilateral;
+	FloatArray batch_length, batch_compliance, batch_lambda;
+	FloatArray particles;	//Batch::particles(solveの間だけ位置を保持し、最後にParticleSystemへ書き戻す)
+};
+
+//バッチの[begin, end)の拘束を1回ずつ解く(同じ質点を共有する拘束を含んではならない)
+//どの実装も演算の順序が同じなので結果は一致する
+void solve_distance_scalar(const ParticleConstraints::Batch &batch, UINT begin, UINT end);
+void solve_distance_sse(const ParticleConstraints::Batch &batch, UINT begin, UINT end);
+void solve_distance_avx2(const ParticleConstraints::Batch &batch, UINT begin, UINT end);
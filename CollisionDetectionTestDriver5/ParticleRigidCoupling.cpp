@@ -0,0 +1,320 @@
+#define NOMINMAX
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include "ParticleRigidCoupling.h"
+
+//1区画の質点数(区画の分け方は質点数だけで決め、スレッド数によらない)
+static const UINT PARTICLES_PER_PARTITION = 4096;
+//区画の数の上限(区画ごとのアキュムレータは剛体数に比例する大きさを持つため)
+static const UINT MAX_PARTITIONS = 64;
+//格子のセルをこれより多く占める剛体は格子に登録せず、全ての質点と判定する
+static const UINT MAX_CELLS_PER_BODY = 64;
+
+ParticleRigidCoupling::ParticleRigidCoupling(FLOAT radius, FLOAT restitution) :
+	radius(radius), restitution(restitution), cell_size(0), jobs(0), contacts(0),
+	inverse_cell(1)
+{
+}
+
+//剛体番号bのAABBを質点の半径だけ広げて覆うセルの範囲
+static void cell_range(const RigidWorld &world, UINT b, FLOAT margin, FLOAT inverse_cell, INT lo[3], INT hi[3])
+{
+	for (int k = 0; k < 3; k++)
+	{
+		lo[k] = (INT)floorf((world.aabb_min[k][b] - margin) * inverse_cell);
+		hi[k] = (INT)floorf((world.aabb_max[k][b] + margin) * inverse_cell);
+	}
+}
+
+void ParticleRigidCoupling::build(const RigidWorld &world)
+{
+	const UINT m = world.size();
+
+	//セルの一辺は平面を除く剛体のAABBの最大辺の平均(剛体の多くが数セルに収まる大きさ)
+	FLOAT size = cell_size;
+	if (size <= 0)
+	{
+		FLOAT sum = 0;
+		UINT count = 0;
+		for (UINT b = 0; b < m; b++)
+		{
+			if (world.shape[b] == SHAPE_PLANE) continue;
+			FLOAT extent = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				extent = std::max(extent, world.aabb_max[k][b] - world.aabb_min[k][b]);
+			}
+			sum += extent;
+			count++;
+		}
+		size = (count > 0 ? sum / count : 1) + 2 * radius;
+	}
+	inverse_cell = 1.0f / size;
+
+	//剛体ごとに覆うセルを数え、平面と大きな剛体を格子から除く
+	large_bodies.clear();
+	UINT entries = 0;
+	INT lo[3], hi[3];
+	for (UINT b = 0; b < m; b++)
+	{
+		if (world.shape[b] == SHAPE_PLANE)
+		{
+			large_bodies.push_back(b);
+			continue;
+		}
+		cell_range(world, b, radius, inverse_cell, lo, hi);
+		double cells = (double)(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+		if (cells > MAX_CELLS_PER_BODY)
+		{
+			large_bodies.push_back(b);
+			continue;
+		}
+		entries += (UINT)cells;
+	}
+
+	//ハッシュ表の大きさは登録数の2倍以上の2のべき乗
+	UINT table_size = 1;
+	while (table_size < 2 * entries) table_size <<= 1;
+	cell_start.assign(table_size + 1, 0);
+	cell_bodies.resize(entries);
+
+	//計数ソートで剛体番号をハッシュ表の番号順に並べる(ParticleCollision::buildと同じ)
+	for (int pass = 0; pass < 2; pass++)
+	{
+		//1回目は数え、2回目は後ろから詰める(同じセルの中では剛体番号の昇順になる)
+		std::vector<UINT>::const_iterator large = large_bodies.end();
+		for (UINT b = m; b > 0; b--)
+		{
+			if (large != large_bodies.begin() && *(large - 1) == b - 1)
+			{
+				--large;
+				continue;
+			}
+			cell_range(world, b - 1, radius, inverse_cell, lo, hi);
+			for (INT z = hi[2]; z >= lo[2]; z--)
+			for (INT y = hi[1]; y >= lo[1]; y--)
+			for (INT x = hi[0]; x >= lo[0]; x--)
+			{
+				UINT c = cell_hash(x, y, z);
+				if (pass == 0) cell_start[c + 1]++;
+				else cell_bodies[--cell_start[c + 1]] = b - 1;
+			}
+		}
+		if (pass == 0)
+		{
+			for (UINT c = 0; c < table_size; c++)
+			{
+				cell_start[c + 1] += cell_start[c];
+			}
+		}
+	}
+	for (UINT c = 0; c < table_size; c++)
+	{
+		cell_start[c] = cell_start[c + 1];
+	}
+	cell_start[table_size] = entries;
+}
+
+//質点(中心p、半径r)と剛体番号bの接触を求める(法線は剛体から質点へ向かう単位ベクトル)
+static bool collide_particle_body(const RigidWorld &world, UINT b, const vec3 &p, FLOAT r, ContactPoint *contact)
+{
+	const vec3 center = world.get_position(b);
+	const vec3 d = p - center;
+	switch (world.shape[b])
+	{
+	case SHAPE_SPHERE:
+	{
+		//collide_sphere_sphereと同じく、接触点は重なりの中央
+		const FLOAT R = world.dimension[0][b];
+		FLOAT l2 = length_sq(d);
+		if (l2 >= (R + r) * (R + r)) return false;
+		FLOAT l = sqrtf(l2);
+		contact->normal = l > FLT_EPSILON ? d / l : vec3(0, 1, 0);
+		contact->penetration = R + r - l;
+		contact->point = center + (R - 0.5f * contact->penetration) * contact->normal;
+		return true;
+	}
+	case SHAPE_BOX:
+	{
+		//回転行列の行は各ローカル軸のワールド座標での向き
+		vec3 axis[3], local, closest;
+		for (int k = 0; k < 3; k++)
+		{
+			axis[k] = vec3(world.rotation[3 * k][b], world.rotation[3 * k + 1][b], world.rotation[3 * k + 2][b]);
+			FLOAT h = world.dimension[k][b];
+			local[k] = dot(d, axis[k]);
+			closest[k] = std::min(std::max(local[k], -h), h);
+		}
+		vec3 outside = local - closest;
+		FLOAT l2 = length_sq(outside);
+		vec3 normal;
+		if (l2 > 0)
+		{
+			//中心が箱の外にある場合はcollide_sphere_boxと同じく最近点で接触する
+			if (l2 >= r * r) return false;
+			FLOAT l = sqrtf(l2);
+			normal = outside / l;
+			contact->penetration = r - l;
+		}
+		else
+		{
+			//中心が箱の中にある場合(collide_sphere_boxは判定しない)は、最も近い面から押し出す
+			int nearest = 0;
+			FLOAT depth = FLT_MAX;
+			for (int k = 0; k < 3; k++)
+			{
+				FLOAT to_face = world.dimension[k][b] - fabsf(local[k]);
+				if (to_face < depth)
+				{
+					depth = to_face;
+					nearest = k;
+				}
+			}
+			normal = vec3(0, 0, 0);
+			normal[nearest] = local[nearest] < 0 ? -1.0f : 1.0f;
+			closest[nearest] = normal[nearest] * world.dimension[nearest][b];
+			contact->penetration = r + depth;
+		}
+		contact->normal = normal.x * axis[0] + normal.y * axis[1] + normal.z * axis[2];
+		contact->point = center + closest.x * axis[0] + closest.y * axis[1] + closest.z * axis[2];
+		return true;
+	}
+	case SHAPE_PLANE:
+	{
+		//平面の裏側は全て剛体の中とみなす(速い質点が1ステップで平面を通り抜けても押し戻す)
+		const vec3 n(world.rotation[3][b], world.rotation[4][b], world.rotation[5][b]);
+		FLOAT distance = dot(n, d);
+		if (distance >= r) return false;
+		contact->normal = n;
+		contact->penetration = r - distance;
+		contact->point = p - distance * n;
+		return true;
+	}
+	}
+	return false;
+}
+
+void ParticleRigidCoupling::collide_partition(ParticleSystem *particles, const RigidWorld &world, UINT partition, UINT begin, UINT end, FLOAT duration)
+{
+	const UINT m = world.size();
+	FLOAT *wrench = partition_wrench.data() + (size_t)partition * m * 6;
+	std::vector<UINT> &touched = partition_bodies[partition];
+	touched.clear();
+	UINT count = 0;
+
+	const FLOAT e = restitution;
+	const FLOAT inverse_duration = 1.0f / duration;
+	const UINT *start = cell_start.data();
+	const UINT *bodies = cell_bodies.data();
+	for (UINT i = begin; i < end; i++)
+	{
+		const FLOAT mass = particles->mass[i];
+		if (mass == FLT_MAX) continue;
+		vec3 p = particles->get_position(i);
+		vec3 v = particles->get_velocity(i);
+
+		//剛体ごとにParticle::collideと同じ式で押し出し、反射で失った運動量を剛体に与える
+		auto respond = [&](UINT b)
+		{
+			ContactPoint contact;
+			if (!collide_particle_body(world, b, p, radius, &contact)) return;
+			count++;
+			const vec3 &n = contact.normal;
+			vec3 arm = contact.point - world.get_position(b);
+			vec3 spin, body_velocity = world.get_linear_velocity(b), angular_velocity = world.get_angular_velocity(b);
+			spin = cross(angular_velocity, arm);
+			body_velocity += spin;
+			vec3 relative = v - body_velocity;
+			FLOAT vn = dot(relative, n);
+			p += contact.penetration * n;
+			if (vn >= 0) return;
+			vec3 dv = -(e + 1) * vn * n;
+			v += dv;
+			if (world.inverse_mass[b] <= 0) return;
+
+			//add_force_at_pointと同じく力と接触点まわりのトルクを加える
+			vec3 force = -mass * inverse_duration * dv, torque;
+			torque = cross(arm, force);
+			FLOAT *w = wrench + (size_t)b * 6;
+			if (w[0] == 0 && w[1] == 0 && w[2] == 0 && w[3] == 0 && w[4] == 0 && w[5] == 0) touched.push_back(b);
+			w[0] += force.x; w[1] += force.y; w[2] += force.z;
+			w[3] += torque.x; w[4] += torque.y; w[5] += torque.z;
+		};
+
+		for (size_t k = 0; k < large_bodies.size(); k++)
+		{
+			respond(large_bodies[k]);
+		}
+		UINT c = cell_hash((INT)floorf(p.x * inverse_cell), (INT)floorf(p.y * inverse_cell), (INT)floorf(p.z * inverse_cell));
+		for (UINT t = start[c]; t < start[c + 1]; t++)
+		{
+			//ハッシュの衝突で同じ剛体が続けて登録されている場合と、AABBが離れている場合は調べない
+			UINT b = bodies[t];
+			if (t > start[c] && bodies[t - 1] == b) continue;
+			if (p.x + radius < world.aabb_min[0][b] || p.x - radius > world.aabb_max[0][b] ||
+				p.y + radius < world.aabb_min[1][b] || p.y - radius > world.aabb_max[1][b] ||
+				p.z + radius < world.aabb_min[2][b] || p.z - radius > world.aabb_max[2][b]) continue;
+			respond(b);
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			particles->position[k][i] = p[k];
+			particles->velocity[k][i] = v[k];
+		}
+	}
+	partition_contacts[partition] = count;
+}
+
+void ParticleRigidCoupling::resolve(ParticleSystem *particles, RigidWorld *world, FLOAT duration)
+{
+	assert(radius > 0 && duration > 0);
+
+	world->update_transforms();
+	world->update_bounds();
+	build(*world);
+
+	//区画の分け方は質点数だけで決める(スレッド数が変わっても同じ区画の順に力を足す)
+	const UINT n = particles->size();
+	const UINT m = world->size();
+	const UINT partitions = std::max(1u, std::min(MAX_PARTITIONS, (n + PARTICLES_PER_PARTITION - 1) / PARTICLES_PER_PARTITION));
+	if (partition_wrench.size() != (size_t)partitions * m * 6)
+	{
+		partition_wrench.assign((size_t)partitions * m * 6, 0);
+	}
+	partition_bodies.resize(partitions);
+	partition_contacts.assign(partitions, 0);
+
+	parallel_for(jobs, partitions, 1, [&](UINT first, UINT last)
+	{
+		for (UINT q = first; q < last; q++)
+		{
+			UINT begin = (UINT)((unsigned long long)n * q / partitions);
+			UINT end = (UINT)((unsigned long long)n * (q + 1) / partitions);
+			collide_partition(particles, *world, q, begin, end, duration);
+		}
+	});
+
+	//区画の順に剛体のアキュムレータへ足し、区画のアキュムレータをゼロに戻す
+	//(足すのは力を受けた剛体だけなので、質点に比べて少ない接触の数に比例する)
+	contacts = 0;
+	for (UINT q = 0; q < partitions; q++)
+	{
+		FLOAT *wrench = partition_wrench.data() + (size_t)q * m * 6;
+		const std::vector<UINT> &touched = partition_bodies[q];
+		for (size_t k = 0; k < touched.size(); k++)
+		{
+			UINT b = touched[k];
+			FLOAT *w = wrench + (size_t)b * 6;
+			for (int j = 0; j < 3; j++)
+			{
+				world->accumulated_force[j][b] += w[j];
+				world->accumulated_torque[j][b] += w[3 + j];
+			}
+			memset(w, 0, sizeof(FLOAT) * 6);
+		}
+		contacts += partition_contacts[q];
+	}
+}
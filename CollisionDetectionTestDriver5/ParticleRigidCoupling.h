@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include "ParticleSystem.h"
+#include "RigidWorld.h"
+
+//ParticleSystemの質点とRigidWorldの剛体(球体・直方体・平面)の双方向の連成
+//質点を半径radiusの球とみなして剛体との接触を求め、
+//・質点はParticle::collide(normal, restitution, penetration)と同じ式で押し出して反射する(速度は接触点での剛体の速度に対する相対速度で扱う)
+//・質点の運動量の変化の反作用を力(力積 / duration)として、add_force_at_pointと同じく力とトルクを剛体のアキュムレータに加える
+//
+//剛体の近傍探索は一様格子のハッシュ表で、平面と格子のセルを多く占める大きな剛体は全ての質点と判定する
+//質点は固定の大きさの区画に分けてジョブで並列に処理し、剛体への力は区画ごとのアキュムレータに集めてから区画の順に足すため、
+//結果はスレッド数によらない(剛体の速度は処理中に変えないため、質点どうしの処理の順序にも依存しない)
+struct ParticleRigidCoupling
+{
+	typedef ParticleSystem::FloatArray FloatArray;
+
+	FLOAT radius;	//質点の半径
+	FLOAT restitution;	//反発係数
+	FLOAT cell_size;	//近傍探索の格子のセルの一辺(0の場合は剛体のAABBの平均の大きさから決める)
+	JobSystem *jobs;	//区画を並列に処理するジョブシステム(0の場合は呼び出し元のスレッドで処理する)
+
+	UINT contacts;	//直前のresolveで見つかった接触の数
+
+	ParticleRigidCoupling(FLOAT radius, FLOAT restitution = 0.5f);
+
+	//全ての質点と剛体の接触を1回解消し、剛体に力を加える(力はworldの次のintegrateで速度に反映される)
+	//worldのupdate_transformsとupdate_boundsを呼んでから判定する
+	void resolve(ParticleSystem *particles, RigidWorld *world, FLOAT duration);
+
+private:
+	//剛体の近傍探索
+	FLOAT inverse_cell;
+	std::vector<UINT> cell_start;	//ハッシュ表の番号ごとのcell_bodiesの開始位置(末尾に番兵を持つ)
+	std::vector<UINT> cell_bodies;	//ハッシュ表の番号順に並べた剛体番号(同じセルの中では剛体番号の昇順)
+	std::vector<UINT> large_bodies;	//全ての質点と判定する剛体(平面と大きな剛体)
+
+	//区画ごとの剛体への力とトルクのアキュムレータ(区画 * 剛体数 * 6成分、使用後はゼロに戻す)
+	FloatArray partition_wrench;
+	std::vector<std::vector<UINT> > partition_bodies;	//区画ごとの力を加えた剛体番号(最初に加えた順)
+	std::vector<UINT> partition_contacts;	//区画ごとの接触の数
+
+	UINT cell_hash(INT x, INT y, INT z) const
+	{
+		return (((UINT)y * 19349663u ^ (UINT)z * 83492791u) + (UINT)x) & (UINT)(cell_start.size() - 2);
+	}
+	void build(const RigidWorld &world);
+	void collide_partition(ParticleSystem *particles, const RigidWorld &world, UINT partition, UINT begin, UINT end, FLOAT duration);
+};
@@ -0,0 +1,176 @@
+#include <assert.h>
+#include "ParticleSystem.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PARTICLE_SYSTEM_X86
+#include <immintrin.h>
+#endif
+
+//GCC/ClangではAVX2の関数だけをAVX2向けにコンパイルする(MSVCは指定なしで組み込み関数を使用できる)
+#if defined(PARTICLE_SYSTEM_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+void ParticleSystem::reserve(UINT n)
+{
+	for_each_array([n](FloatArray &a) { a.reserve(n); });
+}
+
+UINT ParticleSystem::spawn(FLOAT particle_mass, const vec3 &particle_position, const vec3 &particle_velocity)
+{
+	assert(particle_mass > 0);
+
+	UINT i = size();
+	mass.push_back(particle_mass);
+	for (int k = 0; k < 3; k++)
+	{
+		position[k].push_back(particle_position[k]);
+		velocity[k].push_back(particle_velocity[k]);
+		resultant[k].push_back(0);
+	}
+	return i;
+}
+
+void ParticleSystem::kill(UINT i)
+{
+	assert(i < size());
+	UINT last = size() - 1;
+	for_each_array([i, last](FloatArray &a)
+	{
+		a[i] = a[last];
+		a.pop_back();
+	});
+}
+
+void ParticleSystem::clear()
+{
+	for_each_array([](FloatArray &a) { a.clear(); });
+}
+
+void ParticleSystem::add_gravity(const vec3 &g)
+{
+	const UINT n = size();
+	const FLOAT *m = mass.data();
+	FLOAT *fx = resultant[0].data(), *fy = resultant[1].data(), *fz = resultant[2].data();
+	for (UINT i = 0; i < n; i++)
+	{
+		//不動の質点(mass == FLT_MAX)には加えない(FLT_MAX * gがオーバーフローするため)
+		FLOAT w = m[i] < FLT_MAX ? m[i] : 0;
+		fx[i] += w * g.x;
+		fy[i] += w * g.y;
+		fz[i] += w * g.z;
+	}
+}
+
+static void integrate_scalar(ParticleSystem *system, UINT begin, UINT end, FLOAT duration)
+{
+	const FLOAT *m = system->mass.data();
+	FLOAT *px = system->position[0].data(), *py = system->position[1].data(), *pz = system->position[2].data();
+	FLOAT *vx = system->velocity[0].data(), *vy = system->velocity[1].data(), *vz = system->velocity[2].data();
+	FLOAT *fx = system->resultant[0].data(), *fy = system->resultant[1].data(), *fz = system->resultant[2].data();
+	for (UINT i = begin; i < end; i++)
+	{
+		//vec3の除算(resultant / mass)と同じく逆数を掛ける
+		FLOAT inverse_mass = 1.0f / m[i];
+		vx[i] += fx[i] * inverse_mass * duration;
+		vy[i] += fy[i] * inverse_mass * duration;
+		vz[i] += fz[i] * inverse_mass * duration;
+		px[i] += vx[i] * duration;
+		py[i] += vy[i] * duration;
+		pz[i] += vz[i] * duration;
+		fx[i] = fy[i] = fz[i] = 0;
+	}
+}
+
+#if defined(PARTICLE_SYSTEM_X86)
+//SSE2で4質点ずつ処理する(演算の順序はintegrate_scalarと同じ)
+static void integrate_sse(ParticleSystem *system, UINT begin, UINT end, FLOAT duration)
+{
+	const FLOAT *m = system->mass.data();
+	FLOAT *px = system->position[0].data(), *py = system->position[1].data(), *pz = system->position[2].data();
+	FLOAT *vx = system->velocity[0].data(), *vy = system->velocity[1].data(), *vz = system->velocity[2].data();
+	FLOAT *fx = system->resultant[0].data(), *fy = system->resultant[1].data(), *fz = system->resultant[2].data();
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 dt = _mm_set1_ps(duration);
+
+	UINT i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 mi = _mm_div_ps(one, _mm_loadu_ps(m + i));
+		__m128 nvx = _mm_add_ps(_mm_loadu_ps(vx + i), _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(fx + i), mi), dt));
+		__m128 nvy = _mm_add_ps(_mm_loadu_ps(vy + i), _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(fy + i), mi), dt));
+		__m128 nvz = _mm_add_ps(_mm_loadu_ps(vz + i), _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(fz + i), mi), dt));
+		_mm_storeu_ps(vx + i, nvx);
+		_mm_storeu_ps(vy + i, nvy);
+		_mm_storeu_ps(vz + i, nvz);
+		_mm_storeu_ps(px + i, _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(nvx, dt)));
+		_mm_storeu_ps(py + i, _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(nvy, dt)));
+		_mm_storeu_ps(pz + i, _mm_add_ps(_mm_loadu_ps(pz + i), _mm_mul_ps(nvz, dt)));
+		_mm_storeu_ps(fx + i, zero);
+		_mm_storeu_ps(fy + i, zero);
+		_mm_storeu_ps(fz + i, zero);
+	}
+	integrate_scalar(system, i, end, duration);
+}
+
+//AVX2で8質点ずつ処理する(演算の順序はintegrate_scalarと同じ)
+TARGET_AVX2 static void integrate_avx2(ParticleSystem *system, UINT begin, UINT end, FLOAT duration)
+{
+	const FLOAT *m = system->mass.data();
+	FLOAT *px = system->position[0].data(), *py = system->position[1].data(), *pz = system->position[2].data();
+	FLOAT *vx = system->velocity[0].data(), *vy = system->velocity[1].data(), *vz = system->velocity[2].data();
+	FLOAT *fx = system->resultant[0].data(), *fy = system->resultant[1].data(), *fz = system->resultant[2].data();
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 dt = _mm256_set1_ps(duration);
+
+	UINT i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 mi = _mm256_div_ps(one, _mm256_loadu_ps(m + i));
+		__m256 nvx = _mm256_add_ps(_mm256_loadu_ps(vx + i), _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(fx + i), mi), dt));
+		__m256 nvy = _mm256_add_ps(_mm256_loadu_ps(vy + i), _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(fy + i), mi), dt));
+		__m256 nvz = _mm256_add_ps(_mm256_loadu_ps(vz + i), _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(fz + i), mi), dt));
+		_mm256_storeu_ps(vx + i, nvx);
+		_mm256_storeu_ps(vy + i, nvy);
+		_mm256_storeu_ps(vz + i, nvz);
+		_mm256_storeu_ps(px + i, _mm256_add_ps(_mm256_loadu_ps(px + i), _mm256_mul_ps(nvx, dt)));
+		_mm256_storeu_ps(py + i, _mm256_add_ps(_mm256_loadu_ps(py + i), _mm256_mul_ps(nvy, dt)));
+		_mm256_storeu_ps(pz + i, _mm256_add_ps(_mm256_loadu_ps(pz + i), _mm256_mul_ps(nvz, dt)));
+		_mm256_storeu_ps(fx + i, zero);
+		_mm256_storeu_ps(fy + i, zero);
+		_mm256_storeu_ps(fz + i, zero);
+	}
+	integrate_sse(system, i, end, duration);
+}
+#endif
+
+void ParticleSystem::integrate(FLOAT duration)
+{
+	integrate(0, size(), duration);
+}
+
+void ParticleSystem::integrate(UINT begin, UINT end, FLOAT duration)
+{
+	//実行時に検出した命令セットを超える実装は呼び出さない
+	static const SIMD_LEVEL supported = detect_simd_level();
+	SIMD_LEVEL level = simd_level > supported ? supported : simd_level;
+
+	switch (level)
+	{
+#if defined(PARTICLE_SYSTEM_X86)
+	case SIMD_AVX2:
+		integrate_avx2(this, begin, end, duration);
+		break;
+	case SIMD_SSE:
+		integrate_sse(this, begin, end, duration);
+		break;
+#endif
+	default:
+		integrate_scalar(this, begin, end, duration);
+		break;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include "AlignedAllocator.h"
+#include "BatchIntegrator.h"
+
+//大量の質点を成分ごとの配列(SoA)で保持するコンテナ
+//Particleと同じ計算(acceleration = resultant / mass, velocity += acceleration * duration, position += velocity * duration)で
+//全質点をまとめてインテグレーションする
+//質点の番号はkillで末尾の質点と入れ替わり、ParticleCollision::resolve(reorderが真の場合)とSphFluid::stepで並べ替えられるため、番号を保持し続けてはならない
+struct ParticleSystem
+{
+	typedef std::vector<FLOAT, AlignedAllocator<FLOAT, 32> > FloatArray;
+
+	FloatArray mass;	//質量
+	FloatArray position[3];	//位置(x, y, z)
+	FloatArray velocity[3];	//速度
+	FloatArray resultant[3];	//力のアキュムレータ
+
+	SIMD_LEVEL simd_level;	//integrateで使用するSIMD命令セット(既定値は実行中のCPUで使用できる最も広いもの)
+
+	ParticleSystem() : simd_level(detect_simd_level()) {}
+
+	UINT size() const
+	{
+		return (UINT)mass.size();
+	}
+	//配列の容量を確保する(spawnでの再確保を避ける)
+	void reserve(UINT n);
+
+	//質点を追加し、その番号を返す
+	UINT spawn(FLOAT particle_mass, const vec3 &particle_position, const vec3 &particle_velocity = vec3(0, 0, 0));
+	//質点を削除する(末尾の質点を番号iに移動する)
+	void kill(UINT i);
+	void clear();
+
+	void add_force(UINT i, const vec3 &force)
+	{
+		resultant[0][i] += force.x;
+		resultant[1][i] += force.y;
+		resultant[2][i] += force.z;
+	}
+	//全質点に重力(mass * g)を加える(不動の質点(mass == FLT_MAX)を除く)
+	void add_gravity(const vec3 &g);
+
+	vec3 get_position(UINT i) const { return vec3(position[0][i], position[1][i], position[2][i]); }
+	vec3 get_velocity(UINT i) const { return vec3(velocity[0][i], velocity[1][i], velocity[2][i]); }
+
+	//全質点を1ステップ進め、アキュムレータをゼロリセットする(Particle::integrateと同じ)
+	void integrate(FLOAT duration);
+	void integrate(UINT begin, UINT end, FLOAT duration);
+
+	template <typename F> void for_each_array(F f)
+	{
+		f(mass);
+		for (int k = 0; k < 3; k++)
+		{
+			f(position[k]);
+			f(velocity[k]);
+			f(resultant[k]);
+		}
+	}
+};
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include "PerfCounters.h"
+#if defined(__linux__)
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+const char *const perf_counter_names[PERF_COUNTER_COUNT] = { "cycles", "instructions", "L1d misses", "LLC misses", "branch misses" };
+
+PerfCounters::PerfCounters() : leader(-1)
+{
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+	{
+		fds[c] = -1;
+		slot[c] = 0;
+	}
+	message[0] = 0;
+}
+
+PerfCounters::~PerfCounters()
+{
+	close();
+}
+
+#if defined(__linux__)
+
+//kernel.perf_event_paranoidの値(読めない場合は-99)
+static int perf_event_paranoid()
+{
+	FILE *file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+	if (!file) return -99;
+	int level = -99;
+	if (fscanf(file, "%d", &level) != 1) level = -99;
+	fclose(file);
+	return level;
+}
+
+//呼び出したスレッドを数えるカウンタを開く(groupが-1の場合はグループの先頭として、止めた状態で開く)
+static int open_event(unsigned int type, unsigned long long config, int group)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group < 0 ? 1 : 0;
+	attr.exclude_kernel = 1;	//perf_event_paranoidが2でも開けるようにユーザー空間だけを数える
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+BOOL PerfCounters::open()
+{
+	close();
+	static const unsigned int types[PERF_COUNTER_COUNT] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+	static const unsigned long long configs[PERF_COUNTER_COUNT] =
+	{
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES,
+	};
+	int first_error = 0;
+	UINT opened = 0;
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+	{
+		fds[c] = open_event(types[c], configs[c], leader);
+		if (fds[c] < 0)
+		{
+			if (!first_error) first_error = errno;
+			continue;
+		}
+		if (leader < 0) leader = fds[c];
+		slot[c] = opened++;
+	}
+	if (leader < 0)
+	{
+		snprintf(message, sizeof(message), "perf_event_open: %s (kernel.perf_event_paranoid=%d)", strerror(first_error), perf_event_paranoid());
+		return FALSE;
+	}
+	message[0] = 0;
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+	{
+		if (fds[c] >= 0) continue;
+		const size_t length = strlen(message);
+		snprintf(message + length, sizeof(message) - length, "%s%s", length ? ", " : "unavailable: ", perf_counter_names[c]);
+	}
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return TRUE;
+}
+
+void PerfCounters::close()
+{
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+	{
+		if (fds[c] >= 0) ::close(fds[c]);
+		fds[c] = -1;
+	}
+	leader = -1;
+}
+
+BOOL PerfCounters::read(PerfCounterValues *values) const
+{
+	memset(values, 0, sizeof(*values));
+	if (leader < 0) return FALSE;
+	//PERF_FORMAT_GROUPの形式:カウンタの数、有効だった時間、実際に数えた時間、値...
+	unsigned long long data[3 + PERF_COUNTER_COUNT];
+	if (::read(leader, data, sizeof(data)) < (ssize_t)(3 * sizeof(data[0]))) return FALSE;
+	const unsigned long long enabled = data[1], running = data[2];
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+	{
+		if (fds[c] < 0 || slot[c] >= data[0]) continue;
+		unsigned long long v = data[3 + slot[c]];
+		if (running > 0 && running < enabled) v = (unsigned long long)((double)v * enabled / running);
+		values->value[c] = v;
+	}
+	return TRUE;
+}
+
+#else
+
+BOOL PerfCounters::open()
+{
+	snprintf(message, sizeof(message), "hardware counters are only supported on Linux (perf_event_open)");
+	return FALSE;
+}
+
+void PerfCounters::close()
+{
+}
+
+BOOL PerfCounters::read(PerfCounterValues *values) const
+{
+	memset(values, 0, sizeof(*values));
+	return FALSE;
+}
+
+#endif
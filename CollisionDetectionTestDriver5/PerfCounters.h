@@ -0,0 +1,52 @@
+#pragma once
+
+#include "PhysicsMath.h"
+
+//ハードウェアの性能カウンタ(Linuxのperf_event_open)
+//時間だけでは分からない遅さの理由(命令数・IPC・キャッシュミス・分岐予測ミス)を調べるために使う
+//
+//カウンタは呼び出したスレッドだけを数える(openしたスレッドで使い、他のスレッドと共有しないこと)
+//コンテナや仮想マシン、kernel.perf_event_paranoidの制限などでカウンタを開けない場合はopenが偽を返し、errorに理由を残す
+//一部のカウンタだけを開けた場合は、開けたカウンタだけを数える(availableで確認する、開けなかったカウンタの値は0)
+//同時に数えられる数を超えてカーネルが時分割した場合は、数えた時間の割合で補正した値を返す
+enum PERF_COUNTER
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1D_MISSES,	//L1データキャッシュの読み込みのミス
+	PERF_LLC_MISSES,	//最終段のキャッシュのミス
+	PERF_BRANCH_MISSES,
+	PERF_COUNTER_COUNT
+};
+extern const char *const perf_counter_names[PERF_COUNTER_COUNT];
+
+struct PerfCounterValues
+{
+	unsigned long long value[PERF_COUNTER_COUNT];
+};
+
+class PerfCounters
+{
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	//呼び出したスレッドのカウンタを開いて数え始める(1つも開けなかった場合は偽)
+	BOOL open();
+	void close();
+	BOOL is_open() const { return leader >= 0; }
+	BOOL available(PERF_COUNTER counter) const { return fds[counter] >= 0; }
+	//openからの累計(開いていない場合は偽)
+	BOOL read(PerfCounterValues *values) const;
+	//openが失敗した理由(成功した場合、一部のカウンタを開けなかった場合はその名前)
+	const char *error() const { return message; }
+
+private:
+	int fds[PERF_COUNTER_COUNT];
+	int leader;	//グループの先頭のカウンタ(まとめて1回のreadで読む)
+	UINT slot[PERF_COUNTER_COUNT];	//readで読んだ値の中の位置
+	char message[160];
+
+	PerfCounters(const PerfCounters &);
+	PerfCounters &operator=(const PerfCounters &);
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+//物理のコアが使う型と数学
+//ベクトル・クォータニオン・行列はVectorMath.h(vec3, vec4, quat, mat3, mat4)で表し、コアはD3DXに依存しない
+//(D3DXの型はWin32の描画(Core.cpp, CollisionDetectionTestDriver.h, DebugDrawManager.h)だけが使い、境界での変換はD3DXConvert.hで行う)
+//Windowsの型(FLOAT, UINT, BOOLなど)は、Windowsではwindows.hのものを使い、それ以外の環境では同じ名前・同じ大きさで定義する
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <stdint.h>
+
+typedef float FLOAT;
+typedef int INT;
+typedef unsigned int UINT;
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef uint32_t DWORD;
+#define CONST const
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+#endif
+
+#include <float.h>
+#include "VectorMath.h"
@@ -0,0 +1,275 @@
+#define NOMINMAX
+#include <algorithm>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include "Profiler.h"
+
+std::atomic<bool> Profiler::enabled(false);
+std::atomic<bool> Profiler::counting(false);
+
+Profiler::Profiler() : tracing(false), dropped(0)
+{
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++) counter_probe[c] = FALSE;
+	counter_error[0] = 0;
+	epoch_time = std::chrono::steady_clock::now();
+	epoch_ticks = profile_ticks();
+#if defined(PROFILER_TSC)
+	//最初のcollectまでの換算のため、短く待って較正しておく
+	while (std::chrono::steady_clock::now() - epoch_time < std::chrono::milliseconds(2));
+	ticks_per_us = 0;
+	calibrate();
+#else
+	ticks_per_us = 1000;
+#endif
+}
+
+//epochからの経過時間でprofile_ticksの1マイクロ秒あたりの値を求め直す(経過が長いほど正確になる)
+void Profiler::calibrate()
+{
+#if defined(PROFILER_TSC)
+	const std::chrono::steady_clock::time_point now_time = std::chrono::steady_clock::now();
+	const unsigned long long now_ticks = profile_ticks();
+	const double us = std::chrono::duration<double, std::micro>(now_time - epoch_time).count();
+	if (us > 1000 && now_ticks > epoch_ticks) ticks_per_us = (double)(now_ticks - epoch_ticks) / us;
+#endif
+}
+
+BOOL Profiler::enable_counters(BOOL on)
+{
+	if (!on)
+	{
+		counting.store(false, std::memory_order_relaxed);
+		return TRUE;
+	}
+	//呼び出したスレッドで開けるかを確かめる(他のスレッドはそれぞれ最初の区間で開く)
+	PerfCounters probe;
+	const BOOL opened = probe.open();
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++) counter_probe[c] = probe.available((PERF_COUNTER)c);
+	snprintf(counter_error, sizeof(counter_error), "%s", probe.error());
+	counting.store(opened != FALSE, std::memory_order_relaxed);
+	return opened;
+}
+
+UINT Profiler::zone(const char *name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (UINT i = 0; i < (UINT)zones.size(); i++)
+		if (zones[i] == name) return i;
+	zones.push_back(name);
+	return (UINT)zones.size() - 1;
+}
+
+UINT Profiler::zone_count() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (UINT)zones.size();
+}
+
+std::string Profiler::zone_name(UINT zone) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return zone < zones.size() ? zones[zone] : std::string();
+}
+
+ProfileThreadBuffer *Profiler::register_thread()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	buffers.push_back(std::unique_ptr<ProfileThreadBuffer>(new ProfileThreadBuffer((UINT)buffers.size())));
+	return buffers.back().get();
+}
+
+void Profiler::collect()
+{
+	calibrate();
+	std::vector<ProfileEvent> events;
+	std::vector<PerfCounterValues> deltas;	//eventsと同じ位置(カウンタのない区間の分も含む)
+	std::vector<UINT> threads;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (histories.size() < zones.size()) histories.resize(zones.size());
+		if (zone_counters.size() < zones.size())
+		{
+			ProfileCounters zero;
+			memset(&zero, 0, sizeof(zero));
+			zone_counters.resize(zones.size(), zero);
+		}
+		for (size_t i = 0; i < buffers.size(); i++)
+		{
+			ProfileThreadBuffer *buffer = buffers[i].get();
+			const unsigned long long written = buffer->written.load(std::memory_order_acquire);
+			//読み出す前に一周された区間は捨てる
+			if (written - buffer->read > ProfileThreadBuffer::CAPACITY)
+			{
+				dropped += written - ProfileThreadBuffer::CAPACITY - buffer->read;
+				buffer->read = written - ProfileThreadBuffer::CAPACITY;
+			}
+			const size_t first = events.size();
+			PerfCounterValues none;
+			memset(&none, 0, sizeof(none));
+			for (unsigned long long n = buffer->read; n < written; n++)
+			{
+				const ProfileEvent &e = buffer->events[n & (ProfileThreadBuffer::CAPACITY - 1)];
+				events.push_back(e);
+				deltas.push_back(e.counters ? buffer->deltas[n & (ProfileThreadBuffer::CAPACITY - 1)] : none);
+			}
+			//コピーしている間に上書きされた可能性のある区間は捨てる
+			const unsigned long long after = buffer->written.load(std::memory_order_acquire);
+			unsigned long long overwritten = 0;
+			if (after - buffer->read > ProfileThreadBuffer::CAPACITY) overwritten = std::min(after - ProfileThreadBuffer::CAPACITY - buffer->read, written - buffer->read);
+			events.erase(events.begin() + first, events.begin() + first + (size_t)overwritten);
+			deltas.erase(deltas.begin() + first, deltas.begin() + first + (size_t)overwritten);
+			dropped += overwritten;
+			threads.resize(events.size(), buffer->thread_index);
+			buffer->read = written;
+		}
+	}
+
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const ProfileEvent &e = events[i];
+		if (e.zone >= histories.size()) continue;
+		History &h = histories[e.zone];
+		h.durations[h.next] = e.end - e.begin;
+		h.next = (h.next + 1) % WINDOW;
+		h.total_count++;
+		h.allocations += e.allocations;
+		h.bytes += e.bytes;
+		if (e.counters)
+		{
+			ProfileCounters &c = zone_counters[e.zone];
+			c.count++;
+			for (int k = 0; k < PERF_COUNTER_COUNT; k++) c.total.value[k] += deltas[i].value[k];
+		}
+		if (tracing)
+		{
+			TraceEvent t = { e, threads[i], deltas[i] };
+			trace.push_back(t);
+		}
+	}
+}
+
+ProfileStats Profiler::stats(UINT zone) const
+{
+	ProfileStats s = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	if (zone >= histories.size()) return s;
+	const History &h = histories[zone];
+	s.total_count = h.total_count;
+	s.allocations = h.allocations;
+	s.bytes = h.bytes;
+	s.count = (UINT)std::min<unsigned long long>(h.total_count, WINDOW);
+	if (s.count == 0) return s;
+	std::vector<unsigned long long> d(h.durations.begin(), h.durations.begin() + s.count);
+	std::sort(d.begin(), d.end());
+	double sum = 0;
+	for (UINT i = 0; i < s.count; i++) sum += (double)d[i];
+	s.mean = sum / s.count / ticks_per_us;
+	s.p50 = d[(s.count - 1) / 2] / ticks_per_us;
+	s.p99 = d[(s.count - 1) * 99 / 100] / ticks_per_us;
+	s.max = d[s.count - 1] / ticks_per_us;
+	return s;
+}
+
+ProfileCounters Profiler::counters(UINT zone) const
+{
+	ProfileCounters c;
+	memset(&c, 0, sizeof(c));
+	if (zone < zone_counters.size()) c = zone_counters[zone];
+	return c;
+}
+
+ProfileStats Profiler::stats(const char *name) const
+{
+	UINT zone = UINT_MAX;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (UINT i = 0; i < (UINT)zones.size(); i++)
+			if (zones[i] == name) zone = i;
+	}
+	return stats(zone);
+}
+
+void Profiler::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		buffers[i]->read = buffers[i]->written.load(std::memory_order_acquire);
+	}
+	histories.assign(zones.size(), History());
+	ProfileCounters zero;
+	memset(&zero, 0, sizeof(zero));
+	zone_counters.assign(zones.size(), zero);
+	dropped = 0;
+}
+
+void Profiler::start_trace()
+{
+	trace.clear();
+	tracing = true;
+}
+
+void Profiler::stop_trace()
+{
+	tracing = false;
+}
+
+//名前をJSONの文字列として出力する
+static void write_json_string(FILE *file, const std::string &s)
+{
+	fputc('"', file);
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		const char c = s[i];
+		if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+		else if ((unsigned char)c < 0x20) fprintf(file, "\\u%04x", c);
+		else fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+BOOL Profiler::write_chrome_trace(const char *path) const
+{
+	FILE *file = fopen(path, "w");
+	if (!file) return FALSE;
+	std::vector<std::string> names;
+	UINT thread_count;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		names = zones;
+		thread_count = (UINT)buffers.size();
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (UINT i = 0; i < thread_count; i++)
+	{
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}", first ? "" : ",\n", i, i);
+		first = false;
+	}
+	for (size_t i = 0; i < trace.size(); i++)
+	{
+		const TraceEvent &t = trace[i];
+		//epochより前の時刻は0にする
+		const double ts = t.event.begin > epoch_ticks ? (t.event.begin - epoch_ticks) / ticks_per_us : 0;
+		const double dur = t.event.end > t.event.begin ? (t.event.end - t.event.begin) / ticks_per_us : 0;
+		fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+		write_json_string(file, t.event.zone < names.size() ? names[t.event.zone] : std::string("?"));
+		fprintf(file, ",\"cat\":\"physics\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u", ts, dur, t.thread_index);
+		//確保の数とカウンタの差分は区間の引数(args)として出力する
+		if (t.event.counters || t.event.allocations)
+		{
+			fprintf(file, ",\"args\":{\"allocations\":%u,\"allocated bytes\":%u", t.event.allocations, t.event.bytes);
+			for (int c = 0; c < PERF_COUNTER_COUNT && t.event.counters; c++)
+			{
+				fprintf(file, ",\"%s\":%llu", perf_counter_names[c], t.counters.value[c]);
+			}
+			fprintf(file, "}");
+		}
+		fprintf(file, "}");
+		first = false;
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	const bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok ? TRUE : FALSE;
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "PhysicsMath.h"
+#include "PerfCounters.h"
+#include "AllocationTracker.h"
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define PROFILER_TSC
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define PROFILER_TSC
+#endif
+
+//スコープごとの時間の計測(ステップのどこに時間を使っているかを調べる)
+//
+//使い方:
+//	void RigidWorld::broadphase()
+//	{
+//		PROFILE_SCOPE("broadphase");	//スコープの開始から終了までを"broadphase"の区間として記録する
+//		...
+//	}
+//	Profiler::I().enable(TRUE);
+//	world.step(duration);
+//	Profiler::I().collect();	//記録を集めて区間ごとの統計(stats)とトレースに加える(1フレームに1回、どのスレッドからでもよいが同時に呼ばないこと)
+//	ProfileStats s = Profiler::I().stats("broadphase");
+//	Profiler::I().write_chrome_trace("trace.json");	//start_traceからの記録をchrome://tracing(Perfetto)の形式で出力する
+//
+//区間はスレッドごとのリングバッファに書き込む(書き込みはそのスレッドだけが行い、ロックも読み書きの原子的な更新も使わない)
+//collectが間に合わずにリングバッファを一周した区間は捨てる(dropped_eventsで数える)
+//時刻はx86ではタイムスタンプカウンタ(rdtsc)、それ以外はsteady_clockで、マイクロ秒への換算はcollectのたびに較正する
+//
+//enable_countersでハードウェアカウンタ(PerfCounters)も有効にすると、PROFILE_SCOPEは区間の間のカウンタの差分も記録し、
+//collectが区間ごとに合計する(counters)(カウンタはスレッドごとに最初の区間で開く、読むたびにシステムコールを2回使うため時間は長めに出る)
+//
+//AllocationTrackerの計数を有効にしている間は、区間の間に呼び出したスレッドで行った確保の数とバイト数も記録する(ProfileStats::allocations)
+//
+//PHYSICS_PROFILEを0に定義するとPROFILE_SCOPEは何も生成しない
+//有効にしていない(enable(FALSE)、既定)間のPROFILE_SCOPEの費用は分岐1つ
+#ifndef PHYSICS_PROFILE
+#define PHYSICS_PROFILE 1
+#endif
+
+inline unsigned long long profile_ticks()
+{
+#if defined(PROFILER_TSC)
+	return __rdtsc();
+#else
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//記録した区間
+struct ProfileEvent
+{
+	unsigned long long begin, end;	//profile_ticksの値
+	UINT zone;	//区間の名前の番号(Profiler::zone)
+	UINT counters;	//1の場合はProfileThreadBuffer::deltasの同じ位置にカウンタの差分がある
+	UINT allocations, bytes;	//区間の間にこのスレッドで行った確保の回数とバイト数
+};
+
+//スレッドごとのリングバッファ(書き込みは所有するスレッドだけ、読み出しはcollectだけが行う)
+struct ProfileThreadBuffer
+{
+	static const UINT CAPACITY = 1 << 14;	//2の累乗
+
+	ProfileEvent events[CAPACITY];
+	std::atomic<unsigned long long> written;	//書き込んだ区間の総数
+	unsigned long long read;	//collectが読み出した区間の総数
+	UINT thread_index;	//登録した順の番号(トレースのスレッド番号)
+	PerfCounters perf;	//このスレッドのカウンタ(最初のread_countersで開く)
+	bool perf_tried;
+	std::unique_ptr<PerfCounterValues[]> deltas;	//区間ごとのカウンタの差分(eventsと同じ位置、最初のread_countersで確保する)
+
+	ProfileThreadBuffer(UINT thread_index) : written(0), read(0), thread_index(thread_index), perf_tried(false) {}
+
+	void push(UINT zone, unsigned long long begin, unsigned long long end, UINT allocations = 0, UINT bytes = 0)
+	{
+		const unsigned long long n = written.load(std::memory_order_relaxed);
+		ProfileEvent &e = events[n & (CAPACITY - 1)];
+		e.begin = begin;
+		e.end = end;
+		e.zone = zone;
+		e.counters = 0;
+		e.allocations = allocations;
+		e.bytes = bytes;
+		written.store(n + 1, std::memory_order_release);
+	}
+
+	//カウンタの現在の値(このスレッドでカウンタを開けない場合は偽)
+	BOOL read_counters(PerfCounterValues *values)
+	{
+		if (!perf_tried)
+		{
+			perf_tried = true;
+			if (perf.open()) deltas.reset(new PerfCounterValues[CAPACITY]);
+		}
+		return perf.read(values);
+	}
+	//区間と、startからのカウンタの差分を記録する
+	void push_counters(UINT zone, unsigned long long begin, unsigned long long end, UINT allocations, UINT bytes, const PerfCounterValues &start)
+	{
+		PerfCounterValues now;
+		perf.read(&now);
+		const unsigned long long n = written.load(std::memory_order_relaxed);
+		PerfCounterValues &d = deltas[n & (CAPACITY - 1)];
+		for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+		{
+			d.value[c] = now.value[c] >= start.value[c] ? now.value[c] - start.value[c] : 0;
+		}
+		ProfileEvent &e = events[n & (CAPACITY - 1)];
+		e.begin = begin;
+		e.end = end;
+		e.zone = zone;
+		e.counters = 1;
+		e.allocations = allocations;
+		e.bytes = bytes;
+		written.store(n + 1, std::memory_order_release);
+	}
+};
+
+//区間ごとの直近Profiler::WINDOW回の統計(マイクロ秒)
+struct ProfileStats
+{
+	UINT count;	//統計に含めた回数
+	unsigned long long total_count;	//記録した総数
+	double mean, p50, p99, max;
+	unsigned long long allocations, bytes;	//resetからの確保の回数とバイト数の合計
+};
+
+//区間ごとのカウンタの合計(Profiler::counters)
+struct ProfileCounters
+{
+	unsigned long long count;	//カウンタを記録した区間の数
+	PerfCounterValues total;
+};
+
+class Profiler
+{
+public:
+	static const UINT WINDOW = 1024;	//statsが対象とする直近の区間の数
+
+	static Profiler &I()
+	{
+		static Profiler i;
+		return i;
+	}
+
+	static bool is_enabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+	void enable(BOOL on)
+	{
+		enabled.store(on != FALSE, std::memory_order_relaxed);
+	}
+
+	static bool counters_enabled()
+	{
+		return counting.load(std::memory_order_relaxed);
+	}
+	//ハードウェアカウンタの記録を切り替える(呼び出したスレッドでカウンタを開けない場合は有効にせず偽を返す、理由はcounters_error)
+	BOOL enable_counters(BOOL on);
+	const char *counters_error() const { return counter_error; }
+	//呼び出したスレッドで開けたカウンタ(enable_countersが成功した後に使う)
+	BOOL counter_available(PERF_COUNTER counter) const { return counter_probe[counter]; }
+
+	//名前に対応する区間の番号(同じ名前には同じ番号を返す、PROFILE_SCOPEは呼び出し箇所ごとに1回だけ呼ぶ)
+	UINT zone(const char *name);
+	UINT zone_count() const;
+	std::string zone_name(UINT zone) const;
+
+	//呼び出したスレッドのリングバッファ(最初の呼び出しで作って登録する)
+	static ProfileThreadBuffer *thread_buffer()
+	{
+		static thread_local ProfileThreadBuffer *buffer = 0;
+		if (!buffer) buffer = I().register_thread();
+		return buffer;
+	}
+	//[begin, end)を区間zoneとして記録する(PROFILE_SCOPEを使えない、見積もった区間などに使う)
+	static void record(UINT zone, unsigned long long begin, unsigned long long end)
+	{
+		if (is_enabled()) thread_buffer()->push(zone, begin, end);
+	}
+
+	//全てのスレッドのリングバッファから新しい区間を読み出し、統計とトレースに加える
+	void collect();
+	ProfileStats stats(UINT zone) const;
+	ProfileStats stats(const char *name) const;	//登録されていない名前の場合はcountが0
+	ProfileCounters counters(UINT zone) const;	//resetからの合計
+	//一周して捨てた区間の数
+	unsigned long long dropped_events() const { return dropped; }
+	//統計と捨てた区間の数を0に戻す(まだ読み出していない区間は捨てる)
+	void reset();
+
+	//トレースの記録(collectが読み出した区間を、stop_traceまで全て保持する)
+	void start_trace();
+	void stop_trace();
+	size_t trace_size() const { return trace.size(); }
+	//トレースをChromeのtrace_eventの形式(JSON)で出力する
+	BOOL write_chrome_trace(const char *path) const;
+
+	//profile_ticksの1マイクロ秒あたりの値
+	double ticks_per_microsecond() const { return ticks_per_us; }
+
+private:
+	struct TraceEvent
+	{
+		ProfileEvent event;
+		UINT thread_index;
+		PerfCounterValues counters;	//event.countersが1の場合だけ有効
+	};
+	//区間ごとの直近WINDOW回の長さ(profile_ticks)
+	struct History
+	{
+		std::vector<unsigned long long> durations;
+		UINT next;
+		unsigned long long total_count;
+		unsigned long long allocations, bytes;
+		History() : durations(WINDOW), next(0), total_count(0), allocations(0), bytes(0) {}
+	};
+
+	static std::atomic<bool> enabled;
+	static std::atomic<bool> counting;
+
+	mutable std::mutex mutex;	//zonesとbuffersの追加を保護する
+	std::vector<std::string> zones;
+	std::vector<std::unique_ptr<ProfileThreadBuffer> > buffers;	//スレッドの終了後も残す(最後の区間をcollectで読み出すため)
+
+	std::vector<History> histories;
+	std::vector<ProfileCounters> zone_counters;
+	BOOL counter_probe[PERF_COUNTER_COUNT];
+	char counter_error[160];
+	std::vector<TraceEvent> trace;
+	bool tracing;
+	unsigned long long dropped;
+
+	//較正の基準(profile_ticksとsteady_clockを同時に読んだ値)
+	unsigned long long epoch_ticks;
+	std::chrono::steady_clock::time_point epoch_time;
+	double ticks_per_us;
+
+	Profiler();
+	Profiler(const Profiler &);
+	Profiler &operator=(const Profiler &);
+	ProfileThreadBuffer *register_thread();
+	void calibrate();
+};
+
+//スコープの開始から終了までを区間として記録する
+class ProfileScope
+{
+	ProfileThreadBuffer *buffer;	//有効でない場合は0
+	UINT zone;
+	unsigned long long begin;
+	BOOL counting;
+	PerfCounterValues start;	//countingが真の場合の開始時のカウンタ
+	AllocationCounts allocations;	//開始時のこのスレッドの確保の累計
+
+public:
+	ProfileScope(UINT zone) : buffer(0), zone(zone), begin(0), counting(FALSE)
+	{
+		if (Profiler::is_enabled())
+		{
+			buffer = Profiler::thread_buffer();
+			if (Profiler::counters_enabled()) counting = buffer->read_counters(&start);
+			allocations = thread_allocation_counts();
+			begin = profile_ticks();
+		}
+	}
+	~ProfileScope()
+	{
+		if (!buffer) return;
+		const unsigned long long end = profile_ticks();
+		const AllocationCounts now = thread_allocation_counts();
+		const UINT count = (UINT)(now.allocations - allocations.allocations), bytes = (UINT)(now.bytes - allocations.bytes);
+		if (counting) buffer->push_counters(zone, begin, end, count, bytes, start);
+		else buffer->push(zone, begin, end, count, bytes);
+	}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#if PHYSICS_PROFILE
+#define PROFILE_SCOPE(name) \
+	static const UINT PROFILE_CONCAT(profile_zone_, __LINE__) = Profiler::I().zone(name); \
+	ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_zone_, __LINE__))
+#else
+#define PROFILE_SCOPE(name)
+#endif
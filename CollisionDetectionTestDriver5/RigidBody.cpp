@@ -1,211 +1,222 @@
 #define NOMINMAX
+#include "StrictFloat.h"
 #include <assert.h>
 #include "RigidBody.h"
-#include "DebugDrawManager.h"
 
-inline void rotate_vector_by_quaternion(D3DXVECTOR3 *out, const D3DXQUATERNION &q, const D3DXVECTOR3 &v)
+void rotate_vector_by_quaternion(vec3 *out, const quat &q, const vec3 &v)
 {
 #if 1
-	D3DXVECTOR3 p;
-	p.x = 2.0f * (q.x * v.x + q.y * v.y + q.z * v.z) * q.x + (q.w * q.w - (q.x * q.x + q.y * q.y + q.z * q.z)) * v.x + 2.0f * q.w * (q.y * v.z - q.z * v.y);
-	p.y = 2.0f * (q.x * v.x + q.y * v.y + q.z * v.z) * q.y + (q.w * q.w - (q.x * q.x + q.y * q.y + q.z * q.z)) * v.y + 2.0f * q.w * (q.z * v.x - q.x * v.z);
-	p.z = 2.0f * (q.x * v.x + q.y * v.y + q.z * v.z) * q.z + (q.w * q.w - (q.x * q.x + q.y * q.y + q.z * q.z)) * v.z + 2.0f * q.w * (q.x * v.y - q.y * v.x);
-	*out = p;
+	//v' = 2(q・v)q + (w^2 - q・q)v + 2w(q × v) (VectorMath.hのrotate)
+	*out = rotate(q, v);
 #else
-	D3DXQUATERNION conjugate, p( v.x, v.y, v.z, 0 );
-	D3DXQuaternionConjugate( &conjugate, &q );
-	p = conjugate * p * q;
+	quat p( v.x, v.y, v.z, 0 );
+	p = conjugate(q) * p * q;
 	out->x = p.x;
 	out->y = p.y;
 	out->z = p.z;
 #endif
 }
 
+//接触点の情報(contact)からContactオブジェクトを生成し、コンテナ(contacts)に追加する
+//※contact_point.swappedが真の場合は剛体の順序を入れ替える
+static inline void push_contact(const ContactPoint &contact_point, RigidBody *b0, RigidBody *b1, std::vector<Contact> *contacts, FLOAT restitution)
+{
+	Contact contact;
+	contact.normal = contact_point.normal;
+	contact.point = contact_point.point;
+	contact.penetration = contact_point.penetration;
+	contact.body[0] = contact_point.swapped ? b1 : b0;
+	contact.body[1] = contact_point.swapped ? b0 : b1;
+	contact.restitution = restitution;
+	contacts->push_back(contact);
+}
+
+INT collide_sphere_sphere(const vec3 &p0, FLOAT r0, const vec3 &p1, FLOAT r1, ContactPoint *contact)
+{
+	vec3 n = p0 - p1;
+	FLOAT l = length(n);
+	n = normalize(n);
+	if (l < r0 + r1)
+	{
+		contact->normal = n;
+		contact->penetration = r0 + r1 - l;
+		//contact->point = p1 + 0.5f * l * n;
+		contact->point = p1 + (r1 - (0.5f * contact->penetration)) * n;
+		contact->swapped = FALSE;
+		return 1;
+	}
+	return 0;
+}
 INT generate_contact_sphere_sphere(Sphere *s0, Sphere *s1, std::vector<Contact> *contacts, FLOAT restitution)
 {
-	//2̋̂̏Փ˔s
-	//Փ˂ĂꍇContactIuWFNg𐶐
-	//Contact̑SẴoϐɒlZbgARei(contacts)ɒǉ
+	//2つの球体の衝突判定を行う
+	//衝突している場合はContactオブジェクトを生成する
+	//Contactの全てのメンバ変数に値をセットし、コンテナ(contacts)に追加する
 	assert(s0 != s1);
 
-	D3DXVECTOR3 p0 = s0->position;
-	D3DXVECTOR3 p1 = s1->position;
-
-	D3DXVECTOR3 n = p0 - p1;
-	FLOAT l = D3DXVec3Length(&n);
-	D3DXVec3Normalize(&n, &n);
-	if (l < s0->r + s1->r)
+	ContactPoint contact_point;
+	if (collide_sphere_sphere(s0->position, s0->r, s1->position, s1->r, &contact_point))
 	{
-		Contact contact;
-		contact.normal = n;
-		contact.penetration = s0->r + s1->r - l;
-		//contact.point = p1 + 0.5f * l * n;
-		contact.point = p1 + (s1->r - (0.5f * contact.penetration)) * n;
-		contact.body[0] = s0;
-		contact.body[1] = s1;
-		contact.restitution = restitution;
-		contacts->push_back(contact);
+		push_contact(contact_point, s0, s1, contacts, restitution);
 		return 1;
 	}
 	return 0;
 }
-INT generate_contact_sphere_plane(Sphere *sphere, Plane *plane, std::vector<Contact> *contacts, FLOAT restitution, BOOL half_space)
+INT collide_sphere_plane(const vec3 &center, FLOAT r, const vec3 &plane_position, const quat &plane_orientation, ContactPoint *contact, BOOL half_space)
 {
-	//̂ƕʂ̏Փ˔s
-	//Փ˂ĂꍇContactIuWFNg𐶐
-	//Contact̑SẴoϐɒlZbgARei(contacts)ɒǉ
-	//half_space^̏ꍇ͕ЖʁAȔꍇ͗ʂ̏Փ˔s
-	D3DXMATRIX matrix, inverse_matrix;
-	D3DXMatrixRotationQuaternion(&matrix, &plane->orientation);
-	matrix._41 = plane->position.x;
-	matrix._42 = plane->position.y;
-	matrix._43 = plane->position.z;
-	D3DXVECTOR3 n(matrix._21, matrix._22, matrix._23);
-	D3DXMatrixInverse(&inverse_matrix, 0, &matrix);
-
-	D3DXVECTOR3 p;
-	D3DXVec3TransformCoord(&p, &sphere->position, &inverse_matrix);
+	//回転行列の2行目(ローカルのy軸)が平面の法線
+	const mat3 rotation = mat3_from_quat(plane_orientation);
+	vec3 n = rotation.r[1];
+
+	//平面のローカル座標に変換する(回転行列は直交行列のため、逆回転は転置行列)
+	vec3 p = (center - plane_position) * transpose(rotation);
 
 	//Half-space
 	if (half_space && p.y < 0) return 0;
 
-	if (fabsf(p.y) < sphere->r)
+	if (fabsf(p.y) < r)
 	{
-		Contact contact;
-		contact.normal = p.y > 0 ? n : -n;
-		contact.point = sphere->position + p.y * -n;
-		contact.penetration = sphere->r - fabsf(p.y);
-		contact.body[0] = sphere;
-		contact.body[1] = plane;
-		contact.restitution = restitution;
-		contacts->push_back(contact);
+		contact->normal = p.y > 0 ? n : -n;
+		contact->point = center + p.y * -n;
+		contact->penetration = r - fabsf(p.y);
+		contact->swapped = FALSE;
 		return 1;
 	}
 	return 0;
 }
-INT generate_contact_sphere_box(Sphere *sphere, Box *box, std::vector<Contact> *contacts, FLOAT restitution)
+INT generate_contact_sphere_plane(Sphere *sphere, Plane *plane, std::vector<Contact> *contacts, FLOAT restitution, BOOL half_space)
+{
+	//球体と平面の衝突判定を行う
+	//衝突している場合はContactオブジェクトを生成する
+	//Contactの全てのメンバ変数に値をセットし、コンテナ(contacts)に追加する
+	//※half_spaceが真の場合は片面、偽の場合は両面の衝突判定を行う
+	ContactPoint contact_point;
+	if (collide_sphere_plane(sphere->position, sphere->r, plane->position, plane->orientation, &contact_point, half_space))
+	{
+		push_contact(contact_point, sphere, plane, contacts, restitution);
+		return 1;
+	}
+	return 0;
+}
+INT collide_sphere_box(const vec3 &sphere_position, FLOAT r, const vec3 &box_position, const quat &box_orientation, const vec3 &half_size, ContactPoint *contact)
 {
-	//̂ƒ̂̏Փ˔s
-	//Փ˂ĂꍇContactIuWFNg𐶐
-	//Contact̑SẴoϐɒlZbgARei(contacts)ɒǉ
-	D3DXMATRIX matrix, inverse_matrix;
-	D3DXMatrixRotationQuaternion(&matrix, &box->orientation);
-	matrix._41 = box->position.x;
-	matrix._42 = box->position.y;
-	matrix._43 = box->position.z;
-	D3DXMatrixInverse(&inverse_matrix, 0, &matrix);
-
-	D3DXVECTOR3 center;
-	D3DXVec3TransformCoord(&center, &sphere->position, &inverse_matrix);
-
-	//if (fabsf(center.x) - sphere->r > box->half_size.x ||
-	//	fabsf(center.y) - sphere->r > box->half_size.y ||
-	//	fabsf(center.z) - sphere->r > box->half_size.z)
+	//箱のローカル座標に変換する(回転行列は直交行列のため、逆回転は転置行列)
+	const mat3 rotation = mat3_from_quat(box_orientation);
+	vec3 center = (sphere_position - box_position) * transpose(rotation);
+
+	//if (fabsf(center.x) - r > half_size.x ||
+	//	fabsf(center.y) - r > half_size.y ||
+	//	fabsf(center.z) - r > half_size.z)
 	//{
 	//	return 0;
 	//}
 
-	D3DXVECTOR3 closest_point;
+	vec3 closest_point;
 
 	closest_point.x = center.x;
-	if (center.x > box->half_size.x) closest_point.x = box->half_size.x;
-	if (center.x < -box->half_size.x) closest_point.x = -box->half_size.x;
+	if (center.x > half_size.x) closest_point.x = half_size.x;
+	if (center.x < -half_size.x) closest_point.x = -half_size.x;
 
 	closest_point.y = center.y;
-	if (center.y > box->half_size.y) closest_point.y = box->half_size.y;
-	if (center.y < -box->half_size.y) closest_point.y = -box->half_size.y;
+	if (center.y > half_size.y) closest_point.y = half_size.y;
+	if (center.y < -half_size.y) closest_point.y = -half_size.y;
 
 	closest_point.z = center.z;
-	if (center.z > box->half_size.z) closest_point.z = box->half_size.z;
-	if (center.z < -box->half_size.z) closest_point.z = -box->half_size.z;
+	if (center.z > half_size.z) closest_point.z = half_size.z;
+	if (center.z < -half_size.z) closest_point.z = -half_size.z;
 
-	FLOAT distance = D3DXVec3Length(&(closest_point - center));
-	if (distance < sphere->r && distance > FLT_EPSILON)
+	vec3 offset = closest_point - center;
+	FLOAT distance = length(offset);
+	if (distance < r && distance > FLT_EPSILON)
 	{
-		D3DXVec3TransformCoord(&closest_point, &closest_point, &matrix);
+		closest_point = closest_point * rotation + box_position;
 
-		Contact contact;
-		contact.normal = sphere->position - closest_point;
-		contact.point = closest_point;
-		contact.penetration = sphere->r - distance;
-		contact.body[0] = sphere;
-		contact.body[1] = box;
-		contact.restitution = restitution;
-		contacts->push_back(contact);
+		//回転と平行移動では長さは変わらないため、ローカル座標での距離で正規化する
+		contact->normal = (sphere_position - closest_point) / distance;
+		contact->point = closest_point;
+		contact->penetration = r - distance;
+		contact->swapped = FALSE;
 
 		return 1;
 	}
 
 	return 0;
 }
-INT generate_contact_box_plane(Box *box, Plane *plane, std::vector<Contact> *contacts, FLOAT restitution)
+INT generate_contact_sphere_box(Sphere *sphere, Box *box, std::vector<Contact> *contacts, FLOAT restitution)
+{
+	//球体と直方体の衝突判定を行う
+	//衝突している場合はContactオブジェクトを生成する
+	//Contactの全てのメンバ変数に値をセットし、コンテナ(contacts)に追加する
+	ContactPoint contact_point;
+	if (collide_sphere_box(sphere->position, sphere->r, box->position, box->orientation, box->half_size, &contact_point))
+	{
+		push_contact(contact_point, sphere, box, contacts, restitution);
+		return 1;
+	}
+	return 0;
+}
+INT collide_box_plane(const vec3 &box_position, const quat &box_orientation, const vec3 &half_size, const vec3 &plane_position, const quat &plane_orientation, ContactPoint contacts[8])
 {
-	//̂ƕʂ̏Փ˔s
-	//Փ˂ĂꍇContactIuWFNg𐶐
-	//Contact̑SẴoϐɒlZbgARei(contacts)ɒǉ
-	D3DXVECTOR3 vertices[8] =
+	vec3 vertices[8] =
 	{
-		D3DXVECTOR3(-box->half_size.x, -box->half_size.y, -box->half_size.z),
-		D3DXVECTOR3(-box->half_size.x, -box->half_size.y, +box->half_size.z),
-		D3DXVECTOR3(-box->half_size.x, +box->half_size.y, -box->half_size.z),
-		D3DXVECTOR3(-box->half_size.x, +box->half_size.y, +box->half_size.z),
-		D3DXVECTOR3(+box->half_size.x, -box->half_size.y, -box->half_size.z),
-		D3DXVECTOR3(+box->half_size.x, -box->half_size.y, +box->half_size.z),
-		D3DXVECTOR3(+box->half_size.x, +box->half_size.y, -box->half_size.z),
-		D3DXVECTOR3(+box->half_size.x, +box->half_size.y, +box->half_size.z)
+		vec3(-half_size.x, -half_size.y, -half_size.z),
+		vec3(-half_size.x, -half_size.y, +half_size.z),
+		vec3(-half_size.x, +half_size.y, -half_size.z),
+		vec3(-half_size.x, +half_size.y, +half_size.z),
+		vec3(+half_size.x, -half_size.y, -half_size.z),
+		vec3(+half_size.x, -half_size.y, +half_size.z),
+		vec3(+half_size.x, +half_size.y, -half_size.z),
+		vec3(+half_size.x, +half_size.y, +half_size.z)
 	};
 
-	D3DXVECTOR3 n;
-	rotate_vector_by_quaternion(&n, plane->orientation, D3DXVECTOR3(0, 1, 0));
-	FLOAT d = D3DXVec3Dot(&n, &plane->position);
+	vec3 n;
+	rotate_vector_by_quaternion(&n, plane_orientation, vec3(0, 1, 0));
+	FLOAT d = dot(n, plane_position);
 
 	INT contacts_used = 0;
 	for (int i = 0; i < 8; i++)
 	{
-		rotate_vector_by_quaternion(&vertices[i], box->orientation, vertices[i]);
-		vertices[i] += box->position;
+		rotate_vector_by_quaternion(&vertices[i], box_orientation, vertices[i]);
+		vertices[i] += box_position;
 
 
-		FLOAT distance = D3DXVec3Dot(&vertices[i], &n);
+		FLOAT distance = dot(vertices[i], n);
 
 		if (distance < d)
 		{
-			Contact contact;
-			contact.normal = n;
-			contact.point = vertices[i];
-			contact.penetration = d - distance;
-			contact.body[0] = box;
-			contact.body[1] = plane;
-			contact.restitution = restitution;
-			contacts->push_back(contact);
+			contacts[contacts_used].normal = n;
+			contacts[contacts_used].point = vertices[i];
+			contacts[contacts_used].penetration = d - distance;
+			contacts[contacts_used].swapped = FALSE;
 
 			contacts_used++;
 		}
 	}
 	return contacts_used;
 }
-
-enum SAT_TYPE
+INT generate_contact_box_plane(Box *box, Plane *plane, std::vector<Contact> *contacts, FLOAT restitution)
 {
-	POINTA_FACETB,
-	POINTB_FACETA,
-	EDGE_EDGE
-};
-struct OBB {
-	D3DXVECTOR3 c; // OBB center point
-	D3DXVECTOR3 u[3]; // Local x-, y-, and z-axes
-	D3DXVECTOR3 e; // Positive halfwidth extents of OBB along each axis
-};
+	//直方体と平面の衝突判定を行う
+	//衝突している場合はContactオブジェクトを生成する
+	//Contactの全てのメンバ変数に値をセットし、コンテナ(contacts)に追加する
+	ContactPoint contact_points[8];
+	INT contacts_used = collide_box_plane(box->position, box->orientation, box->half_size, plane->position, plane->orientation, contact_points);
+	for (int i = 0; i < contacts_used; i++)
+	{
+		push_contact(contact_points[i], box, plane, contacts, restitution);
+	}
+	return contacts_used;
+}
 
 static inline FLOAT sum_of_projected_radii(
 	const OBB &obb,
-	const D3DXVECTOR3 &axis
+	const vec3 &axis
 	)
 {
 	return
-		fabsf(D3DXVec3Dot(&axis, &(obb.e.x * obb.u[0]))) +
-		fabsf(D3DXVec3Dot(&axis, &(obb.e.y * obb.u[1]))) +
-		fabsf(D3DXVec3Dot(&axis, &(obb.e.z * obb.u[2])));
+		fabsf(dot(axis, obb.e.x * obb.u[0])) +
+		fabsf(dot(axis, obb.e.y * obb.u[1])) +
+		fabsf(dot(axis, obb.e.z * obb.u[2]));
 }
 
 //SAT (Separating Axis Theorem)
@@ -219,8 +230,8 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 	FLOAT penetration = 0;
 
 	FLOAT ra, rb;
-	D3DXVECTOR3 L;
-	D3DXVECTOR3 T = b.c - a.c;
+	vec3 L;
+	vec3 T = b.c - a.c;
 
 	// Test axes L = A0, L = A1, L = A2
 	for (int i = 0; i < 3; i++)
@@ -257,10 +268,10 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 	}
 
 	// Test axis L = A0 x B0
-	D3DXVec3Cross(&L, &a.u[0], &b.u[0]);
-	if (D3DXVec3LengthSq(&L) > FLT_EPSILON) //Is A0 not parallel to B0?
+	L = cross(a.u[0], b.u[0]);
+	if (length_sq(L) > FLT_EPSILON) //Is A0 not parallel to B0?
 	{
-		D3DXVec3Normalize(&L, &L);
+		L = normalize(L);
 		ra = sum_of_projected_radii(a, L);
 		rb = sum_of_projected_radii(b, L);
 		penetration = ra + rb - fabsf(L.x * T.x + L.y * T.y + L.z * T.z);
@@ -275,10 +286,10 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 	}
 
 	// Test axis L = A0 x B1
-	D3DXVec3Cross(&L, &a.u[0], &b.u[1]);
-	if (D3DXVec3LengthSq(&L) > FLT_EPSILON)
+	L = cross(a.u[0], b.u[1]);
+	if (length_sq(L) > FLT_EPSILON)
 	{
-		D3DXVec3Normalize(&L, &L);
+		L = normalize(L);
 		ra = sum_of_projected_radii(a, L);
 		rb = sum_of_projected_radii(b, L);
 		penetration = ra + rb - fabsf(L.x * T.x + L.y * T.y + L.z * T.z);
@@ -292,10 +303,10 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 		}
 	}
 	// Test axis L = A0 x B2
-	D3DXVec3Cross(&L, &a.u[0], &b.u[2]);
-	if (D3DXVec3LengthSq(&L) > FLT_EPSILON)
+	L = cross(a.u[0], b.u[2]);
+	if (length_sq(L) > FLT_EPSILON)
 	{
-		D3DXVec3Normalize(&L, &L);
+		L = normalize(L);
 		ra = sum_of_projected_radii(a, L);
 		rb = sum_of_projected_radii(b, L);
 		penetration = ra + rb - fabsf(L.x * T.x + L.y * T.y + L.z * T.z);
@@ -309,10 +320,10 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 		}
 	}
 	// Test axis L = A1 x B0
-	D3DXVec3Cross(&L, &a.u[1], &b.u[0]);
-	if (D3DXVec3LengthSq(&L) > FLT_EPSILON)
+	L = cross(a.u[1], b.u[0]);
+	if (length_sq(L) > FLT_EPSILON)
 	{
-		D3DXVec3Normalize(&L, &L);
+		L = normalize(L);
 		ra = sum_of_projected_radii(a, L);
 		rb = sum_of_projected_radii(b, L);
 		penetration = ra + rb - fabsf(L.x * T.x + L.y * T.y + L.z * T.z);
@@ -327,10 +338,10 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 	}
 
 	// Test axis L = A1 x B1
-	D3DXVec3Cross(&L, &a.u[1], &b.u[1]);
-	if (D3DXVec3LengthSq(&L) > FLT_EPSILON)
+	L = cross(a.u[1], b.u[1]);
+	if (length_sq(L) > FLT_EPSILON)
 	{
-		D3DXVec3Normalize(&L, &L);
+		L = normalize(L);
 		ra = sum_of_projected_radii(a, L);
 		rb = sum_of_projected_radii(b, L);
 		penetration = ra + rb - fabsf(L.x * T.x + L.y * T.y + L.z * T.z);
@@ -345,10 +356,10 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 	}
 
 	// Test axis L = A1 x B2
-	D3DXVec3Cross(&L, &a.u[1], &b.u[2]);
-	if (D3DXVec3LengthSq(&L) > FLT_EPSILON)
+	L = cross(a.u[1], b.u[2]);
+	if (length_sq(L) > FLT_EPSILON)
 	{
-		D3DXVec3Normalize(&L, &L);
+		L = normalize(L);
 		ra = sum_of_projected_radii(a, L);
 		rb = sum_of_projected_radii(b, L);
 		penetration = ra + rb - fabsf(L.x * T.x + L.y * T.y + L.z * T.z);
@@ -363,10 +374,10 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 	}
 
 	// Test axis L = A2 x B0
-	D3DXVec3Cross(&L, &a.u[2], &b.u[0]);
-	if (D3DXVec3LengthSq(&L) > FLT_EPSILON)
+	L = cross(a.u[2], b.u[0]);
+	if (length_sq(L) > FLT_EPSILON)
 	{
-		D3DXVec3Normalize(&L, &L);
+		L = normalize(L);
 		ra = sum_of_projected_radii(a, L);
 		rb = sum_of_projected_radii(b, L);
 		penetration = ra + rb - fabsf(L.x * T.x + L.y * T.y + L.z * T.z);
@@ -381,10 +392,10 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 	}
 
 	// Test axis L = A2 x B1
-	D3DXVec3Cross(&L, &a.u[2], &b.u[1]);
-	if (D3DXVec3LengthSq(&L) > FLT_EPSILON)
+	L = cross(a.u[2], b.u[1]);
+	if (length_sq(L) > FLT_EPSILON)
 	{
-		D3DXVec3Normalize(&L, &L);
+		L = normalize(L);
 		ra = sum_of_projected_radii(a, L);
 		rb = sum_of_projected_radii(b, L);
 		penetration = ra + rb - fabsf(L.x * T.x + L.y * T.y + L.z * T.z);
@@ -399,10 +410,10 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 	}
 
 	// Test axis L = A2 x B2
-	D3DXVec3Cross(&L, &a.u[2], &b.u[2]);
-	if (D3DXVec3LengthSq(&L) > FLT_EPSILON)
+	L = cross(a.u[2], b.u[2]);
+	if (length_sq(L) > FLT_EPSILON)
 	{
-		D3DXVec3Normalize(&L, &L);
+		L = normalize(L);
 		ra = sum_of_projected_radii(a, L);
 		rb = sum_of_projected_radii(b, L);
 		penetration = ra + rb - fabsf(L.x * T.x + L.y * T.y + L.z * T.z);
@@ -422,217 +433,258 @@ INT sat_obb_obb(const OBB &a, const OBB &b,
 	// Since no separating axis is found, the OBBs must be intersecting
 	return (smallest_penetration < FLT_MAX && smallest_penetration > FLT_EPSILON) ? 1 : 0;
 }
-INT generate_contact_box_box(Box *b0, Box *b1, std::vector<Contact> *contacts, FLOAT restitution)
+INT collide_box_box(const vec3 &p0, const quat &q0, const vec3 &h0, const vec3 &p1, const quat &q1, const vec3 &h1, ContactPoint *contact)
 {
-	D3DXMATRIX m;
-	D3DXMatrixRotationQuaternion(&m, &b0->orientation);
+	//回転行列の各行がローカル軸
+	mat3 m = mat3_from_quat(q0);
 	OBB obb0;
-	obb0.c = b0->position;
-	obb0.u[0].x = m._11; obb0.u[0].y = m._12; obb0.u[0].z = m._13;
-	obb0.u[1].x = m._21; obb0.u[1].y = m._22; obb0.u[1].z = m._23;
-	obb0.u[2].x = m._31; obb0.u[2].y = m._32; obb0.u[2].z = m._33;
-	obb0.e = b0->half_size;
+	obb0.c = p0;
+	obb0.u[0] = m.r[0];
+	obb0.u[1] = m.r[1];
+	obb0.u[2] = m.r[2];
+	obb0.e = h0;
 
-	D3DXMatrixRotationQuaternion(&m, &b1->orientation);
+	m = mat3_from_quat(q1);
 	OBB obb1;
-	obb1.c = b1->position;
-	obb1.u[0].x = m._11; obb1.u[0].y = m._12; obb1.u[0].z = m._13;
-	obb1.u[1].x = m._21; obb1.u[1].y = m._22; obb1.u[1].z = m._23;
-	obb1.u[2].x = m._31; obb1.u[2].y = m._32; obb1.u[2].z = m._33;
-	obb1.e = b1->half_size;
-
-	//sat_obb_obb֐L擾ł悤ɉ
-	FLOAT smallest_penetration = FLT_MAX;	//ŏ߂荞ݗ
-	INT smallest_axis[2];	//ŏ߂荞ݗʂ𓾂̍쐬ɎgpeOBB̃[Jԍ(0-2)
-	SAT_TYPE smallest_case;	//Փ˂̎ enum SAT_TYPE { POINTA_FACETB, POINTB_FACETA, EDGE_EDGE };
+	obb1.c = p1;
+	obb1.u[0] = m.r[0];
+	obb1.u[1] = m.r[1];
+	obb1.u[2] = m.r[2];
+	obb1.e = h1;
+
+	//○sat_obb_obb関数を下記情報を取得できるように改造した
+	FLOAT smallest_penetration = FLT_MAX;	//最小めり込み量
+	INT smallest_axis[2];	//最小めり込み量を得た分離軸の作成に使用した各OBBのローカル軸番号(0-2)
+	SAT_TYPE smallest_case;	//衝突の種類 enum SAT_TYPE { POINTA_FACETB, POINTB_FACETA, EDGE_EDGE };
 	if (!sat_obb_obb(obb0, obb1, smallest_penetration, smallest_axis, smallest_case)) return 0;
 
-	//@LR[h𗝉
-	//obb1̒_obb0̖ʂƏՓ˂ꍇ
+	//①下記コードを理解する
+	//obb1の頂点がobb0の面と衝突した場合
 	if (smallest_case == POINTB_FACETA)
 	{
-		D3DXVECTOR3 d = obb1.c - obb0.c;	//obb0obb1ւ̑Έʒu
-		D3DXVECTOR3 n = obb0.u[smallest_axis[0]];	//obb0̏Փ˖ʂ̖@ƕsobb0̃[JxNg
-		if (D3DXVec3Dot(&n, &d) > 0)	//obb0obb1̈ʒu֌WՓ˖ʂ̖@xNg肷
+		vec3 d = obb1.c - obb0.c;	//obb0からobb1への相対位置
+		vec3 n = obb0.u[smallest_axis[0]];	//obb0の衝突面の法線と平行のobb0のローカル軸ベクトル
+		if (dot(n, d) > 0)	//obb0とobb1の位置関係より衝突面の法線ベクトルを決定する
 		{
 			n = n * -1.0f;
 		}
-		D3DXVec3Normalize(&n, &n);
-
-		//ڐG_(p)obb18_̂̂ǂꂩ
-		D3DXVECTOR3 p = obb1.e;	//obb1̊eӂ̒́Aobb1̏dSڐG_(p)ւ̑Έʒu̎肪ɂȂ
-		//obb0obb1̈ʒu֌W(d)ڐG_(p)߂
-		if (D3DXVec3Dot(&obb1.u[0], &d) > 0) p.x = -p.x;
-		if (D3DXVec3Dot(&obb1.u[1], &d) > 0) p.y = -p.y;
-		if (D3DXVec3Dot(&obb1.u[2], &d) > 0) p.z = -p.z;
-		//[hԂ֍Wϊ
-		rotate_vector_by_quaternion(&p, b1->orientation, p);
-		p += b1->position;
-
-		//ContactIuWFNg𐶐ASẴoϐɒlZbgARei(contacts)ɒǉ
-		Contact contact;
-		contact.normal = n;
-		contact.point = p;
-		contact.penetration = smallest_penetration;
-		contact.body[0] = b0;
-		contact.body[1] = b1;
-		contact.restitution = restitution;
-		contacts->push_back(contact);
+		n = normalize(n);
+
+		//接触点(p)はobb1の8頂点のうちのどれか
+		vec3 p = obb1.e;	//obb1の各辺の長さは、obb1の重心から接触点(p)への相対位置の手がかりになる
+		//obb0とobb1の位置関係(d)より接触点(p)を求める
+		if (dot(obb1.u[0], d) > 0) p.x = -p.x;
+		if (dot(obb1.u[1], d) > 0) p.y = -p.y;
+		if (dot(obb1.u[2], d) > 0) p.z = -p.z;
+		//ワールド空間へ座標変換
+		p = rotate(q1, p);
+		p += obb1.c;
+
+		//接触情報(contact)の全てのメンバ変数に値をセットする
+		contact->normal = n;
+		contact->point = p;
+		contact->penetration = smallest_penetration;
+		contact->swapped = FALSE;
 	}
-	//Aobb0̒_obb1̖ʂƏՓ˂ꍇi@QlɎj
-	//ContactIuWFNg𐶐ASẴoϐɒlZbgARei(contacts)ɒǉ
+	//②obb0の頂点がobb1の面と衝突した場合（①を参考に実装する）
+	//接触情報(contact)の全てのメンバ変数に値をセットする(剛体の順序が入れ替わる)
 	else if (smallest_case == POINTA_FACETB)
 	{
-		D3DXVECTOR3 d = obb0.c - obb1.c;
-		D3DXVECTOR3 n = obb1.u[smallest_axis[1]];
-		if (D3DXVec3Dot(&n, &d) > 0)
+		vec3 d = obb0.c - obb1.c;
+		vec3 n = obb1.u[smallest_axis[1]];
+		if (dot(n, d) > 0)
 		{
 			n = n * -1.0f;
 		}
-		D3DXVec3Normalize(&n, &n);
-
-		D3DXVECTOR3 p = obb0.e;
-		if (D3DXVec3Dot(&obb0.u[0], &d) > 0) p.x = -p.x;
-		if (D3DXVec3Dot(&obb0.u[1], &d) > 0) p.y = -p.y;
-		if (D3DXVec3Dot(&obb0.u[2], &d) > 0) p.z = -p.z;
-
-		rotate_vector_by_quaternion(&p, b0->orientation, p);
-		p += b0->position;
-
-		Contact contact;
-		contact.normal = n;
-		contact.point = p;
-		contact.penetration = smallest_penetration;
-		contact.body[0] = b1;
-		contact.body[1] = b0;
-		contact.restitution = restitution;
-		contacts->push_back(contact);
+		n = normalize(n);
+
+		vec3 p = obb0.e;
+		if (dot(obb0.u[0], d) > 0) p.x = -p.x;
+		if (dot(obb0.u[1], d) > 0) p.y = -p.y;
+		if (dot(obb0.u[2], d) > 0) p.z = -p.z;
+
+		p = rotate(q0, p);
+		p += obb0.c;
+
+		contact->normal = n;
+		contact->point = p;
+		contact->penetration = smallest_penetration;
+		contact->swapped = TRUE;
 	}
-	//Bobb0̕ӂobb1̕ӂƏՓ˂ꍇ
-	//ContactIuWFNg𐶐ASẴoϐɒlZbgARei(contacts)ɒǉ
+	//③obb0の辺とobb1の辺と衝突した場合
+	//接触情報(contact)の全てのメンバ変数に値をセットする
 	else if (smallest_case == EDGE_EDGE)
 	{
-		D3DXVECTOR3 d = obb1.c - obb0.c;
-		D3DXVECTOR3 n;
-		D3DXVec3Cross(&n, &obb0.u[smallest_axis[0]], &obb1.u[smallest_axis[1]]);
-		D3DXVec3Normalize(&n, &n);
-		if (D3DXVec3Dot(&n, &d) > 0)
+		vec3 d = obb1.c - obb0.c;
+		vec3 n = normalize(cross(obb0.u[smallest_axis[0]], obb1.u[smallest_axis[1]]));
+		if (dot(n, d) > 0)
 		{
 			n = n * -1.0f;
 		}
 
-		D3DXVECTOR3 p[2] = { obb0.e, obb1.e };
+		vec3 p[2] = { obb0.e, obb1.e };
 		{
-			if (D3DXVec3Dot(&obb0.u[0], &n) > 0) p[0].x = -p[0].x;
-			if (D3DXVec3Dot(&obb0.u[1], &n) > 0) p[0].y = -p[0].y;
-			if (D3DXVec3Dot(&obb0.u[2], &n) > 0) p[0].z = -p[0].z;
+			if (dot(obb0.u[0], n) > 0) p[0].x = -p[0].x;
+			if (dot(obb0.u[1], n) > 0) p[0].y = -p[0].y;
+			if (dot(obb0.u[2], n) > 0) p[0].z = -p[0].z;
 			p[0][smallest_axis[0]] = 0;
-			rotate_vector_by_quaternion(&p[0], b0->orientation, p[0]);
-			p[0] += b0->position;
+			p[0] = rotate(q0, p[0]);
+			p[0] += obb0.c;
 
 			//_DDM::I().AddCross(p[0], 1);
-			//_DDM::I().AddLine(b0->position, b0->position + smallest_penetration * 100 * obb0.u[smallest_axis[0]]);
+			//_DDM::I().AddLine(p0, obb0.c + smallest_penetration * 100 * obb0.u[smallest_axis[0]]);
 
-			if (D3DXVec3Dot(&obb1.u[0], &n) < 0) p[1].x = -p[1].x;
-			if (D3DXVec3Dot(&obb1.u[1], &n) < 0) p[1].y = -p[1].y;
-			if (D3DXVec3Dot(&obb1.u[2], &n) < 0) p[1].z = -p[1].z;
+			if (dot(obb1.u[0], n) < 0) p[1].x = -p[1].x;
+			if (dot(obb1.u[1], n) < 0) p[1].y = -p[1].y;
+			if (dot(obb1.u[2], n) < 0) p[1].z = -p[1].z;
 			p[1][smallest_axis[1]] = 0;
-			rotate_vector_by_quaternion(&p[1], b1->orientation, p[1]);
-			p[1] += b1->position;
+			p[1] = rotate(q1, p[1]);
+			p[1] += obb1.c;
 
 			//_DDM::I().AddCross(p[1], 1);
-			//_DDM::I().AddLine(b1->position, b1->position + smallest_penetration * 100 * obb1.u[smallest_axis[1]]);
+			//_DDM::I().AddLine(p1, obb1.c + smallest_penetration * 100 * obb1.u[smallest_axis[1]]);
 		}
 
-		Contact contact;
-		contact.normal = n;
-		contact.point = (p[0] + p[1]) * 0.5f;
-		contact.penetration = smallest_penetration;
-		contact.body[0] = b0;
-		contact.body[1] = b1;
-		contact.restitution = restitution;
-		contacts->push_back(contact);
+		contact->normal = n;
+		contact->point = (p[0] + p[1]) * 0.5f;
+		contact->penetration = smallest_penetration;
+		contact->swapped = FALSE;
 	}
 	else assert(0);
 
 	return 1;
 }
 
-void Contact::resolve()
+INT generate_contact_box_box(Box *b0, Box *b1, std::vector<Contact> *contacts, FLOAT restitution)
+{
+	ContactPoint contact_point;
+	if (collide_box_box(b0->position, b0->orientation, b0->half_size, b1->position, b1->orientation, b1->half_size, &contact_point))
+	{
+		push_contact(contact_point, b0, b1, contacts, restitution);
+		return 1;
+	}
+	return 0;
+}
+
+void resolve_contact(ContactBody *a, ContactBody *b, const vec3 &point, const vec3 &normal, FLOAT penetration, FLOAT restitution)
 {
 	assert(penetration > 0);
 
+	//剛体の速度をローカル変数に取り出す(結果は最後に書き戻す)
+	const vec3 p = point, n = normal;
+	const mat3 inverse_inertia_a = a->inverse_inertia_tensor, inverse_inertia_b = b->inverse_inertia_tensor;
+	vec3 va = a->linear_velocity, wa = a->angular_velocity;
+	vec3 vb = b->linear_velocity, wb = b->angular_velocity;
+
 	//David Baraff[1997] An Introduction to Physically Based Modeling:Rigid Body Simulation II - Nonpenetration Constraints pp.40-47
-	//Baraff[1997]̎(8-1)(8-2)(8-3)ՓˑȎΑx(vrel)߂
+	//Baraff[1997]の式(8-1)(8-2)(8-3)から衝突前の相対速度(vrel)を求める
 	FLOAT vrel = 0;
 
 	//(8-1)
-	D3DXVECTOR3 pdota;
-	D3DXVec3Cross(&pdota, &body[0]->angular_velocity, &(point - body[0]->position));
-	pdota += body[0]->linear_velocity;
+	vec3 ra = p - a->position;
+	vec3 pdota = cross(wa, ra) + va;
 
 	//(8-2)
-	D3DXVECTOR3 pdotb;
-	D3DXVec3Cross(&pdotb, &body[1]->angular_velocity, &(point - body[1]->position));
-	pdotb += body[1]->linear_velocity;
+	vec3 rb = p - b->position;
+	vec3 pdotb = cross(wb, rb) + vb;
 
 	//(8-3)
-	vrel = D3DXVec3Dot(&normal, &(pdota - pdotb));
+	vrel = dot(n, pdota - pdotb);
 
-	//Baraff[1997]̎(8-18)̕q(numerator)߂
+	//Baraff[1997]の式(8-18)の分子(numerator)を求める
 	FLOAT numerator = 0;
 	numerator = -(1 + restitution) * vrel;
 
-	//Baraff[1997]̎(8-18)̕(denominator)߂
+	//Baraff[1997]の式(8-18)の分母(denominator)を求める
 	FLOAT denominator = 0;
-	FLOAT term1 = body[0]->inverse_mass();
-	FLOAT term2 = body[1]->inverse_mass();
-	D3DXVECTOR3 ra = point - body[0]->position;
-	D3DXVECTOR3 rb = point - body[1]->position;
-	D3DXVECTOR3 ta, tb;
-	D3DXVec3Cross(&ta, &ra, &normal);
-	D3DXVec3Cross(&tb, &rb, &normal);
-	D3DXVec3TransformCoord(&ta, &ta, &body[0]->inverse_inertia_tensor());
-	D3DXVec3TransformCoord(&tb, &tb, &body[1]->inverse_inertia_tensor());
-	D3DXVec3Cross(&ta, &ta, &ra);
-	D3DXVec3Cross(&tb, &tb, &rb);
-	FLOAT term3 = D3DXVec3Dot(&normal, &ta);
-	FLOAT term4 = D3DXVec3Dot(&normal, &tb);
+	FLOAT term1 = a->inverse_mass;
+	FLOAT term2 = b->inverse_mass;
+	vec3 ta = cross(cross(ra, n) * inverse_inertia_a, ra);
+	vec3 tb = cross(cross(rb, n) * inverse_inertia_b, rb);
+	FLOAT term3 = dot(n, ta);
+	FLOAT term4 = dot(n, tb);
 	denominator = term1 + term2 + term3 + term4;
 
-	//Baraff[1997]̎(8-18)̌(j)߂
+	//Baraff[1997]の式(8-18)の撃力(j)を求める
 	FLOAT j = 0;
 	j = numerator / denominator;
 
-	//Baraff[1997]̎(8-12)ê̕ix(linear_velocity)Ɗpx(angular_velocity)XV
-	D3DXVECTOR3 impulse = j * normal;
-
-	D3DXVECTOR3 friction(0, 0, 0);	//C
-	FLOAT cof = 0.6f;		//CWiCoefficient of frictionj
-	//@ĆiDynamic Frictionj\
-	D3DXVECTOR3 vta = pdota - D3DXVec3Dot(&normal, &pdota) * normal;	//Փ˓_Ȃxipdotaj̏Փ˖ʐڐ
-	D3DXVECTOR3 vtb = pdotb - D3DXVec3Dot(&normal, &pdotb) * normal;	//Փ˓_B̑xipdotbj̏Փ˖ʐڐ
-	D3DXVECTOR3 vt = vta - vtb;	//Փ˓_AB̏Փ˖ʐڐ̑Αxiׂj
-	FLOAT vrel_t = D3DXVec3Length(&vt);
-	if (vrel_t > fabsf(vrel) * cof)	//Փ˓_AB̏Փ˖ʖ@̑Αx̑傫ivreljƏՓ˓_AB̏Փ˖ʐڐ̑Αx̑傫ivrel_tj̔r
+	//Baraff[1997]の式(8-12)より各剛体の並進速度(linear_velocity)と角速度(angular_velocity)を更新する
+	vec3 impulse = j * n;
+
+	vec3 friction(0, 0, 0);	//摩擦力
+	FLOAT cof = 0.6f;		//摩擦係数（Coefficient of friction）
+	//①動摩擦力（Dynamic Friction）を表現する
+	vec3 vta = pdota - dot(n, pdota) * n;	//衝突点Aの速度（pdota）の衝突面接線成分
+	vec3 vtb = pdotb - dot(n, pdotb) * n;	//衝突点Bの速度（pdotb）の衝突面接線成分
+	vec3 vt = vta - vtb;	//衝突点ABの衝突面接線方向の相対速度（すべり方向）
+	FLOAT vrel_t = length(vt);
+	if (vrel_t > fabsf(vrel) * cof)	//衝突点ABの衝突面法線方向の相対速度の大きさ（vrel）と衝突点ABの衝突面接線方向の相対速度の大きさ（vrel_t）の比較
 	{
-		D3DXVec3Normalize(&friction, &-vt); //Cׂ͂͂̋tɍp
-		friction *= j * cof;	//C͂͏Փ˂̑傫ƖCWɔႷ
+		friction = normalize(-vt); //摩擦力はすべり方向の逆方向に作用する
+		friction *= j * cof;	//摩擦力は衝突の大きさと摩擦係数に比例する
 	}
-	impulse += friction;	//͂ɕ␳^
+	impulse += friction;	//撃力に補正を与える
+
+	va += impulse * a->inverse_mass;
+	wa += cross(ra, impulse) * inverse_inertia_a;
+
+	vb -= impulse * b->inverse_mass;
+	wb -= cross(rb, impulse) * inverse_inertia_b;
+
+	a->linear_velocity = va;
+	a->angular_velocity = wa;
+	b->linear_velocity = vb;
+	b->angular_velocity = wb;
 
-	body[0]->linear_velocity += impulse * body[0]->inverse_mass();
-	D3DXVec3Cross(&ta, &ra, &impulse);
-	D3DXVec3TransformCoord(&ta, &ta, &body[0]->inverse_inertia_tensor());
-	body[0]->angular_velocity += ta;
+	//めり込み量の解決
+	a->position += penetration * b->inertial_mass / (a->inertial_mass + b->inertial_mass) * normal;
+	b->position -= penetration * a->inertial_mass / (a->inertial_mass + b->inertial_mass) * normal;
+}
+
+FLOAT contact_relative_velocity(const ContactBody &a, const ContactBody &b, const vec3 &point, const vec3 &normal)
+{
+	//Baraff[1997]の式(8-1)(8-2)(8-3)
+	vec3 pdota = cross(a.angular_velocity, point - a.position) + a.linear_velocity;
+	vec3 pdotb = cross(b.angular_velocity, point - b.position) + b.linear_velocity;
+	return dot(normal, pdota - pdotb);
+}
 
-	body[1]->linear_velocity -= impulse * body[1]->inverse_mass();
-	D3DXVec3Cross(&tb, &rb, &impulse);
-	D3DXVec3TransformCoord(&tb, &tb, &body[1]->inverse_inertia_tensor());
-	body[1]->angular_velocity -= tb;
+FLOAT relax_contact(ContactBody *a, ContactBody *b, const vec3 &point, const vec3 &normal)
+{
+	FLOAT vrel = contact_relative_velocity(*a, *b, point, normal);
+	if (vrel >= 0) return 0;
+
+	//Baraff[1997]の式(8-18)で反発係数を0とした撃力(j)を求める
+	const vec3 p = point, n = normal;
+	const mat3 inverse_inertia_a = a->inverse_inertia_tensor, inverse_inertia_b = b->inverse_inertia_tensor;
+	vec3 ra = p - a->position;
+	vec3 rb = p - b->position;
+	vec3 ta = cross(cross(ra, n) * inverse_inertia_a, ra);
+	vec3 tb = cross(cross(rb, n) * inverse_inertia_b, rb);
+	FLOAT denominator = a->inverse_mass + b->inverse_mass + dot(n, ta) + dot(n, tb);
+	vec3 impulse = (-vrel / denominator) * n;
+
+	//不動オブジェクトの速度は変えない(慣性モーメントの逆数がFLT_EPSILONのため、反復のたびに角速度が積み重なる)
+	if (a->inverse_mass > 0)
+	{
+		a->linear_velocity += impulse * a->inverse_mass;
+		a->angular_velocity += cross(ra, impulse) * inverse_inertia_a;
+	}
+	if (b->inverse_mass > 0)
+	{
+		b->linear_velocity -= impulse * b->inverse_mass;
+		b->angular_velocity -= cross(rb, impulse) * inverse_inertia_b;
+	}
 
-	//߂荞ݗʂ̉
-	body[0]->position += penetration * body[1]->inertial_mass / (body[0]->inertial_mass + body[1]->inertial_mass) * normal;
-	body[1]->position -= penetration * body[0]->inertial_mass / (body[0]->inertial_mass + body[1]->inertial_mass) * normal;
+	return -vrel;
 }
 
+void Contact::resolve()
+{
+	//剛体の状態を取り出して接触を解消し、結果を剛体に書き戻す
+	ContactBody a(*body[0]), b(*body[1]);
+	resolve_contact(&a, &b, point, normal, penetration, restitution);
+	a.store(body[0]);
+	b.store(body[1]);
+}
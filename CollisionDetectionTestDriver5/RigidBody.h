@@ -1,213 +1,201 @@
 #pragma once
 
-#include <d3dx9.h>
+#include "PhysicsMath.h"
 #include <vector>
 #include <assert.h>
 
 struct RigidBody
 {
-	D3DXVECTOR3 position; //ʒu
-	D3DXQUATERNION orientation; //p
+	vec3 position; //位置
+	quat orientation; //姿勢
 
-	D3DXVECTOR3 linear_velocity; //ix
-	D3DXVECTOR3 angular_velocity; //px
+	vec3 linear_velocity; //並進速度
+	vec3 angular_velocity; //角速度
 
-	//(inertial_mass)̒`˃RXgN^œK؂ȏl^邱
+	//慣性質量(inertial_mass)の定義⇒コンストラクタで適切な初期値を与えること
 	FLOAT inertial_mass;
-	//͂̃AL[^(accumulated_force)̒`˃RXgN^œK؂ȏl^邱
-	D3DXVECTOR3 accumulated_force;
+	//力のアキュムレータ(accumulated_force)の定義⇒コンストラクタで適切な初期値を与えること
+	vec3 accumulated_force;
 
-	//[g(inertia_tensor)̒`˃RXgN^œK؂ȏl^邱
-	D3DXMATRIX inertia_tensor;
-	//gNAL[^(accumulated_torque)̒`˃RXgN^œK؂ȏl^邱
-	D3DXVECTOR3 accumulated_torque;
+	//慣性モーメント(inertia_tensor)の定義⇒コンストラクタで適切な初期値を与えること
+	mat3 inertia_tensor;
+	//トルクアキュムレータ(accumulated_torque)の定義⇒コンストラクタで適切な初期値を与えること
+	vec3 accumulated_torque;
 
 	RigidBody() :
 		position(0, 0, 0), orientation(0, 0, 0, 1),
 		linear_velocity(0, 0, 0), angular_velocity(0, 0, 0),
 		inertial_mass(1), accumulated_force(0, 0, 0),
-		accumulated_torque(0, 0, 0)
+		inertia_tensor(mat3_identity()), accumulated_torque(0, 0, 0)
 	{
-		D3DXMatrixIdentity(&inertia_tensor);
 	}
+	//派生クラス(Sphere, Box, Plane)をRigidBody *のまま削除できるようにする
+	virtual ~RigidBody() {}
 
 	void integrate(FLOAT duration)
 	{
-		//IuWFNg̏ꍇ̂݃CeO[Vs
+		//可動オブジェクトの場合のみインテグレーションを行う
 		if(is_movable()) 
 		{
-			//(accumulated_force)x(linear_acceleration)Zox(linear_velocity)XV
-			D3DXVECTOR3 linear_acceleration;
+			//力(accumulated_force)から加速度(linear_acceleration)を算出し速度(linear_velocity)を更新する
+			vec3 linear_acceleration;
 			linear_acceleration = accumulated_force / inertial_mass;
 			linear_velocity += linear_acceleration * duration;
 
-			//ixɂʒu̍XV
+			//並進速度による位置の更新
 			position += linear_velocity * duration;
 
-			//gN(accumulated_torque)px(angular_acceleration)Zopx(angular_velocity)XV
-			D3DXMATRIX inverse_inertia_tensor;
-			D3DXMatrixInverse(&inverse_inertia_tensor, 0, &inertia_tensor);
-			D3DXMATRIX rotation, transposed_rotation;
-			D3DXMatrixRotationQuaternion(&rotation, &orientation);
-			D3DXMatrixTranspose(&transposed_rotation, &rotation);
-			inverse_inertia_tensor = transposed_rotation * inverse_inertia_tensor * rotation;
-			D3DXVECTOR3 angular_acceleration;
-			D3DXVec3TransformCoord(&angular_acceleration, &accumulated_torque, &inverse_inertia_tensor);
+			//トルク(accumulated_torque)から角加速度(angular_acceleration)を算出し角速度(angular_velocity)を更新する
+			mat3 inverse_inertia_tensor;
+			inverse(inertia_tensor, &inverse_inertia_tensor);
+			const mat3 rotation = mat3_from_quat(orientation);
+			inverse_inertia_tensor = transpose(rotation) * inverse_inertia_tensor * rotation;
+			vec3 angular_acceleration = accumulated_torque * inverse_inertia_tensor;
 			angular_velocity += angular_acceleration * duration;
 
-			//pxɂp̍XV
-			D3DXQUATERNION w(angular_velocity.x, angular_velocity.y, angular_velocity.z, 0);
+			//角速度による姿勢の更新
+			quat w(angular_velocity.x, angular_velocity.y, angular_velocity.z, 0);
 			w = orientation * w;
 			orientation += 0.5f * w * duration;
-			D3DXQuaternionNormalize(&orientation, &orientation);
+			orientation = normalize(orientation);
 		}
-		//͂̃AL[^[Zbg
-		accumulated_force = D3DXVECTOR3(0, 0, 0);
-		//gÑAL[^[Zbg
-		accumulated_torque = D3DXVECTOR3(0, 0, 0);
+		//力のアキュムレータをゼロリセットする
+		accumulated_force = vec3(0, 0, 0);
+		//トルクのアキュムレータをゼロリセットする
+		accumulated_torque = vec3(0, 0, 0);
 	}
 
-	void add_force(const D3DXVECTOR3 &force)
+	void add_force(const vec3 &force)
 	{
-		//AL[^(accumulated_force)ɗ(force)ݎZ
+		//アキュムレータ(accumulated_force)に力(force)を累算する
 		accumulated_force += force;
 	}
-	void add_torque(const D3DXVECTOR3 &torque)
+	void add_torque(const vec3 &torque)
 	{
-		//AL[^(accumulated_torque)ɃgN(torque)ݎZ
+		//アキュムレータ(accumulated_torque)にトルク(torque)を累算する
 		accumulated_torque += torque;
 	}
-	void add_force_at_point(const D3DXVECTOR3 &force, const D3DXVECTOR3 &point/*[hW*/)
+	void add_force_at_point(const vec3 &force, const vec3 &point/*ワールド座標*/)
 	{
-		//gN([g)vZ
-		D3DXVECTOR3 torque;
-		D3DXVec3Cross(&torque, &(point - position), &force);
-		//AL[^(accumulated_force)ɗ(force)ݎZ
+		//トルク(モーメント)を計算する
+		vec3 torque, arm = point - position;
+		torque = cross(arm, force);
+		//アキュムレータ(accumulated_force)に力(force)を累算する
 		accumulated_force += force;
-		//AL[^(accumulated_torque)ɃgN(torque)ݎZ
+		//アキュムレータ(accumulated_torque)にトルク(torque)を累算する
 		accumulated_torque += torque;
 	}
 
-	//TCY擾֐(z֐)
-	virtual D3DXVECTOR3 get_dimension() const = 0;
+	//サイズ取得関数(純粋仮想関数)
+	virtual vec3 get_dimension() const = 0;
 
-	//IuWFNgH
+	//可動オブジェクトか？
 	bool is_movable() const
 	{
-		//(inertial_mass)0傫FLT_MAX菬ꍇ͉IuWFNgƂ݂Ȃ
+		//慣性質量(inertial_mass)が0より大きくFLT_MAXより小さい場合は可動オブジェクトとみなす
 		return (inertial_mass > 0 && inertial_mass < FLT_MAX);
 	}
 
-	//(inertial_mass)̋tԂAsIuWFNgꍇ0Ԃ
+	//慣性質量(inertial_mass)の逆数を返し、不可動オブジェクト場合は0を返す
 	FLOAT inverse_mass() const
 	{
 		return (inertial_mass > 0 && inertial_mass < FLT_MAX) ? 1.0f / inertial_mass : 0;
 	}
 
-	//[ge\(inertia_tensor)̋tsԂ
-	D3DXMATRIX inverse_inertia_tensor(bool transformed = true) const
+	//慣性モーメントテンソル(inertia_tensor)の逆行列を返す
+	mat3 inverse_inertia_tensor(bool transformed = true) const
 	{
-		D3DXMATRIX inverse_inertia_tensor;
+		mat3 inverse_inertia_tensor;
 		if (is_movable())
 		{
-			D3DXMatrixInverse(&inverse_inertia_tensor, 0, &inertia_tensor);
+			inverse(inertia_tensor, &inverse_inertia_tensor);
 			if (transformed)
 			{
-				D3DXMATRIX rotation, transposed_rotation;
-				D3DXMatrixRotationQuaternion(&rotation, &orientation);
-				D3DXMatrixTranspose(&transposed_rotation, &rotation);
-				inverse_inertia_tensor = transposed_rotation * inverse_inertia_tensor * rotation;
+				const mat3 rotation = mat3_from_quat(orientation);
+				inverse_inertia_tensor = transpose(rotation) * inverse_inertia_tensor * rotation;
 			}
 		}
 		else
 		{
-			D3DXMatrixIdentity(&inverse_inertia_tensor);
-			inverse_inertia_tensor._11 = FLT_EPSILON;
-			inverse_inertia_tensor._22 = FLT_EPSILON;
-			inverse_inertia_tensor._33 = FLT_EPSILON;
+			inverse_inertia_tensor = mat3_diagonal(vec3(FLT_EPSILON, FLT_EPSILON, FLT_EPSILON));
 		}
 		return inverse_inertia_tensor;
 	}
 };
 
-//̃NX̒`E
+//球体クラスの定義・実装
 struct Sphere : public RigidBody
 {
-	FLOAT r;	//a
-	Sphere(FLOAT r/*a*/, FLOAT density/*x*/) : r(r)
+	FLOAT r;	//半径
+	Sphere(FLOAT r/*半径*/, FLOAT density/*密度*/) : r(r)
 	{
-		//(inertial_mass)vZ
+		//慣性質量(inertial_mass)を計算
 		inertial_mass = 4.0f * 3.14159265358979f * r * r * r / 3.0f * density;
 
-		//[g(inertia_tensor)vZ
-		D3DXMatrixIdentity(&inertia_tensor);
-		inertia_tensor._11 = 0.4f * inertial_mass * r * r;
-		inertia_tensor._22 = 0.4f * inertial_mass * r * r;
-		inertia_tensor._33 = 0.4f * inertial_mass * r * r;
+		//慣性モーメント(inertia_tensor)を計算
+		const FLOAT inertia = 0.4f * inertial_mass * r * r;
+		inertia_tensor = mat3_diagonal(vec3(inertia, inertia, inertia));
 	}
 
-	//TCY(dimension)̎擾֐̎(I[o[Ch)
-	virtual D3DXVECTOR3 get_dimension() const
+	//サイズ(dimension)の取得関数の実装(オーバーライド)
+	virtual vec3 get_dimension() const
 	{
-		return D3DXVECTOR3(r, r, r);
+		return vec3(r, r, r);
 	}
 };
 
-//{bNXNX̒`E
+//ボックスクラスの定義・実装
 struct Box : public RigidBody
 {
-	D3DXVECTOR3 half_size;	//Ӓ
-	Box(D3DXVECTOR3 half_size/*Ӓ*/, FLOAT density/*x*/) : half_size(half_size)
+	vec3 half_size;	//半辺長
+	Box(vec3 half_size/*半辺長*/, FLOAT density/*密度*/) : half_size(half_size)
 	{
-		//(inertial_mass)vZ
+		//慣性質量(inertial_mass)を計算
 		inertial_mass = (half_size.x * half_size.y * half_size.z) * 8.0f * density;
 
-		//[g(inertia_tensor)vZ
-		D3DXMatrixIdentity(&inertia_tensor);
-		inertia_tensor._11 = 0.3333333f * inertial_mass * ((half_size.y * half_size.y) + (half_size.z * half_size.z));
-		inertia_tensor._22 = 0.3333333f * inertial_mass * ((half_size.z * half_size.z) + (half_size.x * half_size.x));
-		inertia_tensor._33 = 0.3333333f * inertial_mass * ((half_size.x * half_size.x) + (half_size.y * half_size.y));
+		//慣性モーメント(inertia_tensor)を計算
+		inertia_tensor = mat3_diagonal(vec3(
+			0.3333333f * inertial_mass * ((half_size.y * half_size.y) + (half_size.z * half_size.z)),
+			0.3333333f * inertial_mass * ((half_size.z * half_size.z) + (half_size.x * half_size.x)),
+			0.3333333f * inertial_mass * ((half_size.x * half_size.x) + (half_size.y * half_size.y))));
 	}
 
-	//TCY擾֐̎(I[o[Ch)
-	virtual D3DXVECTOR3 get_dimension() const
+	//サイズ取得関数の実装(オーバーライド)
+	virtual vec3 get_dimension() const
 	{
 		return half_size;
 	}
 };
 
-//ʃNX̒`E
+//平面クラスの定義・実装
 struct Plane : public RigidBody
 {
-	//sIuWFNgƂĐ
-	Plane(D3DXVECTOR3 n, FLOAT d)
+	//不動オブジェクトとして生成する
+	Plane(vec3 n, FLOAT d)
 	{
-		//(inertial_mass)FLT_MAXZbg
+		//慣性質量(inertial_mass)にFLT_MAXをセット
 		inertial_mass = FLT_MAX;
 
-		//[g(inertia_tensor)̑ΊpFLT_MAXZbg
-		D3DXMatrixIdentity(&inertia_tensor);
-		inertia_tensor._11 = FLT_MAX;
-		inertia_tensor._22 = FLT_MAX;
-		inertia_tensor._33 = FLT_MAX;
+		//慣性モーメント(inertia_tensor)の対角成分にFLT_MAXをセット
+		inertia_tensor = mat3_diagonal(vec3(FLT_MAX, FLT_MAX, FLT_MAX));
 
-		//n = (0, 1, 0),d = 0{ʒuEpƂāAn,d猻݂̈ʒu(position)Ǝp(orientation)vZ
-		D3DXVec3Normalize(&n, &n);
+		//n = (0, 1, 0),d = 0を基本位置・姿勢として、引数のn,dから現在の位置(position)と姿勢(orientation)を計算する
+		n = normalize(n);
 		position = d * n;
 
-		D3DXVECTOR3 Y(0, 1, 0);
-		FLOAT angle = acosf(D3DXVec3Dot(&Y, &n));
-		D3DXVECTOR3 axis;
-		D3DXVec3Cross(&axis, &Y, &n);
-		D3DXVec3Normalize(&axis, &axis);
-		D3DXQuaternionRotationAxis(&orientation, &axis, angle);
-		//D3DXQuaternionNormalize(&orientation, &orientation);
+		vec3 Y(0, 1, 0);
+		FLOAT angle = acosf(dot(Y, n));
+		vec3 axis;
+		axis = cross(Y, n);
+		axis = normalize(axis);
+		orientation = quat_from_axis_angle(axis, angle);
+		//orientation = normalize(orientation);
 	}
 
-	//TCY擾֐̎(I[o[Ch)
-	virtual D3DXVECTOR3 get_dimension() const
+	//サイズ取得関数の実装(オーバーライド)
+	virtual vec3 get_dimension() const
 	{
-		return D3DXVECTOR3(1, 0, 1);
+		return vec3(1, 0, 1);
 	}
 };
 
@@ -220,15 +208,83 @@ struct Contact
 
 	RigidBody* body[2];
 
-	D3DXVECTOR3 point;	//ڐG_
-	D3DXVECTOR3 normal; //0(body[0])猩ڐGʂ̖@
-	FLOAT penetration;	//߂荞ݗ
-	FLOAT restitution;	//W
+	vec3 point;	//接触点
+	vec3 normal; //剛体0(body[0])から見た接触面の法線
+	FLOAT penetration;	//めり込み量
+	FLOAT restitution;	//反発係数
 
-	void resolve();	//ڐG̉
+	void resolve();	//接触の解消
 
 };	
 
+//剛体を参照しない接触情報(形状のみから求める衝突判定の結果)
+struct ContactPoint
+{
+	vec3 point;	//接触点
+	vec3 normal;	//物体0から見た接触面の法線
+	FLOAT penetration;	//めり込み量
+	BOOL swapped;	//真の場合は物体0と物体1の順序が入れ替わる
+};
+
+//接触の解消に必要な剛体の状態(Contact::resolveとRigidWorldで共有する)
+struct ContactBody
+{
+	vec3 position;
+	vec3 linear_velocity;
+	vec3 angular_velocity;
+	FLOAT inertial_mass;
+	FLOAT inverse_mass;
+	mat3 inverse_inertia_tensor;	//ワールド空間の慣性モーメントテンソルの逆行列
+
+	ContactBody() {}
+	ContactBody(const RigidBody &body) :
+		position(body.position),
+		linear_velocity(body.linear_velocity), angular_velocity(body.angular_velocity),
+		inertial_mass(body.inertial_mass), inverse_mass(body.inverse_mass()),
+		inverse_inertia_tensor(body.inverse_inertia_tensor())
+	{
+	}
+	//接触解消の結果を剛体に書き戻す
+	void store(RigidBody *body) const
+	{
+		body->position = position;
+		body->linear_velocity = linear_velocity;
+		body->angular_velocity = angular_velocity;
+	}
+};
+
+//形状のみを引数に取る衝突判定(衝突している場合は接触情報(contact)に値をセットし、接触点の数を返す)
+INT collide_sphere_sphere(const vec3 &p0, FLOAT r0, const vec3 &p1, FLOAT r1, ContactPoint *contact);
+INT collide_sphere_plane(const vec3 &center, FLOAT r, const vec3 &plane_position, const quat &plane_orientation, ContactPoint *contact, BOOL half_space = TRUE);
+INT collide_sphere_box(const vec3 &sphere_position, FLOAT r, const vec3 &box_position, const quat &box_orientation, const vec3 &half_size, ContactPoint *contact);
+INT collide_box_plane(const vec3 &box_position, const quat &box_orientation, const vec3 &half_size, const vec3 &plane_position, const quat &plane_orientation, ContactPoint contacts[8]);
+INT collide_box_box(const vec3 &p0, const quat &q0, const vec3 &h0, const vec3 &p1, const quat &q1, const vec3 &h1, ContactPoint *contact);
+
+//collide_box_boxが使う分離軸判定(SAT)
+enum SAT_TYPE
+{
+	POINTA_FACETB,
+	POINTB_FACETA,
+	EDGE_EDGE
+};
+struct OBB {
+	vec3 c; // OBB center point
+	vec3 u[3]; // Local x-, y-, and z-axes
+	vec3 e; // Positive halfwidth extents of OBB along each axis
+};
+//分離軸が見つからない(交差している)場合は真を返し、最小のめり込み量とその分離軸(各OBBのローカル軸番号)・衝突の種類をセットする
+INT sat_obb_obb(const OBB &a, const OBB &b, FLOAT &smallest_penetration, INT smallest_axis[2], SAT_TYPE &smallest_case);
+//ベクトルvを単位クォータニオンqで回転する
+void rotate_vector_by_quaternion(vec3 *out, const quat &q, const vec3 &v);
+
+//剛体aと剛体bの接触を撃力により解消する
+void resolve_contact(ContactBody *a, ContactBody *b, const vec3 &point, const vec3 &normal, FLOAT penetration, FLOAT restitution);
+//接触点の法線方向の相対速度(vrel、負の値は接近)を求める
+FLOAT contact_relative_velocity(const ContactBody &a, const ContactBody &b, const vec3 &point, const vec3 &normal);
+//接近している接触(vrel < 0)に反発係数0の撃力を与えて相対速度を0にする(位置と不動オブジェクトの速度は変更しない)
+//反復して用いるため、解消前の接近速度(-vrel、離れている場合は0)を返す
+FLOAT relax_contact(ContactBody *a, ContactBody *b, const vec3 &point, const vec3 &normal);
+
 INT generate_contact_sphere_sphere(Sphere *s0, Sphere *s1, std::vector<Contact> *contacts, FLOAT restitution);
 INT generate_contact_sphere_plane(Sphere *sphere, Plane *plane, std::vector<Contact> *contacts, FLOAT restitution, BOOL half_space = TRUE);
 INT generate_contact_sphere_box(Sphere *sphere, Box *box, std::vector<Contact> *contacts, FLOAT restitution);
@@ -0,0 +1,1017 @@
+#define NOMINMAX
+#include "StrictFloat.h"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "RigidWorld.h"
+#include "Profiler.h"
+#include "DebugDraw.h"
+
+RigidWorld::RigidWorld() : restitution(0.4f),
+	solver_budget(200), solver_tolerance(0.01f), solver_max_iterations(8), solver_focus(0, 0, 0), solver_focus_distance(0),
+	simd_level(detect_simd_level()), integrator(&SemiImplicitEuler::integrate), jobs(0), deterministic(FALSE), state_hash(0), contact_batch_peak(0),
+	island_contacts(0), islands(0), island_count(0), island_order(0)
+{
+	memset(&solver_stats, 0, sizeof(solver_stats));
+}
+
+//ステップの前に、作業領域の容量を見込みの要素数n(前のステップの要素数など)の1.5倍以上にする(足りない場合は2倍まで確保する)
+//ステップの中で要素を追加するときに容量を超えて確保し直さないように、また要素数が少しずつ増えていく場合に新しい最大値のたびに確保し直さないようにする
+template <typename V> static void reserve_headroom(V &v, size_t n)
+{
+	if (n + n / 2 > v.capacity()) v.reserve(std::max<size_t>(n * 2, 64));
+}
+
+//剛体1個あたりの組と接触の数の見込み
+//はじめのステップから剛体数に合わせて作業領域を確保し、積み上がって接触が増えていく場面でもウォームアップの後に確保し直さないようにする
+static const UINT CONTACTS_PER_BODY = 2;
+
+//全ての成分配列に同じ処理(f)を適用する
+template <typename F> void RigidWorld::for_each_array(F f)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		f(position[k]);
+		f(previous_position[k]);
+		f(linear_velocity[k]);
+		f(angular_velocity[k]);
+		f(previous_acceleration[k]);
+		f(accumulated_force[k]);
+		f(accumulated_torque[k]);
+		f(inverse_inertia[k]);
+		f(dimension[k]);
+		f(aabb_min[k]);
+		f(aabb_max[k]);
+	}
+	for (int k = 0; k < 4; k++)
+	{
+		f(orientation[k]);
+		f(previous_orientation[k]);
+	}
+	for (int k = 0; k < 9; k++)
+	{
+		f(rotation[k]);
+	}
+	f(inverse_mass);
+}
+
+//Sphere,Boxのコンストラクタと同じ慣性質量・慣性モーメントの逆数
+static void sphere_mass(FLOAT r, FLOAT density, FLOAT *inverse_mass, vec3 *inverse_inertia)
+{
+	FLOAT inertial_mass = 4.0f * 3.14159265358979f * r * r * r / 3.0f * density;
+	FLOAT inertia = 0.4f * inertial_mass * r * r;
+	*inverse_mass = 1.0f / inertial_mass;
+	*inverse_inertia = vec3(1.0f / inertia, 1.0f / inertia, 1.0f / inertia);
+}
+static void box_mass(const vec3 &half_size, FLOAT density, FLOAT *inverse_mass, vec3 *inverse_inertia)
+{
+	FLOAT inertial_mass = (half_size.x * half_size.y * half_size.z) * 8.0f * density;
+	vec3 inertia(
+		0.3333333f * inertial_mass * ((half_size.y * half_size.y) + (half_size.z * half_size.z)),
+		0.3333333f * inertial_mass * ((half_size.z * half_size.z) + (half_size.x * half_size.x)),
+		0.3333333f * inertial_mass * ((half_size.x * half_size.x) + (half_size.y * half_size.y)));
+	*inverse_mass = 1.0f / inertial_mass;
+	*inverse_inertia = vec3(1.0f / inertia.x, 1.0f / inertia.y, 1.0f / inertia.z);
+}
+
+RigidBodyHandle RigidWorld::add_body(SHAPE_TYPE type, FLOAT body_inverse_mass, const vec3 &body_inverse_inertia, const vec3 &body_dimension)
+{
+	UINT i = size();
+	//定数の参照で追加する(値を渡すとGCCがpush_backを関数呼び出しのまま残し、1個の生成が2倍遅くなる)
+	const FLOAT zero = 0;
+	for_each_array([&zero](FloatArray &a) { a.push_back(zero); });
+	shape.push_back((BYTE)type);
+
+	//位置・速度・アキュムレータは0、姿勢は単位クォータニオン、直前の加速度はなし(NO_PREVIOUS_ACCELERATION)で初期化する
+	orientation[3][i] = 1;
+	previous_orientation[3][i] = 1;
+	previous_acceleration[0][i] = NO_PREVIOUS_ACCELERATION;
+	inverse_mass[i] = body_inverse_mass;
+	for (int k = 0; k < 3; k++)
+	{
+		inverse_inertia[k][i] = body_inverse_inertia[k];
+		dimension[k][i] = body_dimension[k];
+	}
+	update_transform(i);
+	return allocate_handle(i);
+}
+
+void RigidWorld::add_bodies(UINT count, SHAPE_TYPE type, FLOAT body_inverse_mass, const vec3 &body_inverse_inertia, const vec3 &body_dimension, RigidBodyHandle *handles)
+{
+	//add_bodyと同じ初期値を、配列ごとにまとめて書き込む
+	const UINT first = size(), n = first + count;
+	for_each_array([n](FloatArray &a) { a.resize(n, 0); });
+	shape.resize(n, (BYTE)type);
+	std::fill(orientation[3].begin() + first, orientation[3].end(), 1.0f);
+	std::fill(previous_orientation[3].begin() + first, previous_orientation[3].end(), 1.0f);
+	std::fill(previous_acceleration[0].begin() + first, previous_acceleration[0].end(), NO_PREVIOUS_ACCELERATION);
+	std::fill(inverse_mass.begin() + first, inverse_mass.end(), body_inverse_mass);
+	for (int k = 0; k < 3; k++)
+	{
+		std::fill(inverse_inertia[k].begin() + first, inverse_inertia[k].end(), body_inverse_inertia[k]);
+		std::fill(dimension[k].begin() + first, dimension[k].end(), body_dimension[k]);
+	}
+	//回転行列はupdate_transformと同じく姿勢から求める(全て単位クォータニオンなので1回だけ求めて並べる)
+	FLOAT r[9];
+	quaternion_to_rotation(0, 0, 0, 1, r);
+	for (int k = 0; k < 9; k++)
+	{
+		std::fill(rotation[k].begin() + first, rotation[k].end(), r[k]);
+	}
+	for (UINT i = first; i < n; i++)
+	{
+		handles[i - first] = allocate_handle(i);
+	}
+}
+
+RigidBodyHandle RigidWorld::allocate_handle(UINT i)
+{
+	//ハンドル番号を割り当てる(削除済みの番号があれば再利用する)
+	UINT index;
+	if (free_handles.empty())
+	{
+		index = (UINT)slot_of_handle.size();
+		slot_of_handle.push_back(i);
+		generation_of_handle.push_back(0);
+	}
+	else
+	{
+		index = free_handles.back();
+		free_handles.pop_back();
+		slot_of_handle[index] = i;
+	}
+	handle_of_slot.push_back(index);
+	return RigidBodyHandle(index, generation_of_handle[index]);
+}
+
+RigidBodyHandle RigidWorld::create_sphere(FLOAT r, FLOAT density)
+{
+	FLOAT body_inverse_mass;
+	vec3 body_inverse_inertia;
+	sphere_mass(r, density, &body_inverse_mass, &body_inverse_inertia);
+	return add_body(SHAPE_SPHERE, body_inverse_mass, body_inverse_inertia, vec3(r, r, r));
+}
+RigidBodyHandle RigidWorld::create_box(const vec3 &half_size, FLOAT density)
+{
+	FLOAT body_inverse_mass;
+	vec3 body_inverse_inertia;
+	box_mass(half_size, density, &body_inverse_mass, &body_inverse_inertia);
+	return add_body(SHAPE_BOX, body_inverse_mass, body_inverse_inertia, half_size);
+}
+void RigidWorld::create_spheres(UINT count, FLOAT r, FLOAT density, RigidBodyHandle *handles)
+{
+	FLOAT body_inverse_mass;
+	vec3 body_inverse_inertia;
+	sphere_mass(r, density, &body_inverse_mass, &body_inverse_inertia);
+	add_bodies(count, SHAPE_SPHERE, body_inverse_mass, body_inverse_inertia, vec3(r, r, r), handles);
+}
+void RigidWorld::create_boxes(UINT count, const vec3 &half_size, FLOAT density, RigidBodyHandle *handles)
+{
+	FLOAT body_inverse_mass;
+	vec3 body_inverse_inertia;
+	box_mass(half_size, density, &body_inverse_mass, &body_inverse_inertia);
+	add_bodies(count, SHAPE_BOX, body_inverse_mass, body_inverse_inertia, half_size, handles);
+}
+RigidBodyHandle RigidWorld::create_plane(vec3 n, FLOAT d)
+{
+	//不動オブジェクトとして生成する(慣性モーメントの逆数はRigidBody::inverse_inertia_tensorと同じくFLT_EPSILON)
+	RigidBodyHandle handle = add_body(SHAPE_PLANE, 0, vec3(FLT_EPSILON, FLT_EPSILON, FLT_EPSILON), vec3(1, 0, 1));
+
+	//n = (0, 1, 0),d = 0を基本位置・姿勢として、引数のn,dから現在の位置と姿勢を計算する(Planeのコンストラクタと同じ)
+	n = normalize(n);
+	vec3 Y(0, 1, 0);
+	FLOAT angle = acosf(dot(Y, n));
+	vec3 axis;
+	axis = cross(Y, n);
+	axis = normalize(axis);
+	quat orientation;
+	orientation = quat_from_axis_angle(axis, angle);
+
+	RigidBodyRef plane = body(handle);
+	plane.set_position(d * n);
+	plane.set_orientation(orientation);
+	return handle;
+}
+
+void RigidWorld::destroy(RigidBodyHandle handle)
+{
+	assert(is_valid(handle));
+	UINT i = slot_of_handle[handle.index];
+	UINT last = size() - 1;
+
+	//末尾の剛体を削除する剛体の位置に移動する
+	for_each_array([i, last](FloatArray &a) { a[i] = a[last]; a.pop_back(); });
+	shape[i] = shape[last];
+	shape.pop_back();
+	handle_of_slot[i] = handle_of_slot[last];
+	handle_of_slot.pop_back();
+	if (i != last) slot_of_handle[handle_of_slot[i]] = i;
+
+	//ハンドルを無効にし、世代を進めて番号を再利用できるようにする
+	slot_of_handle[handle.index] = UINT_MAX;
+	generation_of_handle[handle.index]++;
+	free_handles.push_back(handle.index);
+}
+
+void RigidWorld::destroy(const RigidBodyHandle *handles, UINT count)
+{
+	if (count == 0) return;
+	const UINT n = size(), remaining = n - count;
+
+	//削除する剛体に印を付ける
+	step_arena.reset();
+	BYTE *removed = step_arena.allocate<BYTE>(n);
+	memset(removed, 0, n);
+	for (UINT k = 0; k < count; k++)
+	{
+		assert(is_valid(handles[k]) && !removed[slot_of_handle[handles[k].index]]);
+		removed[slot_of_handle[handles[k].index]] = 1;
+	}
+
+	//剛体番号の大きい順に末尾の剛体を削除した位置へ移す操作を、剛体番号の表(source)の上だけで行い、
+	//残る剛体数より前の削除した位置(holes)と、そこへ移す剛体(movers)を求める
+	//ハンドルも同じ順に無効にする(再利用する番号の順もdestroyを剛体番号の大きい順に呼んだ場合と同じにする)
+	UINT *source = step_arena.allocate<UINT>(n);
+	for (UINT i = 0; i < n; i++)
+	{
+		source[i] = i;
+	}
+	UINT last = n;
+	for (UINT i = n; i-- > 0;)
+	{
+		if (!removed[i]) continue;
+		source[i] = source[--last];
+		UINT index = handle_of_slot[i];
+		slot_of_handle[index] = UINT_MAX;
+		generation_of_handle[index]++;
+		free_handles.push_back(index);
+	}
+	UINT *holes = step_arena.allocate<UINT>(count);
+	UINT *movers = step_arena.allocate<UINT>(count);
+	UINT moves = 0;
+	for (UINT i = 0; i < remaining; i++)
+	{
+		if (!removed[i]) continue;
+		holes[moves] = i;
+		movers[moves++] = source[i];
+	}
+
+	for_each_array([holes, movers, moves, remaining](FloatArray &a)
+	{
+		for (UINT k = 0; k < moves; k++)
+		{
+			a[holes[k]] = a[movers[k]];
+		}
+		a.resize(remaining);
+	});
+	for (UINT k = 0; k < moves; k++)
+	{
+		shape[holes[k]] = shape[movers[k]];
+		handle_of_slot[holes[k]] = handle_of_slot[movers[k]];
+		slot_of_handle[handle_of_slot[holes[k]]] = holes[k];
+	}
+	shape.resize(remaining);
+	handle_of_slot.resize(remaining);
+}
+
+void RigidWorld::reserve(UINT count)
+{
+	for_each_array([count](FloatArray &a) { a.reserve(count); });
+	shape.reserve(count);
+	handle_of_slot.reserve(count);
+	slot_of_handle.reserve(count);
+	generation_of_handle.reserve(count);
+	free_handles.reserve(count);
+}
+
+RigidWorld::MemoryUsage RigidWorld::memory_usage() const
+{
+	MemoryUsage usage;
+	//for_each_arrayは配列を読むだけなのでconstを外して使う
+	usage.bodies = shape.capacity();
+	const_cast<RigidWorld *>(this)->for_each_array([&usage](FloatArray &a) { usage.bodies += a.capacity() * sizeof(FLOAT); });
+	usage.handles = (slot_of_handle.capacity() + generation_of_handle.capacity() + handle_of_slot.capacity() + free_handles.capacity()) * sizeof(UINT);
+	usage.pairs = pairs.capacity() * sizeof(Pair);
+	usage.contacts = contacts.capacity() * sizeof(Contact) + contact_batches.capacity() * sizeof(std::vector<Contact>) + batch_offset.capacity() * sizeof(UINT);
+	for (size_t batch = 0; batch < contact_batches.size(); batch++)
+	{
+		usage.contacts += contact_batches[batch].capacity() * sizeof(Contact);
+	}
+	usage.scratch = step_arena.memory_bytes() + chunk_hashes.capacity() * sizeof(unsigned long long);
+	return usage;
+}
+
+//stepのタスクグラフで1つのタスクが受け持つ剛体数(integrate_batchのSIMDの幅の倍数)
+static const UINT STEP_CHUNK_BODIES = 1024;
+
+//剛体数nをstepのタスクグラフで分ける範囲の数
+static UINT step_chunk_count(UINT n, UINT threads)
+{
+	UINT chunks = std::min((n + STEP_CHUNK_BODIES - 1) / STEP_CHUNK_BODIES, threads * 4);
+	return chunks ? chunks : 1;
+}
+
+//剛体数nをchunks個に分けたc番目の範囲
+//範囲の境界は8の倍数にそろえる(integrate_batchのSIMDの端数の処理を範囲の分け方によらず同じにする)
+static void step_chunk_range(UINT n, UINT c, UINT chunks, UINT *begin, UINT *end)
+{
+	*begin = (UINT)((unsigned long long)n * c / chunks) & ~7u;
+	*end = c + 1 == chunks ? n : (UINT)((unsigned long long)n * (c + 1) / chunks) & ~7u;
+}
+
+void RigidWorld::step(FLOAT duration)
+{
+	PROFILE_SCOPE("step");
+	if (!jobs)
+	{
+		integrate(duration);
+		collide();
+		if (deterministic) state_hash = compute_state_hash();
+		return;
+	}
+	if (step_graph.chunks < step_chunk_count(size(), jobs->thread_count()) || step_graph.threads != jobs->thread_count() || step_graph.deterministic != deterministic) build_step_graph();
+	step_graph.duration = duration;
+	step_graph.graph.run(jobs);
+}
+
+//compute_state_hashで1つの範囲が受け持つ剛体数(ハッシュの値はこの値で決まるため、変更すると過去の記録と比較できなくなる)
+static const UINT HASH_CHUNK_BODIES = 4096;
+static const unsigned long long FNV_OFFSET_BASIS = 14695981039346656037ull;
+static const unsigned long long FNV_PRIME = 1099511628211ull;
+
+//FNV-1aを4バイト単位に適用する(1語の違いは必ずハッシュの違いになる)
+static inline unsigned long long hash_floats(unsigned long long h, const FLOAT *values, UINT begin, UINT end)
+{
+	for (UINT i = begin; i < end; i++)
+	{
+		UINT bits;
+		memcpy(&bits, values + i, sizeof(bits));
+		h = (h ^ bits) * FNV_PRIME;
+	}
+	return h;
+}
+
+unsigned long long RigidWorld::compute_state_hash() const
+{
+	PROFILE_SCOPE("state_hash");
+	const UINT n = size();
+	const UINT chunks = (n + HASH_CHUNK_BODIES - 1) / HASH_CHUNK_BODIES;
+	chunk_hashes.resize(chunks);
+	auto hash_chunks = [this, n](UINT begin, UINT end)
+	{
+		for (UINT c = begin; c < end; c++)
+		{
+			const UINT first = c * HASH_CHUNK_BODIES, last = std::min(first + HASH_CHUNK_BODIES, n);
+			unsigned long long h = FNV_OFFSET_BASIS;
+			for (int k = 0; k < 3; k++) h = hash_floats(h, position[k].data(), first, last);
+			for (int k = 0; k < 4; k++) h = hash_floats(h, orientation[k].data(), first, last);
+			for (int k = 0; k < 3; k++) h = hash_floats(h, linear_velocity[k].data(), first, last);
+			for (int k = 0; k < 3; k++) h = hash_floats(h, angular_velocity[k].data(), first, last);
+			chunk_hashes[c] = h;
+		}
+	};
+	if (jobs && chunks > 1) jobs->parallel_for(chunks, 1, hash_chunks);
+	else hash_chunks(0, chunks);
+
+	//範囲のハッシュを範囲の順に合わせる(剛体数も含める)
+	unsigned long long h = (FNV_OFFSET_BASIS ^ n) * FNV_PRIME;
+	for (UINT c = 0; c < chunks; c++)
+	{
+		h = (h ^ chunk_hashes[c]) * FNV_PRIME;
+	}
+	return h;
+}
+
+void RigidWorld::build_step_graph()
+{
+	//剛体を範囲に分け、範囲ごとにintegrate → update_transforms → update_boundsのタスクをつなぐ
+	//(範囲どうしは独立しているため、早く終わった範囲のupdate_boundsは他の範囲のintegrateと重なって実行される)
+	//範囲の境界はタスクの実行時の剛体数から求める(剛体数が変わってもグラフを作り直さずに済む)
+	const UINT threads = jobs->thread_count();
+	const UINT chunks = step_chunk_count(size(), threads);
+	TaskGraph &graph = step_graph.graph;
+	graph.clear();
+	const UINT broadphase_task = graph.add([this]() { broadphase(); });
+	const UINT narrowphase_task = graph.add([this]() { generate_contacts(); });
+	const UINT solve_task = graph.add([this]() { resolve_contacts(); });
+	for (UINT c = 0; c < chunks; c++)
+	{
+		UINT integrate_task = graph.add([this, c, chunks]()
+		{
+			UINT begin, end;
+			step_chunk_range(size(), c, chunks, &begin, &end);
+			integrate(begin, end, step_graph.duration);
+		});
+		UINT transform_task = graph.add([this, c, chunks]()
+		{
+			UINT begin, end;
+			step_chunk_range(size(), c, chunks, &begin, &end);
+			update_transforms(begin, end);
+		});
+		UINT bounds_task = graph.add([this, c, chunks]()
+		{
+			UINT begin, end;
+			step_chunk_range(size(), c, chunks, &begin, &end);
+			update_bounds(begin, end);
+		});
+		graph.precede(integrate_task, transform_task);
+		graph.precede(transform_task, bounds_task);
+		graph.precede(bounds_task, broadphase_task);
+	}
+	graph.precede(broadphase_task, narrowphase_task);
+	graph.precede(narrowphase_task, solve_task);
+	if (deterministic)
+	{
+		const UINT hash_task = graph.add([this]() { state_hash = compute_state_hash(); });
+		graph.precede(solve_task, hash_task);
+	}
+	step_graph.chunks = chunks;
+	step_graph.threads = threads;
+	step_graph.deterministic = deterministic;
+}
+
+void RigidWorld::collide()
+{
+	update_transforms();
+	update_bounds();
+	broadphase();
+	generate_contacts();
+	resolve_contacts();
+}
+
+void RigidWorld::store_poses()
+{
+	for (int k = 0; k < 3; k++)
+	{
+		previous_position[k] = position[k];
+	}
+	for (int k = 0; k < 4; k++)
+	{
+		previous_orientation[k] = orientation[k];
+	}
+}
+
+vec3 RigidWorld::get_interpolated_position(UINT i, FLOAT alpha) const
+{
+	vec3 p0(previous_position[0][i], previous_position[1][i], previous_position[2][i]);
+	return p0 + (get_position(i) - p0) * alpha;
+}
+
+quat RigidWorld::get_interpolated_orientation(UINT i, FLOAT alpha) const
+{
+	//正規化線形補間(1ステップの回転は小さいため球面線形補間との差は無視できる)
+	quat q0(previous_orientation[0][i], previous_orientation[1][i], previous_orientation[2][i], previous_orientation[3][i]);
+	quat q1 = get_orientation(i);
+	//qと-qは同じ姿勢を表すため、近い方を補間する
+	if (q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w < 0) q1 = -q1;
+	quat q = q0 + (q1 - q0) * alpha;
+	q = normalize(q);
+	return q;
+}
+
+BodyArrays RigidWorld::arrays()
+{
+	BodyArrays bodies;
+	for (int k = 0; k < 3; k++)
+	{
+		bodies.position[k] = position[k].data();
+		bodies.linear_velocity[k] = linear_velocity[k].data();
+		bodies.angular_velocity[k] = angular_velocity[k].data();
+		bodies.accumulated_force[k] = accumulated_force[k].data();
+		bodies.accumulated_torque[k] = accumulated_torque[k].data();
+		bodies.inverse_inertia[k] = inverse_inertia[k].data();
+	}
+	for (int k = 0; k < 4; k++)
+	{
+		bodies.orientation[k] = orientation[k].data();
+	}
+	bodies.inverse_mass = inverse_mass.data();
+	return bodies;
+}
+
+void RigidWorld::integrate(FLOAT duration)
+{
+	integrate(0, size(), duration);
+}
+
+void RigidWorld::integrate(UINT begin, UINT end, FLOAT duration)
+{
+	PROFILE_SCOPE("integrate");
+	//既定値(SemiImplicitEuler)はRigidBody::integrateと同じ計算を配列に対してまとめて行う(integrate_batch)
+	integrator(this, begin, end, duration);
+}
+
+void RigidWorld::update_transform(UINT i)
+{
+	FLOAT r[9];
+	quaternion_to_rotation(orientation[0][i], orientation[1][i], orientation[2][i], orientation[3][i], r);
+	for (int k = 0; k < 9; k++)
+	{
+		rotation[k][i] = r[k];
+	}
+}
+
+void RigidWorld::update_transforms()
+{
+	update_transforms(0, size());
+}
+
+void RigidWorld::update_transforms(UINT begin, UINT end)
+{
+	PROFILE_SCOPE("update_transforms");
+	const FLOAT *qx = orientation[0].data(), *qy = orientation[1].data(), *qz = orientation[2].data(), *qw = orientation[3].data();
+	FLOAT *r[9];
+	for (int k = 0; k < 9; k++)
+	{
+		r[k] = rotation[k].data();
+	}
+	for (UINT i = begin; i < end; i++)
+	{
+		FLOAT m[9];
+		quaternion_to_rotation(qx[i], qy[i], qz[i], qw[i], m);
+		for (int k = 0; k < 9; k++)
+		{
+			r[k][i] = m[k];
+		}
+	}
+}
+
+void RigidWorld::update_bounds()
+{
+	update_bounds(0, size());
+}
+
+void RigidWorld::update_bounds(UINT begin, UINT end)
+{
+	PROFILE_SCOPE("update_bounds");
+	const BYTE *type = shape.data();
+	for (int k = 0; k < 3; k++)
+	{
+		const FLOAT *p = position[k].data();
+		//回転行列の第k列(各ローカル軸のワールドk成分)
+		const FLOAT *r0 = rotation[k].data(), *r1 = rotation[3 + k].data(), *r2 = rotation[6 + k].data();
+		const FLOAT *e0 = dimension[0].data(), *e1 = dimension[1].data(), *e2 = dimension[2].data();
+		FLOAT *lo = aabb_min[k].data(), *hi = aabb_max[k].data();
+		for (UINT i = begin; i < end; i++)
+		{
+			//球体は半径、直方体は各ローカル軸の半辺長をワールド軸へ投影した長さ
+			FLOAT extent = fabsf(r0[i]) * e0[i] + fabsf(r1[i]) * e1[i] + fabsf(r2[i]) * e2[i];
+			if (type[i] == SHAPE_SPHERE) extent = e0[i];
+			lo[i] = p[i] - extent;
+			hi[i] = p[i] + extent;
+			//平面は無限に広がる
+			if (type[i] == SHAPE_PLANE)
+			{
+				lo[i] = -FLT_MAX;
+				hi[i] = FLT_MAX;
+			}
+		}
+	}
+	if (DEBUG_DRAW_ENABLED(DEBUG_DRAW_AABBS))
+	{
+		//可動オブジェクトは緑、不動オブジェクトは灰色(平面は無限に広がるため描かない)
+		DebugDrawBatch *batch = DebugDrawRecorder::thread_batch();
+		for (UINT i = begin; i < end; i++)
+		{
+			if (type[i] == SHAPE_PLANE) continue;
+			batch->add_aabb(vec3(aabb_min[0][i], aabb_min[1][i], aabb_min[2][i]), vec3(aabb_max[0][i], aabb_max[1][i], aabb_max[2][i]),
+				inverse_mass[i] > 0 ? 0xFF00FF00 : 0xFF808080);
+		}
+	}
+}
+
+void RigidWorld::broadphase()
+{
+	PROFILE_SCOPE("broadphase");
+	//x軸方向のSweep and Pruneで衝突の可能性がある剛体の組を求める
+	//前のステップの組の数より余裕を持って確保しておく
+	//組の数は前のステップの組の数か剛体数 × CONTACTS_PER_BODYの多いほうを見込む
+	const UINT n = size();
+	reserve_headroom(pairs, std::max<size_t>(pairs.size(), (size_t)n * CONTACTS_PER_BODY));
+	pairs.clear();
+	step_arena.reset();
+	UINT *sweep_order = step_arena.allocate<UINT>(n);
+	for (UINT i = 0; i < n; i++)
+	{
+		sweep_order[i] = i;
+	}
+	const FLOAT *min_x = aabb_min[0].data();
+	std::sort(sweep_order, sweep_order + n, [min_x](UINT a, UINT b) { return min_x[a] < min_x[b]; });
+
+	for (UINT s = 0; s < n; s++)
+	{
+		UINT i = sweep_order[s];
+		for (UINT t = s + 1; t < n; t++)
+		{
+			UINT j = sweep_order[t];
+			if (aabb_min[0][j] > aabb_max[0][i]) break;
+			if (aabb_min[1][j] > aabb_max[1][i] || aabb_max[1][j] < aabb_min[1][i]) continue;
+			if (aabb_min[2][j] > aabb_max[2][i] || aabb_max[2][j] < aabb_min[2][i]) continue;
+			//不動オブジェクト同士の組は除外する
+			if (inverse_mass[i] == 0 && inverse_mass[j] == 0) continue;
+
+			Pair pair;
+			pair.body[0] = shape[i] <= shape[j] ? i : j;
+			pair.body[1] = shape[i] <= shape[j] ? j : i;
+			pairs.push_back(pair);
+		}
+	}
+
+	//組を剛体番号の組の順に並べる(generate_contactsの接触の並びを、x座標の同じ剛体の順序などに左右されない決まった順にする)
+	std::sort(pairs.begin(), pairs.end(), [](const Pair &a, const Pair &b)
+	{
+		return a.body[0] != b.body[0] ? a.body[0] < b.body[0] : a.body[1] < b.body[1];
+	});
+}
+
+//generate_contactsで並列に判定する1バッチの組の数
+static const UINT PAIRS_PER_BATCH = 128;
+
+void RigidWorld::collide_pair(const Pair &pair, std::vector<Contact> *output) const
+{
+	//形状の組み合わせに応じた衝突判定を行い、接触をoutputに追加する
+	ContactPoint contact_points[8];
+	UINT a = pair.body[0];
+	UINT b = pair.body[1];
+	INT count = 0;
+	switch (shape[a] * 3 + shape[b])
+	{
+	case SHAPE_SPHERE * 3 + SHAPE_SPHERE:
+		count = collide_sphere_sphere(get_position(a), dimension[0][a], get_position(b), dimension[0][b], contact_points);
+		break;
+	case SHAPE_SPHERE * 3 + SHAPE_BOX:
+		count = collide_sphere_box(get_position(a), dimension[0][a], get_position(b), get_orientation(b), get_dimension(b), contact_points);
+		break;
+	case SHAPE_SPHERE * 3 + SHAPE_PLANE:
+		count = collide_sphere_plane(get_position(a), dimension[0][a], get_position(b), get_orientation(b), contact_points);
+		break;
+	case SHAPE_BOX * 3 + SHAPE_BOX:
+		count = collide_box_box(get_position(a), get_orientation(a), get_dimension(a), get_position(b), get_orientation(b), get_dimension(b), contact_points);
+		break;
+	case SHAPE_BOX * 3 + SHAPE_PLANE:
+		count = collide_box_plane(get_position(a), get_orientation(a), get_dimension(a), get_position(b), get_orientation(b), contact_points);
+		break;
+	}
+	for (INT c = 0; c < count; c++)
+	{
+		Contact contact;
+		contact.body[0] = contact_points[c].swapped ? b : a;
+		contact.body[1] = contact_points[c].swapped ? a : b;
+		contact.point = contact_points[c].point;
+		contact.normal = contact_points[c].normal;
+		contact.penetration = contact_points[c].penetration;
+		contact.restitution = restitution;
+		output->push_back(contact);
+		//判定したスレッドのバッファに記録する(並列の判定を止めずに接触を表示する)
+		if (DEBUG_DRAW_ENABLED(DEBUG_DRAW_CONTACTS))
+		{
+			DebugDrawBatch *batch = DebugDrawRecorder::thread_batch();
+			batch->add_cross(contact.point, 1, 0xFFFFFFFF);
+			batch->add_line(contact.point, contact.point + contact.penetration * 100 * contact.normal, 0xFFFF0000);
+		}
+	}
+}
+
+//collide_pairsで時間を計る組の割合(形状の組み合わせごとにこの数の組に1組)
+static const UINT PROFILE_PAIR_SAMPLING = 8;
+
+void RigidWorld::collide_pairs(UINT begin, UINT end, std::vector<Contact> *output) const
+{
+	if (!PHYSICS_PROFILE || !Profiler::is_enabled())
+	{
+		for (UINT k = begin; k < end; k++)
+		{
+			collide_pair(pairs[k], output);
+		}
+		return;
+	}
+
+	//形状の組み合わせごとの時間は、PROFILE_PAIR_SAMPLING組に1組だけ計った平均 × 組数で見積もる
+	//(全ての組を計ると計測の費用が球同士の判定と同程度になり、結果を歪めるため)
+	static const UINT zones[9] =
+	{
+		Profiler::I().zone("narrowphase sphere-sphere"), Profiler::I().zone("narrowphase sphere-box"), Profiler::I().zone("narrowphase sphere-plane"),
+		Profiler::I().zone("narrowphase other"), Profiler::I().zone("narrowphase box-box"), Profiler::I().zone("narrowphase box-plane"),
+		Profiler::I().zone("narrowphase other"), Profiler::I().zone("narrowphase other"), Profiler::I().zone("narrowphase other"),
+	};
+	UINT count[9] = {}, samples[9] = {};
+	unsigned long long sampled[9] = {};
+	const unsigned long long start = profile_ticks();
+	for (UINT k = begin; k < end; k++)
+	{
+		const Pair &pair = pairs[k];
+		const UINT type = shape[pair.body[0]] * 3 + shape[pair.body[1]];
+		if (count[type]++ % PROFILE_PAIR_SAMPLING == 0)
+		{
+			const unsigned long long t = profile_ticks();
+			collide_pair(pair, output);
+			sampled[type] += profile_ticks() - t;
+			samples[type]++;
+		}
+		else
+		{
+			collide_pair(pair, output);
+		}
+	}
+	const unsigned long long finish = profile_ticks();
+
+	//見積もった時間を組み合わせの順に並べた区間として記録する(計った範囲からはみ出さないように切り詰める)
+	unsigned long long t = start;
+	for (UINT type = 0; type < 9; type++)
+	{
+		if (count[type] == 0) continue;
+		const unsigned long long estimate = sampled[type] / samples[type] * count[type];
+		const unsigned long long e = std::min(t + estimate, finish);
+		Profiler::record(zones[type], t, e);
+		t = e;
+	}
+}
+
+void RigidWorld::generate_contacts()
+{
+	PROFILE_SCOPE("generate_contacts");
+	//剛体の組ごとに衝突判定を行い、接触(contacts)を生成する
+	const UINT pair_count = (UINT)pairs.size();
+	if (!jobs || jobs->thread_count() <= 1 || pair_count <= PAIRS_PER_BATCH)
+	{
+		//接触の数は前のステップの接触の数か剛体数 × CONTACTS_PER_BODYの多いほうを見込む
+		reserve_headroom(contacts, std::max<size_t>(contacts.size(), (size_t)size() * CONTACTS_PER_BODY));
+		contacts.clear();
+		collide_pairs(0, pair_count, &contacts);
+		return;
+	}
+
+	//組の列を決まった数ずつのバッチに分け(分け方はスレッド数によらない)、バッチごとのバッファに判定する
+	//各バッチは自分のバッファだけに書き込むため、ロックも原子操作も使わない
+	//バッファは組の配列の容量に入るバッチの数だけ用意する(組が増えてバッチが増えても、組の配列を確保し直すまでは新しいバッファを確保しない)
+	const UINT batches = (pair_count + PAIRS_PER_BATCH - 1) / PAIRS_PER_BATCH;
+	const UINT batch_capacity = (UINT)((pairs.capacity() + PAIRS_PER_BATCH - 1) / PAIRS_PER_BATCH);
+	if (contact_batches.size() < batch_capacity) contact_batches.resize(batch_capacity);
+	reserve_headroom(batch_offset, batch_capacity + 1);
+	batch_offset.resize(batches + 1);
+	//新しいバッファはこれまでで最も多かったバッチの接触の数(少なくとも組の数)を、それ以外のバッファは前のステップの接触の数を見込んで確保する
+	//(容量の足りないバッファだけを確保し直し、1つのバッチが増えても全てのバッファを確保し直さない)
+	for (UINT batch = 0; batch < contact_batches.size(); batch++)
+	{
+		std::vector<Contact> &buffer = contact_batches[batch];
+		reserve_headroom(buffer, buffer.capacity() ? buffer.size() : std::max<size_t>(contact_batch_peak, PAIRS_PER_BATCH));
+	}
+	jobs->parallel_for(batches, 1, [this, pair_count](UINT begin, UINT end)
+	{
+		PROFILE_SCOPE("narrowphase batch");
+		for (UINT batch = begin; batch < end; batch++)
+		{
+			std::vector<Contact> &buffer = contact_batches[batch];
+			buffer.clear();
+			collide_pairs(batch * PAIRS_PER_BATCH, std::min(pair_count, (batch + 1) * PAIRS_PER_BATCH), &buffer);
+		}
+	});
+
+	//バッファをバッチの順(組の順)に連結する
+	PROFILE_SCOPE("narrowphase merge");
+	batch_offset[0] = 0;
+	size_t largest = 0;
+	for (UINT batch = 0; batch < batches; batch++)
+	{
+		batch_offset[batch + 1] = batch_offset[batch] + (UINT)contact_batches[batch].size();
+		largest = std::max(largest, contact_batches[batch].size());
+	}
+	contact_batch_peak = std::max(contact_batch_peak, largest);
+	reserve_headroom(contacts, std::max<size_t>(batch_offset[batches], (size_t)size() * CONTACTS_PER_BODY));
+	contacts.resize(batch_offset[batches]);
+	jobs->parallel_for(batches, 0, [this](UINT begin, UINT end)
+	{
+		for (UINT batch = begin; batch < end; batch++)
+		{
+			std::copy(contact_batches[batch].begin(), contact_batches[batch].end(), contacts.begin() + batch_offset[batch]);
+		}
+	});
+}
+
+ContactBody RigidWorld::contact_body(UINT i) const
+{
+	ContactBody body;
+	body.position = get_position(i);
+	body.linear_velocity = get_linear_velocity(i);
+	body.angular_velocity = get_angular_velocity(i);
+	body.inverse_mass = inverse_mass[i];
+	body.inertial_mass = inverse_mass[i] > 0 ? 1.0f / inverse_mass[i] : FLT_MAX;
+	body.inverse_inertia_tensor = inverse_inertia_tensor(i);
+	return body;
+}
+void RigidWorld::store_contact_body(UINT i, const ContactBody &body)
+{
+	//不動オブジェクトには書き戻さない(全てのアイランドが共有する平面などを、接触の解消で動かさない)
+	if (inverse_mass[i] == 0) return;
+	for (int k = 0; k < 3; k++)
+	{
+		position[k][i] = body.position[k];
+		linear_velocity[k][i] = body.linear_velocity[k];
+		angular_velocity[k][i] = body.angular_velocity[k];
+	}
+}
+
+void RigidWorld::resolve_contacts()
+{
+	PROFILE_SCOPE("resolve_contacts");
+	//Contact::resolveと同じく接触を順番に解消する
+	{
+		PROFILE_SCOPE("solver sequential pass");
+		for (size_t k = 0; k < contacts.size(); k++)
+		{
+			const Contact &contact = contacts[k];
+			ContactBody a = contact_body(contact.body[0]);
+			ContactBody b = contact_body(contact.body[1]);
+			resolve_contact(&a, &b, contact.point, contact.normal, contact.penetration, contact.restitution);
+			store_contact_body(contact.body[0], a);
+			store_contact_body(contact.body[1], b);
+		}
+	}
+
+	memset(&solver_stats, 0, sizeof(solver_stats));
+	if (contacts.empty() || solver_budget <= 0 || solver_max_iterations == 0) return;
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+
+	//接触でつながった可動オブジェクトをアイランドにまとめ、アイランドごとの接近速度と優先度の重みを求める
+	{
+		PROFILE_SCOPE("solver build_islands");
+		//build_islandsの割り当て(剛体ごとに2個、接触ごとにIslandと2個のUINT)が1つのブロックに収まるように、
+		//接触の数は今のステップの接触の数か剛体数 × CONTACTS_PER_BODYの多いほうの1.5倍以上を見込む(足りない場合は2倍まで確保する)
+		step_arena.reset();
+		const size_t n = size(), m = std::max<size_t>(contacts.size(), n * CONTACTS_PER_BODY);
+		const size_t body_bytes = 2 * n * sizeof(UINT) + 5 * CACHE_LINE_SIZE, contact_bytes = sizeof(Island) + 2 * sizeof(UINT);
+		if (body_bytes + (m + m / 2) * contact_bytes > step_arena.memory_bytes()) step_arena.reserve(body_bytes + 2 * m * contact_bytes);
+		build_islands();
+	}
+	for (UINT k = 0; k < island_count; k++)
+	{
+		Island &island = islands[k];
+		FLOAT distance = FLT_MAX;
+		for (UINT c = island.begin; c < island.end; c++)
+		{
+			const Contact &contact = contacts[island_contacts[c]];
+			FLOAT vrel = contact_relative_velocity(contact_body(contact.body[0]), contact_body(contact.body[1]), contact.point, contact.normal);
+			island.residual = std::max(island.residual, -vrel);
+			vec3 offset = contact.point - solver_focus;
+			distance = std::min(distance, length(offset));
+		}
+		island.weight = solver_focus_distance > 0 ? 1.0f / (1.0f + distance / solver_focus_distance) : 1.0f;
+		solver_stats.initial_residual = std::max(solver_stats.initial_residual, island.residual);
+	}
+	solver_stats.islands = island_count;
+	if (DEBUG_DRAW_ENABLED(DEBUG_DRAW_ISLANDS))
+	{
+		//アイランドの可動オブジェクトのAABBを合わせた範囲を、アイランドごとに色を変えて描く
+		static const DebugColor colors[6] = { 0xFFFF8000, 0xFF00FFFF, 0xFFFF00FF, 0xFFFFFF00, 0xFF8080FF, 0xFF80FF80 };
+		DebugDrawBatch *batch = DebugDrawRecorder::thread_batch();
+		for (UINT k = 0; k < island_count; k++)
+		{
+			vec3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (UINT c = islands[k].begin; c < islands[k].end; c++)
+			{
+				const Contact &contact = contacts[island_contacts[c]];
+				for (int b = 0; b < 2; b++)
+				{
+					const UINT i = contact.body[b];
+					if (inverse_mass[i] == 0) continue;
+					lo = vec3(std::min(lo.x, aabb_min[0][i]), std::min(lo.y, aabb_min[1][i]), std::min(lo.z, aabb_min[2][i]));
+					hi = vec3(std::max(hi.x, aabb_max[0][i]), std::max(hi.y, aabb_max[1][i]), std::max(hi.z, aabb_max[2][i]));
+				}
+			}
+			batch->add_aabb(lo, hi, colors[k % 6]);
+		}
+	}
+
+	//未収束のアイランドを優先度(接近速度 × 重み)の高い順に1回ずつ反復し、予算を使い切るか全て収束するまで繰り返す
+	//(アイランドどうしは可動オブジェクトを共有せず、不動オブジェクトは書き換えないため、同じ優先度のアイランドの順は結果に影響しない)
+	for (;;)
+	{
+		PROFILE_SCOPE("solver iteration");
+		UINT order_count = 0;
+		for (UINT k = 0; k < island_count; k++)
+		{
+			if (islands[k].residual > solver_tolerance && islands[k].iterations < solver_max_iterations) island_order[order_count++] = k;
+		}
+		if (order_count == 0) break;
+		const Island *p = islands;
+		std::sort(island_order, island_order + order_count, [p](UINT a, UINT b) { return p[a].residual * p[a].weight > p[b].residual * p[b].weight; });
+
+		for (UINT k = 0; k < order_count && !solver_stats.budget_exhausted; k++)
+		{
+			if (!deterministic && std::chrono::duration<FLOAT, std::micro>(Clock::now() - start).count() >= solver_budget)
+			{
+				solver_stats.budget_exhausted = TRUE;
+				break;
+			}
+			Island &island = islands[island_order[k]];
+			island.residual = relax_island(&island);
+			island.iterations++;
+			solver_stats.iterations++;
+		}
+		if (solver_stats.budget_exhausted) break;
+	}
+
+	for (UINT k = 0; k < island_count; k++)
+	{
+		solver_stats.residual = std::max(solver_stats.residual, islands[k].residual);
+		solver_stats.max_iterations = std::max(solver_stats.max_iterations, islands[k].iterations);
+		if (islands[k].residual > solver_tolerance) solver_stats.unconverged_islands++;
+	}
+	solver_stats.elapsed = std::chrono::duration<FLOAT, std::micro>(Clock::now() - start).count();
+}
+
+void RigidWorld::build_islands()
+{
+	//Union-Findで接触している可動オブジェクトをまとめる(不動オブジェクトはアイランドをつながない)
+	//作業領域はresolve_contactsがresetしたstep_arenaに割り当てる
+	const UINT n = size();
+	const UINT m = (UINT)contacts.size();
+	UINT *parent = step_arena.allocate<UINT>(n);
+	for (UINT i = 0; i < n; i++)
+	{
+		parent[i] = i;
+	}
+	auto find = [parent](UINT i)
+	{
+		while (parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	};
+	for (size_t k = 0; k < contacts.size(); k++)
+	{
+		UINT a = contacts[k].body[0], b = contacts[k].body[1];
+		if (inverse_mass[a] > 0 && inverse_mass[b] > 0) parent[find(a)] = find(b);
+	}
+
+	//アイランドごとに接触を数え、island_contactsに並べる
+	//アイランドの数は接触数を超えないため、接触数の分を割り当てておく
+	islands = step_arena.allocate<Island>(m);
+	island_count = 0;
+	UINT *root_island = step_arena.allocate<UINT>(n);	//代表の剛体番号→アイランド番号
+	std::fill(root_island, root_island + n, UINT_MAX);
+	island_contacts = step_arena.allocate<UINT>(m);
+	island_order = step_arena.allocate<UINT>(m);
+	for (UINT k = 0; k < m; k++)
+	{
+		UINT a = contacts[k].body[0];
+		UINT root = find(inverse_mass[a] > 0 ? a : contacts[k].body[1]);
+		if (root_island[root] == UINT_MAX)
+		{
+			Island island = { 0, 0, 0, 1, 0 };
+			root_island[root] = island_count;
+			islands[island_count++] = island;
+		}
+		island_contacts[k] = root_island[root];
+		islands[root_island[root]].end++;
+	}
+	UINT offset = 0;
+	for (UINT k = 0; k < island_count; k++)
+	{
+		islands[k].begin = offset;
+		offset += islands[k].end;
+		islands[k].end = islands[k].begin;
+	}
+	//接触番号をアイランド順に並べ替える(island_contactsを上書きするためisland_orderを作業領域に使う)
+	std::copy(island_contacts, island_contacts + m, island_order);
+	for (UINT k = 0; k < m; k++)
+	{
+		island_contacts[islands[island_order[k]].end++] = k;
+	}
+}
+
+FLOAT RigidWorld::relax_island(Island *island)
+{
+	//アイランドの接触を順番に1回ずつ反発係数0で解消し、解消前の最大の接近速度を返す
+	FLOAT residual = 0;
+	for (UINT c = island->begin; c < island->end; c++)
+	{
+		const Contact &contact = contacts[island_contacts[c]];
+		ContactBody a = contact_body(contact.body[0]);
+		ContactBody b = contact_body(contact.body[1]);
+		residual = std::max(residual, relax_contact(&a, &b, contact.point, contact.normal));
+		store_contact_body(contact.body[0], a);
+		store_contact_body(contact.body[1], b);
+	}
+	return residual;
+}
+
+mat3 RigidWorld::inverse_inertia_tensor(UINT i, bool transformed) const
+{
+	//RigidBody::inverse_inertia_tensorと同じ値を回転行列(rotation)から求める
+	mat3 inverse_inertia_tensor = mat3_diagonal(vec3(inverse_inertia[0][i], inverse_inertia[1][i], inverse_inertia[2][i]));
+	if (transformed && inverse_mass[i] > 0)
+	{
+		mat3 rotation_matrix;
+		rotation_matrix.r[0] = vec3(rotation[0][i], rotation[1][i], rotation[2][i]);
+		rotation_matrix.r[1] = vec3(rotation[3][i], rotation[4][i], rotation[5][i]);
+		rotation_matrix.r[2] = vec3(rotation[6][i], rotation[7][i], rotation[8][i]);
+		inverse_inertia_tensor = transpose(rotation_matrix) * inverse_inertia_tensor * rotation_matrix;
+	}
+	return inverse_inertia_tensor;
+}
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <limits.h>
+#include "RigidBody.h"
+#include "AlignedAllocator.h"
+#include "MemoryPool.h"
+#include "BatchIntegrator.h"
+#include "Integrator.h"
+#include "JobSystem.h"
+
+//剛体の形状の種類(衝突判定の組み合わせはSPHERE < BOX < PLANEの順に並べる)
+enum SHAPE_TYPE
+{
+	SHAPE_SPHERE,
+	SHAPE_BOX,
+	SHAPE_PLANE
+};
+
+//剛体を識別するハンドル(剛体の追加・削除で配列の並びが変わっても不変)
+struct RigidBodyHandle
+{
+	UINT index;	//ハンドル表の番号
+	UINT generation;	//世代(削除済みの剛体を指すハンドルを検出する)
+
+	RigidBodyHandle() : index(UINT_MAX), generation(0) {}
+	RigidBodyHandle(UINT index, UINT generation) : index(index), generation(generation) {}
+
+	bool operator==(const RigidBodyHandle &h) const { return index == h.index && generation == h.generation; }
+	bool operator!=(const RigidBodyHandle &h) const { return !(*this == h); }
+};
+
+class RigidBodyRef;
+
+//剛体の状態を成分ごとの配列(SoA:Structure of Arrays)で保持するコンテナ
+//配列の添字(slot)は剛体の削除で入れ替わるため、外部からはハンドル(RigidBodyHandle)で参照する
+struct RigidWorld
+{
+	typedef std::vector<FLOAT, AlignedAllocator<FLOAT, 32> > FloatArray;
+
+	FloatArray position[3];	//位置(x, y, z)
+	FloatArray orientation[4];	//姿勢(x, y, z, w)
+
+	FloatArray previous_position[3];	//直前のステップの位置(store_posesで保存する、描画時の補間用)
+	FloatArray previous_orientation[4];	//直前のステップの姿勢
+
+	FloatArray linear_velocity[3];	//並進速度
+	FloatArray angular_velocity[3];	//角速度
+
+	FloatArray previous_acceleration[3];	//直前のステップの加速度(VelocityVerletが速度の補正に使う、x成分がNO_PREVIOUS_ACCELERATIONの場合はまだない)
+
+	FloatArray accumulated_force[3];	//力のアキュムレータ
+	FloatArray accumulated_torque[3];	//トルクのアキュムレータ
+
+	FloatArray inverse_mass;	//慣性質量の逆数(不動オブジェクトは0)
+	FloatArray inverse_inertia[3];	//ローカル空間の慣性モーメントテンソル(対角成分)の逆数
+
+	std::vector<BYTE> shape;	//形状の種類(SHAPE_TYPE)
+	FloatArray dimension[3];	//サイズ(RigidBody::get_dimensionと同じ値)
+
+	FloatArray rotation[9];	//姿勢の回転行列(_11,_12,_13,_21,...の順、update_transformsで更新する)
+	FloatArray aabb_min[3];	//AABBの最小点(update_boundsで更新する)
+	FloatArray aabb_max[3];	//AABBの最大点(update_boundsで更新する)
+
+	//衝突の可能性がある剛体の組(broadphaseの結果、(body[0], body[1])の昇順に並べる)
+	struct Pair
+	{
+		UINT body[2];	//剛体番号(shape[body[0]] <= shape[body[1]])
+	};
+	//剛体番号で剛体を参照する接触(Contactと同じ意味を持つ)
+	struct Contact
+	{
+		UINT body[2];
+		vec3 point;	//接触点
+		vec3 normal; //物体0(body[0])から見た接触面の法線
+		FLOAT penetration;	//めり込み量
+		FLOAT restitution;	//反発係数
+	};
+	std::vector<Pair> pairs;
+	std::vector<Contact> contacts;	//組の順(組の中では衝突判定の関数が返した順)に並べた接触
+
+	FLOAT restitution;	//接触の反発係数
+
+	//resolve_contactsの反復の設定
+	//1回目の解消(Contact::resolveと同じ)の後、時間の予算(solver_budget)を使い切るか、
+	//全アイランドの接近速度がsolver_tolerance以下になるまで、優先度の高いアイランドから反復する
+	FLOAT solver_budget;	//反復に使う時間の予算(マイクロ秒、0の場合は反復しない、deterministicの場合は時間では打ち切らない)
+	FLOAT solver_tolerance;	//収束とみなす接近速度
+	UINT solver_max_iterations;	//アイランドごとの最大反復回数
+	vec3 solver_focus;	//優先する位置(カメラやプレイヤーの位置)
+	FLOAT solver_focus_distance;	//優先度が半分になるsolver_focusからの距離(0の場合は距離を考慮しない)
+
+	//resolve_contactsの統計(ステップごとに更新する)
+	struct SolverStats
+	{
+		UINT islands;	//接触でつながった可動オブジェクトのまとまりの数
+		UINT iterations;	//実行した反復回数(全アイランドの合計)
+		UINT max_iterations;	//1つのアイランドで実行した最大の反復回数
+		UINT unconverged_islands;	//収束しなかったアイランドの数
+		FLOAT initial_residual;	//反復前の最大の接近速度
+		FLOAT residual;	//反復後に残った最大の接近速度(最後の反復の開始時の値で、実際の値以上)
+		FLOAT elapsed;	//反復に要した時間(マイクロ秒)
+		BOOL budget_exhausted;	//予算を使い切って打ち切ったか
+	};
+	SolverStats solver_stats;
+	SIMD_LEVEL simd_level;	//integrateで使用するSIMD命令セット(既定値は実行中のCPUで使用できる最も広いもの)
+	//integrateで剛体番号[begin, end)を1ステップ進める関数(Integrator.hのポリシーのintegrate、既定値はSemiImplicitEuler::integrate)
+	//stepとタスクグラフの範囲ごとのintegrateはこの関数を呼ぶ(BasicRigidWorld<INTEGRATOR>はINTEGRATOR::integrateを設定する)
+	void (*integrator)(RigidWorld *world, UINT begin, UINT end, FLOAT duration);
+
+	//stepを実行するジョブシステム(0の場合は呼び出し元のスレッドで順に実行する)
+	//ジョブシステムを与えた場合、stepは剛体の範囲ごとのintegrate → update_transforms → update_boundsを並列に実行し、
+	//全ての範囲が終わってからbroadphase → generate_contacts → resolve_contactsを実行するタスクグラフになる
+	//(ある範囲のupdate_boundsと別の範囲のintegrateは重なって実行される、結果はjobsによらず一致する)
+	JobSystem *jobs;
+
+	//決定的モード(ロックステップのシミュレーション用)
+	//真の場合、結果をスレッド数・SIMD命令セット・実行時間によらず(同じ入力に対して)ビット単位で一致させる
+	//・剛体は剛体番号の順、接触は組の順に処理し、並列の処理は固定の範囲に分けて範囲の順に合わせる(jobsの有無によらず常にそうなる)
+	//・resolve_contactsの反復を時間の予算では打ち切らず、solver_max_iterationsとsolver_toleranceだけで止める
+	//・stepの後に状態のハッシュ(state_hash)を求める
+	//カーネルのFMAへの融合とfast-mathはStrictFloat.hで禁止している
+	BOOL deterministic;
+	//deterministicの場合にstepの後の状態から求めたハッシュ(compute_state_hashの値、比較して食い違ったステップを検出する)
+	unsigned long long state_hash;
+
+	RigidWorld();
+
+	//剛体の生成(Sphere,Box,Planeのコンストラクタと同じ質量・慣性モーメントを与える)
+	RigidBodyHandle create_sphere(FLOAT r/*半径*/, FLOAT density/*密度*/);
+	RigidBodyHandle create_box(const vec3 &half_size/*半辺長*/, FLOAT density/*密度*/);
+	RigidBodyHandle create_plane(vec3 n, FLOAT d);
+	//同じ形状・大きさ・密度の剛体をcount個まとめて生成し、ハンドルをhandlesに書き込む(位置などは生成後に設定する)
+	//1個ずつ生成した場合と同じ剛体になり、成分配列の拡張とハンドルの割り当てを1回にまとめる
+	void create_spheres(UINT count, FLOAT r, FLOAT density, RigidBodyHandle *handles);
+	void create_boxes(UINT count, const vec3 &half_size, FLOAT density, RigidBodyHandle *handles);
+	//剛体の削除(末尾の剛体を削除した位置に移動する)
+	void destroy(RigidBodyHandle handle);
+	//count個の剛体をまとめて削除する(結果は剛体番号の大きい順に1個ずつdestroyした場合と同じ)
+	void destroy(const RigidBodyHandle *handles, UINT count);
+	//剛体数がcountになるまで成分配列とハンドル表を確保し直さないようにする(count個まで削除しても再利用する番号の表を確保し直さない)
+	void reserve(UINT count);
+
+	BOOL is_valid(RigidBodyHandle handle) const
+	{
+		return handle.index < generation_of_handle.size() && generation_of_handle[handle.index] == handle.generation && slot_of_handle[handle.index] != UINT_MAX;
+	}
+	UINT slot(RigidBodyHandle handle) const
+	{
+		assert(is_valid(handle));
+		return slot_of_handle[handle.index];
+	}
+	RigidBodyHandle handle(UINT slot) const
+	{
+		UINT index = handle_of_slot[slot];
+		return RigidBodyHandle(index, generation_of_handle[index]);
+	}
+	UINT size() const
+	{
+		return (UINT)shape.size();
+	}
+	RigidBodyRef body(RigidBodyHandle handle);
+
+	//1ステップ分のシミュレーションを行う
+	//integrate → collide(update_transforms → update_bounds → broadphase → generate_contacts → resolve_contacts)
+	void step(FLOAT duration);
+
+	//integratorで全剛体を1ステップ進める
+	void integrate(FLOAT duration);
+	void collide();
+	void update_transforms();
+	void update_bounds();
+	//剛体番号[begin, end)だけを処理する(範囲ごとに並列に呼び出してよい)
+	void integrate(UINT begin, UINT end, FLOAT duration);
+	void update_transforms(UINT begin, UINT end);
+	void update_bounds(UINT begin, UINT end);
+	void broadphase();
+	//jobsを与えた場合は組を一定数ずつのバッチに分けて並列に判定し、バッチごとのバッファを組の順に連結する
+	//(接触の並びはスレッド数やジョブの実行順によらず、jobsを与えない場合と一致する)
+	void generate_contacts();
+	void resolve_contacts();
+
+	//剛体番号(slot)による個別のアクセス
+	vec3 get_position(UINT i) const { return vec3(position[0][i], position[1][i], position[2][i]); }
+	quat get_orientation(UINT i) const { return quat(orientation[0][i], orientation[1][i], orientation[2][i], orientation[3][i]); }
+	vec3 get_linear_velocity(UINT i) const { return vec3(linear_velocity[0][i], linear_velocity[1][i], linear_velocity[2][i]); }
+	vec3 get_angular_velocity(UINT i) const { return vec3(angular_velocity[0][i], angular_velocity[1][i], angular_velocity[2][i]); }
+	vec3 get_dimension(UINT i) const { return vec3(dimension[0][i], dimension[1][i], dimension[2][i]); }
+	void update_transform(UINT i);
+	mat3 inverse_inertia_tensor(UINT i, bool transformed = true) const;
+
+	//現在の位置・姿勢を直前のステップの位置・姿勢として保存する(固定ステップの開始時と剛体の配置後に呼ぶ)
+	void store_poses();
+	//直前のステップ(alpha = 0)と現在(alpha = 1)の間を補間した位置・姿勢
+	vec3 get_interpolated_position(UINT i, FLOAT alpha) const;
+	quat get_interpolated_orientation(UINT i, FLOAT alpha) const;
+
+	//位置・姿勢・速度・角速度のビット列のハッシュ(剛体を一定数ずつの範囲に分けて求めたハッシュを範囲の順に合わせる)
+	//jobsを与えた場合は範囲ごとに並列に求める(値はjobsやスレッド数によらない)
+	unsigned long long compute_state_hash() const;
+
+	//integrate_batchに渡す成分配列(剛体の追加・削除で無効になる)
+	BodyArrays arrays();
+
+	//記憶域の使用量(確保済みの容量のバイト数)
+	struct MemoryUsage
+	{
+		size_t bodies;	//成分配列
+		size_t handles;	//ハンドル表
+		size_t pairs;	//broadphaseの組
+		size_t contacts;	//接触とgenerate_contactsのバッチごとのバッファ
+		size_t scratch;	//ステップの作業領域(step_arenaなど)
+
+		size_t total() const { return bodies + handles + pairs + contacts + scratch; }
+	};
+	MemoryUsage memory_usage() const;
+
+private:
+	std::vector<UINT> slot_of_handle;	//ハンドル表(ハンドル番号→剛体番号、削除済みはUINT_MAX)
+	std::vector<UINT> generation_of_handle;	//ハンドル番号ごとの世代
+	std::vector<UINT> handle_of_slot;	//剛体番号→ハンドル番号
+	std::vector<UINT> free_handles;	//再利用可能なハンドル番号
+
+	//ステップの中だけ使う作業領域(broadphaseとresolve_contactsはそれぞれの開始時に、destroyは削除の前にresetする)
+	//要素数がステップごとに変わる一時的な配列をここから割り当て、確保と解放をステップごとに繰り返さないようにする
+	LinearArena step_arena;
+
+	//generate_contactsの作業領域(バッチごとの接触のバッファと、連結後の開始位置、容量は次のステップで再利用する)
+	std::vector<std::vector<Contact> > contact_batches;
+	std::vector<UINT> batch_offset;
+	size_t contact_batch_peak;	//これまでで最も多かった1つのバッチの接触の数(新しいバッチのバッファの容量の見込み)
+
+	//resolve_contactsの作業領域(step_arenaに割り当てる)
+	struct Island
+	{
+		UINT begin, end;	//island_contactsの範囲
+		FLOAT residual;	//最大の接近速度
+		FLOAT weight;	//solver_focusからの距離による重み
+		UINT iterations;
+	};
+	UINT *island_contacts;	//アイランドごとに並べた接触番号(接触数)
+	Island *islands;	//アイランド(最大で接触数)
+	UINT island_count;
+	UINT *island_order;	//反復するアイランドの番号(最大で接触数)
+
+	mutable std::vector<unsigned long long> chunk_hashes;	//compute_state_hashの作業領域
+
+	//jobsで実行するstepのタスクグラフ(範囲の数が足りなくなるか、スレッド数かdeterministicが変わったら作り直す、コピーした場合は作り直す)
+	//範囲の境界は実行するときの剛体数から求めるため、剛体を削除して範囲が多すぎるようになっても作り直さない(空の範囲もある)
+	struct StepGraph
+	{
+		TaskGraph graph;
+		UINT chunks, threads;
+		BOOL deterministic;
+		FLOAT duration;	//実行中のstepの引数
+
+		StepGraph() : chunks(0), threads(0), deterministic(FALSE), duration(0) {}
+		StepGraph(const StepGraph &) : chunks(0), threads(0), deterministic(FALSE), duration(0) {}
+		StepGraph &operator=(const StepGraph &)
+		{
+			graph.clear();
+			chunks = threads = 0;
+			return *this;
+		}
+	};
+	StepGraph step_graph;
+
+	RigidBodyHandle add_body(SHAPE_TYPE type, FLOAT inverse_mass, const vec3 &inverse_inertia, const vec3 &dimension);
+	void add_bodies(UINT count, SHAPE_TYPE type, FLOAT inverse_mass, const vec3 &inverse_inertia, const vec3 &dimension, RigidBodyHandle *handles);
+	RigidBodyHandle allocate_handle(UINT slot);
+	ContactBody contact_body(UINT i) const;
+	void collide_pair(const Pair &pair, std::vector<Contact> *output) const;
+	void collide_pairs(UINT begin, UINT end, std::vector<Contact> *output) const;
+	void store_contact_body(UINT i, const ContactBody &body);
+	void build_islands();
+	FLOAT relax_island(Island *island);
+	void build_step_graph();
+	template <typename F> void for_each_array(F f);
+};
+
+//ハンドルにRigidBodyと同様のアクセサを与える薄いラッパ
+class RigidBodyRef
+{
+	RigidWorld *world;
+	RigidBodyHandle handle;
+
+public:
+	RigidBodyRef(RigidWorld *world, RigidBodyHandle handle) : world(world), handle(handle) {}
+
+	RigidBodyHandle get_handle() const { return handle; }
+	SHAPE_TYPE get_shape() const { return (SHAPE_TYPE)world->shape[world->slot(handle)]; }
+
+	vec3 get_position() const { return world->get_position(world->slot(handle)); }
+	quat get_orientation() const { return world->get_orientation(world->slot(handle)); }
+	vec3 get_linear_velocity() const { return world->get_linear_velocity(world->slot(handle)); }
+	vec3 get_angular_velocity() const { return world->get_angular_velocity(world->slot(handle)); }
+	vec3 get_interpolated_position(FLOAT alpha) const { return world->get_interpolated_position(world->slot(handle), alpha); }
+	quat get_interpolated_orientation(FLOAT alpha) const { return world->get_interpolated_orientation(world->slot(handle), alpha); }
+
+	void set_position(const vec3 &p)
+	{
+		UINT i = world->slot(handle);
+		world->position[0][i] = p.x;
+		world->position[1][i] = p.y;
+		world->position[2][i] = p.z;
+	}
+	void set_orientation(const quat &q)
+	{
+		UINT i = world->slot(handle);
+		world->orientation[0][i] = q.x;
+		world->orientation[1][i] = q.y;
+		world->orientation[2][i] = q.z;
+		world->orientation[3][i] = q.w;
+		world->update_transform(i);
+	}
+	void set_linear_velocity(const vec3 &v)
+	{
+		UINT i = world->slot(handle);
+		world->linear_velocity[0][i] = v.x;
+		world->linear_velocity[1][i] = v.y;
+		world->linear_velocity[2][i] = v.z;
+	}
+	void set_angular_velocity(const vec3 &w)
+	{
+		UINT i = world->slot(handle);
+		world->angular_velocity[0][i] = w.x;
+		world->angular_velocity[1][i] = w.y;
+		world->angular_velocity[2][i] = w.z;
+	}
+
+	void add_force(const vec3 &force)
+	{
+		UINT i = world->slot(handle);
+		world->accumulated_force[0][i] += force.x;
+		world->accumulated_force[1][i] += force.y;
+		world->accumulated_force[2][i] += force.z;
+	}
+	void add_torque(const vec3 &torque)
+	{
+		UINT i = world->slot(handle);
+		world->accumulated_torque[0][i] += torque.x;
+		world->accumulated_torque[1][i] += torque.y;
+		world->accumulated_torque[2][i] += torque.z;
+	}
+	void add_force_at_point(const vec3 &force, const vec3 &point/*ワールド座標*/)
+	{
+		vec3 torque, arm = point - get_position();
+		torque = cross(arm, force);
+		add_force(force);
+		add_torque(torque);
+	}
+
+	vec3 get_dimension() const { return world->get_dimension(world->slot(handle)); }
+
+	bool is_movable() const
+	{
+		return world->inverse_mass[world->slot(handle)] > 0;
+	}
+	FLOAT inverse_mass() const
+	{
+		return world->inverse_mass[world->slot(handle)];
+	}
+	//不動オブジェクトの場合はFLT_MAXを返す
+	FLOAT inertial_mass() const
+	{
+		return is_movable() ? 1.0f / inverse_mass() : FLT_MAX;
+	}
+	mat3 inverse_inertia_tensor(bool transformed = true) const
+	{
+		return world->inverse_inertia_tensor(world->slot(handle), transformed);
+	}
+};
+
+inline RigidBodyRef RigidWorld::body(RigidBodyHandle handle)
+{
+	return RigidBodyRef(this, handle);
+}
+
+//インテグレータ(SemiImplicitEuler, VelocityVerlet, RungeKutta4, ExponentialMap)をコンパイル時に選択したRigidWorld
+//例:BasicRigidWorld<ExponentialMap> world;
+//integratorを設定するだけなので、RigidWorldの参照を通したstepやjobsによる並列のstepでも同じインテグレータを使う
+template <typename INTEGRATOR>
+struct BasicRigidWorld : public RigidWorld
+{
+	typedef INTEGRATOR Integrator;
+
+	BasicRigidWorld()
+	{
+		integrator = &INTEGRATOR::integrate;
+	}
+};
@@ -0,0 +1,554 @@
+#define NOMINMAX
+#include <math.h>
+#include <assert.h>
+#include <algorithm>
+#include "SphFluid.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SPH_FLUID_X86
+#include <immintrin.h>
+#endif
+
+//GCC/ClangではAVX2の関数だけをAVX2向けにコンパイルする(MSVCは指定なしで組み込み関数を使用できる)
+#if defined(SPH_FLUID_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+//近傍探索を各核関数に展開する(AVX2の関数からSSEの命令で書かれた関数を呼ぶと、256bitレジスタの上位の状態の遷移で遅くなるため)
+#if defined(_MSC_VER)
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+static const FLOAT PI = 3.14159265f;
+//1つのジョブで処理する質点数の下限(これより小さく分けるとジョブの分割と待ちの方が高くつく)
+static const UINT PARTICLES_PER_JOB = 1024;
+
+SphFluid::SphFluid(FLOAT smoothing_length, FLOAT rest_density) :
+	smoothing_length(smoothing_length), rest_density(rest_density), stiffness(200), viscosity(10),
+	particle_radius(smoothing_length / 4), restitution(0), friction(0), gravity(0, -9.8f, 0),
+	substeps(6), jobs(0), simd_level(detect_simd_level())
+{
+}
+
+//質点iの近傍の質点の範囲[ranges[r][0], ranges[r][1])を求め、範囲の数(最大27)を返す
+static FORCE_INLINE UINT neighbour_ranges(const SphFluid::Pass &pass, UINT i, UINT (*ranges)[2])
+{
+	//周囲27セルを、x方向に並ぶ3セルずつ(ハッシュ表で連続する範囲)9列に分けて探す(ParticleCollision::collide_rangeと同じ)
+	INT cx = (INT)floorf(pass.position[0][i] * pass.inverse_cell), cy = (INT)floorf(pass.position[1][i] * pass.inverse_cell), cz = (INT)floorf(pass.position[2][i] * pass.inverse_cell);
+	UINT rows[9];
+	UINT row_count = 0;
+	for (INT z = cz - 1; z <= cz + 1; z++)
+	for (INT y = cy - 1; y <= cy + 1; y++)
+	{
+		rows[row_count++] = pass.cell_hash(cx - 1, y, z);
+	}
+	UINT count = 0;
+	for (UINT r = 0; r < 9; r++)
+	{
+		//ハッシュの衝突で前の列と範囲が重なる場合と、表の末尾で折り返す場合は、セルごとに重複を除く
+		bool overlapped = rows[r] + 2 > pass.mask;
+		for (UINT q = 0; q < r; q++)
+		{
+			if (((rows[r] - rows[q] + 2) & pass.mask) <= 4) overlapped = true;
+		}
+		if (!overlapped)
+		{
+			ranges[count][0] = pass.cell_start[rows[r]];
+			ranges[count][1] = pass.cell_start[rows[r] + 3];
+			if (ranges[count][0] < ranges[count][1]) count++;
+			continue;
+		}
+		for (UINT b = 0; b < 3; b++)
+		{
+			UINT c = (rows[r] + b) & pass.mask;
+			bool duplicated = false;
+			for (UINT q = 0; q < r; q++)
+			{
+				if (((c - rows[q]) & pass.mask) <= 2) duplicated = true;
+			}
+			if (duplicated || pass.cell_start[c] == pass.cell_start[c + 1]) continue;
+			ranges[count][0] = pass.cell_start[c];
+			ranges[count][1] = pass.cell_start[c + 1];
+			count++;
+		}
+	}
+	return count;
+}
+
+void SphFluid::build(ParticleSystem *system)
+{
+	const UINT n = system->size();
+
+	//ハッシュ表の大きさは質点数の2倍以上の2のべき乗
+	UINT table_size = 1;
+	while (table_size < 2 * n) table_size <<= 1;
+	cell_start.assign(table_size + 1, 0);
+	cell_of_particle.resize(n);
+	sorted.resize(n);
+
+	Pass hash;
+	hash.mask = table_size - 1;
+	const FLOAT inverse_cell = 1.0f / smoothing_length;
+	const FLOAT *px = system->position[0].data(), *py = system->position[1].data(), *pz = system->position[2].data();
+	UINT *cell = cell_of_particle.data();
+	parallel_for(jobs, n, PARTICLES_PER_JOB, [&](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; i++)
+		{
+			cell[i] = hash.cell_hash((INT)floorf(px[i] * inverse_cell), (INT)floorf(py[i] * inverse_cell), (INT)floorf(pz[i] * inverse_cell));
+		}
+	});
+
+	//計数ソートで質点番号をハッシュ表の番号順に並べる(ParticleCollision::buildと同じ)
+	//前回のstepで並べ替えた順から大きく変わらないため、表への書き込みはほぼ連続する
+	for (UINT i = 0; i < n; i++)
+	{
+		cell_start[cell[i] + 1]++;
+	}
+	for (UINT c = 0; c < table_size; c++)
+	{
+		cell_start[c + 1] += cell_start[c];
+	}
+	for (UINT i = n; i > 0; i--)
+	{
+		UINT c = cell[i - 1];
+		sorted[--cell_start[c + 1]] = i - 1;
+	}
+	for (UINT c = 0; c < table_size; c++)
+	{
+		cell_start[c] = cell_start[c + 1];
+	}
+	cell_start[table_size] = n;
+
+	//質点の全ての配列をsortedの順に並べ替える
+	scratch.resize(n);
+	const UINT *order = sorted.data();
+	JobSystem *const job_system = jobs;
+	FloatArray &temporary = scratch;
+	system->for_each_array([order, n, job_system, &temporary](FloatArray &a)
+	{
+		const FLOAT *source = a.data();
+		FLOAT *destination = temporary.data();
+		parallel_for(job_system, n, PARTICLES_PER_JOB, [&](UINT begin, UINT end)
+		{
+			for (UINT s = begin; s < end; s++)
+			{
+				destination[s] = source[order[s]];
+			}
+		});
+		a.swap(temporary);
+	});
+}
+
+//位置を境界の外へ押し出し、法線方向の速度を反発係数で反転する
+static inline void push_out(vec3 *position, vec3 *velocity, const ContactPoint &contact, const vec3 &body_velocity, FLOAT restitution, FLOAT friction)
+{
+	*position += contact.penetration * contact.normal;
+	vec3 relative = *velocity - body_velocity;
+	FLOAT vn = dot(relative, contact.normal);
+	if (vn < 0)
+	{
+		vec3 tangent = relative - vn * contact.normal;
+		*velocity = body_velocity + (1 - friction) * tangent - restitution * vn * contact.normal;
+	}
+}
+
+void SphFluid::collide_boundary(ParticleSystem *system, UINT begin, UINT end) const
+{
+	for (UINT i = begin; i < end; i++)
+	{
+		vec3 p = system->get_position(i);
+		vec3 v = system->get_velocity(i);
+		ContactPoint contact;
+		for (size_t k = 0; k < boxes.size(); k++)
+		{
+			//箱に外接する球から遠い粒子は調べない(collide_sphere_boxは粒子ごとに逆行列を求めるため)
+			const Box *box = boxes[k];
+			vec3 d = p - box->position;
+			FLOAT reach = length(box->half_size) + particle_radius;
+			if (length_sq(d) < reach * reach &&
+				collide_sphere_box(p, particle_radius, box->position, box->orientation, box->half_size, &contact))
+			{
+				push_out(&p, &v, contact, box->linear_velocity, restitution, friction);
+			}
+		}
+		for (size_t k = 0; k < walls.size(); k++)
+		{
+			//平面の裏側は全て壁の中とみなす(collide_sphere_planeの片面の判定と違い、1ステップで平面を通り抜けた粒子も押し戻す)
+			const Wall &wall = walls[k];
+			FLOAT distance = dot(wall.normal, p) - wall.offset;
+			if (distance < particle_radius)
+			{
+				contact.normal = wall.normal;
+				contact.penetration = particle_radius - distance;
+				push_out(&p, &v, contact, wall.velocity, restitution, friction);
+			}
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			system->position[k][i] = p[k];
+			system->velocity[k][i] = v[k];
+		}
+	}
+}
+
+void SphFluid::step(ParticleSystem *system, FLOAT duration)
+{
+	assert(smoothing_length > 0 && substeps > 0);
+
+	//実行時に検出した命令セットを超える実装は呼び出さない
+	static const SIMD_LEVEL supported = detect_simd_level();
+	const SIMD_LEVEL level = simd_level > supported ? supported : simd_level;
+	void (*density_range)(const Pass &, UINT, UINT) = sph_density_scalar;
+	void (*force_range)(const Pass &, UINT, UINT) = sph_force_scalar;
+#if defined(SPH_FLUID_X86)
+	if (level == SIMD_AVX2)
+	{
+		density_range = sph_density_avx2;
+		force_range = sph_force_avx2;
+	}
+	else if (level == SIMD_SSE)
+	{
+		density_range = sph_density_sse;
+		force_range = sph_force_sse;
+	}
+#endif
+
+	const FLOAT dt = duration / substeps;
+	const FLOAT h = smoothing_length;
+	const FLOAT h3 = h * h * h;
+	const bool has_boundary = !planes.empty() || !boxes.empty();
+
+	//平面の法線(姿勢で回転したy軸)と原点からの距離を求めておく
+	walls.resize(planes.size());
+	for (size_t k = 0; k < planes.size(); k++)
+	{
+		walls[k].normal = mat3_from_quat(planes[k]->orientation).r[1];
+		walls[k].offset = dot(walls[k].normal, planes[k]->position);
+		walls[k].velocity = planes[k]->linear_velocity;
+	}
+	for (UINT s = 0; s < substeps; s++)
+	{
+		//近傍探索(質点はハッシュ表の順に並び替わる)
+		build(system);
+		const UINT n = system->size();
+		density.resize(n);
+		pressure.resize(n);
+		volume.resize(n);
+
+		Pass pass;
+		for (int k = 0; k < 3; k++)
+		{
+			pass.position[k] = system->position[k].data();
+			pass.velocity[k] = system->velocity[k].data();
+			pass.resultant[k] = system->resultant[k].data();
+		}
+		pass.mass = system->mass.data();
+		pass.density = density.data();
+		pass.pressure = pressure.data();
+		pass.volume = volume.data();
+		pass.count = n;
+		pass.cell_start = cell_start.data();
+		pass.mask = (UINT)cell_start.size() - 2;
+		pass.inverse_cell = 1.0f / h;
+		pass.h = h;
+		pass.h2 = h * h;
+		pass.poly6 = 315.0f / (64.0f * PI * h3 * h3 * h3);
+		pass.spiky = 45.0f / (PI * h3 * h3);
+		pass.viscosity = viscosity * pass.spiky;
+		pass.rest_density = rest_density;
+		pass.stiffness = stiffness;
+		pass.gravity = gravity;
+
+		//密度と圧力、力の順に求める(力のパスは全質点の密度と圧力を参照するため、パスごとに全てのジョブを待つ)
+		parallel_for(jobs, n, PARTICLES_PER_JOB, [&](UINT begin, UINT end) { density_range(pass, begin, end); });
+		parallel_for(jobs, n, PARTICLES_PER_JOB, [&](UINT begin, UINT end) { force_range(pass, begin, end); });
+		parallel_for(jobs, n, PARTICLES_PER_JOB, [&](UINT begin, UINT end) { system->integrate(begin, end, dt); });
+		if (has_boundary)
+		{
+			parallel_for(jobs, n, PARTICLES_PER_JOB, [&](UINT begin, UINT end) { collide_boundary(system, begin, end); });
+		}
+	}
+}
+
+//密度から圧力と体積(質量 / 密度)を求めて書き込む
+//圧力は負にしない(表面で粒子が引き合って固まるのを防ぐ)
+static inline void store_density(const SphFluid::Pass &pass, UINT i, FLOAT rho)
+{
+	pass.density[i] = rho;
+	pass.pressure[i] = std::max(0.0f, pass.stiffness * (rho - pass.rest_density));
+	pass.volume[i] = pass.mass[i] / rho;
+}
+
+void sph_density_scalar(const SphFluid::Pass &pass, UINT begin, UINT end)
+{
+	const FLOAT *px = pass.position[0], *py = pass.position[1], *pz = pass.position[2];
+	const FLOAT *m = pass.mass;
+	UINT ranges[27][2];
+	for (UINT i = begin; i < end; i++)
+	{
+		FLOAT sum = 0;
+		const UINT range_count = neighbour_ranges(pass, i, ranges);
+		for (UINT r = 0; r < range_count; r++)
+		{
+			for (UINT j = ranges[r][0]; j < ranges[r][1]; j++)
+			{
+				FLOAT dx = px[i] - px[j], dy = py[i] - py[j], dz = pz[i] - pz[j];
+				FLOAT r2 = dx * dx + dy * dy + dz * dz;
+				if (r2 < pass.h2)
+				{
+					FLOAT w = pass.h2 - r2;
+					sum += m[j] * w * w * w;
+				}
+			}
+		}
+		store_density(pass, i, pass.poly6 * sum);
+	}
+}
+
+//質点iが近傍の質点jから受ける圧力と粘性の力(単位体積あたり)
+static inline void accumulate_force(const SphFluid::Pass &pass, UINT i, UINT j, FLOAT half_spiky, vec3 *f)
+{
+	FLOAT dx = pass.position[0][i] - pass.position[0][j], dy = pass.position[1][i] - pass.position[1][j], dz = pass.position[2][i] - pass.position[2][j];
+	FLOAT r2 = dx * dx + dy * dy + dz * dz;
+	if (r2 < pass.h2 && r2 > 0)
+	{
+		FLOAT r = sqrtf(r2);
+		FLOAT q = pass.h - r;
+		FLOAT a = pass.volume[j];
+		FLOAT cp = a * (pass.pressure[i] + pass.pressure[j]) * half_spiky * (q * q) / r;
+		FLOAT cv = a * pass.viscosity * q;
+		f->x += cp * dx + cv * (pass.velocity[0][j] - pass.velocity[0][i]);
+		f->y += cp * dy + cv * (pass.velocity[1][j] - pass.velocity[1][i]);
+		f->z += cp * dz + cv * (pass.velocity[2][j] - pass.velocity[2][i]);
+	}
+}
+
+//単位体積あたりの力を密度で割って加速度にし、質量を掛けてアキュムレータに加える(重力も合わせて加える)
+static inline void add_resultant(const SphFluid::Pass &pass, UINT i, const vec3 &f)
+{
+	FLOAT s = pass.volume[i];
+	pass.resultant[0][i] += s * f.x + pass.mass[i] * pass.gravity.x;
+	pass.resultant[1][i] += s * f.y + pass.mass[i] * pass.gravity.y;
+	pass.resultant[2][i] += s * f.z + pass.mass[i] * pass.gravity.z;
+}
+
+void sph_force_scalar(const SphFluid::Pass &pass, UINT begin, UINT end)
+{
+	const FLOAT half_spiky = 0.5f * pass.spiky;
+	UINT ranges[27][2];
+	for (UINT i = begin; i < end; i++)
+	{
+		vec3 f(0, 0, 0);
+		const UINT range_count = neighbour_ranges(pass, i, ranges);
+		for (UINT r = 0; r < range_count; r++)
+		{
+			for (UINT j = ranges[r][0]; j < ranges[r][1]; j++)
+			{
+				accumulate_force(pass, i, j, half_spiky, &f);
+			}
+		}
+		add_resultant(pass, i, f);
+	}
+}
+
+#if defined(SPH_FLUID_X86)
+//SIMDの実装は近傍の範囲を4・8個ずつ読み、レーンごとの部分和を最後に0番から順に足す
+//範囲の末尾の端数は、範囲の終わりまでを含む1組を読み直し(質点数を超えないよう前にずらす)、処理済みと範囲外のレーンをマスクで除く
+//(全質点が1組に満たない場合はscalarの実装を使う)
+
+//範囲[j, last)の先頭から読む1組の位置(端数の場合は前にずらす)
+static inline UINT chunk_start(const SphFluid::Pass &pass, UINT j, UINT last, UINT width)
+{
+	return j + width <= last ? j : std::min(j, pass.count - width);
+}
+
+//SSEで位置sから読む4個のうち、範囲[j, last)に含まれるレーン
+static inline __m128 lane_mask_sse(UINT s, UINT j, UINT last)
+{
+	__m128i index = _mm_add_epi32(_mm_set1_epi32((INT)s), _mm_setr_epi32(0, 1, 2, 3));
+	return _mm_castsi128_ps(_mm_andnot_si128(_mm_cmpgt_epi32(_mm_set1_epi32((INT)j), index), _mm_cmpgt_epi32(_mm_set1_epi32((INT)last), index)));
+}
+
+void sph_density_sse(const SphFluid::Pass &pass, UINT begin, UINT end)
+{
+	if (pass.count < 4)
+	{
+		sph_density_scalar(pass, begin, end);
+		return;
+	}
+	const FLOAT *px = pass.position[0], *py = pass.position[1], *pz = pass.position[2];
+	const __m128 h2 = _mm_set1_ps(pass.h2);
+	UINT ranges[27][2];
+	for (UINT i = begin; i < end; i++)
+	{
+		const UINT range_count = neighbour_ranges(pass, i, ranges);
+		const __m128 xi = _mm_set1_ps(px[i]), yi = _mm_set1_ps(py[i]), zi = _mm_set1_ps(pz[i]);
+		__m128 sum = _mm_setzero_ps();
+		for (UINT r = 0; r < range_count; r++)
+		{
+			const UINT last = ranges[r][1];
+			for (UINT j = ranges[r][0]; j < last; j += 4)
+			{
+				const UINT s = chunk_start(pass, j, last, 4);
+				__m128 dx = _mm_sub_ps(xi, _mm_loadu_ps(px + s)), dy = _mm_sub_ps(yi, _mm_loadu_ps(py + s)), dz = _mm_sub_ps(zi, _mm_loadu_ps(pz + s));
+				__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				__m128 w = _mm_sub_ps(h2, r2);
+				__m128 c = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(pass.mass + s), w), w), w);
+				sum = _mm_add_ps(sum, _mm_and_ps(_mm_and_ps(lane_mask_sse(s, j, last), _mm_cmplt_ps(r2, h2)), c));
+			}
+		}
+		FLOAT lanes[4];
+		_mm_storeu_ps(lanes, sum);
+		store_density(pass, i, pass.poly6 * (lanes[0] + lanes[1] + lanes[2] + lanes[3]));
+	}
+}
+
+void sph_force_sse(const SphFluid::Pass &pass, UINT begin, UINT end)
+{
+	if (pass.count < 4)
+	{
+		sph_force_scalar(pass, begin, end);
+		return;
+	}
+	const FLOAT *px = pass.position[0], *py = pass.position[1], *pz = pass.position[2];
+	const FLOAT *vx = pass.velocity[0], *vy = pass.velocity[1], *vz = pass.velocity[2];
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 h = _mm_set1_ps(pass.h), h2 = _mm_set1_ps(pass.h2);
+	const __m128 hs = _mm_set1_ps(0.5f * pass.spiky), mu = _mm_set1_ps(pass.viscosity);
+	UINT ranges[27][2];
+	for (UINT i = begin; i < end; i++)
+	{
+		const UINT range_count = neighbour_ranges(pass, i, ranges);
+		const __m128 xi = _mm_set1_ps(px[i]), yi = _mm_set1_ps(py[i]), zi = _mm_set1_ps(pz[i]);
+		const __m128 uxi = _mm_set1_ps(vx[i]), uyi = _mm_set1_ps(vy[i]), uzi = _mm_set1_ps(vz[i]);
+		const __m128 pi = _mm_set1_ps(pass.pressure[i]);
+		__m128 fx = zero, fy = zero, fz = zero;
+		for (UINT r = 0; r < range_count; r++)
+		{
+			const UINT last = ranges[r][1];
+			for (UINT j = ranges[r][0]; j < last; j += 4)
+			{
+				const UINT s = chunk_start(pass, j, last, 4);
+				__m128 dx = _mm_sub_ps(xi, _mm_loadu_ps(px + s)), dy = _mm_sub_ps(yi, _mm_loadu_ps(py + s)), dz = _mm_sub_ps(zi, _mm_loadu_ps(pz + s));
+				__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				//自分自身(r2 == 0)と範囲外の質点は0/0やオーバーフローを含むため、係数をマスクで0にする
+				__m128 in = _mm_and_ps(lane_mask_sse(s, j, last), _mm_and_ps(_mm_cmplt_ps(r2, h2), _mm_cmpgt_ps(r2, zero)));
+				__m128 l = _mm_sqrt_ps(r2);
+				__m128 q = _mm_sub_ps(h, l);
+				__m128 a = _mm_loadu_ps(pass.volume + s);
+				__m128 cp = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(a, _mm_add_ps(pi, _mm_loadu_ps(pass.pressure + s))), hs), _mm_mul_ps(q, q)), l);
+				__m128 cv = _mm_mul_ps(_mm_mul_ps(a, mu), q);
+				cp = _mm_and_ps(in, cp);
+				cv = _mm_and_ps(in, cv);
+				fx = _mm_add_ps(fx, _mm_add_ps(_mm_mul_ps(cp, dx), _mm_mul_ps(cv, _mm_sub_ps(_mm_loadu_ps(vx + s), uxi))));
+				fy = _mm_add_ps(fy, _mm_add_ps(_mm_mul_ps(cp, dy), _mm_mul_ps(cv, _mm_sub_ps(_mm_loadu_ps(vy + s), uyi))));
+				fz = _mm_add_ps(fz, _mm_add_ps(_mm_mul_ps(cp, dz), _mm_mul_ps(cv, _mm_sub_ps(_mm_loadu_ps(vz + s), uzi))));
+			}
+		}
+		FLOAT lx[4], ly[4], lz[4];
+		_mm_storeu_ps(lx, fx);
+		_mm_storeu_ps(ly, fy);
+		_mm_storeu_ps(lz, fz);
+		add_resultant(pass, i, vec3(lx[0] + lx[1] + lx[2] + lx[3], ly[0] + ly[1] + ly[2] + ly[3], lz[0] + lz[1] + lz[2] + lz[3]));
+	}
+}
+
+//AVX2で位置sから読む8個のうち、範囲[j, last)に含まれるレーン
+TARGET_AVX2 static inline __m256 lane_mask_avx2(UINT s, UINT j, UINT last)
+{
+	__m256i index = _mm256_add_epi32(_mm256_set1_epi32((INT)s), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	return _mm256_castsi256_ps(_mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32((INT)j), index), _mm256_cmpgt_epi32(_mm256_set1_epi32((INT)last), index)));
+}
+
+//8個のレーンを0番から順に足す
+TARGET_AVX2 static inline FLOAT horizontal_sum_avx2(__m256 v)
+{
+	FLOAT lanes[8];
+	_mm256_storeu_ps(lanes, v);
+	FLOAT sum = lanes[0];
+	for (int b = 1; b < 8; b++) sum += lanes[b];
+	return sum;
+}
+
+TARGET_AVX2 void sph_density_avx2(const SphFluid::Pass &pass, UINT begin, UINT end)
+{
+	if (pass.count < 8)
+	{
+		sph_density_scalar(pass, begin, end);
+		return;
+	}
+	const FLOAT *px = pass.position[0], *py = pass.position[1], *pz = pass.position[2];
+	const __m256 h2 = _mm256_set1_ps(pass.h2);
+	UINT ranges[27][2];
+	for (UINT i = begin; i < end; i++)
+	{
+		const UINT range_count = neighbour_ranges(pass, i, ranges);
+		const __m256 xi = _mm256_set1_ps(px[i]), yi = _mm256_set1_ps(py[i]), zi = _mm256_set1_ps(pz[i]);
+		__m256 sum = _mm256_setzero_ps();
+		for (UINT r = 0; r < range_count; r++)
+		{
+			const UINT last = ranges[r][1];
+			for (UINT j = ranges[r][0]; j < last; j += 8)
+			{
+				const UINT s = chunk_start(pass, j, last, 8);
+				__m256 dx = _mm256_sub_ps(xi, _mm256_loadu_ps(px + s)), dy = _mm256_sub_ps(yi, _mm256_loadu_ps(py + s)), dz = _mm256_sub_ps(zi, _mm256_loadu_ps(pz + s));
+				__m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+				__m256 w = _mm256_sub_ps(h2, r2);
+				__m256 c = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(pass.mass + s), w), w), w);
+				sum = _mm256_add_ps(sum, _mm256_and_ps(_mm256_and_ps(lane_mask_avx2(s, j, last), _mm256_cmp_ps(r2, h2, _CMP_LT_OQ)), c));
+			}
+		}
+		store_density(pass, i, pass.poly6 * horizontal_sum_avx2(sum));
+	}
+}
+
+TARGET_AVX2 void sph_force_avx2(const SphFluid::Pass &pass, UINT begin, UINT end)
+{
+	if (pass.count < 8)
+	{
+		sph_force_scalar(pass, begin, end);
+		return;
+	}
+	const FLOAT *px = pass.position[0], *py = pass.position[1], *pz = pass.position[2];
+	const FLOAT *vx = pass.velocity[0], *vy = pass.velocity[1], *vz = pass.velocity[2];
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 h = _mm256_set1_ps(pass.h), h2 = _mm256_set1_ps(pass.h2);
+	const __m256 hs = _mm256_set1_ps(0.5f * pass.spiky), mu = _mm256_set1_ps(pass.viscosity);
+	UINT ranges[27][2];
+	for (UINT i = begin; i < end; i++)
+	{
+		const UINT range_count = neighbour_ranges(pass, i, ranges);
+		const __m256 xi = _mm256_set1_ps(px[i]), yi = _mm256_set1_ps(py[i]), zi = _mm256_set1_ps(pz[i]);
+		const __m256 uxi = _mm256_set1_ps(vx[i]), uyi = _mm256_set1_ps(vy[i]), uzi = _mm256_set1_ps(vz[i]);
+		const __m256 pi = _mm256_set1_ps(pass.pressure[i]);
+		__m256 fx = zero, fy = zero, fz = zero;
+		for (UINT r = 0; r < range_count; r++)
+		{
+			const UINT last = ranges[r][1];
+			for (UINT j = ranges[r][0]; j < last; j += 8)
+			{
+				const UINT s = chunk_start(pass, j, last, 8);
+				__m256 dx = _mm256_sub_ps(xi, _mm256_loadu_ps(px + s)), dy = _mm256_sub_ps(yi, _mm256_loadu_ps(py + s)), dz = _mm256_sub_ps(zi, _mm256_loadu_ps(pz + s));
+				__m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+				__m256 in = _mm256_and_ps(lane_mask_avx2(s, j, last), _mm256_and_ps(_mm256_cmp_ps(r2, h2, _CMP_LT_OQ), _mm256_cmp_ps(r2, zero, _CMP_GT_OQ)));
+				__m256 l = _mm256_sqrt_ps(r2);
+				__m256 q = _mm256_sub_ps(h, l);
+				__m256 a = _mm256_loadu_ps(pass.volume + s);
+				__m256 cp = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(a, _mm256_add_ps(pi, _mm256_loadu_ps(pass.pressure + s))), hs), _mm256_mul_ps(q, q)), l);
+				__m256 cv = _mm256_mul_ps(_mm256_mul_ps(a, mu), q);
+				cp = _mm256_and_ps(in, cp);
+				cv = _mm256_and_ps(in, cv);
+				fx = _mm256_add_ps(fx, _mm256_add_ps(_mm256_mul_ps(cp, dx), _mm256_mul_ps(cv, _mm256_sub_ps(_mm256_loadu_ps(vx + s), uxi))));
+				fy = _mm256_add_ps(fy, _mm256_add_ps(_mm256_mul_ps(cp, dy), _mm256_mul_ps(cv, _mm256_sub_ps(_mm256_loadu_ps(vy + s), uyi))));
+				fz = _mm256_add_ps(fz, _mm256_add_ps(_mm256_mul_ps(cp, dz), _mm256_mul_ps(cv, _mm256_sub_ps(_mm256_loadu_ps(vz + s), uzi))));
+			}
+		}
+		add_resultant(pass, i, vec3(horizontal_sum_avx2(fx), horizontal_sum_avx2(fy), horizontal_sum_avx2(fz)));
+	}
+}
+#endif
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include "RigidBody.h"
+#include "ParticleSystem.h"
+#include "JobSystem.h"
+
+//ParticleSystemの質点を流体の粒子として扱うSPH(Smoothed Particle Hydrodynamics)ソルバー
+//密度はPoly6、圧力はSpikyの勾配、粘性はViscosityのラプラシアンの核関数で求める(圧力は状態方程式 stiffness * (密度 - rest_density))
+//
+//近傍探索の格子(セルの一辺はsmoothing_length)はParticleCollisionと同じハッシュ表で、stepのたびに質点をハッシュ表の順に並べ替える
+//同じセルの質点が配列で連続するため、核関数は近傍のセルの範囲を連続したメモリからSIMDで4・8個ずつ読む
+//各パスは質点ごとに自分の値だけを書き込むため、範囲ごとにジョブに分けて並列に処理しても結果はスレッド数によらない
+//
+//質点は全て同じ流体の粒子として扱う(不動の質点(mass == FLT_MAX)や番号を保持する拘束とは併用できない)
+struct SphFluid
+{
+	typedef ParticleSystem::FloatArray FloatArray;
+
+	FLOAT smoothing_length;	//核関数の半径(近傍探索のセルの一辺)
+	FLOAT rest_density;	//静止密度
+	FLOAT stiffness;	//状態方程式の係数(音速の2乗)
+	FLOAT viscosity;	//粘性係数
+	FLOAT particle_radius;	//境界との衝突で使う粒子の半径
+	FLOAT restitution;	//境界での反発係数
+	FLOAT friction;	//境界との接触での接線方向の速度の減衰率(0～1)
+	vec3 gravity;	//重力加速度
+	UINT substeps;	//1回のstepの分割数
+	JobSystem *jobs;	//並列に処理するジョブシステム(0の場合は呼び出し元のスレッドで処理する)
+	SIMD_LEVEL simd_level;	//密度と力の核関数で使用するSIMD命令セット(既定値は実行中のCPUで使用できる最も広いもの)
+
+	//境界(流体の外で管理し、stepの間は変更しない)
+	//平面は半空間として容器の壁に、箱は障害物に使う
+	std::vector<const Plane *> planes;
+	std::vector<const Box *> boxes;
+
+	FloatArray density;	//直前のstepで求めた質点ごとの密度(ParticleSystemと同じ順)
+	FloatArray pressure;	//直前のstepで求めた質点ごとの圧力
+
+	SphFluid(FLOAT smoothing_length, FLOAT rest_density = 1000);
+
+	//粒子の間隔spacingの立方格子で静止密度になる粒子の質量
+	FLOAT particle_mass(FLOAT spacing) const
+	{
+		return rest_density * spacing * spacing * spacing;
+	}
+
+	//durationだけ進める(substeps回に分割して、近傍探索・密度・力・インテグレーション・境界の順に処理する)
+	//質点はハッシュ表の順に並べ替えられる
+	void step(ParticleSystem *system, FLOAT duration);
+
+	//各パスの核関数が参照する配列と定数(配列は全てハッシュ表の順に並べ替えた後のもの)
+	struct Pass
+	{
+		const FLOAT *position[3];
+		const FLOAT *velocity[3];
+		const FLOAT *mass;
+		FLOAT *density;
+		FLOAT *pressure;
+		FLOAT *volume;	//質量 / 密度(密度のパスで求め、力のパスで使う)
+		FLOAT *resultant[3];	//力のアキュムレータ(力のパスで圧力・粘性・重力を加える)
+		const UINT *cell_start;	//ハッシュ表の番号ごとの質点の開始位置(末尾に番兵を持つ)
+		UINT mask;	//ハッシュ表の大きさ - 1
+		UINT count;	//質点数
+		FLOAT inverse_cell;
+		FLOAT h, h2;
+		FLOAT poly6, spiky, viscosity;	//核関数の係数(viscosityは粘性係数を掛けたもの)
+		FLOAT rest_density, stiffness;
+		vec3 gravity;
+
+		UINT cell_hash(INT x, INT y, INT z) const
+		{
+			return (((UINT)y * 19349663u ^ (UINT)z * 83492791u) + (UINT)x) & mask;
+		}
+	};
+
+private:
+	std::vector<UINT> cell_of_particle;	//質点ごとのハッシュ表の番号
+	std::vector<UINT> cell_start;
+	std::vector<UINT> sorted;	//ハッシュ表の番号順に並べた質点番号
+	FloatArray scratch;	//並べ替えの作業用の配列
+	FloatArray volume;
+
+	//stepの最初に求める平面の法線と原点からの距離
+	struct Wall
+	{
+		vec3 normal;
+		FLOAT offset;
+		vec3 velocity;
+	};
+	std::vector<Wall> walls;
+
+	void build(ParticleSystem *system);
+	void collide_boundary(ParticleSystem *system, UINT begin, UINT end) const;
+};
+
+//質点[begin, end)の密度と圧力を求める
+//SIMDの実装は近傍の和を4・8個ずつ部分和にまとめるため、結果はscalarと丸め誤差の範囲で異なる(同じ実装ならスレッド数によらず一致する)
+void sph_density_scalar(const SphFluid::Pass &pass, UINT begin, UINT end);
+void sph_density_sse(const SphFluid::Pass &pass, UINT begin, UINT end);
+void sph_density_avx2(const SphFluid::Pass &pass, UINT begin, UINT end);
+//質点[begin, end)に圧力・粘性・重力による力を加える(全質点の密度と圧力を求めた後に呼ぶ)
+void sph_force_scalar(const SphFluid::Pass &pass, UINT begin, UINT end);
+void sph_force_sse(const SphFluid::Pass &pass, UINT begin, UINT end);
+void sph_force_avx2(const SphFluid::Pass &pass, UINT begin, UINT end);
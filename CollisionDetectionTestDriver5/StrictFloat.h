@@ -0,0 +1,18 @@
+#pragma once
+
+//物理のカーネル(剛体のインテグレーション・衝突判定・接触の解消)の浮動小数点演算の規則
+//RigidWorld::deterministicの結果をスレッド数やマシンによらずビット単位で一致させるため、
+//乗算と加算の積和演算(FMA)への融合と、演算の順序を変える最適化(fast-math)を禁止する
+//カーネルの.cppの先頭(関数を定義するヘッダより前)でインクルードする
+#if defined(__FAST_MATH__) || defined(_M_FP_FAST)
+#error 物理のカーネルは-ffast-math(/fp:fast)でコンパイルしてはならない
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma float_control(precise, on)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
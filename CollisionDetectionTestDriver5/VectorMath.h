@@ -0,0 +1,510 @@
+#pragma once
+
+#include <math.h>
+
+//WindowsとD3DXに依存しないヘッダのみの数学ライブラリ(物理のコアのベクトル・クォータニオン・行列は全てこの型で表す)
+//D3DXの型はWin32の描画だけが使い、描画の境界での変換はD3DXConvert.hのto_vec3, to_d3dxなどで行う
+//vec3/vec4/quat/mat4はD3DXVECTOR3/D3DXVECTOR4/D3DXQUATERNION/D3DXMATRIXと同じメモリ配置で、
+//行ベクトルの規約(v' = v * M、平行移動は4行目)と、D3DXQuaternionMultiplyと同じ乗算の順序(a * bはaの回転の後にbの回転)に従う
+//
+//4成分の演算(vec4, quat, mat4)はSSE(x86)とNEON(AArch64)で処理し、mat4同士の積はAVXが使える場合は2行ずつ処理する
+//どのバックエンドもスカラー実装と同じ演算を同じ順序で行うため、結果はビット単位で一致する(RigidWorld::deterministicの前提)
+//3成分の演算は、12バイトの配置のままレジスタに出し入れする費用の方が大きいため、バックエンドによらずスカラー実装を使う
+//VECTOR_MATH_SCALARを定義するとSIMDを使用しない
+#if !defined(VECTOR_MATH_SCALAR)
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VECTOR_MATH_SSE
+#include <emmintrin.h>
+#if defined(__AVX__)
+#define VECTOR_MATH_AVX
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define VECTOR_MATH_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+struct vec3
+{
+	float x, y, z;
+
+	vec3() {}
+	vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+	float &operator[](int i) { return (&x)[i]; }
+	float operator[](int i) const { return (&x)[i]; }
+};
+
+struct vec4
+{
+	float x, y, z, w;
+
+	vec4() {}
+	vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+	vec4(const vec3 &v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+	float &operator[](int i) { return (&x)[i]; }
+	float operator[](int i) const { return (&x)[i]; }
+};
+
+struct quat
+{
+	float x, y, z, w;
+
+	quat() {}
+	quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+};
+
+//行ごとの3x3行列(r[i]がi行目、回転行列の場合は各行がローカル軸)
+struct mat3
+{
+	vec3 r[3];
+};
+
+//行ごとの4x4行列(r[3]が平行移動)
+struct mat4
+{
+	vec4 r[4];
+};
+
+//3成分の演算(D3DXVECTOR3の演算子・関数と同じ)
+inline vec3 operator+(const vec3 &a, const vec3 &b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline vec3 operator-(const vec3 &a, const vec3 &b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline vec3 operator-(const vec3 &a) { return vec3(-a.x, -a.y, -a.z); }
+inline vec3 operator*(const vec3 &a, float s) { return vec3(a.x * s, a.y * s, a.z * s); }
+inline vec3 operator*(float s, const vec3 &a) { return vec3(s * a.x, s * a.y, s * a.z); }
+//D3DXVECTOR3::operator/と同じく逆数を掛ける
+inline vec3 operator/(const vec3 &a, float s) { float r = 1.0f / s; return vec3(a.x * r, a.y * r, a.z * r); }
+inline vec3 &operator+=(vec3 &a, const vec3 &b) { a.x += b.x; a.y += b.y; a.z += b.z; return a; }
+inline vec3 &operator-=(vec3 &a, const vec3 &b) { a.x -= b.x; a.y -= b.y; a.z -= b.z; return a; }
+inline vec3 &operator*=(vec3 &a, float s) { a.x *= s; a.y *= s; a.z *= s; return a; }
+inline vec3 &operator/=(vec3 &a, float s) { float r = 1.0f / s; a.x *= r; a.y *= r; a.z *= r; return a; }
+inline bool operator==(const vec3 &a, const vec3 &b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+inline bool operator!=(const vec3 &a, const vec3 &b) { return !(a == b); }
+
+inline float dot(const vec3 &a, const vec3 &b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+inline vec3 cross(const vec3 &a, const vec3 &b)
+{
+	return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+inline float length_sq(const vec3 &a)
+{
+	return dot(a, a);
+}
+inline float length(const vec3 &a)
+{
+	return sqrtf(dot(a, a));
+}
+//長さ0のベクトルは0ベクトルにする(D3DXVec3Normalizeと同じ)
+inline vec3 normalize(const vec3 &a)
+{
+	float l = length(a);
+	return l > 0 ? vec3(a.x / l, a.y / l, a.z / l) : vec3(0, 0, 0);
+}
+
+//4成分のレジスタ(バックエンドごとの最小限の操作)
+#if defined(VECTOR_MATH_SSE)
+typedef __m128 simd4;
+inline simd4 simd_load(const float *p) { return _mm_loadu_ps(p); }
+inline void simd_store(float *p, simd4 a) { _mm_storeu_ps(p, a); }
+inline simd4 simd_splat(float s) { return _mm_set1_ps(s); }
+inline simd4 simd_add(simd4 a, simd4 b) { return _mm_add_ps(a, b); }
+inline simd4 simd_sub(simd4 a, simd4 b) { return _mm_sub_ps(a, b); }
+inline simd4 simd_mul(simd4 a, simd4 b) { return _mm_mul_ps(a, b); }
+#elif defined(VECTOR_MATH_NEON)
+typedef float32x4_t simd4;
+inline simd4 simd_load(const float *p) { return vld1q_f32(p); }
+inline void simd_store(float *p, simd4 a) { vst1q_f32(p, a); }
+inline simd4 simd_splat(float s) { return vdupq_n_f32(s); }
+inline simd4 simd_add(simd4 a, simd4 b) { return vaddq_f32(a, b); }
+inline simd4 simd_sub(simd4 a, simd4 b) { return vsubq_f32(a, b); }
+inline simd4 simd_mul(simd4 a, simd4 b) { return vmulq_f32(a, b); }
+#endif
+
+//4成分の演算
+inline vec4 operator+(const vec4 &a, const vec4 &b)
+{
+#if defined(VECTOR_MATH_SSE) || defined(VECTOR_MATH_NEON)
+	vec4 o;
+	simd_store(&o.x, simd_add(simd_load(&a.x), simd_load(&b.x)));
+	return o;
+#else
+	return vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+#endif
+}
+inline vec4 operator-(const vec4 &a, const vec4 &b)
+{
+#if defined(VECTOR_MATH_SSE) || defined(VECTOR_MATH_NEON)
+	vec4 o;
+	simd_store(&o.x, simd_sub(simd_load(&a.x), simd_load(&b.x)));
+	return o;
+#else
+	return vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+#endif
+}
+inline vec4 operator*(const vec4 &a, float s)
+{
+#if defined(VECTOR_MATH_SSE) || defined(VECTOR_MATH_NEON)
+	vec4 o;
+	simd_store(&o.x, simd_mul(simd_load(&a.x), simd_splat(s)));
+	return o;
+#else
+	return vec4(a.x * s, a.y * s, a.z * s, a.w * s);
+#endif
+}
+inline vec4 operator*(float s, const vec4 &a)
+{
+	return a * s;
+}
+inline float dot(const vec4 &a, const vec4 &b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+//クォータニオンの積(D3DXQuaternionMultiply(a, b)と同じく、aの回転の後にbの回転を行うクォータニオン)
+//ハミルトン積 p * q (p = b, q = a)を、各成分が pw * q + px * q' + py * q'' + pz * q''' の同じ順序の和になるように並べて求める
+inline quat operator*(const quat &a, const quat &b)
+{
+	const quat &p = b, &q = a;
+#if defined(VECTOR_MATH_SSE)
+	const __m128 v = _mm_loadu_ps(&q.x);
+	const __m128 sign1 = _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f);	//(+, -, +, -)
+	const __m128 sign2 = _mm_set_ps(-0.0f, -0.0f, 0.0f, 0.0f);	//(+, +, -, -)
+	const __m128 sign3 = _mm_set_ps(-0.0f, 0.0f, 0.0f, -0.0f);	//(-, +, +, -)
+	__m128 t1 = _mm_xor_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)), sign1);	//(qw, -qz, qy, -qx)
+	__m128 t2 = _mm_xor_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)), sign2);	//(qz, qw, -qx, -qy)
+	__m128 t3 = _mm_xor_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)), sign3);	//(-qy, qx, qw, -qz)
+	__m128 o = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.w), v), _mm_mul_ps(_mm_set1_ps(p.x), t1)), _mm_mul_ps(_mm_set1_ps(p.y), t2)), _mm_mul_ps(_mm_set1_ps(p.z), t3));
+	quat result;
+	_mm_storeu_ps(&result.x, o);
+	return result;
+#elif defined(VECTOR_MATH_NEON)
+	//符号は±1を掛けて反転する(1と-1の積は丸めが起きないため、スカラー実装の単項マイナスと一致する)
+	const float s1[4] = { 1, -1, 1, -1 }, s2[4] = { 1, 1, -1, -1 }, s3[4] = { -1, 1, 1, -1 };
+	const float32x4_t v = vld1q_f32(&q.x);
+	const float32x4_t zwxy = vextq_f32(v, v, 2);
+	float32x4_t t1 = vmulq_f32(vrev64q_f32(zwxy), vld1q_f32(s1));	//(qw, -qz, qy, -qx)
+	float32x4_t t2 = vmulq_f32(zwxy, vld1q_f32(s2));	//(qz, qw, -qx, -qy)
+	float32x4_t t3 = vmulq_f32(vrev64q_f32(v), vld1q_f32(s3));	//(-qy, qx, qw, -qz)
+	float32x4_t o = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(vdupq_n_f32(p.w), v), vmulq_f32(vdupq_n_f32(p.x), t1)), vmulq_f32(vdupq_n_f32(p.y), t2)), vmulq_f32(vdupq_n_f32(p.z), t3));
+	quat result;
+	vst1q_f32(&result.x, o);
+	return result;
+#else
+	return quat(
+		p.w * q.x + p.x * q.w + p.y * q.z + p.z * -q.y,
+		p.w * q.y + p.x * -q.z + p.y * q.w + p.z * q.x,
+		p.w * q.z + p.x * q.y + p.y * -q.x + p.z * q.w,
+		p.w * q.w + p.x * -q.x + p.y * -q.y + p.z * -q.z);
+#endif
+}
+//成分ごとの演算(姿勢の積分と補間で使う、D3DXQUATERNIONの演算子と同じ)
+inline quat operator+(const quat &a, const quat &b)
+{
+#if defined(VECTOR_MATH_SSE) || defined(VECTOR_MATH_NEON)
+	quat o;
+	simd_store(&o.x, simd_add(simd_load(&a.x), simd_load(&b.x)));
+	return o;
+#else
+	return quat(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+#endif
+}
+inline quat operator-(const quat &a, const quat &b)
+{
+#if defined(VECTOR_MATH_SSE) || defined(VECTOR_MATH_NEON)
+	quat o;
+	simd_store(&o.x, simd_sub(simd_load(&a.x), simd_load(&b.x)));
+	return o;
+#else
+	return quat(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+#endif
+}
+inline quat operator-(const quat &a) { return quat(-a.x, -a.y, -a.z, -a.w); }
+inline quat operator*(const quat &a, float s)
+{
+#if defined(VECTOR_MATH_SSE) || defined(VECTOR_MATH_NEON)
+	quat o;
+	simd_store(&o.x, simd_mul(simd_load(&a.x), simd_splat(s)));
+	return o;
+#else
+	return quat(a.x * s, a.y * s, a.z * s, a.w * s);
+#endif
+}
+inline quat operator*(float s, const quat &a)
+{
+	return a * s;
+}
+inline quat &operator+=(quat &a, const quat &b) { return a = a + b; }
+inline quat &operator-=(quat &a, const quat &b) { return a = a - b; }
+inline bool operator==(const quat &a, const quat &b) { return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w; }
+inline bool operator!=(const quat &a, const quat &b) { return !(a == b); }
+
+inline quat conjugate(const quat &q)
+{
+	return quat(-q.x, -q.y, -q.z, q.w);
+}
+inline float dot(const quat &a, const quat &b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+inline float length(const quat &q)
+{
+	return sqrtf(dot(q, q));
+}
+//長さ0のクォータニオンは0にする(D3DXQuaternionNormalizeと同じ)
+inline quat normalize(const quat &q)
+{
+	float l = length(q);
+	return l > 0 ? quat(q.x / l, q.y / l, q.z / l, q.w / l) : quat(0, 0, 0, 0);
+}
+//単位ベクトルとは限らない回転軸(axis)の周りにangleラジアン回転するクォータニオン(D3DXQuaternionRotationAxisと同じ)
+inline quat quat_from_axis_angle(const vec3 &axis, float angle)
+{
+	vec3 n = normalize(axis);
+	float s = sinf(0.5f * angle);
+	return quat(n.x * s, n.y * s, n.z * s, cosf(0.5f * angle));
+}
+
+//ヨー(y軸)・ピッチ(x軸)・ロール(z軸)の回転をロール・ピッチ・ヨーの順に行うクォータニオン(D3DXQuaternionRotationYawPitchRollと同じ)
+inline quat quat_from_yaw_pitch_roll(float yaw, float pitch, float roll)
+{
+	const float sy = sinf(0.5f * yaw), cy = cosf(0.5f * yaw);
+	const float sp = sinf(0.5f * pitch), cp = cosf(0.5f * pitch);
+	const float sr = sinf(0.5f * roll), cr = cosf(0.5f * roll);
+	return quat(
+		sy * cp * sr + cy * sp * cr,
+		sy * cp * cr - cy * sp * sr,
+		cy * cp * sr - sy * sp * cr,
+		cy * cp * cr + sy * sp * sr);
+}
+
+//ベクトルvを単位クォータニオンqで回転する
+//v' = 2(q・v)q + (w^2 - q・q)v + 2w(q × v) (qはクォータニオンのベクトル部)
+//vec3の他の演算と同じく、1個のベクトルではレジスタへの詰め替えの方が高くつくため、SIMDを使わない
+inline vec3 rotate(const quat &q, const vec3 &v)
+{
+	const float s = 2.0f * (q.x * v.x + q.y * v.y + q.z * v.z);
+	const float t = q.w * q.w - (q.x * q.x + q.y * q.y + q.z * q.z);
+	const float u = 2.0f * q.w;
+	vec3 c = cross(vec3(q.x, q.y, q.z), v);
+	return vec3(
+		s * q.x + t * v.x + u * c.x,
+		s * q.y + t * v.y + u * c.y,
+		s * q.z + t * v.z + u * c.z);
+}
+
+//3x3行列
+inline mat3 mat3_identity()
+{
+	mat3 m;
+	m.r[0] = vec3(1, 0, 0);
+	m.r[1] = vec3(0, 1, 0);
+	m.r[2] = vec3(0, 0, 1);
+	return m;
+}
+//対角成分がdの行列(慣性モーメントテンソルなど)
+inline mat3 mat3_diagonal(const vec3 &d)
+{
+	mat3 m;
+	m.r[0] = vec3(d.x, 0, 0);
+	m.r[1] = vec3(0, d.y, 0);
+	m.r[2] = vec3(0, 0, d.z);
+	return m;
+}
+//単位クォータニオンの回転行列(D3DXMatrixRotationQuaternionの左上3x3と同じ)
+inline mat3 mat3_from_quat(const quat &q)
+{
+	const float x = q.x, y = q.y, z = q.z, w = q.w;
+	mat3 m;
+	m.r[0] = vec3(1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w));
+	m.r[1] = vec3(2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w));
+	m.r[2] = vec3(2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y));
+	return m;
+}
+inline mat3 transpose(const mat3 &m)
+{
+	mat3 t;
+	t.r[0] = vec3(m.r[0].x, m.r[1].x, m.r[2].x);
+	t.r[1] = vec3(m.r[0].y, m.r[1].y, m.r[2].y);
+	t.r[2] = vec3(m.r[0].z, m.r[1].z, m.r[2].z);
+	return t;
+}
+//行ベクトルの変換 v * m
+inline vec3 operator*(const vec3 &v, const mat3 &m)
+{
+	return vec3(
+		v.x * m.r[0].x + v.y * m.r[1].x + v.z * m.r[2].x,
+		v.x * m.r[0].y + v.y * m.r[1].y + v.z * m.r[2].y,
+		v.x * m.r[0].z + v.y * m.r[1].z + v.z * m.r[2].z);
+}
+inline mat3 operator*(const mat3 &a, const mat3 &b)
+{
+	mat3 m;
+	for (int i = 0; i < 3; i++)
+	{
+		m.r[i] = a.r[i] * b;
+	}
+	return m;
+}
+//逆行列を求める(行列式が0の場合はfalseを返し、outを変更しない)
+inline bool inverse(const mat3 &m, mat3 *out)
+{
+	vec3 c0 = cross(m.r[1], m.r[2]), c1 = cross(m.r[2], m.r[0]), c2 = cross(m.r[0], m.r[1]);
+	float det = dot(m.r[0], c0);
+	if (det == 0) return false;
+	float inverse_det = 1.0f / det;
+	out->r[0] = vec3(c0.x, c1.x, c2.x) * inverse_det;
+	out->r[1] = vec3(c0.y, c1.y, c2.y) * inverse_det;
+	out->r[2] = vec3(c0.z, c1.z, c2.z) * inverse_det;
+	return true;
+}
+
+//4x4行列
+inline mat4 mat4_identity()
+{
+	mat4 m;
+	m.r[0] = vec4(1, 0, 0, 0);
+	m.r[1] = vec4(0, 1, 0, 0);
+	m.r[2] = vec4(0, 0, 1, 0);
+	m.r[3] = vec4(0, 0, 0, 1);
+	return m;
+}
+//回転(単位クォータニオンq)の後に平行移動(t)を行う行列
+inline mat4 mat4_from_rotation_translation(const quat &q, const vec3 &t)
+{
+	mat3 r = mat3_from_quat(q);
+	mat4 m;
+	m.r[0] = vec4(r.r[0], 0);
+	m.r[1] = vec4(r.r[1], 0);
+	m.r[2] = vec4(r.r[2], 0);
+	m.r[3] = vec4(t, 1);
+	return m;
+}
+//行ベクトルの変換 v * m (各成分は x*r0 + y*r1 + z*r2 + w*r3 の順の和)
+inline vec4 operator*(const vec4 &v, const mat4 &m)
+{
+#if defined(VECTOR_MATH_SSE) || defined(VECTOR_MATH_NEON)
+	simd4 o = simd_add(simd_add(simd_add(
+		simd_mul(simd_splat(v.x), simd_load(&m.r[0].x)),
+		simd_mul(simd_splat(v.y), simd_load(&m.r[1].x))),
+		simd_mul(simd_splat(v.z), simd_load(&m.r[2].x))),
+		simd_mul(simd_splat(v.w), simd_load(&m.r[3].x)));
+	vec4 result;
+	simd_store(&result.x, o);
+	return result;
+#else
+	return vec4(
+		v.x * m.r[0].x + v.y * m.r[1].x + v.z * m.r[2].x + v.w * m.r[3].x,
+		v.x * m.r[0].y + v.y * m.r[1].y + v.z * m.r[2].y + v.w * m.r[3].y,
+		v.x * m.r[0].z + v.y * m.r[1].z + v.z * m.r[2].z + v.w * m.r[3].z,
+		v.x * m.r[0].w + v.y * m.r[1].w + v.z * m.r[2].w + v.w * m.r[3].w);
+#endif
+}
+//点の変換(w = 1として変換し、wで割る、D3DXVec3TransformCoordと同じ)
+inline vec3 transform_coord(const vec3 &v, const mat4 &m)
+{
+#if defined(VECTOR_MATH_SSE) || defined(VECTOR_MATH_NEON)
+	simd4 o = simd_add(simd_add(simd_add(
+		simd_mul(simd_splat(v.x), simd_load(&m.r[0].x)),
+		simd_mul(simd_splat(v.y), simd_load(&m.r[1].x))),
+		simd_mul(simd_splat(v.z), simd_load(&m.r[2].x))),
+		simd_load(&m.r[3].x));
+	float t[4];
+	simd_store(t, o);
+	return vec3(t[0] / t[3], t[1] / t[3], t[2] / t[3]);
+#else
+	vec4 t(
+		v.x * m.r[0].x + v.y * m.r[1].x + v.z * m.r[2].x + m.r[3].x,
+		v.x * m.r[0].y + v.y * m.r[1].y + v.z * m.r[2].y + m.r[3].y,
+		v.x * m.r[0].z + v.y * m.r[1].z + v.z * m.r[2].z + m.r[3].z,
+		v.x * m.r[0].w + v.y * m.r[1].w + v.z * m.r[2].w + m.r[3].w);
+	return vec3(t.x / t.w, t.y / t.w, t.z / t.w);
+#endif
+}
+//方向の変換(平行移動を含めない、D3DXVec3TransformNormalと同じ)
+inline vec3 transform_normal(const vec3 &v, const mat4 &m)
+{
+	return vec3(
+		v.x * m.r[0].x + v.y * m.r[1].x + v.z * m.r[2].x,
+		v.x * m.r[0].y + v.y * m.r[1].y + v.z * m.r[2].y,
+		v.x * m.r[0].z + v.y * m.r[1].z + v.z * m.r[2].z);
+}
+//行列の積 a * b (D3DXMatrixMultiplyと同じく、aの変換の後にbの変換を行う)
+inline mat4 operator*(const mat4 &a, const mat4 &b)
+{
+	mat4 m;
+#if defined(VECTOR_MATH_AVX)
+	//2行ずつ、上位と下位の128ビットにそれぞれの行を置いて処理する
+#define VECTOR_MATH_ROW(k) _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&b.r[k].x)), _mm_loadu_ps(&b.r[k].x), 1)
+	const __m256 b0 = VECTOR_MATH_ROW(0), b1 = VECTOR_MATH_ROW(1), b2 = VECTOR_MATH_ROW(2), b3 = VECTOR_MATH_ROW(3);
+#undef VECTOR_MATH_ROW
+	for (int i = 0; i < 4; i += 2)
+	{
+		const vec4 &r0 = a.r[i], &r1 = a.r[i + 1];
+#define VECTOR_MATH_PAIR(c) _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(r0.c)), _mm_set1_ps(r1.c), 1)
+		__m256 o = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(VECTOR_MATH_PAIR(x), b0),
+			_mm256_mul_ps(VECTOR_MATH_PAIR(y), b1)),
+			_mm256_mul_ps(VECTOR_MATH_PAIR(z), b2)),
+			_mm256_mul_ps(VECTOR_MATH_PAIR(w), b3));
+#undef VECTOR_MATH_PAIR
+		_mm256_storeu_ps(&m.r[i].x, o);
+	}
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		m.r[i] = a.r[i] * b;
+	}
+#endif
+	return m;
+}
+inline mat4 transpose(const mat4 &m)
+{
+#if defined(VECTOR_MATH_SSE)
+	__m128 r0 = _mm_loadu_ps(&m.r[0].x), r1 = _mm_loadu_ps(&m.r[1].x), r2 = _mm_loadu_ps(&m.r[2].x), r3 = _mm_loadu_ps(&m.r[3].x);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	mat4 t;
+	_mm_storeu_ps(&t.r[0].x, r0);
+	_mm_storeu_ps(&t.r[1].x, r1);
+	_mm_storeu_ps(&t.r[2].x, r2);
+	_mm_storeu_ps(&t.r[3].x, r3);
+	return t;
+#else
+	mat4 t;
+	for (int i = 0; i < 4; i++)
+	{
+		t.r[i] = vec4(m.r[0][i], m.r[1][i], m.r[2][i], m.r[3][i]);
+	}
+	return t;
+#endif
+}
+//逆行列を余因子展開で求める(行列式が0の場合はfalseを返し、outを変更しない、detが0でなければ行列式を格納する)
+//バックエンドによらずスカラー実装を使う(2x2の小行列式を共有するため、4成分にそろえる並べ替えの費用の方が大きい)
+inline bool inverse(const mat4 &m, mat4 *out, float *det = 0)
+{
+	const float a00 = m.r[0].x, a01 = m.r[0].y, a02 = m.r[0].z, a03 = m.r[0].w;
+	const float a10 = m.r[1].x, a11 = m.r[1].y, a12 = m.r[1].z, a13 = m.r[1].w;
+	const float a20 = m.r[2].x, a21 = m.r[2].y, a22 = m.r[2].z, a23 = m.r[2].w;
+	const float a30 = m.r[3].x, a31 = m.r[3].y, a32 = m.r[3].z, a33 = m.r[3].w;
+
+	//上2行と下2行の2x2小行列式
+	const float s0 = a00 * a11 - a10 * a01, s1 = a00 * a12 - a10 * a02, s2 = a00 * a13 - a10 * a03;
+	const float s3 = a01 * a12 - a11 * a02, s4 = a01 * a13 - a11 * a03, s5 = a02 * a13 - a12 * a03;
+	const float c5 = a22 * a33 - a32 * a23, c4 = a21 * a33 - a31 * a23, c3 = a21 * a32 - a31 * a22;
+	const float c2 = a20 * a33 - a30 * a23, c1 = a20 * a32 - a30 * a22, c0 = a20 * a31 - a30 * a21;
+
+	const float d = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	if (det) *det = d;
+	if (d == 0) return false;
+	const float k = 1.0f / d;
+
+	out->r[0] = vec4((a11 * c5 - a12 * c4 + a13 * c3) * k, (-a01 * c5 + a02 * c4 - a03 * c3) * k, (a31 * s5 - a32 * s4 + a33 * s3) * k, (-a21 * s5 + a22 * s4 - a23 * s3) * k);
+	out->r[1] = vec4((-a10 * c5 + a12 * c2 - a13 * c1) * k, (a00 * c5 - a02 * c2 + a03 * c1) * k, (-a30 * s5 + a32 * s2 - a33 * s1) * k, (a20 * s5 - a22 * s2 + a23 * s1) * k);
+	out->r[2] = vec4((a10 * c4 - a11 * c2 + a13 * c0) * k, (-a00 * c4 + a01 * c2 - a03 * c0) * k, (a30 * s4 - a31 * s2 + a33 * s0) * k, (-a20 * s4 + a21 * s2 - a23 * s0) * k);
+	out->r[3] = vec4((-a10 * c3 + a11 * c1 - a12 * c0) * k, (a00 * c3 - a01 * c1 + a02 * c0) * k, (-a30 * s3 + a31 * s1 - a32 * s0) * k, (a20 * s3 - a21 * s1 + a22 * s0) * k);
+	return true;
+}